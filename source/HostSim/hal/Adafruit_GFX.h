@@ -0,0 +1,61 @@
+// host stand-in for Adafruit GFX - the classic 6x8 text, pixels and filled rectangles, drawn the same way the library does
+#pragma once
+#include "Arduino.h"
+
+#define BLACK 0
+#define WHITE 1
+#define INVERSE 2
+
+class Adafruit_GFX : public Print {
+public:
+  Adafruit_GFX(int16_t w, int16_t h);
+  virtual void drawPixel(int16_t x, int16_t y, uint16_t color)=0;
+  virtual void fillRect(int16_t x, int16_t y, int16_t w, int16_t h, uint16_t color);
+  virtual void fillScreen(uint16_t color);
+  void drawFastHLine(int16_t x, int16_t y, int16_t w, uint16_t color) { fillRect(x,y,w,1,color); }
+  void drawFastVLine(int16_t x, int16_t y, int16_t h, uint16_t color) { fillRect(x,y,1,h,color); }
+  void drawRect(int16_t x, int16_t y, int16_t w, int16_t h, uint16_t color);
+  void drawLine(int16_t x0, int16_t y0, int16_t x1, int16_t y1, uint16_t color);
+  void drawChar(int16_t x, int16_t y, unsigned char c, uint16_t color, uint16_t bg, uint8_t size);
+  void drawChar(int16_t x, int16_t y, unsigned char c, uint16_t color, uint16_t bg, uint8_t sizex, uint8_t sizey);
+  size_t write(uint8_t c) override;
+  using Print::write;
+
+  void setCursor(int16_t x, int16_t y) { cursor_x=x; cursor_y=y; }
+  int16_t getCursorX(void) const { return cursor_x; }
+  int16_t getCursorY(void) const { return cursor_y; }
+  void setTextSize(uint8_t s) { setTextSize(s,s); }
+  void setTextSize(uint8_t sx, uint8_t sy) { textsize_x=sx ? sx : 1; textsize_y=sy ? sy : 1; }
+  void setTextColor(uint16_t c) { textcolor=textbgcolor=c; }
+  void setTextColor(uint16_t c, uint16_t bg) { textcolor=c; textbgcolor=bg; }
+  void setTextWrap(bool w) { wrap=w; }
+  void cp437(bool x=true) { _cp437=x; }
+  void setRotation(uint8_t r);
+  uint8_t getRotation(void) const { return rotation; }
+  int16_t width(void) const { return _width; }
+  int16_t height(void) const { return _height; }
+
+protected:
+  const int16_t WIDTH,HEIGHT;
+  int16_t _width,_height;
+  int16_t cursor_x=0,cursor_y=0;
+  uint16_t textcolor=0xffff,textbgcolor=0xffff;
+  uint8_t textsize_x=1,textsize_y=1;
+  uint8_t rotation=0;
+  bool wrap=true;
+  bool _cp437=false;
+};
+
+// 1 bit canvas in memory, rows of bytes with the leftmost pixel in the top bit
+class GFXcanvas1 : public Adafruit_GFX {
+public:
+  GFXcanvas1(uint16_t w, uint16_t h);
+  ~GFXcanvas1();
+  void drawPixel(int16_t x, int16_t y, uint16_t color) override;
+  bool getPixel(int16_t x, int16_t y) const;
+  uint8_t * getBuffer(void) const { return buffer; }
+private:
+  uint8_t * buffer;
+};
+
+extern const uint8_t simfont[96][5];  // the classic GFX font from space, 5 columns a character with the top pixel in bit 0
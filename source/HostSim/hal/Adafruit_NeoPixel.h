@@ -0,0 +1,27 @@
+// host stand-in for Adafruit NeoPixel - show() copies the colours to simleds[] and takes as long as the bits take to send
+#pragma once
+#include "Arduino.h"
+
+#define NEO_GRB ((1 << 6) | (1 << 4) | (0 << 2) | (2))
+#define NEO_RGB ((0 << 6) | (0 << 4) | (1 << 2) | (2))
+#define NEO_KHZ800 0x0000
+
+class Adafruit_NeoPixel {
+public:
+  Adafruit_NeoPixel(uint16_t n, int16_t pin=6, uint16_t type=NEO_GRB+NEO_KHZ800);
+  ~Adafruit_NeoPixel();
+  void begin(void) {}
+  void show(void);
+  void setPixelColor(uint16_t n, uint32_t c);
+  void setPixelColor(uint16_t n, uint8_t r, uint8_t g, uint8_t b);
+  uint32_t getPixelColor(uint16_t n) const;
+  uint8_t * getPixels(void) const { return pixels; }
+  uint16_t numPixels(void) const { return numLEDs; }
+  void clear(void) { memset(pixels,0,numLEDs*3); }
+  void setBrightness(uint8_t b) { (void)b; }
+  bool canShow(void) { return true; }
+  static uint32_t Color(uint8_t r, uint8_t g, uint8_t b) { return ((uint32_t)r << 16) | ((uint32_t)g << 8) | b; }
+private:
+  uint16_t numLEDs;
+  uint8_t * pixels;  // GRB, the order they're sent in
+};
@@ -0,0 +1,30 @@
+// host stand-in for the Adafruit SSD1306 driver
+// the buffer is laid out like the panel's RAM - a byte is 8 vertical pixels, pages of WIDTH bytes. display() copies it to
+// simpanel[] and takes as long as the transfer would over I2C at 400kHz, which is what the library sets while it sends
+#pragma once
+#include "Adafruit_GFX.h"
+#include "Wire.h"
+
+#define SSD1306_SWITCHCAPVCC 0x02
+#define SSD1306_EXTERNALVCC 0x01
+#define SSD1306_DISPLAYOFF 0xae
+#define SSD1306_DISPLAYON 0xaf
+#define SSD1306_SETCONTRAST 0x81
+
+class Adafruit_SSD1306 : public Adafruit_GFX {
+public:
+  Adafruit_SSD1306(uint8_t w, uint8_t h, TwoWire * twi=&Wire, int8_t rst_pin=-1, uint32_t clkDuring=400000UL, uint32_t clkAfter=100000UL);
+  ~Adafruit_SSD1306();
+  bool begin(uint8_t switchvcc=SSD1306_SWITCHCAPVCC, uint8_t i2caddr=0, bool reset=true, bool periphBegin=true);
+  void display(void);
+  void clearDisplay(void);
+  void drawPixel(int16_t x, int16_t y, uint16_t color) override;
+  bool getPixel(int16_t x, int16_t y);
+  uint8_t * getBuffer(void) { return buffer; }
+  void ssd1306_command(uint8_t c);
+  void dim(bool dim) { (void)dim; }
+  void invertDisplay(bool i) { (void)i; }
+private:
+  uint8_t * buffer=0;
+  uint32_t wireclk;
+};
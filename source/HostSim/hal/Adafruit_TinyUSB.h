@@ -0,0 +1,2 @@
+// USB is modelled by the Control Surface stand-in - nothing needed from TinyUSB
+#pragma once
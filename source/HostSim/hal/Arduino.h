@@ -0,0 +1,145 @@
+// host stand-in for the arduino-pico core
+// just enough of the Arduino API for the Twisty 2 sketches, running on the virtual clock in sim.cpp
+// time only moves when the firmware waits for something (delay, __wfi, a blocking peripheral) or finishes a pass of loop() -
+// see sim.h for the cost model. micros() and millis() are 32 bit like they are on the RP2040 so wrap around behaves the same
+
+#pragma once
+#include <math.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdlib.h>
+
+typedef bool boolean;
+typedef uint8_t byte;
+
+#define HIGH 1
+#define LOW 0
+#define INPUT 0
+#define OUTPUT 1
+#define INPUT_PULLUP 2
+
+#define PROGMEM
+#define F(s) (s)
+#define PSTR(s) (s)
+#define pgm_read_byte(p) (*(const uint8_t *)(p))
+#define pgm_read_word(p) (*(const uint16_t *)(p))
+#define __not_in_flash_func(f) f
+#define bitRead(v,b) (((v) >> (b)) & 1)
+#define constrain(amt,low,high) ((amt)<(low)?(low):((amt)>(high)?(high):(amt)))
+
+// templates rather than macros, same as ArduinoCore-API, so <algorithm> still compiles
+template<class T, class L> auto min(const T &a, const L &b) -> decltype((b < a) ? b : a) { return (b < a) ? b : a; }
+template<class T, class L> auto max(const T &a, const L &b) -> decltype((b < a) ? b : a) { return (a < b) ? b : a; }
+
+void pinMode(int pin, int mode);
+int digitalRead(int pin);
+void digitalWrite(int pin, int value);
+int analogRead(int pin);
+
+uint32_t millis(void);
+uint32_t micros(void);
+void delay(uint32_t ms);
+void delayMicroseconds(uint32_t us);
+void yield(void);
+
+long random(long howbig);
+long random(long howsmall, long howbig);
+void randomSeed(unsigned long seed);
+
+void noInterrupts(void);
+void interrupts(void);
+#define cli() noInterrupts()
+#define sei() interrupts()
+void __wfi(void);
+void __wfe(void);
+void __sev(void);
+void __dmb(void);
+void tight_loop_contents(void);  // pico-sdk busy wait body - the simulator moves time on here
+uint32_t time_us_32(void);
+uint64_t time_us_64(void);
+
+class Print {
+public:
+  virtual ~Print() {}
+  virtual size_t write(uint8_t c)=0;
+  virtual size_t write(const uint8_t * buf, size_t n);
+  size_t write(const char * s) { return write((const uint8_t *)s,strlen(s)); }
+  size_t print(const char * s) { return write(s); }
+  size_t print(char c) { return write((uint8_t)c); }
+  size_t print(int n);
+  size_t print(unsigned n);
+  size_t print(long n);
+  size_t print(unsigned long n);
+  size_t print(double n, int digits=2);
+  size_t println(void) { return write("\r\n"); }
+  template<class T> size_t println(T v) { size_t n=print(v); return n+println(); }
+  size_t printf(const char * fmt, ...) __attribute__((format(printf,2,3)));
+  virtual void flush(void) {}
+};
+
+class Stream : public Print {
+public:
+  virtual int available(void) { return 0; }
+  virtual int read(void) { return -1; }
+  virtual int peek(void) { return -1; }
+};
+
+// the USB serial port. output is collected in simserial (sim.h) and echoed to stdout if simecho is set
+// input is whatever sim_serialinput() has queued
+class SerialUSB : public Stream {
+public:
+  void begin(unsigned long baud) { (void)baud; }
+  size_t write(uint8_t c) override;
+  size_t write(const uint8_t * buf, size_t n) override;
+  using Print::write;
+  int available(void) override;
+  int read(void) override;
+  int peek(void) override;
+  operator bool() { return true; }
+};
+
+// a hardware UART. only used as the serial MIDI port, which models its own wire timing
+class SerialUART : public Stream {
+public:
+  void begin(unsigned long baud) { (void)baud; }
+  size_t write(uint8_t c) override { (void)c; return 1; }
+  using Print::write;
+  operator bool() { return true; }
+};
+
+extern SerialUSB Serial;
+extern SerialUART Serial1;
+typedef SerialUART HardwareSerial;
+
+// inter core FIFO - each core pushes to the other one's queue
+class SimFIFO {
+public:
+  bool available(void);
+  uint32_t pop(void);
+  bool pop_nb(uint32_t * value);
+  void push(uint32_t value);
+  bool push_nb(uint32_t value);
+};
+
+class RP2040 {
+public:
+  SimFIFO fifo;
+  void idleOtherCore(void);
+  void resumeOtherCore(void);
+  int getFreeHeap(void);
+  int getUsedHeap(void);
+  int getTotalHeap(void);
+  uint32_t getCycleCount(void);
+  uint64_t getCycleCount64(void);
+  uint32_t f_cpu(void) { return 133000000; }
+  void reboot(void);
+};
+extern RP2040 rp2040;
+
+#include "hardware/timer.h"
+#include "hardware/irq.h"
+#include "hardware/sync.h"
+#include "sim.h"
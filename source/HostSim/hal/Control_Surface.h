@@ -0,0 +1,211 @@
+// host stand-in for the parts of Control Surface the sketches use
+// the MIDI interfaces log what's sent into simmidi[] (sim.h) with the time it would have left the unit:
+// - USB collects event packets in a 64 byte endpoint buffer like the real USBMIDI_Interface. they go out at sendNow(), when
+//   the buffer is full, or - unless disableTimeout() was called - at the next update() a millisecond after the first one
+// - DIN is a 31250 baud UART with a 32 byte FIFO. sending blocks the CPU while the FIFO is full
+// - BLE goes out at the next connection event, up to 4 notifications of 20 bytes per event
+// input queued with sim_midiin() is parsed and handed to the callbacks at update() once its time has come
+
+#pragma once
+#include "Arduino.h"
+
+#define MIDI_BAUD 31250
+#define SYSEX_BUFFER_SIZE 128
+
+enum MIDIMessageType : uint8_t {
+  NOTE_OFF=0x80,NOTE_ON=0x90,KEY_PRESSURE=0xa0,CONTROL_CHANGE=0xb0,PROGRAM_CHANGE=0xc0,CHANNEL_PRESSURE=0xd0,PITCH_BEND=0xe0,
+  SYSEX_START=0xf0,MTC_QUARTER_FRAME=0xf1,SONG_POSITION_POINTER=0xf2,SONG_SELECT=0xf3,TUNE_REQUEST=0xf6,SYSEX_END=0xf7,
+  TIMING_CLOCK=0xf8,START=0xfa,CONTINUE=0xfb,STOP=0xfc,ACTIVE_SENSING=0xfe,SYSTEM_RESET=0xff
+};
+
+class Channel {
+public:
+  constexpr Channel(uint8_t r=0) : raw(r & 0x0f) {}
+  constexpr uint8_t getRaw() const { return raw; }
+  constexpr uint8_t getOneBased() const { return raw+1; }
+  static constexpr Channel createChannel(uint8_t c) { return Channel(c-1); }
+  constexpr Channel operator+(int offset) const { return Channel(raw+offset); }
+  constexpr bool operator==(const Channel &o) const { return raw == o.raw; }
+  uint8_t raw;
+};
+constexpr Channel Channel_1=Channel(0);
+
+class Cable {
+public:
+  constexpr Cable(uint8_t r=0) : raw(r & 0x0f) {}
+  constexpr uint8_t getRaw() const { return raw; }
+  constexpr uint8_t getOneBased() const { return raw+1; }
+  uint8_t raw;
+};
+constexpr Cable Cable_1=Cable(0);
+
+struct MIDIAddress {
+  uint8_t address;
+  Channel channel;
+  Cable cable;
+  MIDIAddress(int a, Channel c=Channel_1, Cable cb=Cable_1) : address(a), channel(c), cable(cb) {}
+};
+
+struct MIDIChannelCable {
+  Channel channel;
+  Cable cable;
+  MIDIChannelCable(Channel c, Cable cb=Cable_1) : channel(c), cable(cb) {}
+};
+
+struct ChannelMessage {
+  uint8_t header,data1,data2;
+  Cable cable;
+  ChannelMessage() : header(0), data1(0), data2(0) {}
+  ChannelMessage(uint8_t h, uint8_t d1, uint8_t d2, Cable c=Cable_1) : header(h), data1(d1), data2(d2), cable(c) {}
+  MIDIMessageType getMessageType() const { return (MIDIMessageType)(header & 0xf0); }
+  Channel getChannel() const { return Channel(header & 0x0f); }
+  bool hasTwoDataBytes() const { uint8_t t=header & 0xf0; return (t != 0xc0) && (t != 0xd0); }
+};
+
+struct SysExMessage {
+  const uint8_t * data;
+  uint16_t length;
+  Cable cable;
+  SysExMessage() : data(0), length(0) {}
+  SysExMessage(const uint8_t * d, uint16_t l, Cable c=Cable_1) : data(d), length(l), cable(c) {}
+  bool isFirstChunk() const { return length && (data[0] == 0xf0); }
+  bool isLastChunk() const { return length && (data[length-1] == 0xf7); }
+  bool isCompleteMessage() const { return isFirstChunk() && isLastChunk(); }
+};
+
+struct SysCommonMessage {
+  uint8_t header,data1,data2;
+  Cable cable;
+  SysCommonMessage() : header(0), data1(0), data2(0) {}
+  SysCommonMessage(MIDIMessageType t, uint8_t d1=0, uint8_t d2=0, Cable c=Cable_1) : header(t), data1(d1), data2(d2), cable(c) {}
+  MIDIMessageType getMessageType() const { return (MIDIMessageType)header; }
+  uint8_t getData1() const { return data1; }
+  uint16_t getData14bit() const { return data1 | (data2 << 7); }
+};
+
+struct RealTimeMessage {
+  uint8_t message;
+  Cable cable;
+  RealTimeMessage(MIDIMessageType m, Cable c=Cable_1) : message(m), cable(c) {}
+  RealTimeMessage(uint8_t m, Cable c=Cable_1) : message(m), cable(c) {}
+  MIDIMessageType getMessageType() const { return (MIDIMessageType)message; }
+};
+
+class MIDI_Interface;
+
+struct MIDI_Callbacks {
+  virtual void onChannelMessage(MIDI_Interface &, ChannelMessage) {}
+  virtual void onSysExMessage(MIDI_Interface &, SysExMessage) {}
+  virtual void onSysCommonMessage(MIDI_Interface &, SysCommonMessage) {}
+  virtual void onRealTimeMessage(MIDI_Interface &, RealTimeMessage) {}
+  virtual ~MIDI_Callbacks() {}
+};
+
+// splits the messages out to one call per type like the real one
+template<class Derived> struct FineGrainedMIDI_Callbacks : MIDI_Callbacks {
+  void onChannelMessage(MIDI_Interface &, ChannelMessage msg) override {
+    Derived &d=static_cast<Derived &>(*this);
+    Channel ch=msg.getChannel();
+    switch (msg.getMessageType()) {
+      case NOTE_OFF: d.onNoteOff(ch,msg.data1,msg.data2,msg.cable); break;
+      case NOTE_ON: d.onNoteOn(ch,msg.data1,msg.data2,msg.cable); break;
+      case KEY_PRESSURE: d.onKeyPressure(ch,msg.data1,msg.data2,msg.cable); break;
+      case CONTROL_CHANGE: d.onControlChange(ch,msg.data1,msg.data2,msg.cable); break;
+      case PROGRAM_CHANGE: d.onProgramChange(ch,msg.data1,msg.cable); break;
+      case CHANNEL_PRESSURE: d.onChannelPressure(ch,msg.data1,msg.cable); break;
+      case PITCH_BEND: d.onPitchBend(ch,msg.data1 | (msg.data2 << 7),msg.cable); break;
+      default: break;
+    }
+  }
+  void onSysExMessage(MIDI_Interface &, SysExMessage msg) override {
+    static_cast<Derived &>(*this).onSystemExclusive(msg);
+  }
+  void onSysCommonMessage(MIDI_Interface &, SysCommonMessage msg) override {
+    Derived &d=static_cast<Derived &>(*this);
+    switch (msg.getMessageType()) {
+      case MTC_QUARTER_FRAME: d.onTimeCodeQuarterFrame(msg.data1,msg.cable); break;
+      case SONG_POSITION_POINTER: d.onSongPosition(msg.getData14bit(),msg.cable); break;
+      case SONG_SELECT: d.onSongSelect(msg.data1,msg.cable); break;
+      case TUNE_REQUEST: d.onTuneRequest(msg.cable); break;
+      default: break;
+    }
+  }
+  void onRealTimeMessage(MIDI_Interface &, RealTimeMessage msg) override {
+    Derived &d=static_cast<Derived &>(*this);
+    switch (msg.getMessageType()) {
+      case TIMING_CLOCK: d.onClock(msg.cable); break;
+      case START: d.onStart(msg.cable); break;
+      case CONTINUE: d.onContinue(msg.cable); break;
+      case STOP: d.onStop(msg.cable); break;
+      case ACTIVE_SENSING: d.onActiveSensing(msg.cable); break;
+      case SYSTEM_RESET: d.onSystemReset(msg.cable); break;
+      default: break;
+    }
+  }
+  void onNoteOff(Channel, uint8_t, uint8_t, Cable) {}
+  void onNoteOn(Channel, uint8_t, uint8_t, Cable) {}
+  void onKeyPressure(Channel, uint8_t, uint8_t, Cable) {}
+  void onControlChange(Channel, uint8_t, uint8_t, Cable) {}
+  void onProgramChange(Channel, uint8_t, Cable) {}
+  void onChannelPressure(Channel, uint8_t, Cable) {}
+  void onPitchBend(Channel, uint16_t, Cable) {}
+  void onSystemExclusive(SysExMessage) {}
+  void onTimeCodeQuarterFrame(uint8_t, Cable) {}
+  void onSongPosition(uint16_t, Cable) {}
+  void onSongSelect(uint8_t, Cable) {}
+  void onTuneRequest(Cable) {}
+  void onClock(Cable) {}
+  void onStart(Cable) {}
+  void onContinue(Cable) {}
+  void onStop(Cable) {}
+  void onActiveSensing(Cable) {}
+  void onSystemReset(Cable) {}
+};
+
+class MIDI_Interface {
+public:
+  MIDI_Interface(int port);
+  virtual ~MIDI_Interface() {}
+  static void beginAll(void);
+  static void updateAll(void);
+  void begin(void) {}
+  void update(void);
+  void setCallbacks(MIDI_Callbacks * cb) { callbacks=cb; }
+  void setCallbacks(MIDI_Callbacks &cb) { callbacks=&cb; }
+
+  void send(ChannelMessage msg);
+  void send(SysExMessage msg);
+  void send(SysCommonMessage msg);
+  void send(RealTimeMessage msg);
+  void sendChannelMessage(MIDIMessageType type, Channel ch, uint8_t d1, uint8_t d2, Cable c=Cable_1) { send(ChannelMessage(type | ch.getRaw(),d1,d2,c)); }
+  void sendNoteOn(MIDIAddress a, uint8_t velocity) { send(ChannelMessage(NOTE_ON | a.channel.getRaw(),a.address,velocity,a.cable)); }
+  void sendNoteOff(MIDIAddress a, uint8_t velocity) { send(ChannelMessage(NOTE_OFF | a.channel.getRaw(),a.address,velocity,a.cable)); }
+  void sendControlChange(MIDIAddress a, uint8_t value) { send(ChannelMessage(CONTROL_CHANGE | a.channel.getRaw(),a.address,value,a.cable)); }
+  void sendProgramChange(MIDIAddress a) { send(ChannelMessage(PROGRAM_CHANGE | a.channel.getRaw(),a.address,0,a.cable)); }
+  void sendProgramChange(MIDIChannelCable a, uint8_t value) { send(ChannelMessage(PROGRAM_CHANGE | a.channel.getRaw(),value,0,a.cable)); }
+  void sendRealTime(MIDIMessageType m, Cable c=Cable_1) { send(RealTimeMessage(m,c)); }
+  void sendRealTime(RealTimeMessage m) { send(m); }
+  void sendSysEx(const uint8_t * data, uint16_t length, Cable c=Cable_1) { send(SysExMessage(data,length,c)); }
+  template<size_t N> void sendSysEx(const uint8_t (&data)[N]) { sendSysEx(data,N); }
+  void sendNow(void);
+
+  int portnum;          // SIM_USB, SIM_DIN or SIM_BLE
+  bool usetimeout=true;
+  MIDI_Callbacks * callbacks=0;
+  MIDI_Interface * next;
+  uint8_t sysex[SYSEX_BUFFER_SIZE];  // input SysEx being collected
+  uint16_t sysexlen;
+  bool insysex;
+};
+
+class USBMIDI_Interface : public MIDI_Interface {
+public:
+  USBMIDI_Interface() : MIDI_Interface(SIM_USB) {}
+  void disableTimeout(void) { usetimeout=false; }
+  void setTimeout(unsigned long ms) { usetimeout=ms != 0; }
+};
+
+class HardwareSerialMIDI_Interface : public MIDI_Interface {
+public:
+  HardwareSerialMIDI_Interface(HardwareSerial &serial, unsigned long baud) : MIDI_Interface(SIM_DIN) { (void)serial; (void)baud; }
+};
@@ -0,0 +1,59 @@
+// host stand-in for the arduino-pico LittleFS - files live in memory (fs.cpp)
+// writes cost what a flash erase and program would when the file is closed, with interrupts off and the other core held
+// like the real flash routines do
+#pragma once
+#include "Arduino.h"
+
+struct simopenfile;
+
+class File : public Stream {
+public:
+  File() : f(0) {}
+  File(simopenfile * of) : f(of) {}
+  File(const File &o);
+  File &operator=(const File &o);
+  ~File();
+  operator bool() const { return f != 0; }
+  size_t write(uint8_t c) override { return write(&c,1); }
+  size_t write(const uint8_t * buf, size_t n) override;
+  using Print::write;
+  int available(void) override;
+  int read(void) override;
+  int peek(void) override;
+  size_t read(uint8_t * buf, size_t n);
+  bool seek(uint32_t pos);
+  size_t position(void) const;
+  size_t size(void) const;
+  void flush(void) override;
+  void close(void);
+  const char * name(void) const;
+private:
+  simopenfile * f;
+};
+
+class Dir {
+public:
+  bool next(void);
+  const char * fileName(void) const;
+  size_t fileSize(void) const;
+  File openFile(const char * mode);
+  int index=-1;
+};
+
+struct FSInfo {
+  size_t totalBytes,usedBytes,blockSize,pageSize,maxOpenFiles,maxPathLength;
+};
+
+class FS {
+public:
+  bool begin(void);
+  void end(void) {}
+  bool format(void);
+  bool exists(const char * path);
+  bool remove(const char * path);
+  bool rename(const char * from, const char * to);
+  File open(const char * path, const char * mode);
+  Dir openDir(const char * path);
+  bool info(FSInfo &info);
+};
+extern FS LittleFS;
@@ -0,0 +1,2 @@
+// the sketches include the FortySevenEffects MIDI library header but only use Control Surface
+#pragma once
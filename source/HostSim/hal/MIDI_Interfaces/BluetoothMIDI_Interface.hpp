@@ -0,0 +1,9 @@
+// host stand-in for the Control Surface BLE MIDI interface - see Control_Surface.h for the timing model
+#pragma once
+#include "../Control_Surface.h"
+
+class BluetoothMIDI_Interface : public MIDI_Interface {
+public:
+  BluetoothMIDI_Interface() : MIDI_Interface(SIM_BLE) {}
+  void setName(const char * name) { (void)name; }
+};
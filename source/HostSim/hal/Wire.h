@@ -0,0 +1,13 @@
+// host stand-in for the I2C port - the display models its own transfer time at the clock set here
+#pragma once
+#include "Arduino.h"
+
+class TwoWire {
+public:
+  uint32_t clock=100000;
+  void setSDA(int pin) { (void)pin; }
+  void setSCL(int pin) { (void)pin; }
+  void begin(void) {}
+  void setClock(uint32_t hz) { clock=hz; }
+};
+extern TwoWire Wire,Wire1;
@@ -0,0 +1,334 @@
+// Twisty 2 host simulator - OLED, GFX text and the NeoPixels
+
+#include "Adafruit_SSD1306.h"
+#include "Adafruit_NeoPixel.h"
+
+void * sim_realloc(void * p, size_t size);
+void sim_free(void * p);
+
+uint8_t simpanel[128*64/8];
+bool simpanelon=true;
+uint32_t simframes;
+uint32_t simdrawpixels;
+uint32_t simleds[64];
+uint32_t simledshows;
+
+static int16_t panelw=128,panelh=32;
+static uint8_t panelrot;
+
+TwoWire Wire,Wire1;
+
+// the classic Adafruit GFX font from space to DEL. the sketches don't use the rest, which draws blank
+const uint8_t simfont[96][5]={
+  {0x00,0x00,0x00,0x00,0x00},{0x00,0x00,0x5f,0x00,0x00},{0x00,0x07,0x00,0x07,0x00},{0x14,0x7f,0x14,0x7f,0x14},
+  {0x24,0x2a,0x7f,0x2a,0x12},{0x23,0x13,0x08,0x64,0x62},{0x36,0x49,0x56,0x20,0x50},{0x00,0x08,0x07,0x03,0x00},
+  {0x00,0x1c,0x22,0x41,0x00},{0x00,0x41,0x22,0x1c,0x00},{0x2a,0x1c,0x7f,0x1c,0x2a},{0x08,0x08,0x3e,0x08,0x08},
+  {0x00,0x80,0x70,0x30,0x00},{0x08,0x08,0x08,0x08,0x08},{0x00,0x00,0x60,0x60,0x00},{0x20,0x10,0x08,0x04,0x02},
+  {0x3e,0x51,0x49,0x45,0x3e},{0x00,0x42,0x7f,0x40,0x00},{0x72,0x49,0x49,0x49,0x46},{0x21,0x41,0x49,0x4d,0x33},
+  {0x18,0x14,0x12,0x7f,0x10},{0x27,0x45,0x45,0x45,0x39},{0x3c,0x4a,0x49,0x49,0x31},{0x41,0x21,0x11,0x09,0x07},
+  {0x36,0x49,0x49,0x49,0x36},{0x46,0x49,0x49,0x29,0x1e},{0x00,0x00,0x14,0x00,0x00},{0x00,0x40,0x34,0x00,0x00},
+  {0x00,0x08,0x14,0x22,0x41},{0x14,0x14,0x14,0x14,0x14},{0x00,0x41,0x22,0x14,0x08},{0x02,0x01,0x59,0x09,0x06},
+  {0x3e,0x41,0x5d,0x59,0x4e},{0x7c,0x12,0x11,0x12,0x7c},{0x7f,0x49,0x49,0x49,0x36},{0x3e,0x41,0x41,0x41,0x22},
+  {0x7f,0x41,0x41,0x41,0x3e},{0x7f,0x49,0x49,0x49,0x41},{0x7f,0x09,0x09,0x09,0x01},{0x3e,0x41,0x41,0x51,0x73},
+  {0x7f,0x08,0x08,0x08,0x7f},{0x00,0x41,0x7f,0x41,0x00},{0x20,0x40,0x41,0x3f,0x01},{0x7f,0x08,0x14,0x22,0x41},
+  {0x7f,0x40,0x40,0x40,0x40},{0x7f,0x02,0x1c,0x02,0x7f},{0x7f,0x04,0x08,0x10,0x7f},{0x3e,0x41,0x41,0x41,0x3e},
+  {0x7f,0x09,0x09,0x09,0x06},{0x3e,0x41,0x51,0x21,0x5e},{0x7f,0x09,0x19,0x29,0x46},{0x26,0x49,0x49,0x49,0x32},
+  {0x03,0x01,0x7f,0x01,0x03},{0x3f,0x40,0x40,0x40,0x3f},{0x1f,0x20,0x40,0x20,0x1f},{0x3f,0x40,0x38,0x40,0x3f},
+  {0x63,0x14,0x08,0x14,0x63},{0x03,0x04,0x78,0x04,0x03},{0x61,0x59,0x49,0x4d,0x43},{0x00,0x7f,0x41,0x41,0x41},
+  {0x02,0x04,0x08,0x10,0x20},{0x00,0x41,0x41,0x41,0x7f},{0x04,0x02,0x01,0x02,0x04},{0x40,0x40,0x40,0x40,0x40},
+  {0x00,0x03,0x07,0x08,0x00},{0x20,0x54,0x54,0x78,0x40},{0x7f,0x28,0x44,0x44,0x38},{0x38,0x44,0x44,0x44,0x28},
+  {0x38,0x44,0x44,0x28,0x7f},{0x38,0x54,0x54,0x54,0x18},{0x00,0x08,0x7e,0x09,0x02},{0x18,0xa4,0xa4,0x9c,0x78},
+  {0x7f,0x08,0x04,0x04,0x78},{0x00,0x44,0x7d,0x40,0x00},{0x20,0x40,0x40,0x3d,0x00},{0x7f,0x10,0x28,0x44,0x00},
+  {0x00,0x41,0x7f,0x40,0x00},{0x7c,0x04,0x78,0x04,0x78},{0x7c,0x08,0x04,0x04,0x78},{0x38,0x44,0x44,0x44,0x38},
+  {0xfc,0x18,0x24,0x24,0x18},{0x18,0x24,0x24,0x18,0xfc},{0x7c,0x08,0x04,0x04,0x08},{0x48,0x54,0x54,0x54,0x24},
+  {0x04,0x04,0x3f,0x44,0x24},{0x3c,0x40,0x40,0x20,0x7c},{0x1c,0x20,0x40,0x20,0x1c},{0x3c,0x40,0x30,0x40,0x3c},
+  {0x44,0x28,0x10,0x28,0x44},{0x4c,0x90,0x90,0x90,0x7c},{0x44,0x64,0x54,0x4c,0x44},{0x00,0x08,0x36,0x41,0x00},
+  {0x00,0x00,0x77,0x00,0x00},{0x00,0x41,0x36,0x08,0x00},{0x02,0x01,0x02,0x04,0x02},{0x3c,0x26,0x23,0x26,0x3c}
+};
+
+// ---------------------------------------------------------------------------- GFX
+
+Adafruit_GFX::Adafruit_GFX(int16_t w, int16_t h) : WIDTH(w), HEIGHT(h), _width(w), _height(h) {}
+
+void Adafruit_GFX::setRotation(uint8_t r) {
+  rotation=r & 3;
+  _width=(rotation & 1) ? HEIGHT : WIDTH;
+  _height=(rotation & 1) ? WIDTH : HEIGHT;
+}
+
+void Adafruit_GFX::fillRect(int16_t x, int16_t y, int16_t w, int16_t h, uint16_t color) {
+  for (int16_t i=x; i<x+w; ++i) {
+    for (int16_t j=y; j<y+h; ++j) drawPixel(i,j,color);
+  }
+}
+
+void Adafruit_GFX::fillScreen(uint16_t color) {
+  fillRect(0,0,_width,_height,color);
+}
+
+void Adafruit_GFX::drawRect(int16_t x, int16_t y, int16_t w, int16_t h, uint16_t color) {
+  drawFastHLine(x,y,w,color);
+  drawFastHLine(x,y+h-1,w,color);
+  drawFastVLine(x,y,h,color);
+  drawFastVLine(x+w-1,y,h,color);
+}
+
+void Adafruit_GFX::drawLine(int16_t x0, int16_t y0, int16_t x1, int16_t y1, uint16_t color) {
+  int16_t dx=abs(x1-x0),dy=-abs(y1-y0);
+  int16_t sx=(x0 < x1) ? 1 : -1,sy=(y0 < y1) ? 1 : -1;
+  int16_t err=dx+dy;
+  for (;;) {
+    drawPixel(x0,y0,color);
+    if ((x0 == x1) && (y0 == y1)) break;
+    int16_t e2=2*err;
+    if (e2 >= dy) { err+=dy; x0+=sx; }
+    if (e2 <= dx) { err+=dx; y0+=sy; }
+  }
+}
+
+void Adafruit_GFX::drawChar(int16_t x, int16_t y, unsigned char c, uint16_t color, uint16_t bg, uint8_t size) {
+  drawChar(x,y,c,color,bg,size,size);
+}
+
+// same order and clipping as the library, including the blank sixth column drawn in the background colour
+void Adafruit_GFX::drawChar(int16_t x, int16_t y, unsigned char c, uint16_t color, uint16_t bg, uint8_t sizex, uint8_t sizey) {
+  if ((x >= _width) || (y >= _height) || ((x+6*sizex-1) < 0) || ((y+8*sizey-1) < 0)) return;
+  if (!_cp437 && (c >= 176)) c++;
+  for (int8_t i=0; i<5; ++i) {
+    uint8_t line=((c >= 32) && (c < 128)) ? simfont[c-32][i] : 0;
+    for (int8_t j=0; j<8; ++j, line >>= 1) {
+      if (line & 1) {
+        if ((sizex == 1) && (sizey == 1)) drawPixel(x+i,y+j,color);
+        else fillRect(x+i*sizex,y+j*sizey,sizex,sizey,color);
+      }
+      else if (bg != color) {
+        if ((sizex == 1) && (sizey == 1)) drawPixel(x+i,y+j,bg);
+        else fillRect(x+i*sizex,y+j*sizey,sizex,sizey,bg);
+      }
+    }
+  }
+  if (bg != color) {
+    if ((sizex == 1) && (sizey == 1)) drawFastVLine(x+5,y,8,bg);
+    else fillRect(x+5*sizex,y,sizex,8*sizey,bg);
+  }
+}
+
+size_t Adafruit_GFX::write(uint8_t c) {
+  if (c == '\n') {
+    cursor_x=0;
+    cursor_y+=textsize_y*8;
+  }
+  else if (c != '\r') {
+    if (wrap && ((cursor_x+textsize_x*6) > _width)) {
+      cursor_x=0;
+      cursor_y+=textsize_y*8;
+    }
+    drawChar(cursor_x,cursor_y,c,textcolor,textbgcolor,textsize_x,textsize_y);
+    cursor_x+=textsize_x*6;
+  }
+  return 1;
+}
+
+GFXcanvas1::GFXcanvas1(uint16_t w, uint16_t h) : Adafruit_GFX(w,h) {
+  buffer=(uint8_t *)malloc(((w+7)/8)*h);
+  memset(buffer,0,((w+7)/8)*h);
+}
+
+GFXcanvas1::~GFXcanvas1() {
+  free(buffer);
+}
+
+void GFXcanvas1::drawPixel(int16_t x, int16_t y, uint16_t color) {
+  if ((x < 0) || (y < 0) || (x >= _width) || (y >= _height)) return;
+  uint8_t * p=&buffer[(x/8)+y*((WIDTH+7)/8)];
+  if (color == WHITE) *p|=0x80 >> (x & 7);
+  else if (color == INVERSE) *p^=0x80 >> (x & 7);
+  else *p&=~(0x80 >> (x & 7));
+}
+
+bool GFXcanvas1::getPixel(int16_t x, int16_t y) const {
+  if ((x < 0) || (y < 0) || (x >= _width) || (y >= _height)) return false;
+  return buffer[(x/8)+y*((WIDTH+7)/8)] & (0x80 >> (x & 7));
+}
+
+// ---------------------------------------------------------------------------- SSD1306
+
+Adafruit_SSD1306::Adafruit_SSD1306(uint8_t w, uint8_t h, TwoWire * twi, int8_t rst_pin, uint32_t clkDuring, uint32_t clkAfter) :
+  Adafruit_GFX(w,h), wireclk(clkDuring) {
+  (void)twi;
+  (void)rst_pin;
+  (void)clkAfter;
+}
+
+Adafruit_SSD1306::~Adafruit_SSD1306() {
+  free(buffer);
+}
+
+bool Adafruit_SSD1306::begin(uint8_t switchvcc, uint8_t i2caddr, bool reset, bool periphBegin) {
+  (void)switchvcc;
+  (void)i2caddr;
+  (void)reset;
+  (void)periphBegin;
+  if (!buffer && !(buffer=(uint8_t *)malloc(WIDTH*((HEIGHT+7)/8)))) return false;
+  clearDisplay();
+  panelw=WIDTH;
+  panelh=HEIGHT;
+  delay(1);  // the library pauses for the reset and then sends ~25 init command bytes
+  sim_spend(25*9*1000000000ull/wireclk);
+  simpanelon=true;
+  return true;
+}
+
+void Adafruit_SSD1306::clearDisplay(void) {
+  memset(buffer,0,WIDTH*((HEIGHT+7)/8));
+}
+
+void Adafruit_SSD1306::drawPixel(int16_t x, int16_t y, uint16_t color) {
+  if ((x < 0) || (y < 0) || (x >= width()) || (y >= height())) return;
+  ++simdrawpixels;
+  switch (rotation) {
+    case 1: { int16_t t=x; x=WIDTH-y-1; y=t; } break;
+    case 2: x=WIDTH-x-1; y=HEIGHT-y-1; break;
+    case 3: { int16_t t=x; x=y; y=HEIGHT-t-1; } break;
+  }
+  uint8_t * p=&buffer[x+(y/8)*WIDTH];
+  if (color == WHITE) *p|=1 << (y & 7);
+  else if (color == INVERSE) *p^=1 << (y & 7);
+  else *p&=~(1 << (y & 7));
+}
+
+bool Adafruit_SSD1306::getPixel(int16_t x, int16_t y) {
+  if ((x < 0) || (y < 0) || (x >= width()) || (y >= height())) return false;
+  switch (rotation) {
+    case 1: { int16_t t=x; x=WIDTH-y-1; y=t; } break;
+    case 2: x=WIDTH-x-1; y=HEIGHT-y-1; break;
+    case 3: { int16_t t=x; x=y; y=HEIGHT-t-1; } break;
+  }
+  return buffer[x+(y/8)*WIDTH] & (1 << (y & 7));
+}
+
+// 6 command bytes to set the window, then the buffer in 32 byte I2C writes of a control byte and 31 data bytes,
+// each write with its address byte. 9 bits a byte on the wire
+void Adafruit_SSD1306::display(void) {
+  uint32_t bytes=WIDTH*((HEIGHT+7)/8);
+  uint32_t writes=(bytes+30)/31;
+  uint64_t wirebytes=6*2+bytes+writes*2;
+  sim_spend(wirebytes*9*1000000000ull/wireclk);
+  memcpy(simpanel,buffer,bytes);
+  panelrot=rotation;
+  ++simframes;
+}
+
+void Adafruit_SSD1306::ssd1306_command(uint8_t c) {
+  sim_spend(2*9*1000000000ull/wireclk);
+  if (c == SSD1306_DISPLAYOFF) simpanelon=false;
+  if (c == SSD1306_DISPLAYON) simpanelon=true;
+}
+
+bool sim_pixel(int x, int y) {
+  if ((panelrot & 1) ? ((x >= panelh) || (y >= panelw)) : ((x >= panelw) || (y >= panelh))) return false;
+  switch (panelrot) {
+    case 1: { int t=x; x=panelw-y-1; y=t; } break;
+    case 2: x=panelw-x-1; y=panelh-y-1; break;
+    case 3: { int t=x; x=y; y=panelh-t-1; } break;
+  }
+  return simpanel[x+(y/8)*panelw] & (1 << (y & 7));
+}
+
+void sim_display_dump(FILE * f) {
+  int w=(panelrot & 1) ? panelh : panelw;
+  int h=(panelrot & 1) ? panelw : panelh;
+  fprintf(f,"+");
+  for (int x=0; x<w; ++x) fputc('-',f);
+  fprintf(f,"+%s\n",simpanelon ? "" : " (off)");
+  for (int y=0; y<h; ++y) {
+    fputc('|',f);
+    for (int x=0; x<w; ++x) fputc(sim_pixel(x,y) ? '#' : ' ',f);
+    fprintf(f,"|\n");
+  }
+  fprintf(f,"+");
+  for (int x=0; x<w; ++x) fputc('-',f);
+  fprintf(f,"+\n");
+}
+
+// does the 6x8 cell at x,y hold character c, either way round
+static bool cellis(int x, int y, uint8_t c, bool inverse) {
+  for (int i=0; i<6; ++i) {
+    uint8_t col=(i < 5) ? simfont[c-32][i] : 0;
+    for (int j=0; j<8; ++j) {
+      if (sim_pixel(x+i,y+j) != (bool)(((col >> j) & 1) ^ inverse)) return false;
+    }
+  }
+  return true;
+}
+
+// read the panel back as size 1 text on 8 pixel rows - anything that isn't a character is skipped a column at a time,
+// six blank columns count as a space
+size_t sim_display_text(char * buf, size_t size) {
+  int w=(panelrot & 1) ? panelh : panelw;
+  int h=(panelrot & 1) ? panelw : panelh;
+  size_t n=0;
+  for (int y=0; (y+8 <= h) && (n+2 < size); y+=8) {
+    size_t linestart=n;
+    int blank=0;
+    for (int x=0; (x < w) && (n+2 < size);) {
+      int found=0;
+      for (uint8_t c=0x21; (c < 0x7f) && !found; ++c) {
+        if ((x+6 <= w+1) && (cellis(x,y,c,false) || cellis(x,y,c,true))) found=c;
+      }
+      if (found) {
+        buf[n++]=found;
+        blank=0;
+        x+=6;
+        continue;
+      }
+      bool empty=true;
+      for (int j=0; j<8; ++j) empty=empty && !sim_pixel(x,y+j);
+      if (empty && (++blank == 6)) {
+        buf[n++]=' ';
+        blank=0;
+      }
+      ++x;
+    }
+    while ((n > linestart) && (buf[n-1] == ' ')) --n;
+    buf[n++]='\n';
+  }
+  buf[n]=0;
+  return n;
+}
+
+// ---------------------------------------------------------------------------- NeoPixels
+
+Adafruit_NeoPixel::Adafruit_NeoPixel(uint16_t n, int16_t pin, uint16_t type) : numLEDs(n) {
+  (void)pin;
+  (void)type;
+  pixels=(uint8_t *)malloc(n*3);
+  memset(pixels,0,n*3);
+}
+
+Adafruit_NeoPixel::~Adafruit_NeoPixel() {
+  free(pixels);
+}
+
+void Adafruit_NeoPixel::setPixelColor(uint16_t n, uint32_t c) {
+  setPixelColor(n,(uint8_t)(c >> 16),(uint8_t)(c >> 8),(uint8_t)c);
+}
+
+void Adafruit_NeoPixel::setPixelColor(uint16_t n, uint8_t r, uint8_t g, uint8_t b) {
+  if (n >= numLEDs) return;
+  pixels[n*3]=g;
+  pixels[n*3+1]=r;
+  pixels[n*3+2]=b;
+}
+
+uint32_t Adafruit_NeoPixel::getPixelColor(uint16_t n) const {
+  if (n >= numLEDs) return 0;
+  return ((uint32_t)pixels[n*3+1] << 16) | ((uint32_t)pixels[n*3] << 8) | pixels[n*3+2];
+}
+
+// 24 bits at 800kHz a pixel and the latch gap
+void Adafruit_NeoPixel::show(void) {
+  sim_spend(numLEDs*30000ull+50000);
+  for (uint16_t i=0; (i < numLEDs) && (i < 64); ++i) simleds[i]=getPixelColor(i);
+  ++simledshows;
+}
@@ -0,0 +1,289 @@
+// Twisty 2 host simulator - LittleFS in memory
+// a file's data is written when it's closed or flushed, one sector erase per 4K and one page program per 256 bytes. each
+// of those holds the other core and masks interrupts for its duration the way the arduino-pico flash routines do
+
+#include "LittleFS.h"
+
+void * sim_realloc(void * p, size_t size);
+void sim_free(void * p);
+
+#define FS_FILES 64
+#define FS_NAME 64
+#define FS_SIZE (1024*1024)
+#define FLASH_SECTOR 4096
+#define FLASH_PAGE 256
+
+uint64_t simflasherase=45000000;
+uint64_t simflashprog=400000;
+uint64_t simflashwrites;
+uint64_t simflashstall;
+
+struct simfile {
+  bool used;
+  char name[FS_NAME];
+  uint8_t * data;
+  size_t len,size;
+};
+
+struct simopenfile {
+  int refs;
+  int file;
+  size_t pos;
+  bool write,read;
+  size_t dirty;      // bytes written since the last flush
+};
+
+static simfile files[FS_FILES];
+static bool fsfail;
+FS LittleFS;
+
+static const char * fsname(const char * path) {
+  while (*path == '/') ++path;
+  return path;
+}
+
+static int fsfind(const char * path) {
+  path=fsname(path);
+  for (int i=0; i<FS_FILES; ++i) {
+    if (files[i].used && !strcmp(files[i].name,path)) return i;
+  }
+  return -1;
+}
+
+static int fscreate(const char * path) {
+  for (int i=0; i<FS_FILES; ++i) {
+    if (!files[i].used) {
+      files[i].used=true;
+      snprintf(files[i].name,FS_NAME,"%s",fsname(path));
+      files[i].len=0;
+      return i;
+    }
+  }
+  return -1;
+}
+
+static void fsgrow(simfile &f, size_t len) {
+  if (len <= f.size) return;
+  f.size=(len > f.size*2) ? len : f.size*2;
+  f.data=(uint8_t *)sim_realloc(f.data,f.size);
+}
+
+// one flash operation - both cores stop for it
+static void flashop(uint64_t ns) {
+  uint32_t status=save_and_disable_interrupts();
+  rp2040.idleOtherCore();
+  sim_spend(ns);
+  rp2040.resumeOtherCore();
+  restore_interrupts(status);
+  if (ns > simflashstall) simflashstall=ns;
+}
+
+static void fsprogram(size_t bytes) {
+  if (!bytes) return;
+  for (size_t s=0; s<(bytes+FLASH_SECTOR-1)/FLASH_SECTOR; ++s) flashop(simflasherase);
+  for (size_t p=0; p<(bytes+FLASH_PAGE-1)/FLASH_PAGE; ++p) flashop(simflashprog);
+  flashop(simflashprog);  // the metadata commit
+  simflashwrites+=bytes;
+}
+
+bool FS::begin(void) {
+  return !fsfail;
+}
+
+bool FS::format(void) {
+  sim_fs_format();
+  flashop(simflasherase);
+  return true;
+}
+
+bool FS::exists(const char * path) {
+  return fsfind(path) >= 0;
+}
+
+bool FS::remove(const char * path) {
+  int i=fsfind(path);
+  if (i < 0) return false;
+  files[i].used=false;
+  flashop(simflashprog);
+  return true;
+}
+
+bool FS::rename(const char * from, const char * to) {
+  int i=fsfind(from);
+  if ((i < 0) || (fsfind(to) >= 0)) return false;
+  snprintf(files[i].name,FS_NAME,"%s",fsname(to));
+  flashop(simflashprog);
+  return true;
+}
+
+File FS::open(const char * path, const char * mode) {
+  int i=fsfind(path);
+  bool write=(mode[0] == 'w') || (mode[0] == 'a') || (mode[1] == '+');
+  if (i < 0) {
+    if (mode[0] == 'r') return File();
+    if ((i=fscreate(path)) < 0) return File();
+  }
+  if (mode[0] == 'w') files[i].len=0;
+  simopenfile * of=(simopenfile *)sim_realloc(0,sizeof(simopenfile));
+  memset(of,0,sizeof(*of));
+  of->refs=1;
+  of->file=i;
+  of->write=write;
+  of->read=(mode[0] == 'r') || (mode[1] == '+');
+  of->pos=(mode[0] == 'a') ? files[i].len : 0;
+  if (mode[0] == 'w') of->dirty=1;  // truncating is a write even if nothing follows
+  return File(of);
+}
+
+bool FS::info(FSInfo &info) {
+  memset(&info,0,sizeof(info));
+  info.totalBytes=FS_SIZE;
+  info.blockSize=FLASH_SECTOR;
+  info.pageSize=FLASH_PAGE;
+  info.maxOpenFiles=16;
+  info.maxPathLength=FS_NAME;
+  for (int i=0; i<FS_FILES; ++i) {
+    if (files[i].used) info.usedBytes+=((files[i].len+FLASH_SECTOR-1)/FLASH_SECTOR+1)*FLASH_SECTOR;
+  }
+  return true;
+}
+
+Dir FS::openDir(const char * path) {
+  (void)path;
+  return Dir();
+}
+
+bool Dir::next(void) {
+  while (++index < FS_FILES) {
+    if (files[index].used) return true;
+  }
+  return false;
+}
+
+const char * Dir::fileName(void) const {
+  return ((index >= 0) && (index < FS_FILES)) ? files[index].name : "";
+}
+
+size_t Dir::fileSize(void) const {
+  return ((index >= 0) && (index < FS_FILES)) ? files[index].len : 0;
+}
+
+File Dir::openFile(const char * mode) {
+  return LittleFS.open(fileName(),mode);
+}
+
+// ---------------------------------------------------------------------------- File
+
+File::File(const File &o) : f(o.f) {
+  if (f) ++f->refs;
+}
+
+File &File::operator=(const File &o) {
+  if (o.f) ++o.f->refs;
+  close();
+  f=o.f;
+  return *this;
+}
+
+File::~File() {
+  close();
+}
+
+size_t File::write(const uint8_t * buf, size_t n) {
+  if (!f || !f->write) return 0;
+  simfile &sf=files[f->file];
+  fsgrow(sf,f->pos+n);
+  memcpy(sf.data+f->pos,buf,n);
+  f->pos+=n;
+  if (f->pos > sf.len) sf.len=f->pos;
+  f->dirty+=n;
+  return n;
+}
+
+int File::available(void) {
+  if (!f || !f->read) return 0;
+  return files[f->file].len-f->pos;
+}
+
+int File::read(void) {
+  uint8_t c;
+  return (read(&c,1) == 1) ? c : -1;
+}
+
+int File::peek(void) {
+  if (!f || !f->read || (f->pos >= files[f->file].len)) return -1;
+  return files[f->file].data[f->pos];
+}
+
+size_t File::read(uint8_t * buf, size_t n) {
+  if (!f || !f->read) return 0;
+  simfile &sf=files[f->file];
+  if (f->pos >= sf.len) return 0;
+  if (n > sf.len-f->pos) n=sf.len-f->pos;
+  memcpy(buf,sf.data+f->pos,n);
+  f->pos+=n;
+  return n;
+}
+
+bool File::seek(uint32_t pos) {
+  if (!f || (pos > files[f->file].len)) return false;
+  f->pos=pos;
+  return true;
+}
+
+size_t File::position(void) const {
+  return f ? f->pos : 0;
+}
+
+size_t File::size(void) const {
+  return f ? files[f->file].len : 0;
+}
+
+void File::flush(void) {
+  if (!f || !f->dirty) return;
+  fsprogram(f->dirty);
+  f->dirty=0;
+}
+
+void File::close(void) {
+  if (!f) return;
+  simopenfile * of=f;
+  f=0;
+  if (--of->refs) return;
+  if (of->dirty) {
+    fsprogram(of->dirty);
+    of->dirty=0;
+  }
+  sim_free(of);
+}
+
+const char * File::name(void) const {
+  return f ? files[f->file].name : "";
+}
+
+// ---------------------------------------------------------------------------- harness
+
+bool sim_fs_put(const char * name, const uint8_t * data, size_t len) {
+  int i=fsfind(name);
+  if ((i < 0) && ((i=fscreate(name)) < 0)) return false;
+  fsgrow(files[i],len);
+  memcpy(files[i].data,data,len);
+  files[i].len=len;
+  return true;
+}
+
+long sim_fs_get(const char * name, uint8_t * data, size_t size) {
+  int i=fsfind(name);
+  if (i < 0) return -1;
+  size_t n=(files[i].len < size) ? files[i].len : size;
+  memcpy(data,files[i].data,n);
+  return files[i].len;
+}
+
+void sim_fs_format(void) {
+  for (int i=0; i<FS_FILES; ++i) files[i].used=false;
+}
+
+void sim_fs_fail(bool fail) {
+  fsfail=fail;
+}
@@ -0,0 +1,9 @@
+// host stand-in for the pico-sdk interrupt controller calls - only the timer alarm interrupts exist
+
+#pragma once
+#include <stdint.h>
+
+typedef void (*irq_handler_t)(void);
+void irq_set_exclusive_handler(unsigned num, irq_handler_t handler);
+void irq_set_enabled(unsigned num, bool enabled);
+bool irq_is_enabled(unsigned num);
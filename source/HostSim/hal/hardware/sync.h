@@ -0,0 +1,14 @@
+// host stand-in for the pico-sdk interrupt masking and spin locks
+// a spin lock is never contended in the simulator - the cores only switch where one of them waits for something
+
+#pragma once
+#include <stdint.h>
+
+uint32_t save_and_disable_interrupts(void);
+void restore_interrupts(uint32_t status);
+
+typedef volatile uint32_t spin_lock_t;
+spin_lock_t * spin_lock_init(unsigned num);
+unsigned spin_lock_claim_unused(bool required);
+uint32_t spin_lock_blocking(spin_lock_t * lock);
+void spin_unlock(spin_lock_t * lock, uint32_t status);
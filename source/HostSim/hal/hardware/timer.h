@@ -0,0 +1,30 @@
+// host stand-in for the RP2040 timer registers
+// timerawl reads the virtual clock and writing an alarm register arms it, the same as the hardware. an armed alarm whose
+// interrupt is enabled runs its handler on the core that installed it once the clock gets there (see sim.cpp)
+
+#pragma once
+#include <stdint.h>
+
+struct sim_timeraw {
+  operator uint32_t() const;
+};
+
+struct sim_alarmreg {
+  uint32_t value;
+  sim_alarmreg &operator=(uint32_t v);  // arms the alarm
+  operator uint32_t() const { return value; }
+};
+
+typedef struct {
+  sim_timeraw timerawl,timerawh;
+  uint32_t inte,intr,intf,ints,armed;
+  sim_alarmreg alarm[4];
+} timer_hw_t;
+
+extern timer_hw_t * timer_hw;
+
+#define TIMER_IRQ_0 0
+unsigned timer_hardware_alarm_get_irq_num(timer_hw_t * timer, unsigned alarm);
+
+void hw_set_bits(volatile uint32_t * reg, uint32_t mask);
+void hw_clear_bits(volatile uint32_t * reg, uint32_t mask);
@@ -0,0 +1,329 @@
+// Twisty 2 host simulator - MIDI ports
+// output is logged per port with the time it would have left the unit, input is handed to the callbacks at update()
+
+#include <time.h>
+#include "Control_Surface.h"
+
+void * sim_realloc(void * p, size_t size);
+void sim_free(void * p);
+
+#define USB_BUFFER_PACKETS 16   // 64 byte endpoint buffer, 4 bytes an event packet
+#define USB_TIMEOUT_NS 1000000
+#define DIN_BYTE_NS 320000      // 10 bits at 31250 baud
+#define DIN_FIFO 32
+#define BLE_PACKET 20
+#define BLE_PACKETS_PER_EVENT 4
+
+simport simmidi[SIM_PORTS];
+uint64_t simblerate=7500000;
+
+static MIDI_Interface * interfaces;
+
+MIDI_Interface::MIDI_Interface(int port) : portnum(port), next(interfaces), sysexlen(0), insysex(false) {
+  interfaces=this;
+}
+
+void MIDI_Interface::beginAll(void) {}
+
+// ---------------------------------------------------------------------------- output
+
+static size_t usbflushed;       // simmidi[SIM_USB].log entries before this have gone out
+static uint32_t usbpackets;     // event packets in the endpoint buffer
+static uint64_t usbfirst;       // when the oldest of them was sent
+static uint64_t dinfree;        // when the UART will have sent everything in its FIFO
+static uint64_t bleevent;       // connection event being filled
+static uint32_t bleused;        // bytes in it
+
+static simmsg &logmsg(int port, const uint8_t * data, size_t len) {
+  simport &p=simmidi[port];
+  if (p.count == p.size) {
+    p.size=p.size ? p.size*2 : 1024;
+    p.log=(simmsg *)sim_realloc(p.log,p.size*sizeof(simmsg));
+  }
+  simmsg &m=p.log[p.count++];
+  memset(&m,0,sizeof(m));
+  m.queued=sim_ns();
+  m.len=len;
+  if ((len > 3) || (data[0] == 0xf0)) {
+    m.sysex=(uint8_t *)sim_realloc(0,len);
+    memcpy(m.sysex,data,len);
+  }
+  memcpy(m.data,data,len < 3 ? len : 3);
+  p.bytes+=len;
+  return m;
+}
+
+static void usbflush(void) {
+  simport &p=simmidi[SIM_USB];
+  if (usbflushed == p.count) return;
+  for (size_t i=usbflushed; i<p.count; ++i) p.log[i].ns=sim_ns();
+  usbflushed=p.count;
+  usbpackets=0;
+  ++p.transfers;
+}
+
+// event packets carry 3 MIDI bytes - a SysEx takes one per 3 bytes, everything else one each
+static uint32_t usbpacketcount(const uint8_t * data, size_t len) {
+  if (data[0] == 0xf0) return (len+2)/3;
+  return 1;
+}
+
+static void usbsend(const uint8_t * data, size_t len) {
+  uint32_t packets=usbpacketcount(data,len);
+  if (usbpackets+packets > USB_BUFFER_PACKETS) usbflush();
+  if (!usbpackets) usbfirst=sim_ns();
+  logmsg(SIM_USB,data,len);
+  usbpackets+=packets;
+  while (usbpackets >= USB_BUFFER_PACKETS) usbflush();  // a long SysEx goes out a buffer at a time
+}
+
+static void dinsend(const uint8_t * data, size_t len) {
+  for (size_t i=0; i<len; ++i) {
+    uint64_t now=sim_ns();
+    if (dinfree > now+DIN_FIFO*(uint64_t)DIN_BYTE_NS) {  // FIFO full - the write waits for room
+      sim_spend(dinfree-now-DIN_FIFO*(uint64_t)DIN_BYTE_NS);
+      now=sim_ns();
+    }
+    dinfree=((dinfree > now) ? dinfree : now)+DIN_BYTE_NS;
+  }
+  simmsg &m=logmsg(SIM_DIN,data,len);
+  m.ns=dinfree;
+  simmidi[SIM_DIN].transfers+=len;
+}
+
+static void blesend(const uint8_t * data, size_t len) {
+  uint64_t event=(sim_ns()/simblerate+1)*simblerate;
+  if (bleevent < event) {
+    bleevent=event;
+    bleused=0;
+  }
+  uint32_t need=len+1;  // a timestamp byte per message
+  if (bleused+need > BLE_PACKET*BLE_PACKETS_PER_EVENT) {
+    bleevent+=simblerate;
+    bleused=0;
+  }
+  if ((bleused % BLE_PACKET)+need > BLE_PACKET) ++simmidi[SIM_BLE].transfers;
+  if (!bleused) ++simmidi[SIM_BLE].transfers;
+  bleused+=need;
+  simmsg &m=logmsg(SIM_BLE,data,len);
+  m.ns=bleevent;
+}
+
+static void sendbytes(int port, const uint8_t * data, size_t len) {
+  if (!len) return;
+  switch (port) {
+    case SIM_USB: usbsend(data,len); break;
+    case SIM_DIN: dinsend(data,len); break;
+    case SIM_BLE: blesend(data,len); break;
+  }
+}
+
+void MIDI_Interface::send(ChannelMessage msg) {
+  uint8_t data[3]={msg.header,msg.data1,msg.data2};
+  sendbytes(portnum,data,msg.hasTwoDataBytes() ? 3 : 2);
+}
+
+void MIDI_Interface::send(SysExMessage msg) {
+  sendbytes(portnum,msg.data,msg.length);
+}
+
+void MIDI_Interface::send(SysCommonMessage msg) {
+  uint8_t data[3]={msg.header,msg.data1,msg.data2};
+  size_t len=(msg.header == SONG_POSITION_POINTER) ? 3 : (msg.header == TUNE_REQUEST) ? 1 : 2;
+  sendbytes(portnum,data,len);
+}
+
+void MIDI_Interface::send(RealTimeMessage msg) {
+  sendbytes(portnum,&msg.message,1);
+}
+
+void MIDI_Interface::sendNow(void) {
+  if (portnum == SIM_USB) usbflush();
+}
+
+void sim_midi_clear(void) {
+  if (simmidi[SIM_USB].count > usbflushed) usbflush();
+  for (int port=0; port<SIM_PORTS; ++port) {
+    simport &p=simmidi[port];
+    for (size_t i=0; i<p.count; ++i) sim_free(p.log[i].sysex);
+    p.count=0;
+    p.bytes=0;
+    p.transfers=0;
+  }
+  usbflushed=0;
+}
+
+const char * sim_msgtext(const simmsg &m, char * buf, size_t size) {
+  const uint8_t * d=m.sysex ? m.sysex : m.data;
+  size_t n=0;
+  buf[0]=0;
+  for (size_t i=0; (i < m.len) && (i < 8) && (n+4 < size); ++i) n+=snprintf(buf+n,size-n,i ? " %02X" : "%02X",d[i]);
+  if ((m.len > 8) && (n+16 < size)) snprintf(buf+n,size-n," ... (%u bytes)",(unsigned)m.len);
+  return buf;
+}
+
+void sim_midi_dump(FILE * f, int port) {
+  static const char * const names[SIM_PORTS]={"USB","DIN","BLE"};
+  simport &p=simmidi[port];
+  char text[64];
+  for (size_t i=0; i<p.count; ++i) {
+    fprintf(f,"%s %10.3f ms (+%.3f) %s\n",names[port],p.log[i].ns/1e6,(p.log[i].ns-p.log[i].queued)/1e6,sim_msgtext(p.log[i],text,sizeof(text)));
+  }
+}
+
+// ---------------------------------------------------------------------------- input
+
+struct inmsg {
+  uint64_t ns;       // when it has all arrived
+  uint16_t len;
+  uint8_t * data;
+};
+
+struct inqueue {
+  inmsg * q;
+  size_t head,count,size;
+  size_t done;       // USB - bytes of the front message handed over already
+  uint64_t wireend;  // DIN - end of the last byte queued
+};
+static inqueue inputs[SIM_PORTS];
+
+// bytes in a message starting with this status, 0 for SysEx
+static size_t msglen(uint8_t status) {
+  if (status < 0xf0) return ((status & 0xe0) == 0xc0) ? 2 : 3;
+  switch (status) {
+    case 0xf0: return 0;
+    case 0xf1: case 0xf3: return 2;
+    case 0xf2: return 3;
+    default: return 1;
+  }
+}
+
+void sim_midiin(int port, uint64_t atus, const uint8_t * data, size_t len) {
+  inqueue &in=inputs[port];
+  uint64_t at=atus*1000;
+  if ((port == SIM_DIN) && (in.wireend > at)) at=in.wireend;
+  size_t i=0;
+  while (i < len) {
+    size_t n=msglen(data[i]);
+    if (!n) {  // SysEx runs to its F7
+      n=1;
+      while ((i+n < len) && (data[i+n-1] != 0xf7)) ++n;
+    }
+    if (i+n > len) n=len-i;
+    if (in.count == in.size) {
+      size_t old=in.size;
+      in.size=old ? old*2 : 256;
+      inmsg * q=(inmsg *)sim_realloc(0,in.size*sizeof(inmsg));
+      for (size_t k=0; k<in.count; ++k) q[k]=in.q[(in.head+k) % old];
+      sim_free(in.q);
+      in.q=q;
+      in.head=0;
+    }
+    inmsg &m=in.q[(in.head+in.count) % in.size];
+    if (port == SIM_DIN) at+=n*DIN_BYTE_NS;
+    else if (port == SIM_BLE) at=(at/simblerate+1)*simblerate;
+    m.ns=at;
+    m.len=n;
+    m.data=(uint8_t *)sim_realloc(0,n);
+    memcpy(m.data,data+i,n);
+    ++in.count;
+    i+=n;
+  }
+  if (port == SIM_DIN) in.wireend=at;
+}
+
+void sim_midiin3(int port, uint64_t atus, uint8_t status, uint8_t data1, uint8_t data2) {
+  uint8_t data[3]={status,data1,data2};
+  sim_midiin(port,atus,data,msglen(status) ? msglen(status) : 1);
+}
+
+size_t sim_midiin_pending(int port) {
+  return inputs[port].count;
+}
+
+// next time input arrives on any port - wakes __wfi()
+uint64_t sim_midiwake(void) {
+  uint64_t wake=UINT64_MAX;
+  for (int port=0; port<SIM_PORTS; ++port) {
+    inqueue &in=inputs[port];
+    if (in.count && (in.q[in.head].ns < wake)) wake=in.q[in.head].ns;
+  }
+  return wake;
+}
+
+simcallbackstat simcallbacks;
+
+static uint64_t hostclock(void) {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC,&t);
+  return (uint64_t)t.tv_sec*1000000000ull+t.tv_nsec;
+}
+
+// a SysEx is handed over in buffer sized chunks like Control Surface does
+static void deliver(MIDI_Interface &midi, const uint8_t * d, size_t len) {
+  MIDI_Callbacks * cb=midi.callbacks;
+  if (!cb) return;
+  uint64_t start=hostclock();
+  uint8_t status=d[0];
+  if (status == 0xf0) {
+    for (size_t i=0; i<len; i+=SYSEX_BUFFER_SIZE) {
+      size_t n=(len-i < SYSEX_BUFFER_SIZE) ? len-i : SYSEX_BUFFER_SIZE;
+      memcpy(midi.sysex,d+i,n);
+      cb->onSysExMessage(midi,SysExMessage(midi.sysex,n));
+    }
+  }
+  else if (status < 0xf0) cb->onChannelMessage(midi,ChannelMessage(status,len > 1 ? d[1] : 0,len > 2 ? d[2] : 0));
+  else if (status >= 0xf8) cb->onRealTimeMessage(midi,RealTimeMessage(status));
+  else cb->onSysCommonMessage(midi,SysCommonMessage((MIDIMessageType)status,len > 1 ? d[1] : 0,len > 2 ? d[2] : 0));
+  uint64_t took=hostclock()-start;
+  ++simcallbacks.count;
+  simcallbacks.hostns+=took;
+  if (took > simcallbacks.hostmax) simcallbacks.hostmax=took;
+}
+
+// SysEx bytes into the buffer, handed over each time it fills or the F7 is in
+static void sysexin(MIDI_Interface &midi, const uint8_t * d, size_t len) {
+  for (size_t i=0; i<len; ++i) {
+    midi.sysex[midi.sysexlen++]=d[i];
+    if ((midi.sysexlen < SYSEX_BUFFER_SIZE) && (d[i] != 0xf7)) continue;
+    uint64_t start=hostclock();
+    if (midi.callbacks) midi.callbacks->onSysExMessage(midi,SysExMessage(midi.sysex,midi.sysexlen));
+    uint64_t took=hostclock()-start;
+    ++simcallbacks.count;
+    simcallbacks.hostns+=took;
+    if (took > simcallbacks.hostmax) simcallbacks.hostmax=took;
+    midi.sysexlen=0;
+  }
+}
+
+// USB is handed over an endpoint buffer's worth an update - the computer waits with the rest till the firmware reads
+// again, so a long SysEx comes in over many updates
+void MIDI_Interface::update(void) {
+  if ((portnum == SIM_USB) && usetimeout && usbpackets && (sim_ns()-usbfirst >= USB_TIMEOUT_NS)) usbflush();
+  inqueue &in=inputs[portnum];
+  size_t packets=0;
+  while (in.count && (in.q[in.head].ns <= sim_ns())) {
+    inmsg m=in.q[in.head];
+    if ((portnum == SIM_USB) && (m.data[0] == 0xf0)) {
+      if (packets == USB_BUFFER_PACKETS) break;
+      size_t n=m.len-in.done;
+      if (n > (USB_BUFFER_PACKETS-packets)*3) n=(USB_BUFFER_PACKETS-packets)*3;  // 3 SysEx bytes a packet
+      sysexin(*this,m.data+in.done,n);
+      packets+=(n+2)/3;
+      in.done+=n;
+      if (in.done < m.len) break;
+      in.done=0;
+    }
+    else {
+      if ((portnum == SIM_USB) && (packets++ == USB_BUFFER_PACKETS)) break;
+      deliver(*this,m.data,m.len);
+    }
+    in.head=(in.head+1) % in.size;
+    --in.count;
+    sim_free(m.data);
+  }
+}
+
+void MIDI_Interface::updateAll(void) {
+  for (MIDI_Interface * m=interfaces; m; m=m->next) m->update();
+}
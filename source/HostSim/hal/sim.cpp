@@ -0,0 +1,752 @@
+// Twisty 2 host simulator - virtual clock, the two cores, interrupts, pins and the encoder model
+// see sim.h for how time is accounted
+
+#include <ucontext.h>
+#include <malloc.h>
+#include <time.h>
+#include "Arduino.h"
+
+extern "C" void * __libc_malloc(size_t size);
+extern "C" void * __libc_realloc(void * p, size_t size);
+extern "C" void * __libc_calloc(size_t n, size_t size);
+extern "C" void __libc_free(void * p);
+
+// the sketch - setup1() and loop1() only exist in the two core sketches
+void setup(void);
+void loop(void);
+void setup1(void) __attribute__((weak));
+void loop1(void) __attribute__((weak));
+
+#define CORE_STACK (1024*1024)
+
+uint64_t simloopcost[SIM_CORES]={20000,5000};
+uint64_t simsleep[SIM_CORES];
+bool simecho=false;
+simloopstat simloops[SIM_CORES];
+simirqstat simirq;
+simencoder simenc[SIM_ENCODERS];
+char * simserial;
+size_t simseriallen;
+uint32_t simmallocs;
+
+static int64_t heapused;
+static uint32_t clockbase;
+
+// ---------------------------------------------------------------------------- heap
+// every allocation is counted so a test can check the firmware doesn't allocate on its hot paths
+
+extern "C" void * malloc(size_t size) {
+  void * p=__libc_malloc(size);
+  ++simmallocs;
+  if (p) heapused+=malloc_usable_size(p);
+  return p;
+}
+
+extern "C" void * calloc(size_t n, size_t size) {
+  void * p=__libc_calloc(n,size);
+  ++simmallocs;
+  if (p) heapused+=malloc_usable_size(p);
+  return p;
+}
+
+extern "C" void * realloc(void * old, size_t size) {
+  if (old) heapused-=malloc_usable_size(old);
+  void * p=__libc_realloc(old,size);
+  ++simmallocs;
+  if (p) heapused+=malloc_usable_size(p);
+  return p;
+}
+
+extern "C" void free(void * p) {
+  if (p) heapused-=malloc_usable_size(p);
+  __libc_free(p);
+}
+
+// the simulator's own buffers don't count against the firmware
+void * sim_realloc(void * p, size_t size) {
+  p=__libc_realloc(p,size);
+  if (!p) {
+    fprintf(stderr,"sim: out of memory\n");
+    exit(1);
+  }
+  return p;
+}
+
+void sim_free(void * p) {
+  __libc_free(p);
+}
+
+// ---------------------------------------------------------------------------- cores
+
+struct simcore {
+  ucontext_t ctx;
+  char * stack;
+  uint64_t ns;          // this core's clock
+  bool exists;
+  bool idled;           // held by idleOtherCore() or a flash write on the other core
+  bool masked;          // interrupts off
+  int irqdepth;
+  uint64_t hostns;      // host time this core has run for, up to when it last got the CPU
+  uint64_t resumed;     // host time it last got the CPU
+};
+
+static simcore cores[SIM_CORES];
+static ucontext_t schedctx;
+static int current=-1;       // core running, -1 in the harness
+static uint64_t rununtil;    // sim_run() stops each core once its clock gets here
+static uint64_t simnow;      // harness time - where the last run finished
+static bool booted;
+
+static uint64_t hostclock(void) {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC,&t);
+  return (uint64_t)t.tv_sec*1000000000ull+t.tv_nsec;
+}
+
+uint64_t sim_ns(void) {
+  return (current >= 0) ? cores[current].ns : simnow;
+}
+
+uint64_t sim_us(void) {
+  return sim_ns()/1000;
+}
+
+void sim_clockbase(uint32_t us) {
+  clockbase=us;
+}
+
+static bool runnable(int c) {
+  return cores[c].exists && !cores[c].idled && (cores[c].ns < rununtil);
+}
+
+// hand the CPU back to the harness scheduler if the other core is now behind this one
+static void sim_yield(void) {
+  int other=current ^ 1;
+  simcore &c=cores[current];
+  if ((c.ns < rununtil) && !(runnable(other) && (cores[other].ns < c.ns))) return;
+  c.hostns+=hostclock()-c.resumed;
+  swapcontext(&c.ctx,&schedctx);
+  c.resumed=hostclock();
+}
+
+// host time the running core has had so far
+static uint64_t corehost(simcore &c) {
+  return c.hostns+hostclock()-c.resumed;
+}
+
+// ---------------------------------------------------------------------------- timer and interrupts
+
+static timer_hw_t timerregs;
+timer_hw_t * timer_hw=&timerregs;
+
+struct simalarm {
+  bool armed;
+  uint64_t due;          // ns
+  irq_handler_t handler;
+  bool enabled;
+  int core;              // core the handler was installed from
+};
+static simalarm alarms[4];
+
+sim_timeraw::operator uint32_t() const {
+  return micros();
+}
+
+// the alarm fires when the low 32 bits of the timer match - a time already gone means a wait for the counter to wrap
+sim_alarmreg &sim_alarmreg::operator=(uint32_t v) {
+  value=v;
+  int n=this-timer_hw->alarm;
+  uint64_t now=sim_ns()/1000;
+  uint32_t ahead=v-(uint32_t)(now+clockbase);
+  alarms[n].armed=true;
+  alarms[n].due=(now+ahead)*1000;
+  timer_hw->armed|=1u << n;
+  return *this;
+}
+
+unsigned timer_hardware_alarm_get_irq_num(timer_hw_t * timer, unsigned alarm) {
+  (void)timer;
+  return TIMER_IRQ_0+alarm;
+}
+
+void hw_set_bits(volatile uint32_t * reg, uint32_t mask) {
+  *reg|=mask;
+}
+
+void hw_clear_bits(volatile uint32_t * reg, uint32_t mask) {
+  *reg&=~mask;
+}
+
+void irq_set_exclusive_handler(unsigned num, irq_handler_t handler) {
+  alarms[num & 3].handler=handler;
+  alarms[num & 3].core=(current >= 0) ? current : 0;
+}
+
+void irq_set_enabled(unsigned num, bool enabled) {
+  alarms[num & 3].enabled=enabled;
+}
+
+bool irq_is_enabled(unsigned num) {
+  return alarms[num & 3].enabled;
+}
+
+// earliest alarm the running core would take, or UINT64_MAX
+static int nextalarm(uint64_t * due) {
+  int found=-1;
+  *due=UINT64_MAX;
+  for (int n=0; n<4; ++n) {
+    simalarm &a=alarms[n];
+    if (a.armed && a.enabled && a.handler && (a.core == current) && (timer_hw->inte & (1u << n)) && (a.due < *due)) {
+      *due=a.due;
+      found=n;
+    }
+  }
+  return found;
+}
+
+// run an alarm handler that's due by the running core's clock
+static bool takeirq(uint64_t limit) {
+  simcore &c=cores[current];
+  if (c.masked || c.irqdepth) return false;
+  uint64_t due;
+  int n=nextalarm(&due);
+  if ((n < 0) || (due > limit)) return false;
+  if (due > c.ns) c.ns=due;
+  uint64_t late=c.ns-due;
+  if (late > simirq.latemax) simirq.latemax=late;
+  alarms[n].armed=false;
+  timer_hw->armed&=~(1u << n);
+  timer_hw->intr|=1u << n;
+  uint64_t start=c.ns;
+  ++c.irqdepth;
+  alarms[n].handler();
+  --c.irqdepth;
+  ++simirq.count;
+  simirq.busyns+=c.ns-start;
+  return true;
+}
+
+void sim_spend(uint64_t ns) {
+  if (current < 0) {
+    simnow+=ns;
+    return;
+  }
+  simcore &c=cores[current];
+  uint64_t left=ns;
+  for (;;) {
+    uint64_t due;
+    if (c.masked || c.irqdepth || (nextalarm(&due) < 0) || (due > c.ns+left)) break;
+    if (due > c.ns) {
+      left-=due-c.ns;
+      c.ns=due;
+    }
+    takeirq(c.ns);  // the rest of the wait carries on after the handler
+  }
+  c.ns+=left;
+  sim_yield();
+}
+
+void noInterrupts(void) {
+  if (current >= 0) cores[current].masked=true;
+}
+
+void interrupts(void) {
+  if (current < 0) return;
+  cores[current].masked=false;
+  while (takeirq(cores[current].ns)) ;
+}
+
+uint32_t save_and_disable_interrupts(void) {
+  if (current < 0) return 0;
+  uint32_t was=cores[current].masked;
+  cores[current].masked=true;
+  return was;
+}
+
+void restore_interrupts(uint32_t status) {
+  if (status) return;
+  interrupts();
+}
+
+static spin_lock_t spinlocks[32];
+static uint32_t spinclaimed=1;  // lock 0 is the SDK's
+
+spin_lock_t * spin_lock_init(unsigned num) {
+  spinlocks[num & 31]=0;
+  return &spinlocks[num & 31];
+}
+
+unsigned spin_lock_claim_unused(bool required) {
+  for (unsigned n=0; n<32; ++n) {
+    if (!(spinclaimed & (1u << n))) {
+      spinclaimed|=1u << n;
+      return n;
+    }
+  }
+  if (required) {
+    fprintf(stderr,"sim: no spin locks left\n");
+    exit(1);
+  }
+  return (unsigned)-1;
+}
+
+// the cores only change over where one of them waits, so nothing can be holding a lock when it's taken
+uint32_t spin_lock_blocking(spin_lock_t * lock) {
+  uint32_t status=save_and_disable_interrupts();
+  if (*lock) {
+    fprintf(stderr,"sim: spin lock taken twice\n");
+    exit(1);
+  }
+  *lock=1;
+  return status;
+}
+
+void spin_unlock(spin_lock_t * lock, uint32_t status) {
+  *lock=0;
+  restore_interrupts(status);
+}
+
+// sleep until the next interrupt. MIDI input arriving wakes the core too
+uint64_t sim_midiwake(void);
+void __wfi(void) {
+  if (current < 0) return;
+  simcore &c=cores[current];
+  uint64_t wake=rununtil;
+  uint64_t due;
+  if (!c.masked && (nextalarm(&due) >= 0) && (due < wake)) wake=due;
+  uint64_t midi=sim_midiwake();
+  if ((midi > c.ns) && (midi < wake)) wake=midi;
+  if (wake > c.ns) {
+    simsleep[current]+=wake-c.ns;
+    c.ns=wake;
+  }
+  takeirq(c.ns);
+  sim_yield();
+}
+
+void __wfe(void) {
+  sim_spend(1000);
+}
+
+void __sev(void) {}
+void __dmb(void) {}
+
+void tight_loop_contents(void) {
+  sim_spend(1000);
+}
+
+// ---------------------------------------------------------------------------- time
+
+uint32_t micros(void) {
+  return (uint32_t)(sim_ns()/1000+clockbase);
+}
+
+uint32_t millis(void) {
+  return (uint32_t)((sim_ns()/1000+clockbase)/1000);
+}
+
+uint32_t time_us_32(void) {
+  return micros();
+}
+
+uint64_t time_us_64(void) {
+  return sim_ns()/1000+clockbase;
+}
+
+void delay(uint32_t ms) {
+  sim_spend((uint64_t)ms*1000000);
+}
+
+void delayMicroseconds(uint32_t us) {
+  sim_spend((uint64_t)us*1000);
+}
+
+void yield(void) {
+  sim_yield();
+}
+
+static uint64_t randstate=0x9e3779b97f4a7c15ull;
+
+void randomSeed(unsigned long seed) {
+  randstate=seed ? seed : 1;
+}
+
+long random(long howbig) {
+  if (howbig <= 0) return 0;
+  randstate^=randstate << 13;
+  randstate^=randstate >> 7;
+  randstate^=randstate << 17;
+  return (long)(randstate % (uint64_t)howbig);
+}
+
+long random(long howsmall, long howbig) {
+  if (howsmall >= howbig) return howsmall;
+  return howsmall+random(howbig-howsmall);
+}
+
+// ---------------------------------------------------------------------------- cores and the FIFO
+
+static void (*corecall[SIM_CORES])(void);  // sim_call() function waiting to run
+
+static void coremain(int core) {
+  simcore &c=cores[core];
+  c.resumed=hostclock();
+  if (core == 0) {
+    setup();
+    c.hostns+=hostclock()-c.resumed;
+    swapcontext(&c.ctx,&schedctx);  // back to sim_boot()
+    c.resumed=hostclock();
+  }
+  else setup1();
+  for (;;) {
+    if (corecall[core]) {
+      corecall[core]();
+      corecall[core]=0;
+    }
+    uint64_t start=c.ns;
+    uint64_t host=corehost(c);
+    if (core == 0) loop();
+    else loop1();
+    uint64_t hostpass=corehost(c)-host;
+    simloopstat &s=simloops[core];
+    ++s.passes;
+    s.hostns+=hostpass;
+    if (hostpass > s.hostmax) s.hostmax=hostpass;
+    sim_spend(simloopcost[core]);
+    uint64_t pass=c.ns-start;
+    s.simns+=pass;
+    if (pass > s.simmax) s.simmax=pass;
+  }
+}
+
+static void core0main(void) { coremain(0); }
+static void core1main(void) { coremain(1); }
+
+void sim_loopstats_reset(void) {
+  memset(simloops,0,sizeof(simloops));
+}
+
+#define STACK_PAINT 0xa5
+
+static void startcore(int core) {
+  simcore &c=cores[core];
+  c.stack=(char *)sim_realloc(0,CORE_STACK);
+  memset(c.stack,STACK_PAINT,CORE_STACK);  // for sim_stackused()
+  getcontext(&c.ctx);
+  c.ctx.uc_stack.ss_sp=c.stack;
+  c.ctx.uc_stack.ss_size=CORE_STACK;
+  c.ctx.uc_link=0;
+  makecontext(&c.ctx,core ? core1main : core0main,0);
+  c.ns=simnow;
+  c.exists=true;
+}
+
+// the stack starts out painted - the deepest byte that isn't paint any more is as far down as it has been used
+size_t sim_stackused(int core) {
+  simcore &c=cores[core];
+  if (!c.exists) return 0;
+  size_t i=0;
+  while ((i < CORE_STACK) && ((uint8_t)c.stack[i] == STACK_PAINT)) ++i;
+  return CORE_STACK-i;
+}
+
+void sim_stackmark(void) {
+  simcore &c=cores[current];
+  char * below=(char *)__builtin_frame_address(0)-1024;  // well clear of this frame, memset's and the x86-64 red zone
+  if (below > c.stack) memset(c.stack,STACK_PAINT,below-c.stack);
+}
+
+// setup() runs to the end before core 1 starts - on the RP2040 setup1() waits on it anyway
+void sim_boot(void) {
+  if (booted) return;
+  booted=true;
+  startcore(0);
+  uint64_t until=rununtil;
+  rununtil=UINT64_MAX;  // nothing to hand over to while setup() runs
+  current=0;
+  swapcontext(&schedctx,&cores[0].ctx);
+  current=-1;
+  rununtil=until;
+  simnow=cores[0].ns;
+  if (setup1) startcore(1);
+}
+
+// the scheduler - always run the core whose clock is furthest behind
+void sim_runto(uint64_t us) {
+  if (!booted) sim_boot();
+  rununtil=us*1000;
+  for (;;) {
+    int next=-1;
+    for (int c=0; c<SIM_CORES; ++c) {
+      if (runnable(c) && ((next < 0) || (cores[c].ns < cores[next].ns))) next=c;
+    }
+    if (next < 0) break;
+    current=next;
+    swapcontext(&schedctx,&cores[next].ctx);
+    current=-1;
+  }
+  if (rununtil > simnow) simnow=rununtil;
+}
+
+void sim_call(int core, void (*fn)(void)) {
+  if (!booted) sim_boot();
+  corecall[core]=fn;
+  while (corecall[core]) sim_run(1000);
+}
+
+void sim_run(uint64_t us) {
+  sim_runto(simnow/1000+us);
+}
+
+// idle the other core - it doesn't run again until resumeOtherCore(), and its clock can't be behind the time it was let go
+void RP2040::idleOtherCore(void) {
+  if (current >= 0) cores[current ^ 1].idled=true;
+}
+
+void RP2040::resumeOtherCore(void) {
+  if (current < 0) return;
+  simcore &o=cores[current ^ 1];
+  o.idled=false;
+  if (o.ns < cores[current].ns) o.ns=cores[current].ns;
+}
+
+int RP2040::getTotalHeap(void) { return 256*1024-64*1024; }  // roughly what the sketches leave for the heap
+int RP2040::getUsedHeap(void) { return (int)heapused; }
+int RP2040::getFreeHeap(void) { return getTotalHeap()-getUsedHeap(); }
+uint32_t RP2040::getCycleCount(void) { return (uint32_t)(sim_ns()*133/1000); }
+uint64_t RP2040::getCycleCount64(void) { return sim_ns()*133/1000; }
+
+void RP2040::reboot(void) {
+  fprintf(stderr,"sim: firmware rebooted at %llu us\n",(unsigned long long)sim_us());
+  exit(2);
+}
+
+RP2040 rp2040;
+
+#define FIFO_DEPTH 8
+static uint32_t fifobuf[SIM_CORES][FIFO_DEPTH];  // [reading core]
+static int fifocount[SIM_CORES];
+
+bool SimFIFO::available(void) {
+  return fifocount[current < 0 ? 0 : current] > 0;
+}
+
+bool SimFIFO::pop_nb(uint32_t * value) {
+  int me=current < 0 ? 0 : current;
+  if (!fifocount[me]) return false;
+  *value=fifobuf[me][0];
+  memmove(&fifobuf[me][0],&fifobuf[me][1],(FIFO_DEPTH-1)*sizeof(uint32_t));
+  --fifocount[me];
+  return true;
+}
+
+uint32_t SimFIFO::pop(void) {
+  uint32_t value;
+  while (!pop_nb(&value)) tight_loop_contents();
+  return value;
+}
+
+bool SimFIFO::push_nb(uint32_t value) {
+  int other=(current < 0 ? 0 : current) ^ 1;
+  if (fifocount[other] == FIFO_DEPTH) return false;
+  fifobuf[other][fifocount[other]++]=value;
+  return true;
+}
+
+void SimFIFO::push(uint32_t value) {
+  while (!push_nb(value)) tight_loop_contents();
+}
+
+// ---------------------------------------------------------------------------- pins and the encoders
+// the Twisty 2 board: a 4067 mux addressed by GPIO 9,8,7,6 puts one of 16 encoders on GPIO 17 (A), 11 (B) and 10 (switch)
+// the menu encoders are on 19,18,16 and 22,21,20. everything is active low with pullups
+
+#define MUX_0 9
+#define MUX_1 8
+#define MUX_2 7
+#define MUX_3 6
+
+struct simpin {
+  int16_t enc;    // encoder this pin reads, -1 for the mux
+  int8_t what;    // 0 A, 1 B, 2 switch
+};
+
+static int muxaddr;
+static uint8_t pinout[32];
+
+void pinMode(int pin, int mode) {
+  (void)pin;
+  (void)mode;
+}
+
+void digitalWrite(int pin, int value) {
+  if ((pin < 0) || (pin >= 32)) return;
+  pinout[pin]=value ? 1 : 0;
+  int bit=(pin == MUX_0) ? 1 : (pin == MUX_1) ? 2 : (pin == MUX_2) ? 4 : (pin == MUX_3) ? 8 : 0;
+  if (bit) muxaddr=value ? (muxaddr | bit) : (muxaddr & ~bit);
+}
+
+// where an encoder is now - spins are worked out from the clock so they run at any rate
+static int32_t encpos(simencoder &e) {
+  if (!e.spinperiod || !e.spinstates) return e.pos;
+  uint64_t now=sim_ns();
+  if (now < e.spinstart) return e.pos;
+  uint64_t steps=(now-e.spinstart)/e.spinperiod;
+  int32_t n=e.spinstates > 0 ? e.spinstates : -e.spinstates;
+  if (steps >= (uint64_t)n) {
+    e.pos=e.spinfrom+e.spinstates;
+    e.spinperiod=0;
+    return e.pos;
+  }
+  e.pos=e.spinfrom+(e.spinstates > 0 ? (int32_t)steps : -(int32_t)steps);
+  return e.pos;
+}
+
+// quadrature states in the order ClickEncoder counts up: A B = 00 01 11 10 with 1 meaning active (low)
+static const uint8_t quadA[4]={0,0,1,1};
+static const uint8_t quadB[4]={0,1,1,0};
+
+// reading A is taken as the scan of that encoder - the lost count is states that went by since the last one
+static int encread(int index, int what) {
+  simencoder &e=simenc[index];
+  int32_t pos=encpos(e);
+  if (what == 0) {
+    if (e.seen) {
+      int32_t moved=pos-e.lastseen;
+      if (moved < 0) moved=-moved;
+      if (moved > 1) e.lost+=moved-1;
+    }
+    e.lastseen=pos;
+    e.seen=true;
+    ++e.scans;
+  }
+  int active;
+  if (what == 2) active=e.pressed;
+  else active=(what == 0) ? quadA[pos & 3] : quadB[pos & 3];
+  return active ? LOW : HIGH;
+}
+
+int digitalRead(int pin) {
+  switch (pin) {
+    case 17: return encread(muxaddr,0);
+    case 11: return encread(muxaddr,1);
+    case 10: return encread(muxaddr,2);
+    case 19: return encread(SIM_LMENU,0);
+    case 18: return encread(SIM_LMENU,1);
+    case 16: return encread(SIM_LMENU,2);
+    case 22: return encread(SIM_RMENU,0);
+    case 21: return encread(SIM_RMENU,1);
+    case 20: return encread(SIM_RMENU,2);
+  }
+  if ((pin >= 0) && (pin < 32)) return pinout[pin];
+  return HIGH;
+}
+
+// battery divider input - about 3.9V
+int analogRead(int pin) {
+  (void)pin;
+  return 605;
+}
+
+// ClickEncoder runs 4 states to a detent and ENCDIVIDE counts a detent per 4 states
+void sim_spin(int e, int32_t detents, uint32_t periodus, uint32_t count) {
+  simencoder &s=simenc[e];
+  encpos(s);
+  s.spinfrom=s.pos;
+  s.spinstart=sim_ns();
+  s.spinstates=detents*4*(int32_t)count;
+  s.spinperiod=(uint64_t)periodus*1000/4/(detents < 0 ? -detents : detents);
+  if (!s.spinperiod) s.spinperiod=1;
+}
+
+void sim_turn(int e, int32_t detents) {
+  sim_spin(e,detents > 0 ? 1 : -1,10000,detents > 0 ? detents : -detents);
+}
+
+void sim_button(int e, bool down) {
+  simenc[e].pressed=down;
+}
+
+bool sim_spinning(void) {
+  for (int e=0; e<SIM_ENCODERS; ++e) {
+    encpos(simenc[e]);
+    if (simenc[e].spinperiod) return true;
+  }
+  return false;
+}
+
+uint32_t sim_lost(void) {
+  uint32_t lost=0;
+  for (int e=0; e<SIM_ENCODERS; ++e) lost+=simenc[e].lost;
+  return lost;
+}
+
+// ---------------------------------------------------------------------------- serial
+
+SerialUSB Serial;
+SerialUART Serial1;
+static size_t serialsize;
+static char * serialin;
+static size_t serialinlen,serialinpos;
+
+size_t Print::write(const uint8_t * buf, size_t n) {
+  for (size_t i=0; i<n; ++i) write(buf[i]);
+  return n;
+}
+
+size_t Print::print(int n) { return printf("%d",n); }
+size_t Print::print(unsigned n) { return printf("%u",n); }
+size_t Print::print(long n) { return printf("%ld",n); }
+size_t Print::print(unsigned long n) { return printf("%lu",n); }
+size_t Print::print(double n, int digits) { return printf("%.*f",digits,n); }
+
+size_t Print::printf(const char * fmt, ...) {
+  char buf[512];
+  va_list ap;
+  va_start(ap,fmt);
+  int n=vsnprintf(buf,sizeof(buf),fmt,ap);
+  va_end(ap);
+  if (n < 0) return 0;
+  if (n >= (int)sizeof(buf)) n=sizeof(buf)-1;
+  return write((const uint8_t *)buf,n);
+}
+
+size_t SerialUSB::write(uint8_t c) {
+  return write(&c,1);
+}
+
+size_t SerialUSB::write(const uint8_t * buf, size_t n) {
+  if (simseriallen+n+1 > serialsize) {
+    serialsize=(simseriallen+n+1)*2;
+    simserial=(char *)sim_realloc(simserial,serialsize);
+  }
+  memcpy(simserial+simseriallen,buf,n);
+  simseriallen+=n;
+  simserial[simseriallen]=0;
+  if (simecho) fwrite(buf,1,n,stdout);
+  return n;
+}
+
+int SerialUSB::available(void) {
+  return serialinlen-serialinpos;
+}
+
+int SerialUSB::read(void) {
+  return (serialinpos < serialinlen) ? (uint8_t)serialin[serialinpos++] : -1;
+}
+
+int SerialUSB::peek(void) {
+  return (serialinpos < serialinlen) ? (uint8_t)serialin[serialinpos] : -1;
+}
+
+void sim_serial_clear(void) {
+  simseriallen=0;
+  if (simserial) simserial[0]=0;
+}
+
+void sim_serialinput(const char * s) {
+  size_t n=strlen(s);
+  serialin=(char *)sim_realloc(serialin,serialinlen+n+1);
+  memcpy(serialin+serialinlen,s,n);
+  serialinlen+=n;
+}
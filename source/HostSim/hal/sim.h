@@ -0,0 +1,137 @@
+// Twisty 2 host simulator - the test harness side of the stand-in HAL
+//
+// the firmware runs on a virtual clock kept in nanoseconds. each core has its own clock and the one furthest behind always
+// runs next, so the two cores of the Rhythmicon interleave the way they would on the RP2040 without any host threads.
+// code runs in no time at all except for:
+// - simloopcost[core] charged at the end of every loop() / loop1() pass
+// - delay(), delayMicroseconds() and tight_loop_contents()
+// - the peripherals that block the CPU on the real hardware: display.display() over I2C, LEDS.show(), DIN MIDI once the
+//   UART FIFO is full, and flash writes, which also stall the other core and hold off interrupts like they do on the RP2040
+// __wfi() skips straight to the next interrupt. the timer alarm interrupt runs on the core that installed it as soon as
+// that core's clock passes the alarm, in the middle of whatever it was waiting on
+//
+// the board model is the Twisty 2 hardware: 16 encoders behind a 4067 mux plus the two menu encoders. encoders are driven
+// by sim_spin() and sim_button(). MIDI out is captured per port in simmidi[] with the time it would have left the unit,
+// MIDI in is queued with sim_midiin(), the display keeps the last frame sent to the panel and LittleFS is a map in memory
+//
+// a test #includes the sketch source built by inoproto.py and then drives it:
+//   sim_boot();                // runs setup() - and setup1() if the sketch has one
+//   sim_spin(3,1,1000,400);    // encoder 3 one detent clockwise every ms for 400 detents
+//   sim_run(500000);           // half a second of virtual time
+
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+
+#define SIM_CORES 2
+#define SIM_ENCODERS 18  // the 16 mux encoders then the left and right menu encoders
+#define SIM_LMENU 16
+#define SIM_RMENU 17
+
+enum simports {SIM_USB,SIM_DIN,SIM_BLE,SIM_PORTS};  // same order as the sketches' port numbers
+
+// clock and scheduling
+extern uint64_t simloopcost[SIM_CORES];  // ns charged per loop() / loop1() pass - default 20us and 5us
+extern bool simecho;                     // copy Serial output to stdout as it's printed
+uint64_t sim_ns(void);                   // virtual time of the core that's running, or of the whole simulation between runs
+uint64_t sim_us(void);
+void sim_spend(uint64_t ns);             // the running core is busy for this long - interrupts still get in
+void sim_boot(void);
+void sim_run(uint64_t us);               // run both cores until each has covered this much more virtual time
+void sim_runto(uint64_t us);
+void sim_clockbase(uint32_t us);         // offset of micros() from sim time - call before sim_boot() to test wrap around
+void sim_call(int core, void (*fn)(void));  // run fn on that core ahead of its next loop pass - returns once it has
+
+// per core loop statistics. host time is what the firmware code itself took on this machine
+struct simloopstat {
+  uint64_t passes;
+  uint64_t hostns,hostmax;   // host CPU time of loop passes
+  uint64_t simns,simmax;     // virtual time of loop passes including everything the pass waited on
+};
+extern simloopstat simloops[SIM_CORES];
+void sim_loopstats_reset(void);
+extern uint64_t simsleep[SIM_CORES];     // virtual time each core has spent asleep in __wfi(), ns
+
+// interrupt statistics for the timer alarm
+struct simirqstat {
+  uint64_t count;
+  uint64_t latemax;  // longest an interrupt waited past its alarm, ns
+  uint64_t busyns;   // total virtual time spent in the handler
+};
+extern simirqstat simirq;
+
+// encoders and buttons
+struct simencoder {
+  int32_t pos;                 // quadrature state count, 4 to a detent
+  uint64_t spinstart,spinperiod;
+  int32_t spinfrom,spinstates;  // a spin moves pos from spinfrom by spinstates states, one every spinperiod
+  bool pressed;
+  int32_t lastseen;             // pos at the last scan of this encoder
+  bool seen;
+  uint32_t lost;                // states that went by between two scans - what the firmware can't have counted right
+  uint32_t scans;
+};
+extern simencoder simenc[SIM_ENCODERS];
+void sim_spin(int e, int32_t detents, uint32_t periodus, uint32_t count=1);  // count detents each periodus apart, sign is direction
+void sim_turn(int e, int32_t detents);                                       // a brisk turn by hand - a detent per 10ms
+void sim_button(int e, bool down);
+bool sim_spinning(void);
+uint32_t sim_lost(void);       // total of simenc[].lost
+
+// MIDI
+struct simmsg {
+  uint64_t ns;          // time it left the unit - wire end for DIN, transfer for USB, connection event for BLE
+  uint64_t queued;      // time the firmware sent it
+  uint16_t len;
+  uint8_t data[3];      // channel, system and real time messages
+  uint8_t * sysex;      // SysEx bytes when len > 3 or data[0] == 0xf0, owned by the log
+};
+struct simport {
+  simmsg * log;
+  size_t count,size;
+  uint64_t bytes;       // MIDI bytes sent
+  uint64_t transfers;   // USB transfers, DIN bytes or BLE packets
+};
+extern simport simmidi[SIM_PORTS];
+void sim_midi_clear(void);
+const char * sim_msgtext(const simmsg &m, char * buf, size_t size);
+void sim_midi_dump(FILE * f, int port);
+// queue MIDI input. DIN input is spaced at the wire rate after anything already queued on that port
+void sim_midiin(int port, uint64_t atus, const uint8_t * data, size_t len);
+void sim_midiin3(int port, uint64_t atus, uint8_t status, uint8_t data1=0, uint8_t data2=0);
+size_t sim_midiin_pending(int port);
+struct simcallbackstat {
+  uint64_t count;          // input messages handed to the sketch's MIDI callbacks
+  uint64_t hostns,hostmax; // host time the callbacks took
+};
+extern simcallbackstat simcallbacks;
+extern uint64_t simblerate;   // BLE connection interval, ns
+
+// display, LEDs and serial
+extern uint8_t simpanel[128*64/8];   // what the OLED shows - the frame buffer as of the last display.display()
+extern bool simpanelon;
+extern uint32_t simframes;           // display.display() calls
+extern uint32_t simdrawpixels;       // pixels drawn into the display buffer through GFX
+extern uint32_t simleds[64];         // colours as of the last LEDS.show()
+extern uint32_t simledshows;
+bool sim_pixel(int x, int y);        // panel pixel in the rotation the sketch set
+void sim_display_dump(FILE * f);     // the panel as text, one character per pixel
+size_t sim_display_text(char * buf, size_t size);  // the panel read back as characters in the 6x8 font, one line per text row
+extern char * simserial;             // everything printed to Serial
+extern size_t simseriallen;
+void sim_serial_clear(void);
+void sim_serialinput(const char * s);
+
+// flash, heap and stack
+extern uint64_t simflasherase;       // ns to erase a 4K sector - 45ms typical for the W25Q16
+extern uint64_t simflashprog;        // ns to program a 256 byte page
+extern uint64_t simflashwrites;      // bytes programmed
+extern uint64_t simflashstall;       // longest the cores were held by one flash operation, ns
+extern uint32_t simmallocs;          // calls to malloc/new since start
+size_t sim_stackused(int core);      // deepest the core's stack has been, in bytes
+void sim_stackmark(void);            // call on a core (from sim_call()) - sim_stackused() counts from what's in use now
+bool sim_fs_put(const char * name, const uint8_t * data, size_t len);  // file straight into the filesystem
+long sim_fs_get(const char * name, uint8_t * data, size_t size);       // -1 if not there
+void sim_fs_format(void);
+void sim_fs_fail(bool fail);         // LittleFS.begin() fails from now on
@@ -0,0 +1,67 @@
+#!/usr/bin/env python3
+# turns a sketch folder into something g++ can build the way the Arduino builder does:
+# the .ino gets #include <Arduino.h> on top and prototypes for its functions ahead of the first one, with #line so errors
+# still point at the .ino. the sketch folder has to be on the include path for the rest of its files
+#
+#   inoproto.py <sketch folder> <output folder>     writes <output folder>/<Sketch>.cpp
+
+import os
+import re
+import sys
+
+# blank out comments, strings and character constants, keeping every offset the same
+def strip(s):
+  s=re.sub(r'//[^\n]*',lambda m: ' '*len(m.group()),s)
+  s=re.sub(r'/\*.*?\*/',lambda m: re.sub(r'[^\n]',' ',m.group()),s,flags=re.S)
+  s=re.sub(r'"(\\.|[^"\\\n])*"',lambda m: '"'+' '*(len(m.group())-2)+'"',s)
+  s=re.sub(r"'(\\.|[^'\\\n])'",lambda m: "' '"+' '*(len(m.group())-3),s)
+  return s
+
+FUNCTION=re.compile(r'^((?:static\s+|inline\s+)*[A-Za-z_][\w:<>]*(?:\s*[\*&]\s*|\s+)(?:[\*&]\s*)*)(\w+)\s*\(([^;]*)\)\s*$',re.S)
+
+# (offset, prototype) for each function defined at file scope
+def prototypes(src):
+  s=strip(src)
+  found=[]
+  depth=0
+  start=0
+  i=0
+  while i < len(s):
+    c=s[i]
+    if c == '{':
+      if depth == 0:
+        head=s[start:i].strip()
+        m=FUNCTION.match(head)
+        if m and (m.group(2) not in ('if','while','for','switch')) and not re.match(r'^(struct|class|enum|union|namespace)\b',head) and ('=' not in head.split('(')[0]):
+          found.append((start,' '.join((m.group(1)+m.group(2)+'('+m.group(3)+');').split())))
+      depth+=1
+    elif c == '}':
+      depth-=1
+      if depth == 0: start=i+1
+    elif (c == ';') and (depth == 0):
+      start=i+1
+    elif (c == '#') and (depth == 0) and ((i == 0) or (s[i-1] == '\n')):
+      j=s.find('\n',i)
+      while (j > 0) and (s[j-1] == '\\'): j=s.find('\n',j+1)
+      if j < 0: break
+      i=j
+      start=j+1
+      continue
+    i+=1
+  return found
+
+def main():
+  sketch=os.path.abspath(sys.argv[1].rstrip('/'))
+  out=sys.argv[2]
+  name=os.path.basename(sketch)
+  os.makedirs(out,exist_ok=True)
+  ino=os.path.join(sketch,name+'.ino')
+  src=open(ino).read()
+  protos=prototypes(src)
+  if protos:
+    pos=protos[0][0]
+    line=src.count('\n',0,pos)+1
+    src=src[:pos]+'\n'+'\n'.join(p for _,p in protos)+'\n#line %d "%s"\n' % (line,ino)+src[pos:]
+  open(os.path.join(out,name+'.cpp'),'w').write('#include <Arduino.h>\n#line 1 "%s"\n' % ino+src)
+
+main()
@@ -0,0 +1,44 @@
+// shared by the *_bench tests - reads back the JSON lines bench.h prints
+#pragma once
+#include <stdlib.h>
+#include <string.h>
+
+// a number field from one result line, -1 if it isn't there
+static long benchfield(const char * line, const char * field) {
+  char key[32];
+  snprintf(key,sizeof(key),"\"%s\":",field);
+  const char * p=strstr(line,key);
+  return p ? strtol(p+strlen(key),0,10) : -1;
+}
+
+// print the results and check the ones that shouldn't allocate don't, and that the checksum line is there. returns how
+// many result lines there were
+static int benchresults(const char * const * allocok, int nallocok) {
+  int results=0;
+  bool checksum=false;
+  const char * line=simserial;
+  while (line && *line) {
+    const char * end=strchr(line,'\n');
+    size_t len=end ? end-line : strlen(line);
+    char buf[256];
+    snprintf(buf,sizeof(buf),"%.*s",(int)len,line);
+    if (strstr(buf,"\"bench\":")) {
+      ++results;
+      const char * name=strstr(buf,"\"bench\":\"")+9;
+      bool mayalloc=false;
+      for (int i=0; i<nallocok; ++i) mayalloc|=!strncmp(name,allocok[i],strlen(allocok[i])) && (name[strlen(allocok[i])] == '"');
+      long allocs=benchfield(buf,"allocs");
+      printf("  %-28.*s %8ld ns/op  %ld allocs\n",(int)(strchr(name,'"')-name),name,benchfield(buf,"ns_per_op"),allocs);
+      CHECK(allocs >= 0);
+      if (!mayalloc) CHECK(allocs == 0);
+    }
+    else if (strstr(buf,"\"flash\":")) printf("  %s\n",buf);
+    else if (strstr(buf,"\"checksum\":")) {
+      printf("  %s\n",buf);
+      checksum=true;
+    }
+    line=end ? end+1 : 0;
+  }
+  CHECK(checksum);
+  return results;
+}
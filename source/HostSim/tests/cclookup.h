@@ -0,0 +1,112 @@
+// incoming CC lookup - the (channel, CC) index against scanning every control, and the redraw an incoming CC causes
+// shared by twisty2_cclookup (the 4 pages the unit has) and twisty2_cclookup64, which builds the sketch with 64 pages
+// every slot gets its own channel and CC so a lookup finds exactly one control, the way a DAW template maps them
+
+#include "Twisty2.cpp"
+#include "report.h"
+
+#define LOOKUPS 200000
+
+static uint32_t rng=12345;
+static uint32_t random32(void) {
+  rng=rng*1664525+1013904223;
+  return rng;
+}
+
+static void slotmapping(int slot, int16_t * channel, int16_t * cc) {
+  *channel=1+(slot/128)%16;
+  *cc=slot%128;
+}
+
+// what ccfeedback() would have to do without the index - look at every control on every page
+static uint32_t scanlookup(uint8_t channel, uint8_t cc) {
+  uint32_t found=0;
+  for (int16_t p=0; p<CONTROLLER_PAGES; ++p) {
+    for (int16_t i=0; i<NUMENCODERS; ++i) {
+      controllerencoder &e=controls[p].encoder[i];
+      if ((e.type == CCTYPE) && (e.channel == channel+1) && (e.ccnumber == cc)) found+=ccslot(p,ENCODER,i)+1;
+      controllerswitch &s=controls[p].encswitch[i];
+      if ((s.type == CCMESSAGE) && (s.channel == channel+1) && (s.ccnumber == cc)) found+=ccslot(p,BUTTON,i)+1;
+    }
+  }
+  return found;
+}
+
+static uint32_t indexlookup(uint8_t channel, uint8_t cc) {
+  uint32_t found=0;
+  for (ccslot_t slot=ccindex[channel & 0x0f][cc & 0x7f]; slot != NOSLOT; slot=ccnext[slot]) found+=slot+1;
+  return found;
+}
+
+int main() {
+  uint64_t wallstart=wallns();
+  sim_boot();
+  sim_run(3000000);  // past the power on message
+  CHECK(UI_state == UI_SEND_MIDI);
+
+  for (int16_t p=0; p<CONTROLLER_PAGES; ++p) {
+    for (int16_t i=0; i<NUMENCODERS; ++i) {
+      slotmapping(ccslot(p,ENCODER,i),&controls[p].encoder[i].channel,&controls[p].encoder[i].ccnumber);
+      controls[p].encswitch[i].type=CCMESSAGE;
+      slotmapping(ccslot(p,BUTTON,i),&controls[p].encswitch[i].channel,&controls[p].encswitch[i].ccnumber);
+    }
+  }
+  buildccindex();
+
+  // the index finds the same controls a scan does for every channel and CC
+  uint32_t mismatches=0,hits=0;
+  for (int ch=0; ch<16; ++ch) {
+    for (int cc=0; cc<128; ++cc) {
+      uint32_t s=scanlookup(ch,cc);
+      if (s != indexlookup(ch,cc)) ++mismatches;
+      hits+=(s != 0);
+    }
+  }
+  printf("%d pages, %d slots: %u of 2048 channel/CC pairs mapped, %u lookups disagree with a scan\n",CONTROLLER_PAGES,NUMSLOTS,
+    (unsigned)hits,(unsigned)mismatches);
+  CHECK(mismatches == 0);
+  CHECK(hits == (NUMSLOTS < 2048 ? NUMSLOTS : 2048));
+
+  uint8_t * msgs=(uint8_t *)malloc(LOOKUPS*2);
+  for (int i=0; i<LOOKUPS; ++i) {
+    msgs[i*2]=random32() % 16;
+    msgs[i*2+1]=random32() % 128;
+  }
+  volatile uint32_t sink=0;
+  uint64_t t0=wallns();
+  for (int i=0; i<LOOKUPS; ++i) sink+=scanlookup(msgs[i*2],msgs[i*2+1]);
+  uint64_t t1=wallns();
+  for (int i=0; i<LOOKUPS; ++i) sink+=indexlookup(msgs[i*2],msgs[i*2+1]);
+  uint64_t t2=wallns();
+  for (int i=0; i<LOOKUPS; ++i) ccfeedback(msgs[i*2],msgs[i*2+1],i & 0x7f);
+  uint64_t t3=wallns();
+  double scanns=(double)(t1-t0)/LOOKUPS,indexns=(double)(t2-t1)/LOOKUPS;
+  printf("  host ns per incoming CC: scan %.1f, index %.1f, all of ccfeedback() %.1f\n",scanns,indexns,(double)(t3-t2)/LOOKUPS);
+  printf("  index memory %u bytes\n",(unsigned)(sizeof(ccindex)+sizeof(ccnext)));
+  CHECK(indexns < scanns);
+  free(msgs);
+
+  // a burst of CCs for the control on the display is one redraw, not one per CC - a USB endpoint buffer's worth, all read
+  // in one loop pass
+  page=0;
+  lastcontrol=0;
+  lastcontroltype=ENCODER;
+  ccfeedbackdirty=false;
+  sim_run(100000);
+  int16_t channel,cc;
+  slotmapping(ccslot(0,ENCODER,0),&channel,&cc);
+  uint8_t burst[16*3];
+  for (int i=0; i<16; ++i) {
+    burst[i*3]=0xb0 | (channel-1);
+    burst[i*3+1]=cc;
+    burst[i*3+2]=i;
+  }
+  uint32_t frames=simframes;
+  sim_midiin(SIM_USB,sim_us()+1000,burst,sizeof(burst));
+  sim_run(100000);
+  printf("  16 CCs for the control on show: value %d, %u display frames sent\n",controls[0].encoder[0].value,(unsigned)(simframes-frames));
+  CHECK(controls[0].encoder[0].value == 15);
+  CHECK(simframes-frames <= 2);  // showencoder() sends the frame twice - once for the heading and once for the value
+  CHECK(!ccfeedbackdirty);
+  return report_done(wallstart);
+}
@@ -0,0 +1,83 @@
+// idle governor duty cycle - shared by twisty2_duty and rhythmicon_duty, #included after the sketch
+// the active duty cycle is the share of virtual time a core wasn't asleep in __wfi() - the time it would be drawing run
+// current on a battery. three scripts of what a player does, each after the unit has settled into it:
+// - idle: nothing touched and no MIDI coming in, after the 10 s it takes to drop to the slowest scan rate
+// - light use: a control turned by hand every 3 s and a CC from the DAW twice a second
+// - heavy use: four encoders spinning, MIDI clock and 200 CCs a second coming in over USB
+// then checks a touch when the unit is scanning at its slowest is picked up within one scan period
+
+#include "report.h"
+
+#define TICK_US 100000
+
+struct dutyresult {
+  double awake[SIM_CORES];  // percent
+  double scans,frames,ledshows;  // a second
+};
+
+// run a script for seconds, calling tick every TICK_US with the us since it started so it can queue what comes next
+static dutyresult runscript(const char * name, void (*tick)(uint64_t us), uint32_t seconds) {
+  uint64_t sleep[SIM_CORES];
+  for (int c=0; c<SIM_CORES; ++c) sleep[c]=simsleep[c];
+  uint64_t start=sim_ns(),irqs=simirq.count;
+  uint32_t frames=simframes,leds=simledshows;
+  sim_loopstats_reset();
+  for (uint64_t us=0; us<seconds*1000000ull; us+=TICK_US) {
+    if (tick) tick(us);
+    sim_run(TICK_US);
+  }
+  double elapsed=(sim_ns()-start)/1e9;
+  dutyresult r;
+  printf("%-10s",name);
+  for (int c=0; c<SIM_CORES; ++c) {
+    r.awake[c]=100.0-(simsleep[c]-sleep[c])/1e7/elapsed;
+    if (simloops[c].passes) printf("  core %d %5.1f%% awake",c,r.awake[c]);
+  }
+  r.scans=(simirq.count-irqs)/elapsed;
+  r.frames=(simframes-frames)/elapsed;
+  r.ledshows=(simledshows-leds)/elapsed;
+  printf("  %5.0f scans/s  %5.1f display frames/s  %5.1f LED updates/s\n",r.scans,r.frames,r.ledshows);
+  return r;
+}
+
+static void lightuse(uint64_t us) {
+  if (!(us % 3000000)) sim_turn((us/3000000)%NUMENCODERS,5);
+  if (!(us % 500000)) sim_midiin3(SIM_USB,sim_us()+1000,0xb0,100,(us/500000) & 0x7f);
+}
+
+static void heavyuse(uint64_t us) {
+  if (!us) for (int e=0; e<4; ++e) sim_spin(e,(e & 1) ? -1 : 1,10000,1000);  // 100 detents a second for 10 s
+  uint64_t now=sim_us();
+  for (int i=0; i<20; ++i) sim_midiin3(SIM_USB,now+i*5000+1000,0xb0,100+(i & 7),(uint8_t)(us/TICK_US+i) & 0x7f);
+  for (uint64_t t=(us+20832)/20833*20833; t<us+TICK_US; t+=20833) sim_midiin3(SIM_USB,now+(t-us)+500,0xf8);  // 120 BPM
+}
+
+// ledsidle - nothing should change the LEDs when the unit is left alone
+static int dutymain(bool ledsidle) {
+  uint64_t wallstart=wallns();
+  sim_boot();
+  sim_run(12000000);  // past the power on message and long enough without a touch to drop to the slowest scan rate
+  dutyresult idle=runscript("idle",0,20);
+  CHECK(scanperiod == SCAN_SLEEP_MICROS);
+
+  // a touch at the slowest scan rate - the first state goes by 2ms into the spin
+  uint64_t first=sim_ns()+2000000;
+  sim_spin(5,1,8000,3);
+  while ((scanperiod != TIMER_MICROS_FAST) && (sim_ns() < first+10000000)) sim_run(50);
+  uint64_t seen=sim_ns();
+  printf("touch at the idle scan rate picked up %.0f us after the encoder moved, scanning every %u us after\n",(seen-first)/1e3,
+    (unsigned)scanperiod);
+  CHECK(scanperiod == TIMER_MICROS_FAST);
+  CHECK(seen-first <= SCAN_SLEEP_MICROS*1000ull+100000);  // one slow period, and the 50us steps we look in
+  sim_run(1000000);
+
+  dutyresult light=runscript("light use",lightuse,30);
+  dutyresult heavy=runscript("heavy use",heavyuse,10);
+  CHECK(idle.awake[0] < light.awake[0]);
+  CHECK(light.awake[0] < heavy.awake[0]);
+  CHECK(idle.awake[0] < 10);
+  if (ledsidle) CHECK(idle.ledshows == 0);
+  CHECK(idle.scans < 1000000/TIMER_MICROS);
+  CHECK(heavy.scans > 1000000/TIMER_MICROS);
+  return report_done(wallstart);
+}
@@ -0,0 +1,131 @@
+// every menu screen drawn and checked against a recording - shared by twisty2_menus and rhythmicon_menus, #included
+// after report.h with MENUS_FILE set to the recording
+// the screens are each top menu page, each page of each menu's items, and each item alone on its line at every value of
+// a text item and at the min and max of a number. every parameter is set to its min first so nothing live - stats,
+// battery, profiler times - gets into the pictures. each screen is recorded as a hash of the panel, named by menu, item
+// and value, and a screen that differs is named. the Stats menu is only built with PROFILE, which the sim doesn't define
+// run the test with "record" to write the recording from the current tables
+
+#include <string.h>
+
+#define MAX_SCREENS 4000
+#define MAX_PARAMS 512
+
+struct screen {
+  char name[64];
+  uint64_t hash;
+};
+
+static screen screens[MAX_SCREENS];
+static int nscreens;
+
+static uint64_t panelhash(void) {
+  uint64_t h=14695981039346656037ull;  // FNV-1a
+  for (size_t i=0; i<sizeof(simpanel); ++i) h=(h ^ simpanel[i])*1099511628211ull;
+  return h;
+}
+
+static void shot(const char * menuname, const char * item, const char * value) {
+  if (nscreens == MAX_SCREENS) return;
+  screen &s=screens[nscreens++];
+  snprintf(s.name,sizeof(s.name),"%s|%s|%s",menuname,item,value);
+  for (char * c=s.name; *c; ++c) if (*c == ' ') *c='_';
+  s.hash=panelhash();
+}
+
+static int16_t * saved[MAX_PARAMS];
+static int16_t savedvalue[MAX_PARAMS];
+static int nsaved;
+
+static void setall(void) {
+  nsaved=0;
+  for (size_t t=0; t<NUM_MAIN_MENUS; ++t) {
+    for (int i=0; i<mainmenu[t].numsubmenus; ++i) {
+      const submenu &sub=mainmenu[t].submenus[i];
+      if (!sub.step || !sub.parameter || (nsaved == MAX_PARAMS)) continue;
+      saved[nsaved]=sub.parameter;
+      savedvalue[nsaved++]=*sub.parameter;
+      *sub.parameter=(sub.ptype == TYPE_TEXT) ? max(sub.min,(int16_t)0) : sub.min;
+    }
+  }
+}
+
+static void restoreall(void) {
+  while (nsaved) {
+    --nsaved;
+    *saved[nsaved]=savedvalue[nsaved];
+  }
+}
+
+static void drawall(void) {
+  setall();
+  int8_t savedtop=topmenuindex;
+  char value[16];
+  for (size_t i=0; i<NUM_MAIN_MENUS; i+=TOPMENU_LINES) {
+    drawtopmenu(i);
+    snprintf(value,sizeof(value),"%d",(int)i);
+    shot("top",mainmenu[i].name,value);
+  }
+  for (size_t t=0; t<NUM_MAIN_MENUS; ++t) {
+    topmenuindex=t;
+    int8_t savedpos=menupos[t].submenuindex;
+    for (int i=0; i<mainmenu[t].numsubmenus; i+=SUBMENU_LINES) {
+      menupos[t].submenuindex=i;
+      drawsubmenus();
+      shot(mainmenu[t].name,mainmenu[t].submenus[i].name,"page");
+    }
+    for (int i=0; i<mainmenu[t].numsubmenus; ++i) {
+      const submenu &sub=mainmenu[t].submenus[i];
+      if (!sub.step || !sub.parameter) continue;
+      int16_t was=*sub.parameter;
+      int16_t vals[2]={sub.min,sub.max};
+      int16_t lo=(sub.ptype == TYPE_TEXT) ? max(sub.min,(int16_t)0) : 0;
+      int n=(sub.ptype == TYPE_TEXT) ? sub.max-lo+1 : 2;
+      for (int v=0; v<n; ++v) {
+        *sub.parameter=(sub.ptype == TYPE_TEXT) ? lo+v : vals[v];
+        display.fillScreen(BLACK);
+        drawsubmenu(i);
+        snprintf(value,sizeof(value),"%d",*sub.parameter);
+        shot(mainmenu[t].name,sub.name,value);
+      }
+      *sub.parameter=was;
+    }
+    menupos[t].submenuindex=savedpos;
+  }
+  topmenuindex=savedtop;
+  restoreall();
+}
+
+// the recording against what was drawn. returns the screens that differ or are missing
+static uint32_t checkmenus(bool record) {
+  sim_call(0,drawall);
+  if (record) {
+    FILE * f=fopen(MENUS_FILE,"w");
+    CHECK(f != NULL);
+    if (!f) return 1;
+    for (int i=0; i<nscreens; ++i) fprintf(f,"%s %016llx\n",screens[i].name,(unsigned long long)screens[i].hash);
+    fclose(f);
+    printf("recorded %d screens in %s\n",nscreens,MENUS_FILE);
+    return 0;
+  }
+  FILE * f=fopen(MENUS_FILE,"r");
+  CHECK(f != NULL);
+  if (!f) return 1;
+  uint32_t wrong=0;
+  int n=0;
+  char name[128];
+  unsigned long long hash;
+  while (fscanf(f,"%127s %llx",name,&hash) == 2) {
+    if ((n < nscreens) && !strcmp(name,screens[n].name) && (hash == screens[n].hash)) {
+      ++n;
+      continue;
+    }
+    if ((wrong++ < 3) && (n < nscreens) && !strcmp(name,screens[n].name)) printf("  screen %d %s differs\n",n,name);
+    else if (wrong <= 3) printf("  screen %d recorded as %s, drawn as %s\n",n,name,(n < nscreens) ? screens[n].name : "nothing");
+    ++n;
+  }
+  fclose(f);
+  wrong+=(n < nscreens) ? nscreens-n : 0;
+  printf("%d menu screens drawn, %d recorded, %u differ\n",nscreens,n,(unsigned)wrong);
+  return wrong;
+}
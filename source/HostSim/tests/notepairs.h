@@ -0,0 +1,41 @@
+// note on / note off pairing from the MIDI log - shared by the Rhythmicon sequencer tests, #included after report.h
+// each note on is matched with the next note off for the same channel and note. a note on that comes while the key is
+// still down counts as a second note on, so a retrigger without its note off shows up as unmatched
+
+#define MAX_PAIRS 20000
+
+struct notepair {
+  uint64_t on,off;  // us the firmware sent them, off is 0 if no note off came
+  uint8_t channel,note;
+};
+
+static notepair notepairs[MAX_PAIRS];
+static size_t npairs;
+
+// pair up the notes logged on a port. returns the note ons with no note off
+static uint32_t pairnotes(int port) {
+  static int32_t down[16][128];  // pair index + 1 of the key's sounding note, 0 if up
+  memset(down,0,sizeof(down));
+  npairs=0;
+  uint32_t unmatched=0;
+  simport &p=simmidi[port];
+  for (size_t i=0; i<p.count; ++i) {
+    uint8_t status=p.log[i].data[0] & 0xf0;
+    uint8_t ch=p.log[i].data[0] & 0x0f;
+    uint8_t note=p.log[i].data[1] & 0x7f;
+    bool on=(status == 0x90) && p.log[i].data[2];
+    bool off=(status == 0x80) || ((status == 0x90) && !p.log[i].data[2]);
+    if (on) {
+      if (down[ch][note]) ++unmatched;
+      if (npairs == MAX_PAIRS) continue;
+      notepairs[npairs]={p.log[i].queued/1000,0,(uint8_t)(ch+1),note};
+      down[ch][note]=++npairs;
+    }
+    else if (off && down[ch][note]) {
+      notepairs[down[ch][note]-1].off=p.log[i].queued/1000;
+      down[ch][note]=0;
+    }
+  }
+  for (int ch=0; ch<16; ++ch) for (int n=0; n<128; ++n) unmatched+=(down[ch][n] != 0);
+  return unmatched;
+}
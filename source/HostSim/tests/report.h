@@ -0,0 +1,42 @@
+// shared by the host tests - checks, timing stats and the summary each scenario ends with
+#pragma once
+#include <stdio.h>
+#include <time.h>
+#include "sim.h"
+
+static int checkfails;
+
+#define CHECK(cond) do { if (!(cond)) { ++checkfails; printf("FAIL %s:%d: %s\n",__FILE__,__LINE__,#cond); } } while (0)
+
+// min / mean / max of a series of times in ns
+struct timestat {
+  uint64_t n,sum,min,max;
+  void add(uint64_t t) { if (!n || (t < min)) min=t; if (t > max) max=t; sum+=t; ++n; }
+  double mean(void) const { return n ? (double)sum/n : 0; }
+};
+
+static const char * const portnames[SIM_PORTS]={"USB","DIN","BLE"};
+
+static uint64_t wallns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC,&ts);
+  return ts.tv_sec*1000000000ull+ts.tv_nsec;
+}
+
+// per core loop() / loop1() passes - host is what the firmware took on this machine, sim is virtual time per pass
+static inline void report_loops(void) {
+  for (int c=0; c<SIM_CORES; ++c) {
+    simloopstat &s=simloops[c];
+    if (!s.passes) continue;
+    printf("  core %d: %llu passes, host %.2f us mean %.2f us max, sim %.1f us mean %.1f us max\n",c,(unsigned long long)s.passes,
+      s.hostns/1e3/s.passes,s.hostmax/1e3,s.simns/1e3/s.passes,s.simmax/1e3);
+  }
+}
+
+// exit status for make test
+static int report_done(uint64_t wallstart) {
+  double wall=(wallns()-wallstart)/1e9;
+  printf("  %.1f s simulated in %.2f s, %.0fx real time\n",sim_ns()/1e9,wall,sim_ns()/1e9/wall);
+  printf(checkfails ? "FAILED %d checks\n" : "passed\n",checkfails);
+  return checkfails ? 1 : 0;
+}
@@ -0,0 +1,126 @@
+// PicoRhythmicon background autosave - the stall a save puts into a running sequence
+// a setting that doesn't change the sound is edited while the sequencer plays, and the autosave writes it to flash.
+// the simulated flash holds both cores for each erase and page program, as it does on the RP2040
+// - where the sequence leaves a gap long enough for the write, core 1 parks in it and no note on or note off goes out late
+// - where it never does, the save goes ahead after PARK_TIMEOUT_MS anyway. notes due during it go out late by no more
+//   than the write takes, and the tick grid doesn't slip - the ticks missed are caught up on their original times
+// - reports for each sequence how long the save waited for a gap, how long core 1 was parked and how late the notes went
+
+#include "Twisty2_Rhythmicon.cpp"
+#include "report.h"
+#include "notepairs.h"
+
+#define POLL_US 100
+#define ONTIME_US 100  // within a few loop1() passes
+#define SETTLE_US ((AUTOSAVE_QUIET_MS+2*AUTOSAVE_CHECK_MS+PARK_TIMEOUT_MS)*1000+500000)
+
+struct sequence {
+  const char * name;
+  int16_t bpm;
+  int16_t divider;
+  int16_t tracks;  // tracks on the divider
+  int16_t gate[NTRACKS];
+  bool gap;        // leaves a gap the write fits in
+};
+
+static const sequence sequences[]={
+  {"one track of 8ths at 90 BPM",90,2,1,{50,50,50},true},
+  {"three tracks of 16ths at 120 BPM",120,1,3,{66,66,66},true},
+  {"three tracks of 16ths at 180 BPM",180,1,3,{20,25,30},true},
+  {"three tracks of 16ths at 240 BPM",240,1,3,{20,50,80},false},
+};
+
+static void edit(void) {
+  MIDIinputchannel[NTRACKS-1]=(MIDIinputchannel[NTRACKS-1] % 16)+1;  // saved, but nothing on the output changes
+}
+
+struct saveresult {
+  uint64_t edited,requested,parked,released,saved;  // us
+  uint32_t notes,late;
+  uint32_t onlate,offlate;  // worst us
+  uint32_t afterlate;       // worst us a note on was off the grid once the save was done
+};
+
+static saveresult run(const sequence &seq) {
+  bpm=seq.bpm;
+  memset(rhythmclks,0,sizeof(bool)*NTRACKS*NUM_CLOCKS);
+  rhythm[0].divider=seq.divider;
+  for (int16_t track=0; track<NTRACKS; ++track) {
+    rhythmclks[track][0]=track < seq.tracks;
+    notes[track].gate=seq.gate[track];
+    notes[track].gatems=0;
+    trackdelay[track]=0;
+  }
+  for (int16_t clk=0; clk<NUM_CLOCKS; ++clk) swing[clk]=SWING_STRAIGHT;
+  sim_run(SETTLE_US);  // the sequence's own settings are saved first
+  sim_midi_clear();
+  sim_run(1000000);
+
+  saveresult r={};
+  r.edited=sim_us();
+  sim_call(0,edit);
+  uint64_t limit=r.edited+(AUTOSAVE_QUIET_MS+2*AUTOSAVE_CHECK_MS+PARK_TIMEOUT_MS)*1000ull+500000;
+  while (sim_us() < limit) {
+    sim_run(POLL_US);
+    if (parkrequest && !r.requested) r.requested=sim_us();
+    if (core1parked && !r.parked) r.parked=sim_us();
+    if (r.requested && !parkrequest && !r.released) r.released=sim_us();
+    if (r.released && !sessiondirty && (savestate == SAVE_IDLE)) {
+      r.saved=sim_us();
+      break;
+    }
+  }
+  sim_run(1000000);
+
+  // note ons against the divider's pulse grid, note offs against their note on's due time plus the gate
+  pairnotes(SIM_USB);
+  uint32_t pulse=seq.divider*PPQN_DIV*tickperiod;
+  uint64_t phase=notepairs[0].on;
+  for (size_t i=0; i<npairs; ++i) {
+    uint32_t late=(notepairs[i].on+pulse-phase % pulse) % pulse;
+    if (late > pulse-ONTIME_US) late=0;  // a hair early against the first note
+    if (late > r.onlate) r.onlate=late;
+    if (notepairs[i].on > r.saved+pulse) r.afterlate=max(r.afterlate,late);
+    r.late+=(late > ONTIME_US);
+    ++r.notes;
+    if (!notepairs[i].off) continue;
+    int track=notepairs[i].channel-MIDIoutputchannel[0];
+    uint64_t due=notepairs[i].on-late+gatelength(track,seq.divider);
+    uint32_t offlate=(notepairs[i].off > due) ? notepairs[i].off-due : 0;
+    if (offlate > r.offlate) r.offlate=offlate;
+    r.late+=(offlate > ONTIME_US);
+  }
+  return r;
+}
+
+int main() {
+  uint64_t wallstart=wallns();
+  sim_boot();
+  sim_run(2000000);  // past the splash screen with the sequencer going
+
+  for (size_t s=0; s<sizeof(sequences)/sizeof(sequences[0]); ++s) {
+    const sequence &seq=sequences[s];
+    simflashstall=0;
+    saveresult r=run(seq);
+    bool saved=r.saved && (sim_fs_get(SESSION_FILE,NULL,0) >= 0);
+    printf("%s: saved %.2f s after the edit, waited %.0f ms for a gap, core 1 parked %.1f ms%s\n",seq.name,
+      saved ? (r.saved-r.edited)/1e6 : 0.0,r.parked ? (r.parked-r.requested)/1e3 : (r.released-r.requested)/1e3,
+      r.parked ? (r.released-r.parked)/1e3 : 0.0,r.parked ? "" : " - never, saved on the timeout");
+    printf("  %u notes, %u late: note ons %.1f ms and note offs %.1f ms at worst, %.1f ms after the save. longest flash operation %.1f ms\n",
+      (unsigned)r.notes,(unsigned)r.late,r.onlate/1e3,r.offlate/1e3,r.afterlate/1e3,simflashstall/1e6);
+    CHECK(saved);
+    CHECK(r.notes > 0);
+    CHECK(r.afterlate <= ONTIME_US);  // the grid didn't slip
+    if (seq.gap) {
+      CHECK(r.parked != 0);
+      CHECK(r.late == 0);
+    }
+    else {
+      CHECK(r.released-r.requested >= PARK_TIMEOUT_MS*1000ull);
+      uint64_t write=r.released-r.requested-PARK_TIMEOUT_MS*1000ull;
+      CHECK(r.onlate <= write+ONTIME_US);  // no later than the write took
+      CHECK(r.offlate <= write+ONTIME_US);
+    }
+  }
+  return report_done(wallstart);
+}
@@ -0,0 +1,34 @@
+// the bench.h microbenchmarks run on the host - see twisty2_bench.cpp
+// checks the scan benchmark leaves the alarm alone, nothing allocates and the sequencer carries on afterwards
+
+#define BENCHMARK
+#include "Twisty2_Rhythmicon.cpp"
+#include "report.h"
+#include "bench.h"
+
+static uint32_t alarmbefore,alarmafter;
+
+static void scanonly(void) {
+  irq_set_enabled(ALARM_IRQ,false);
+  alarmbefore=timer_hw->alarm[ALARM_NUM].value;
+  for (int i=0; i<1000; ++i) scan_encoders();
+  alarmafter=timer_hw->alarm[ALARM_NUM].value;
+  irq_set_enabled(ALARM_IRQ,true);
+}
+
+int main() {
+  uint64_t wallstart=wallns();
+  sim_boot();
+  printf("at power on:\n");
+  CHECK(benchresults(0,0) > 0);
+  sim_call(0,scanonly);
+  CHECK(alarmafter == alarmbefore);
+  CHECK(controlstate == RUNNING);
+  sim_midi_clear();
+  sim_run(1000000);
+  size_t notes=0;
+  for (size_t i=0; i<simmidi[SIM_USB].count; ++i) notes+=(simmidi[SIM_USB].log[i].data[0] & 0xf0) == 0x90;
+  printf("  %u note ons in the second after\n",(unsigned)notes);
+  CHECK(notes > 0);
+  return report_done(wallstart);
+}
@@ -0,0 +1,82 @@
+// PicoRhythmicon boot - how soon after power on the sequencer plays and takes MIDI in, with the power on message up
+// for SPLASH_MS in front of it. nothing is touched
+// - reports the time each boot phase ended and to the first note on sent, and checks MIDI in and out are working
+//   within BOOT_MIDI_MS
+// - a note on for track 1 and one for track 2 come in while the message is up and set the tracks' offsets
+// - the panel is the power on message and no frame is sent until SPLASH_MS, then the sequencer screen comes up within
+//   LATE_MS, the same as one drawn from scratch
+
+#include "Twisty2_Rhythmicon.cpp"
+#include "report.h"
+
+#define BOOT_MIDI_MS 100  // MIDI in and out working this soon after power on
+#define STEP_US 1000
+#define LATE_MS 20        // the screen is on the panel this soon after SPLASH_MS - a frame and a loop pass
+
+static uint8_t splash[sizeof(simpanel)],screen[sizeof(simpanel)];
+
+static void redraw(void) {
+  display.clearDisplay();
+  shownotes();
+  showrhythms();
+}
+
+int main() {
+  uint64_t wallstart=wallns();
+  sim_boot();
+  uint64_t up=sim_us();
+  uint64_t down=splashstart*1000ull+SPLASH_MS*1000;  // when the message is due to come down
+  memcpy(splash,simpanel,sizeof(splash));
+  uint32_t frames=simframes;
+  uint32_t lit=0;
+  for (size_t i=0; i<sizeof(splash); ++i) lit+=(splash[i] != 0);
+  CHECK(lit > 0);  // the message is on the panel
+
+  sim_midiin3(SIM_USB,up+BOOT_MIDI_MS*1000/2,0x90 | (MIDIinputchannel[0]-1),MIDDLE_C+5,100);
+  sim_midiin3(SIM_USB,down-200000,0x90 | (MIDIinputchannel[1]-1),MIDDLE_C-7,100);
+
+  // until SPLASH_MS the panel doesn't change
+  uint64_t changed=0;
+  uint32_t pushed=0;
+  while (sim_us() < down+LATE_MS*1000) {
+    sim_run(STEP_US);
+    if (simframes != frames) {
+      if (!pushed) changed=sim_us();
+      pushed+=simframes-frames;
+      frames=simframes;
+    }
+    if (!changed && memcmp(simpanel,splash,sizeof(splash))) changed=sim_us();
+  }
+  uint64_t firstout=0;
+  uint32_t notesout=0;
+  for (size_t i=0; i<simmidi[SIM_USB].count; ++i) {
+    simmsg &m=simmidi[SIM_USB].log[i];
+    if (((m.data[0] & 0xf0) != 0x90) || (m.ns/1000 >= down)) continue;
+    if (!firstout) firstout=m.ns/1000;
+    ++notesout;
+  }
+  printf("setup() returned at %.1f ms\n",up/1e3);
+  for (int16_t i=0; i<NUM_BOOT_PHASES; ++i) {
+    if (boottime[i]) printf("  %-14s %8.3f ms\n",bootnames[i],boottime[i]/1e3);
+    else printf("  %-14s        -\n",bootnames[i]);
+  }
+  printf("  %-14s %8.3f ms\n","first note on",firstout/1e3);
+  printf("the power on message was due down at %.1f ms and the screen was up at %.1f ms, %u frames sent. %u note ons sent while it was up, track offsets %d and %d\n",
+    down/1e3,changed/1e3,(unsigned)pushed,(unsigned)notesout,notes[0].offset,notes[1].offset);
+  CHECK(boottime[BOOT_MIDI] && (boottime[BOOT_MIDI] < BOOT_MIDI_MS*1000));
+  CHECK(boottime[BOOT_FIRSTMIDI] && (boottime[BOOT_FIRSTMIDI] < BOOT_MIDI_MS*1000));
+  CHECK(firstout && (firstout < up+BOOT_MIDI_MS*1000));
+  CHECK(notes[0].offset == 5);
+  CHECK(notes[1].offset == -7);
+  CHECK(changed >= down);
+  CHECK(changed <= down+LATE_MS*1000);
+  CHECK(pushed == 1);
+
+  memcpy(screen,simpanel,sizeof(screen));
+  sim_call(0,redraw);
+  sim_run(STEP_US);
+  bool same=!memcmp(simpanel,screen,sizeof(screen));
+  printf("the sequencer screen that came up is %s one drawn from scratch\n",same ? "the same as" : "different from");
+  CHECK(same);
+  return report_done(wallstart);
+}
@@ -0,0 +1,10 @@
+// PicoRhythmicon active duty cycle for idle, light and heavy use - see duty.h
+// core 1 runs the sequencer flat out on purpose, so it's core 0 that the governor puts to sleep
+// the sequencer plays from power on, so the step LEDs keep changing even with nobody at the controls
+
+#include "Twisty2_Rhythmicon.cpp"
+#include "duty.h"
+
+int main() {
+  return dutymain(false);
+}
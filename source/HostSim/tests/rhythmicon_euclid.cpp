@@ -0,0 +1,273 @@
+// PicoRhythmicon Euclidean rhythms - the compile time tables against a reference Bjorklund implementation, and a pattern
+// played by the sequencer
+// - every table entry up to EUCLID_MAX steps has the right number of hits and nothing past its last step, spaces its hits
+//   as evenly as they go - gaps differ by one step at most - and is the reference pattern, up to where it starts
+// - Toussaint's published Euclidean rhythms come out the same, up to where they start
+// - euclidupdate() rotates every pattern by every amount the menu allows, and keeps settings out of range in range
+// - a divider playing E(5,13) rotated by 3 fires on its pattern's hits and nowhere else, and follows a change of pattern
+// - reports host ns per clocktick() with no Euclidean pattern, with one that hits every step - the same notes go out, so
+//   the difference is the table lookup - and with E(5,16)
+
+#include "Twisty2_Rhythmicon.cpp"
+#include "report.h"
+
+#define TICKS (PPQN*64)  // 16 bars of clocktick() for the timing
+#define SETTLE_US ((AUTOSAVE_QUIET_MS+2*AUTOSAVE_CHECK_MS+PARK_TIMEOUT_MS)*1000+500000)
+
+// a pattern started r steps in - what euclidupdate() should make of it
+static uint32_t rotated(uint32_t m, int16_t steps, int16_t r) {
+  uint32_t out=0;
+  for (int16_t i=0; i<steps; ++i) out|=((m >> ((i+r) % steps)) & 1) << i;
+  return out;
+}
+
+// the reference - Bjorklund's algorithm as he published it, counts and remainders then a recursive build of the string
+// rotated to start on a hit. step 0 in bit 0, like the tables
+static int16_t refcounts[EUCLID_MAX+2],refremainders[EUCLID_MAX+2];
+static uint32_t refpattern;
+static int16_t reflen;
+
+static void refbuild(int16_t level) {
+  if (level == -1) ++reflen;  // a rest
+  else if (level == -2) refpattern|=1u << reflen++;  // a hit
+  else {
+    for (int16_t i=0; i<refcounts[level]; ++i) refbuild(level-1);
+    if (refremainders[level]) refbuild(level-2);
+  }
+}
+
+static uint32_t reference(int16_t steps, int16_t hits) {
+  if (!hits) return 0;
+  refpattern=0;
+  reflen=0;
+  int16_t divisor=steps-hits;
+  refremainders[0]=hits;
+  int16_t level=0;
+  do {
+    refcounts[level]=divisor/refremainders[level];
+    refremainders[level+1]=divisor % refremainders[level];
+    divisor=refremainders[level];
+    ++level;
+  } while (refremainders[level] > 1);
+  refcounts[level]=divisor;
+  refbuild(level);
+  CHECK(reflen == steps);
+  int16_t first=0;
+  while (!((refpattern >> first) & 1)) ++first;
+  return rotated(refpattern,steps,first);
+}
+
+static bool samerhythm(uint32_t a, uint32_t b, int16_t steps) {
+  for (int16_t r=0; r<steps; ++r) {
+    if (rotated(a,steps,r) == b) return true;
+  }
+  return false;
+}
+
+// true if the gaps between hits - round the end back to the start - differ by a step at most
+static bool even(uint32_t m, int16_t steps) {
+  int16_t shortest=EUCLID_MAX,longest=0,first=-1,last=-1;
+  for (int16_t i=0; i<steps; ++i) {
+    if (!((m >> i) & 1)) continue;
+    if (last >= 0) {
+      shortest=min(shortest,(int16_t)(i-last));
+      longest=max(longest,(int16_t)(i-last));
+    }
+    else first=i;
+    last=i;
+  }
+  if (first < 0) return true;
+  int16_t wrap=steps-last+first;
+  shortest=min(shortest,wrap);
+  longest=max(longest,wrap);
+  return longest-shortest <= 1;
+}
+
+static uint32_t parse(const char * s) {
+  uint32_t m=0;
+  for (int16_t i=0; s[i]; ++i) m|=(uint32_t)(s[i] == 'x') << i;
+  return m;
+}
+
+// Toussaint, The Euclidean Algorithm Generates Traditional Musical Rhythms
+static const struct { int16_t hits,steps; const char * pattern; } toussaint[]={
+  {2,5,"x.x.."},{3,4,"x.xx"},{3,5,"x.x.x"},{3,7,"x.x.x.."},{3,8,"x..x..x."},{4,7,"x.x.x.x"},{4,9,"x.x.x.x.."},
+  {4,11,"x..x..x..x."},{5,6,"x.xxxx"},{5,7,"x.xx.xx"},{5,8,"x.xx.xx."},{5,9,"x.x.x.x.x"},{5,11,"x.x.x.x.x.."},
+  {5,12,"x..x.x..x.x."},{5,16,"x..x..x..x..x...."},{7,8,"x.xxxxxx"},{7,12,"x.xx.x.xx.x."},{7,16,"x..x.x.x..x.x.x."},
+  {9,16,"x.xx.x.x.xx.x.x."},{11,24,"x..x.x.x.x.x..x.x.x.x.x."},{13,24,"x.xx.x.x.x.x.xx.x.x.x.x."},
+};
+
+// ----------------------------------------------------------------------------- played
+
+static int16_t playsteps,playhits,playrotate;
+
+static void setpattern(void) {
+  euclid[0].on=1;
+  euclid[0].steps=playsteps;
+  euclid[0].hits=playhits;
+  euclid[0].rotate=playrotate;
+  euclidupdate(0);
+}
+
+// pulses the divider fired on over a window, against every way its mask could line up with the window. returns the
+// pulses that disagree with the best fit
+static uint32_t played(uint32_t * notesout, uint32_t * pulses) {
+  sim_midi_clear();
+  uint64_t start=sim_us();
+  uint32_t pulse=rhythm[0].divider*PPQN_DIV*tickperiod;
+  sim_run(3*playsteps*pulse);
+  static bool hit[4*EUCLID_MAX];
+  memset(hit,0,sizeof(hit));
+  uint64_t first=0;
+  uint32_t n=0;
+  simport &p=simmidi[SIM_USB];
+  for (size_t i=0; i<p.count; ++i) {
+    if (((p.log[i].data[0] & 0xf0) != 0x90) || !p.log[i].data[2]) continue;
+    uint64_t t=p.log[i].queued/1000;
+    if (!n) first=t-((t-start)/pulse)*pulse;  // the first pulse in the window
+    uint32_t k=(t-first+pulse/2)/pulse;
+    if (k < 4*EUCLID_MAX) hit[k]=true;
+    ++n;
+  }
+  *notesout=n;
+  *pulses=(uint32_t)((sim_us()-first)/pulse);
+  uint32_t best=UINT32_MAX;
+  for (int16_t o=0; o<playsteps; ++o) {
+    uint32_t wrong=0;
+    for (uint32_t k=0; k<*pulses; ++k) wrong+=(hit[k] != (bool)((euclid[0].mask >> ((o+k) % playsteps)) & 1));
+    best=min(best,wrong);
+  }
+  return best;
+}
+
+// ----------------------------------------------------------------------------- timing
+
+static uint64_t tickns;
+
+static void timeticks(void) {
+  uint64_t t0=wallns();
+  for (int i=0; i<TICKS; ++i) {
+    clocktick();
+    usbflush();
+  }
+  tickns=wallns()-t0;
+  all_notes_off();
+  usbflush();
+  sync_sequencers();
+}
+
+int main() {
+  uint64_t wallstart=wallns();
+
+  // the tables
+  uint32_t entries=0,wronghits=0,uneven=0,notref=0,exact=0;
+  for (int16_t steps=1; steps<=EUCLID_MAX; ++steps) {
+    for (int16_t hits=0; hits<=steps; ++hits) {
+      uint32_t m=euclidtable.mask[steps][hits];
+      uint32_t ref=reference(steps,hits);
+      ++entries;
+      wronghits+=(__builtin_popcount(m) != hits) || ((steps < 32) && (m >> steps));
+      uneven+=!even(m,steps);
+      notref+=!samerhythm(m,ref,steps);
+      exact+=(m == ref);
+    }
+  }
+  uint32_t nottoussaint=0;
+  for (size_t i=0; i<sizeof(toussaint)/sizeof(toussaint[0]); ++i) {
+    nottoussaint+=!samerhythm(euclidtable.mask[toussaint[i].steps][toussaint[i].hits],parse(toussaint[i].pattern),toussaint[i].steps);
+  }
+  printf("%u table entries up to %d steps: %u with the wrong hits, %u uneven, %u not the reference pattern (%u the same from the first step). %u of %u of Toussaint's rhythms differ\n",
+    (unsigned)entries,EUCLID_MAX,(unsigned)wronghits,(unsigned)uneven,(unsigned)notref,(unsigned)exact,(unsigned)nottoussaint,
+    (unsigned)(sizeof(toussaint)/sizeof(toussaint[0])));
+  CHECK(entries == (EUCLID_MAX+1)*(EUCLID_MAX+2)/2-1);
+  CHECK(wronghits == 0);
+  CHECK(uneven == 0);
+  CHECK(notref == 0);
+  CHECK(nottoussaint == 0);
+
+  // rotation and range checks, on a spare divider's settings
+  euclidgen saved=euclid[NUM_CLOCKS-1];
+  uint32_t rotations=0,badrotations=0;
+  for (int16_t steps=1; steps<=EUCLID_MAX; ++steps) {
+    for (int16_t hits=0; hits<=steps; ++hits) {
+      for (int16_t r=0; r<steps; ++r) {
+        euclid[NUM_CLOCKS-1].steps=steps;
+        euclid[NUM_CLOCKS-1].hits=hits;
+        euclid[NUM_CLOCKS-1].rotate=r;
+        euclidupdate(NUM_CLOCKS-1);
+        badrotations+=(euclid[NUM_CLOCKS-1].mask != rotated(euclidtable.mask[steps][hits],steps,r));
+        ++rotations;
+      }
+    }
+  }
+  printf("%u rotations, %u wrong\n",(unsigned)rotations,(unsigned)badrotations);
+  CHECK(badrotations == 0);
+  euclid[NUM_CLOCKS-1].steps=EUCLID_MAX+8;
+  euclid[NUM_CLOCKS-1].hits=EUCLID_MAX+8;
+  euclid[NUM_CLOCKS-1].rotate=-3;
+  euclidupdate(NUM_CLOCKS-1);
+  CHECK((euclid[NUM_CLOCKS-1].steps == EUCLID_MAX) && (euclid[NUM_CLOCKS-1].hits == EUCLID_MAX) && (euclid[NUM_CLOCKS-1].rotate == 0));
+  CHECK(euclid[NUM_CLOCKS-1].mask == 0xffffffff);
+  euclid[NUM_CLOCKS-1].steps=0;
+  euclid[NUM_CLOCKS-1].hits=5;
+  euclid[NUM_CLOCKS-1].rotate=9;
+  euclidupdate(NUM_CLOCKS-1);
+  CHECK((euclid[NUM_CLOCKS-1].steps == 1) && (euclid[NUM_CLOCKS-1].hits == 1) && (euclid[NUM_CLOCKS-1].rotate == 0));
+  euclid[NUM_CLOCKS-1]=saved;
+
+  // played by the sequencer - track 1 on the first divider only, 16ths at 120 BPM
+  sim_boot();
+  sim_run(2000000);
+  bpm=120;
+  memset(rhythmclks,0,sizeof(bool)*NTRACKS*NUM_CLOCKS);
+  rhythmclks[0][0]=true;
+  rhythm[0].divider=1;
+  swing[0]=SWING_STRAIGHT;
+  trackdelay[0]=0;
+  playsteps=13;
+  playhits=5;
+  playrotate=3;
+  sim_call(0,setpattern);
+  sim_run(SETTLE_US);  // the change is autosaved - notes due during a save can go out late
+  uint32_t notes,pulses;
+  uint32_t wrong=played(&notes,&pulses);
+  printf("E(%d,%d) rotated %d: %u notes over %u pulses, %u pulses off the pattern\n",playhits,playsteps,playrotate,
+    (unsigned)notes,(unsigned)pulses,(unsigned)wrong);
+  CHECK(pulses >= 3*(uint32_t)playsteps-1);
+  CHECK(notes >= 3*(uint32_t)playhits-1);
+  CHECK(wrong == 0);
+  playsteps=16;
+  playhits=7;
+  playrotate=0;
+  sim_call(0,setpattern);
+  sim_run(SETTLE_US);
+  wrong=played(&notes,&pulses);
+  printf("changed to E(%d,%d): %u notes over %u pulses, %u pulses off the pattern\n",playhits,playsteps,
+    (unsigned)notes,(unsigned)pulses,(unsigned)wrong);
+  CHECK(notes >= 3*(uint32_t)playhits-1);
+  CHECK(wrong == 0);
+
+  // what the table lookups cost a tick, against plain division. every divider on every track, and a pattern with a hit on
+  // every step sends the same notes as none
+  memset(rhythmclks,1,sizeof(bool)*NTRACKS*NUM_CLOCKS);
+  for (int16_t clk=0; clk<NUM_CLOCKS; ++clk) euclid[clk].on=0;
+  sim_call(1,timeticks);  // warm up
+  sim_call(1,timeticks);
+  uint64_t plain=tickns;
+  uint64_t timed[2];
+  const int16_t timedhits[2]={16,5};
+  for (int i=0; i<2; ++i) {
+    for (int16_t clk=0; clk<NUM_CLOCKS; ++clk) {
+      euclid[clk].on=1;
+      euclid[clk].steps=16;
+      euclid[clk].hits=timedhits[i];
+      euclid[clk].rotate=0;
+      euclidupdate(clk);
+    }
+    sim_call(1,timeticks);
+    timed[i]=tickns;
+  }
+  printf("host ns per clocktick() on every divider: %.1f with no Euclidean pattern, %.1f with E(16,16), %.1f with E(5,16)\n",
+    (double)plain/TICKS,(double)timed[0]/TICKS,(double)timed[1]/TICKS);
+  return report_done(wallstart);
+}
@@ -0,0 +1,141 @@
+// PicoRhythmicon MIDI input - a mixed stream of 1000 messages a second into USB while the sequencer plays
+// reports what the callbacks cost per message on this machine and checks
+// - every message reached the callbacks and note ons were routed to the tracks listening on their channel
+// - everything the callbacks logged was either printed by core 0 or counted as dropped
+// - the note ons the sequencer sends stay on the same grid as with no input
+
+#include "Twisty2_Rhythmicon.cpp"
+#include "report.h"
+
+#define STREAM_US 2000000
+#define STREAM_RATE 1000
+
+// a cycle of 10 messages, one per ms. no clock or start / stop - those change what the sequencer does
+static const uint8_t stream[10][8]={
+  {3,0x90,64,100},                     // note on, track 1's channel - offset +4
+  {3,0x80,64,0},
+  {3,0xb0,7,100},                      // logged
+  {3,0x95,40,100},                     // note on on a channel no track listens to
+  {2,0xf1,0x21},                       // MTC quarter frame, logged
+  {3,0xb3,74,20},                      // logged
+  {6,0xf0,0x7d,0x01,0x02,0x03,0xf7},   // SysEx, logged
+  {1,0xfe},                            // active sensing, logged
+  {3,0xe0,0,64},                       // pitch bend - no callback does anything with it
+  {3,0x91,57,100},                     // note on, track 2's channel - offset -3
+};
+static const int logged=5;  // of each cycle
+
+static uint32_t gridus;
+
+static uint32_t offgrid(uint64_t ns) {
+  return ((uint32_t)(ns/1000)-gridus) % tickperiod;
+}
+
+// note ons sent after their PPQN tick - the earliest one over both runs is taken as the grid
+static void findgrid(void) {
+  simport &p=simmidi[SIM_USB];
+  uint32_t best=UINT32_MAX;
+  gridus=0;
+  for (size_t i=0; i<p.count; ++i) {
+    if ((p.log[i].data[0] & 0xf0) != 0x90) continue;
+    uint32_t phase=offgrid(p.log[i].queued);
+    if (phase < best) best=phase;
+  }
+  gridus=best;
+}
+
+static timestat notetiming(void) {
+  simport &p=simmidi[SIM_USB];
+  timestat t={};
+  for (size_t i=0; i<p.count; ++i) {
+    if ((p.log[i].data[0] & 0xf0) == 0x90) t.add(offgrid(p.log[i].queued)*1000ull);
+  }
+  return t;
+}
+
+static size_t countlines(const char * prefix) {
+  size_t n=0,len=strlen(prefix);
+  for (const char * s=simserial; s && (s=strstr(s,prefix)); s+=len) ++n;
+  return n;
+}
+
+// drops core 0 reported in "MIDI log dropped N messages" lines
+static size_t countdropped(void) {
+  size_t n=0;
+  for (const char * s=simserial; s && (s=strstr(s,"MIDI log dropped ")); ++s) n+=atoi(s+17);
+  return n;
+}
+
+int main() {
+  uint64_t wallstart=wallns();
+  sim_boot();
+  sim_run(2000000);  // past the splash screen with the sequencer going
+  CHECK(controlstate == RUNNING);
+
+  sim_midi_clear();
+  sim_loopstats_reset();
+  sim_run(STREAM_US);
+  findgrid();
+  timestat quiet=notetiming();
+  printf("no input: %llu note ons, sent %.1f us mean %.1f us max after the tick\n",(unsigned long long)quiet.n,quiet.mean()/1e3,quiet.max/1e3);
+  report_loops();
+
+  sim_midi_clear();
+  sim_serial_clear();
+  sim_loopstats_reset();
+  simcallbacks={};
+  uint64_t start=sim_us();
+  uint32_t count=STREAM_US/1000*STREAM_RATE/1000;
+  for (uint32_t i=0; i<count; ++i) {
+    const uint8_t * m=stream[i % 10];
+    sim_midiin(SIM_USB,start+i*(1000000/STREAM_RATE),m+1,m[0]);
+  }
+  sim_run(STREAM_US+100000);  // and a bit for core 0 to finish printing
+  timestat busy=notetiming();
+  printf("%u messages a second for %.1f s:\n",STREAM_RATE,STREAM_US/1e6);
+  printf("  %llu messages to the callbacks, host %.0f ns mean %.0f ns max each\n",(unsigned long long)simcallbacks.count,
+    (double)simcallbacks.hostns/simcallbacks.count,(double)simcallbacks.hostmax);
+  printf("  %llu note ons, sent %.1f us mean %.1f us max after the tick\n",(unsigned long long)busy.n,busy.mean()/1e3,busy.max/1e3);
+  report_loops();
+  CHECK(simcallbacks.count == count);
+  CHECK(sim_midiin_pending(SIM_USB) == 0);
+  CHECK(notes[0].offset == 4);
+  CHECK(notes[1].offset == -3);
+  CHECK(notes[2].offset == 0);
+  CHECK(busy.n > 0);
+  CHECK(busy.max <= quiet.max);
+
+  // every logged message printed or counted
+  size_t printed=countlines("Control Change: ")+countlines("MTC Quarter Frame: ")+countlines("System Exclusive: ")+countlines("Active Sensing: ");
+  size_t dropped=countdropped();
+  printf("  %u logged, %u printed by core 0, %u dropped\n",(unsigned)(count/10*logged),(unsigned)printed,(unsigned)dropped);
+  CHECK(printed+dropped == count/10*logged);
+  CHECK(midiloghead == midilogtail);
+
+  // a burst faster than core 0 prints - the log overflows and the overflow is counted, reported once and not again
+  sim_serial_clear();
+  uint8_t burst[100*3];
+  for (int i=0; i<100; ++i) {
+    burst[i*3]=0xb0;
+    burst[i*3+1]=1;
+    burst[i*3+2]=i;
+  }
+  sim_midiin(SIM_USB,sim_us()+1000,burst,sizeof(burst));
+  sim_run(200000);
+  printed=countlines("Control Change: ");
+  dropped=countdropped();
+  printf("burst of 100 CCs: %u printed, %u dropped\n",(unsigned)printed,(unsigned)dropped);
+  CHECK(dropped > 0);
+  CHECK(printed+dropped == 100);
+  CHECK((uint16_t)(midilogdropped-midilogreported) == 0);
+
+  // moving track 3 onto channel 6 reroutes notes on that channel to it from the next message on
+  MIDIinputchannel[2]=6;
+  buildchannelmap();
+  CHECK(channeltracks[2] == 0);
+  CHECK(channeltracks[5] == 4);
+  sim_midiin3(SIM_USB,sim_us()+1000,0x95,72,100);
+  sim_run(10000);
+  CHECK(notes[2].offset == 12);
+  return report_done(wallstart);
+}
@@ -0,0 +1,176 @@
+// PicoRhythmicon note off wheel under random clock routing
+// each round routes the three tracks to random clock dividers with random dividers, tempo, swing and gate - a percentage
+// of the fastest divider or a fixed length up to GATE_MAX_MS, longer than a turn of the wheel
+// - every note on has its note off, sent its gate after the note on to within a loop1() pass. a note cut short by the
+//   same note starting again has its note off sent right before the new note on
+// - once the sequencer stops every pending note off is sent, nothing is left sounding and the whole pool is free again
+// - a MIDI stop with long notes sounding turns every one of them off at once
+
+#include "Twisty2_Rhythmicon.cpp"
+#include "report.h"
+#include "notepairs.h"
+
+#define ROUNDS 16
+#define WINDOW_US 2000000
+#define TOLERANCE_US 50
+#define SETTLE_US ((AUTOSAVE_QUIET_MS+2*AUTOSAVE_CHECK_MS+PARK_TIMEOUT_MS)*1000+500000)  // the round's settings are written by the autosave
+
+static uint32_t seed=12345;
+
+static uint32_t randomn(uint32_t n) {
+  seed=seed*1103515245+12345;
+  return (seed >> 16) % n;
+}
+
+static uint32_t expectedgate[NTRACKS];
+
+// a random routing, dividers, gates and steps. every track gets at least one clock
+static void randomround(void) {
+  for (int16_t clk=0; clk<NUM_CLOCKS; ++clk) {
+    rhythm[clk].divider=1+randomn(8);
+    swing[clk]=SWING_STRAIGHT+randomn(SWING_MAX-SWING_STRAIGHT+1);
+  }
+  for (int16_t track=0; track<NTRACKS; ++track) {
+    for (int16_t clk=0; clk<NUM_CLOCKS; ++clk) rhythmclks[track][clk]=randomn(3) == 0;
+    rhythmclks[track][randomn(NUM_CLOCKS)]=1;
+    notes[track].gate=1+randomn(100);
+    notes[track].gatems=randomn(3) ? 0 : 10*randomn(GATE_MAX_MS/10+1);
+    trackdelay[track]=randomn(4)*1000;
+    for (int16_t step=0; step<SEQ_STEPS; ++step) notes[track].val[step]=randomn(4) ? randomn(13)-6 : 0;  // some steps repeat a note
+  }
+  bpm=60+randomn(141);
+}
+
+// the gate each track's notes should get - the formula from the request, not the sketch's gatelength()
+static void gates(void) {
+  uint32_t tick=60000000/((uint32_t)bpm*PPQN);
+  for (int16_t track=0; track<NTRACKS; ++track) {
+    uint32_t fastest=MAX_DIVIDER;
+    for (int16_t clk=0; clk<NUM_CLOCKS; ++clk) if (rhythmclks[track][clk] && ((uint32_t)rhythm[clk].divider < fastest)) fastest=rhythm[clk].divider;
+    if (notes[track].gatems) expectedgate[track]=notes[track].gatems*1000;
+    else expectedgate[track]=fastest*PPQN_DIV*tick/100*notes[track].gate;
+  }
+}
+
+static int trackof(uint8_t channel) {
+  for (int track=0; track<NTRACKS; ++track) if (MIDIoutputchannel[track] == channel) return track;
+  return -1;
+}
+
+// the note on that a note's note off was sent for, if it was the same note again
+static bool retriggered(size_t i) {
+  for (size_t j=i+1; j<npairs; ++j) {
+    if (notepairs[j].on > notepairs[i].off+TOLERANCE_US) break;
+    if ((notepairs[j].channel == notepairs[i].channel) && (notepairs[j].note == notepairs[i].note) && (notepairs[j].on+TOLERANCE_US >= notepairs[i].off)) return true;
+  }
+  return false;
+}
+
+static uint32_t pooled(void) {
+  uint32_t n=0;
+  for (int16_t i=noteofffree; i >= 0; i=noteoffs[i].next) ++n;
+  return n;
+}
+
+static uint32_t sounding(void) {
+  uint32_t n=0;
+  for (int ch=0; ch<16; ++ch) for (int w=0; w<4; ++w) n+=__builtin_popcount(soundingnotes[ch][w]);
+  return n;
+}
+
+static void stop(void) {
+  controlstate=IDLE;
+}
+
+static void start(void) {
+  controlstate=RUNNING;
+}
+
+// what a MIDI stop does
+static void panic(void) {
+  controlstate=IDLE;
+  all_notes_off();
+}
+
+int main() {
+  uint64_t wallstart=wallns();
+  sim_boot();
+  sim_run(2000000);  // past the splash screen with the sequencer going
+
+  uint32_t total=0,retrigs=0,missing=0,wrong=0,longest=0,offwheel=0;
+  timestat error={};
+  printf("round  BPM  gates us                    note ons  retriggered  worst us off the gate\n");
+  for (int round=0; round<ROUNDS; ++round) {
+    randomround();
+    gates();
+    sim_run(SETTLE_US);
+    sim_midi_clear();
+    uint64_t start=sim_us();
+    sim_run(WINDOW_US);
+    pairnotes(SIM_USB);
+    uint32_t worst=0,n=0,r=0;
+    for (size_t i=0; i<npairs; ++i) {
+      int track=trackof(notepairs[i].channel);
+      if (track < 0) {
+        ++wrong;
+        continue;
+      }
+      uint32_t gate=expectedgate[track];
+      if (!notepairs[i].off) {
+        if (notepairs[i].on+gate+TOLERANCE_US < start+WINDOW_US) ++missing;  // should have ended inside the window
+        continue;
+      }
+      ++n;
+      uint32_t len=notepairs[i].off-notepairs[i].on;
+      if ((len+TOLERANCE_US < gate) && retriggered(i)) {
+        ++r;
+        continue;
+      }
+      uint32_t d=(len > gate) ? len-gate : gate-len;
+      error.add(d*1000ull);
+      if (d > worst) worst=d;
+      if (d > TOLERANCE_US) ++wrong;
+      if (gate > WHEEL_SLOTS << WHEEL_SHIFT) ++offwheel;
+      if (len > longest) longest=len;
+    }
+    printf("%5d  %3d  %7u %7u %7u  %9u  %11u  %u\n",round+1,bpm,(unsigned)expectedgate[0],(unsigned)expectedgate[1],(unsigned)expectedgate[2],
+      (unsigned)n,(unsigned)r,(unsigned)worst);
+    total+=n;
+    retrigs+=r;
+  }
+  printf("%u note ons: %u retriggered, %u longer than a turn of the wheel, %.1f us mean %.1f us max off their gate, %u wrong, %u note offs missing\n",
+    (unsigned)total,(unsigned)retrigs,(unsigned)offwheel,error.mean()/1e3,error.max/1e3,(unsigned)wrong,(unsigned)missing);
+  CHECK(total > 300);
+  CHECK(retrigs > 0);
+  CHECK(offwheel > 0);
+  CHECK(wrong == 0);
+  CHECK(missing == 0);
+
+  // stop and let the last gates run out
+  sim_midi_clear();
+  sim_call(0,stop);
+  sim_run(GATE_MAX_MS*1000+500000);
+  uint32_t unmatched=pairnotes(SIM_USB);
+  printf("stopped: %u note ons without a note off, %u still sounding, %u of %d note offs free\n",(unsigned)unmatched,(unsigned)sounding(),
+    (unsigned)pooled(),NOTEOFF_POOL);
+  CHECK(unmatched == 0);
+  CHECK(sounding() == 0);
+  CHECK(pooled() == NOTEOFF_POOL);
+
+  // long notes on all three tracks, then a MIDI stop
+  for (int16_t track=0; track<NTRACKS; ++track) notes[track].gatems=GATE_MAX_MS;
+  sim_call(0,start);
+  sim_run(1000000);
+  uint32_t before=sounding();
+  sim_midi_clear();
+  sim_call(1,panic);
+  uint32_t offs=0;
+  for (size_t i=0; i<simmidi[SIM_USB].count; ++i) offs+=(simmidi[SIM_USB].log[i].data[0] & 0xf0) == 0x80;
+  printf("MIDI stop with %u notes sounding: %u note offs sent, %u still sounding, %u of %d note offs free\n",(unsigned)before,(unsigned)offs,
+    (unsigned)sounding(),(unsigned)pooled(),NOTEOFF_POOL);
+  CHECK(before > NTRACKS);
+  CHECK(offs == before);
+  CHECK(sounding() == 0);
+  CHECK(pooled() == NOTEOFF_POOL);
+  return report_done(wallstart);
+}
@@ -0,0 +1,155 @@
+// PicoRhythmicon pattern switching under a running clock
+// three patterns with their own roots, dividers and clock routing are picked from core 0 at odd moments, the way the
+// Pattern menu item does it
+// - with Switch At set to Bar each one lands on the first tick of a bar, and within the bar after it was picked. with
+//   Cycle it lands within the slowest connected divider's cycle
+// - no note of the old pattern goes out after the switch and none of the new one before it
+// - every note on stays on the PPQN tick grid through the switches, and every note on has its note off once the
+//   sequencer is stopped
+
+#include "Twisty2_Rhythmicon.cpp"
+#include "report.h"
+#include "notepairs.h"
+
+#define POLL_US 200
+#define RANGE 12  // pattern notes are within an octave of its root
+
+static const uint8_t roots[]={60,36,84};
+static int16_t picked;
+
+static void pick(void) {
+  patternselect=picked;
+  queuepattern();
+}
+
+static void stop(void) {
+  controlstate=IDLE;
+}
+
+// a pattern with its own root, dividers and routing
+static void makepattern(struct pattern * pat, int16_t n) {
+  for (int16_t track=0; track<NTRACKS; ++track) {
+    for (int16_t step=0; step<SEQ_STEPS; ++step) pat->val[track][step]=((track+step*n) % 5)-2;
+    pat->root[track]=roots[n];
+    pat->scale[track]=0;
+    pat->stepmode[track]=FORWARD;
+  }
+  pat->clocks=0;
+  for (int16_t track=0; track<NTRACKS; ++track) pat->clocks|=1 << (track*NUM_CLOCKS+(track+n) % NUM_CLOCKS);
+  pat->clocks|=1 << ((n+1) % NUM_CLOCKS);  // track 1 on a second clock
+  for (int16_t clk=0; clk<NUM_CLOCKS; ++clk) {
+    pat->divider[clk]=1+(clk+n) % 3;
+    pat->eucsteps[clk]=8;
+    pat->euchits[clk]=3;
+    pat->eucrotate[clk]=0;
+  }
+  pat->euclid=0;
+}
+
+// which pattern a note belongs to, -1 for none
+static int patternof(uint8_t note) {
+  for (int n=0; n<3; ++n) if ((note >= roots[n]-RANGE) && (note <= roots[n]+RANGE)) return n;
+  return -1;
+}
+
+struct switchtime {
+  uint64_t picked,seen;  // us
+  int16_t from,to;
+};
+static switchtime switches[16];
+static int nswitches;
+
+// pick pattern n+1 and wait for core 1 to swap it in. returns false if it never did
+static bool switchto(int16_t n, uint64_t limitus) {
+  switchtime &s=switches[nswitches++];
+  s.from=patternselect-1;
+  s.to=n;
+  s.picked=sim_us();
+  picked=n+1;
+  sim_call(0,pick);
+  while (sim_us() < s.picked+limitus) {
+    sim_run(POLL_US);
+    if (!patternqueued && (notes[0].root == roots[n])) {
+      s.seen=sim_us();
+      return true;
+    }
+  }
+  return false;
+}
+
+int main() {
+  uint64_t wallstart=wallns();
+  sim_boot();
+  sim_run(2000000);  // past the splash screen with the sequencer going
+  for (int n=0; n<3; ++n) makepattern(&bank[n],n);
+  picked=1;
+  sim_call(0,pick);
+  sim_run(4000000);
+  CHECK(notes[0].root == roots[0]);
+  sim_midi_clear();
+  uint64_t start=sim_us();
+
+  uint32_t bartime=BAR_TICKS*tickperiod;
+  static const int16_t order[]={1,2,0,2,1};
+  uint32_t offbar=0,late=0;
+  for (size_t i=0; i<sizeof(order)/sizeof(order[0]); ++i) {
+    sim_run(333333+i*271000);  // somewhere in the bar
+    bool ok=switchto(order[i],2*bartime);
+    CHECK(ok);
+    switchtime &s=switches[nswitches-1];
+    offbar+=(bartick != 1);  // the swap ran on the bar's first tick, which has just been clocked
+    late+=(s.seen-s.picked > bartime+POLL_US);
+    printf("bar switch %d to %d: %.0f ms after it was picked, %u ticks into the bar\n",s.from+1,s.to+1,(s.seen-s.picked)/1e3,(unsigned)bartick);
+  }
+  CHECK(offbar == 0);
+  CHECK(late == 0);
+
+  switchpoint=SWITCH_CYCLE;
+  static const int16_t cycleorder[]={0,1,2};
+  for (size_t i=0; i<sizeof(cycleorder)/sizeof(cycleorder[0]); ++i) {
+    sim_run(123457+i*300000);
+    uint32_t longest=0;  // the slowest connected divider of the pattern playing
+    for (int16_t clk=0; clk<NUM_CLOCKS; ++clk) {
+      bool used=false;
+      for (int16_t track=0; track<NTRACKS; ++track) used|=rhythmclks[track][clk];
+      if (used && ((uint32_t)rhythm[clk].divider > longest)) longest=rhythm[clk].divider;
+    }
+    uint32_t cycletime=longest*PPQN_DIV*tickperiod;
+    bool ok=switchto(cycleorder[i],2*bartime);
+    CHECK(ok);
+    switchtime &s=switches[nswitches-1];
+    printf("cycle switch %d to %d: %.0f ms after it was picked, slowest cycle %.0f ms\n",s.from+1,s.to+1,(s.seen-s.picked)/1e3,cycletime/1e3);
+    CHECK(s.seen-s.picked <= cycletime+POLL_US);
+  }
+  sim_run(1000000);
+  sim_call(0,stop);
+  sim_run(1000000);
+
+  // notes against the switches and the tick grid
+  uint32_t unmatched=pairnotes(SIM_USB);
+  uint32_t wrong=0,offgrid=0;
+  uint32_t grid=notepairs[0].on % tickperiod;
+  timestat phase={};
+  for (size_t i=0; i<npairs; ++i) {
+    uint64_t t=notepairs[i].on;
+    int16_t playing=switches[0].from;
+    for (int s=0; s<nswitches; ++s) if (t+tickperiod > switches[s].seen) playing=switches[s].to;  // swapped on the tick before it was seen
+    bool between=false;  // the tick the swap happened on could be either side of it
+    for (int s=0; s<nswitches; ++s) between|=(t+tickperiod > switches[s].seen) && (t <= switches[s].seen);
+    if (!between && (patternof(notepairs[i].note) != playing)) ++wrong;
+    uint32_t off=(t+tickperiod-grid) % tickperiod;
+    if (off > tickperiod/2) off=tickperiod-off;  // a little before the first note's phase
+    phase.add(off*1000ull);
+    offgrid+=(off > 100);
+  }
+  uint32_t sounding=0;
+  for (int ch=0; ch<16; ++ch) for (int w=0; w<4; ++w) sounding+=__builtin_popcount(soundingnotes[ch][w]);
+  printf("%u note ons in %.1f s over %d switches: %u from the wrong pattern, %.1f us mean %.1f us max off the tick grid, %u note ons without a note off, %u still sounding\n",
+    (unsigned)npairs,(sim_us()-start)/1e6,nswitches,(unsigned)wrong,phase.mean()/1e3,phase.max/1e3,(unsigned)unmatched,(unsigned)sounding);
+  CHECK(npairs > 100);
+  CHECK(wrong == 0);
+  CHECK(offgrid == 0);
+  CHECK(unmatched == 0);
+  CHECK(sounding == 0);
+  return report_done(wallstart);
+}
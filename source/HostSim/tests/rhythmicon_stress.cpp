@@ -0,0 +1,81 @@
+// PicoRhythmicon under load - all 16 encoders spun at once while the sequencer plays
+// each round spins every encoder faster and reports
+// - quadrature states the scan missed (the harness sees every state go by) and the invalid transitions the firmware counted
+// - loop() and loop1() time per pass, on this machine and in virtual time
+// - how late the note ons were against the PPQN grid, when the firmware sent them and when they left each port
+
+#include "Twisty2_Rhythmicon.cpp"
+#include "report.h"
+
+#define ROUND_US 2000000
+
+// one detent every this many us on every encoder - 4 quadrature states each
+static const uint32_t detentus[]={4000,2000,1000,800};
+
+static uint32_t gridus;   // tick grid phase in micros()
+
+// us past the last PPQN tick
+static uint32_t offgrid(uint64_t ns) {
+  return ((uint32_t)(ns/1000)-gridus) % tickperiod;
+}
+
+// the earliest any note on went out relative to the tick period is taken as the grid
+static void findgrid(void) {
+  simport &p=simmidi[SIM_USB];
+  uint32_t best=UINT32_MAX;
+  gridus=0;
+  for (size_t i=0; i<p.count; ++i) {
+    if ((p.log[i].data[0] & 0xf0) != 0x90) continue;
+    uint32_t phase=offgrid(p.log[i].queued);
+    if (phase < best) best=phase;
+  }
+  gridus=best;
+}
+
+static void report_notes(void) {
+  for (int port=0; port<SIM_PORTS; ++port) {
+    simport &p=simmidi[port];
+    timestat sent={},wire={};
+    for (size_t i=0; i<p.count; ++i) {
+      if ((p.log[i].data[0] & 0xf0) != 0x90) continue;
+      sent.add(offgrid(p.log[i].queued)*1000ull);
+      wire.add(offgrid(p.log[i].ns)*1000ull);
+    }
+    printf("  %s: %llu note ons, sent %.0f us mean %.0f us max after the tick, out %.0f us mean %.0f us max\n",portnames[port],
+      (unsigned long long)sent.n,sent.mean()/1e3,sent.max/1e3,wire.mean()/1e3,wire.max/1e3);
+    CHECK(sent.n > 0);
+  }
+}
+
+int main() {
+  uint64_t wallstart=wallns();
+  sim_boot();
+  sim_run(ROUND_US);  // past the splash screen with the sequencer going
+  findgrid();
+  printf("idle: tick %u us\n",(unsigned)tickperiod);
+  report_notes();
+  report_loops();
+
+  for (size_t r=0; r<sizeof(detentus)/sizeof(detentus[0]); ++r) {
+    sim_midi_clear();
+    sim_loopstats_reset();
+    uint32_t lost=sim_lost();
+    uint16_t errors=encodererrors();
+    uint64_t irqs=simirq.count;
+    simirq.latemax=0;
+    uint32_t count=ROUND_US/detentus[r];
+    for (int e=0; e<NUMENCODERS; ++e) {
+      int dir=(e >= NTRACKS*NUM_CLOCKS) ? 1 : ((e+r) & 1) ? -1 : 1;  // dividers down to 1 for the most notes, the rest both ways
+      sim_spin(e,dir,detentus[r],count);
+    }
+    sim_run(ROUND_US+100000);
+    uint32_t states=NUMENCODERS*count*4;
+    printf("all encoders, a detent per %u us (a state per %u us):\n",(unsigned)detentus[r],(unsigned)detentus[r]/4);
+    printf("  %u states, %u missed by the scan, %u invalid transitions counted, %llu scans, irq %.1f us late max\n",(unsigned)states,
+      (unsigned)(sim_lost()-lost),(unsigned)(uint16_t)(encodererrors()-errors),(unsigned long long)(simirq.count-irqs),simirq.latemax/1e3);
+    report_notes();
+    report_loops();
+    if (detentus[r]/4 > TIMER_MICROS_FAST) CHECK(sim_lost() == lost);  // slower than the fast scan - nothing should be missed
+  }
+  return report_done(wallstart);
+}
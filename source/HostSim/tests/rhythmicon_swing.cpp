@@ -0,0 +1,108 @@
+// PicoRhythmicon swing and track delay - note on times against where the swung grid says they should be
+// track 1 and track 2 both play 16ths off the first clock divider. track 2 is delayed by a fixed number of us
+// - at each tempo and swing setting every second 16th goes out late by (swing-50)/50 of a 16th, the others on the beat,
+//   to within a loop1() pass - the timing comes from the timestamped output queue, not the PPQN grid
+// - track 2's notes go out exactly its delay after track 1's
+// - the gate is the same on and off the beat - note offs are timed from when the note on was due. a swung note cut short
+//   by the same note starting again on the next beat is left out
+
+#include "Twisty2_Rhythmicon.cpp"
+#include "report.h"
+#include "notepairs.h"
+
+#define TOLERANCE_US 20
+#define DELAY_US 7000
+#define SETTLE_US ((AUTOSAVE_QUIET_MS+2*AUTOSAVE_CHECK_MS+PARK_TIMEOUT_MS)*1000+500000)
+
+static const int16_t tempos[]={60,120,180};
+static const int16_t swings[]={50,58,66,75};
+
+struct swingresult {
+  uint32_t notes,delayed;
+  uint32_t worst;      // us from the swung position
+  uint32_t delayworst; // us from track 1 + the delay
+  uint32_t gateworst;  // us from the gate
+};
+
+// track 1's note ons against a grid of pulse us starting at t0, every second one late by swung us
+static uint32_t fitgrid(const uint64_t * on, uint32_t n, uint32_t pulse, uint32_t swung, bool oddlate) {
+  uint32_t worst=0;
+  for (uint32_t i=0; i<n; ++i) {
+    uint64_t want=on[0]+(uint64_t)i*pulse+(((i & 1) == oddlate) ? swung : 0)-(oddlate ? 0 : swung);
+    uint32_t d=(on[i] > want) ? on[i]-want : want-on[i];
+    if (d > worst) worst=d;
+  }
+  return worst;
+}
+
+// true if a note's note off was sent for the same note starting again
+static bool retriggered(size_t i) {
+  for (size_t j=i+1; j<npairs; ++j) {
+    if (notepairs[j].on > notepairs[i].off) break;
+    if ((notepairs[j].channel == notepairs[i].channel) && (notepairs[j].note == notepairs[i].note)) return true;
+  }
+  return false;
+}
+
+static swingresult measure(int16_t tempo, int16_t amount) {
+  bpm=tempo;
+  swing[0]=amount;
+  sim_run(SETTLE_US);  // the new tempo and swing settle in and the autosave of them is written - notes due during a save go out late
+  sim_midi_clear();
+  sim_run(3000000);
+  pairnotes(SIM_USB);
+  static uint64_t on1[MAX_PAIRS],on2[MAX_PAIRS];
+  uint32_t n1=0,n2=0;
+  swingresult r={};
+  uint32_t gate=gatelength(0,rhythm[0].divider);
+  for (size_t i=0; i<npairs; ++i) {
+    if (!notepairs[i].off) continue;  // cut off by the end of the window
+    if (notepairs[i].channel == MIDIoutputchannel[0]) on1[n1++]=notepairs[i].on;
+    if (notepairs[i].channel == MIDIoutputchannel[1]) on2[n2++]=notepairs[i].on;
+    if (retriggered(i)) continue;  // the same note again before its gate was up
+    uint32_t len=notepairs[i].off-notepairs[i].on;
+    uint32_t d=(len > gate) ? len-gate : gate-len;
+    if (d > r.gateworst) r.gateworst=d;
+  }
+  uint32_t pulse=PPQN_DIV*tickperiod;
+  uint32_t swung=(uint32_t)(amount-SWING_STRAIGHT)*pulse/SWING_STRAIGHT;
+  // the first note could be on or off the beat - take whichever fits
+  r.worst=min(fitgrid(on1,n1,pulse,swung,true),fitgrid(on1,n1,pulse,swung,false));
+  r.notes=n1;
+  for (uint32_t i=0; i<n2; ++i) {  // each track 2 note against the track 1 note it follows
+    uint32_t j=0;
+    while ((j+1 < n1) && (on1[j+1] <= on2[i])) ++j;
+    if (!n1 || (on1[j] > on2[i])) continue;
+    ++r.delayed;
+    uint32_t d=on2[i]-on1[j];
+    d=(d > DELAY_US) ? d-DELAY_US : DELAY_US-d;
+    if (d > r.delayworst) r.delayworst=d;
+  }
+  return r;
+}
+
+int main() {
+  uint64_t wallstart=wallns();
+  sim_boot();
+  sim_run(2000000);  // past the splash screen with the sequencer going
+  memset(rhythmclks,0,sizeof(bool)*NTRACKS*NUM_CLOCKS);
+  rhythmclks[0][0]=rhythmclks[1][0]=1;
+  rhythm[0].divider=1;
+  notes[1].root=72;  // so track 2's notes are told apart by channel and by ear
+  trackdelay[1]=DELAY_US;
+
+  printf("16ths on divider 1, worst us from the swung grid / track 2 from track 1 + %d us / gate:\n",DELAY_US);
+  for (size_t t=0; t<sizeof(tempos)/sizeof(tempos[0]); ++t) {
+    for (size_t s=0; s<sizeof(swings)/sizeof(swings[0]); ++s) {
+      swingresult r=measure(tempos[t],swings[s]);
+      printf("  %3d BPM swing %2d%%: %3u notes %3u us   %3u delayed %3u us   gate %3u us\n",tempos[t],swings[s],(unsigned)r.notes,
+        (unsigned)r.worst,(unsigned)r.delayed,(unsigned)r.delayworst,(unsigned)r.gateworst);
+      CHECK(r.notes >= (uint32_t)tempos[t]*4*3/60-2);  // 4 16ths a beat for 3 s
+      CHECK(r.worst <= TOLERANCE_US);
+      CHECK(r.delayed >= r.notes-2);
+      CHECK(r.delayworst <= TOLERANCE_US);
+      CHECK(r.gateworst <= TOLERANCE_US);
+    }
+  }
+  return report_done(wallstart);
+}
@@ -0,0 +1,31 @@
+// PicoRhythmicon USB MIDI packing - the notes a clock tick fires go out together in one USB transfer
+// and the firmware's packet and transfer counters agree with what the simulator's endpoint saw
+
+#include "Twisty2_Rhythmicon.cpp"
+#include "report.h"
+
+int main() {
+  uint64_t wallstart=wallns();
+  sim_boot();
+  sim_run(2000000);  // past the splash screen with the sequencer going
+  for (int16_t t=0; t<NTRACKS; ++t) rhythmclks[t][0]=1;  // every track on the first clock - three notes each tick
+  rhythm[0].divider=1;
+  sim_run(100000);
+  sim_midi_clear();
+  uint32_t packets=usbpackets,transfers=usbtransfers;
+  sim_run(2000000);
+  simport &usb=simmidi[SIM_USB];
+  uint32_t split=0;  // messages sent in the same loop1() pass that left in different transfers
+  for (size_t i=1; i<usb.count; ++i) {
+    if ((usb.log[i].queued-usb.log[i-1].queued < 100000) && (usb.log[i].ns != usb.log[i-1].ns)) ++split;
+  }
+  printf("%llu USB messages in %llu transfers, %.1f a transfer. firmware counted %u packets in %u transfers. %u split from their tick\n",
+    (unsigned long long)usb.count,(unsigned long long)usb.transfers,(double)usb.count/usb.transfers,(unsigned)(usbpackets-packets),
+    (unsigned)(usbtransfers-transfers),(unsigned)split);
+  CHECK(usb.count > 0);
+  CHECK(usb.transfers < usb.count);
+  CHECK(split == 0);
+  CHECK(usbpackets-packets == usb.count);
+  CHECK(usbtransfers-transfers == usb.transfers);
+  return report_done(wallstart);
+}
@@ -0,0 +1,249 @@
+// automation recorder - the event coding, what gestures cost in bytes, and what a loop wrap sends
+// - varints and zigzag deltas read back as written, and are as short as they should be. a varint cut off by the end of
+//   the buffer reads as nothing
+// - gesture traces recorded through auto_live() decode back to exactly the moves that went in, a tick's moves on one
+//   control merged to the last. reports the bytes per event of each
+// - at the end of the loop only the controls the recording moves are put back - one the DAW changed is left alone and
+//   nothing is sent for it
+// - a recording saved with a slot loads back the same, and knows again which controls it moves
+// - damaged files are refused and leave nothing to play - a start value over 127, events that take a value past either
+//   end or name a control that isn't there, data cut off mid event, and loops of no length or not whole bars
+
+#include "Twisty2.cpp"
+#include "report.h"
+
+#define SLOT 16
+
+static uint32_t varinterrors,zigzagerrors;
+
+static uint16_t varintlen(uint32_t v) {
+  uint16_t n=1;
+  while (v >= 0x80) {
+    v >>= 7;
+    ++n;
+  }
+  return n;
+}
+
+static void coding(void) {
+  uint8_t buf[8];
+  uint32_t v=0,back;
+  for (int n=0; n<200000; ++n) {
+    if (n < 40) v=(n & 1) ? (1u << (n/2))-1 : 1u << (n/2);  // either side of each 7 bit boundary
+    else v=v*1103515245+12345;
+    uint16_t len=auto_putvarint(buf,v);
+    varinterrors+=(len != varintlen(v));
+    varinterrors+=(auto_getvarint(buf,0,len,&back) != len) || (back != v);
+    varinterrors+=(len > 1) && (auto_getvarint(buf,0,len-1,&back) != 0);
+  }
+  for (int32_t d=-70000; d<=70000; ++d) zigzagerrors+=(auto_unzigzag(auto_zigzag(d)) != d) || (varintlen(auto_zigzag(d)) > varintlen(2*abs(d)));
+  zigzagerrors+=(auto_zigzag(-1) != 1) || (auto_zigzag(1) != 2) || (auto_zigzag(-64) != 127);
+}
+
+// what a player does with the encoders, a tick at a time
+struct move {
+  uint32_t tick;
+  uint8_t ctl,value;
+};
+static move expected[AUTO_BUFSIZE];
+static uint32_t nexpected;
+static void (*tracefn)(uint32_t tick);
+static uint32_t traceticks;
+
+static void touch(uint32_t tick, int16_t ctl, int16_t value) {
+  value=constrain(value,0,127);
+  controls[ctl/NUMENCODERS].encoder[ctl%NUMENCODERS].value=value;
+  auto_live(ctl/NUMENCODERS,ctl%NUMENCODERS);
+  if (nexpected && (expected[nexpected-1].tick == tick) && (expected[nexpected-1].ctl == ctl)) expected[nexpected-1].value=value;
+  else expected[nexpected++]={tick,(uint8_t)ctl,(uint8_t)value};
+}
+
+// a filter swept up over four bars, a detent every few ticks
+static void sweep(uint32_t tick) {
+  if (!(tick % 3)) touch(tick,0,tick/3);
+}
+
+// fast twists - a burst of detents inside each tick, back and forth every beat
+static void twist(uint32_t tick) {
+  int16_t ctl=1;
+  int16_t dir=((tick/AUTO_PPQN) & 1) ? -1 : 1;
+  for (int i=0; i<4; ++i) touch(tick,ctl,controls[0].encoder[ctl].value+dir);
+}
+
+// four controls wiggled together every tick
+static void dense(uint32_t tick) {
+  for (int16_t c=4; c<8; ++c) touch(tick,c,64+((int32_t)((tick*(c-2)) % 40))-20);
+}
+
+// a control on another page jumped now and then
+static void jumps(uint32_t tick) {
+  if (!(tick % AUTO_PPQN)) touch(tick,NUMENCODERS+3+(tick/AUTO_PPQN)%5,(tick*37) & 0x7f);
+}
+
+static uint32_t decodeerrors,events;
+static uint16_t bytes;
+
+static void recordtrace(void) {
+  auto_record();
+  nexpected=0;
+  for (uint32_t t=0; t<traceticks; ++t) {
+    tracefn(t);
+    auto_tick();
+  }
+  auto_play();
+  autostate=AUTO_OFF;
+  bytes=autoused;
+
+  // read it back event by event
+  uint32_t tick;
+  uint8_t ctl,value;
+  uint16_t len;
+  memcpy(autovalue,autostart,sizeof(autovalue));
+  autopos=0;
+  autolasttick=0;
+  events=0;
+  while (auto_peekevent(&tick,&ctl,&value,&len)) {
+    if ((events >= nexpected) || (expected[events].tick != tick) || (expected[events].ctl != ctl) || (expected[events].value != value)) ++decodeerrors;
+    autopos+=len;
+    autolasttick=tick;
+    autovalue[ctl]=value;
+    ++events;
+  }
+  decodeerrors+=(events != nexpected) || (autopos != autoused);
+}
+
+static void runtrace(const char * name, void (*fn)(uint32_t), uint32_t ticks) {
+  tracefn=fn;
+  traceticks=ticks;
+  uint32_t errors=decodeerrors;
+  sim_call(0,recordtrace);
+  printf("  %-28s %5u events in %5u bytes, %.2f bytes an event, %u decoded wrong\n",name,(unsigned)events,(unsigned)bytes,
+    events ? (double)bytes/events : 0.0,(unsigned)(decodeerrors-errors));
+}
+
+static void allpaths(uint32_t tick) {
+  sweep(tick);
+  twist(tick);
+  dense(tick);
+  jumps(tick);
+}
+
+// the loop the wrap test plays - encoder 1 and 2 on page 1 moved over one bar
+static void shortloop(uint32_t tick) {
+  if (tick < AUTO_BAR/2) touch(tick,0,64+tick/2);
+  else touch(tick,1,tick & 0x7f);
+}
+
+static bool iscc(const simmsg &m, int e) {
+  return (m.data[0] == (0xb0 | (controls[0].encoder[e].channel-1))) && (m.data[1] == controls[0].encoder[e].ccnumber);
+}
+
+static uint32_t startrecorded[(AUTO_CONTROLS+31)/32];
+static uint8_t startbuf[AUTO_BUFSIZE];
+static uint16_t startused;
+static uint32_t startlength;
+static bool saved,loaded;
+
+static void save(void) {
+  memcpy(startrecorded,autorecorded,sizeof(autorecorded));
+  memcpy(startbuf,autobuf,autoused);
+  startused=autoused;
+  startlength=autolength;
+  saved=saveautomation(SLOT);
+  memset(autobuf,0,sizeof(autobuf));
+  memset(autorecorded,0,sizeof(autorecorded));
+  loaded=loadautomation(SLOT);
+}
+
+static void load(void) { loaded=loadautomation(SLOT); }
+
+static uint8_t goodfile[AUTO_HEADER+AUTO_BUFSIZE],badfile[AUTO_HEADER+AUTO_BUFSIZE+8];
+
+// the saved file with a change. at is where it changes, add is bytes put on the end of the events
+static void damage(const char * name, long len, int at, uint8_t value, const uint8_t * add, int addlen) {
+  memcpy(badfile,goodfile,len);
+  if (at >= 0) badfile[at]=value;
+  memcpy(&badfile[len],add,addlen);
+  uint16_t used=(goodfile[8] | (goodfile[9] << 8))+addlen;
+  badfile[8]=used;
+  badfile[9]=used >> 8;
+  CHECK(sim_fs_put("slot16.auto",badfile,len+addlen));
+  sim_serial_clear();
+  sim_call(0,load);
+  bool refused=!loaded && (autoused == 0) && (autostate == AUTO_OFF) && strstr(simserial,"damaged");
+  printf("  %-28s %s\n",name,refused ? "refused" : "loaded");
+  CHECK(refused);
+}
+
+int main() {
+  uint64_t wallstart=wallns();
+  sim_boot();
+  sim_run(3000000);  // past the power on message
+
+  sim_call(0,coding);
+  printf("varints and zigzag deltas: %u and %u wrong\n",(unsigned)varinterrors,(unsigned)zigzagerrors);
+  CHECK(varinterrors == 0);
+  CHECK(zigzagerrors == 0);
+
+  printf("gesture traces:\n");
+  runtrace("sweep over 4 bars",sweep,4*AUTO_BAR);
+  CHECK(bytes <= events*3);
+  runtrace("fast twists for 4 bars",twist,4*AUTO_BAR);
+  CHECK(events == 4*AUTO_BAR);  // 4 detents a tick merged into one event
+  runtrace("4 controls every tick 8 bars",dense,8*AUTO_BAR);
+  runtrace("jumps on page 2 for 8 bars",jumps,8*AUTO_BAR);
+  runtrace("all of them for 8 bars",allpaths,8*AUTO_BAR);
+  CHECK(decodeerrors == 0);
+  CHECK(bytes < events*7/2);  // 3 bytes an event and a little
+
+  // a one bar loop plays on the internal clock while the DAW moves a control it doesn't touch
+  for (int e=0; e<NUMENCODERS; ++e) controls[0].encoder[e].value=64;
+  runtrace("one bar on 2 controls",shortloop,AUTO_BAR);
+  CHECK(decodeerrors == 0);
+  sim_call(0,auto_play);
+  CHECK(autostate == AUTO_PLAY);
+  sim_run(500000);
+  sim_midiin3(SIM_USB,sim_us()+1000,0xb0 | (controls[0].encoder[5].channel-1),controls[0].encoder[5].ccnumber,100);
+  sim_run(100000);
+  CHECK(controls[0].encoder[5].value == 100);
+  sim_midi_clear();
+  sim_run(4000000);  // two wraps
+  uint32_t played[NUMENCODERS]={};
+  for (size_t i=0; i<simmidi[SIM_USB].count; ++i) for (int e=0; e<NUMENCODERS; ++e) played[e]+=iscc(simmidi[SIM_USB].log[i],e);
+  uint32_t others=0;
+  for (int e=2; e<NUMENCODERS; ++e) others+=played[e];
+  printf("two loop wraps: %u and %u CCs on the recorded controls, %u on the others. the one the DAW set is at %d\n",
+    (unsigned)played[0],(unsigned)played[1],(unsigned)others,controls[0].encoder[5].value);
+  CHECK(played[0] > 0);
+  CHECK(played[1] > 0);
+  CHECK(others == 0);
+  CHECK(controls[0].encoder[5].value == 100);
+
+  sim_call(0,save);
+  sim_call(0,auto_stop);
+  printf("saved %u bytes to slot %d and loaded them back: %s\n",(unsigned)startused,SLOT,
+    (saved && loaded && (autoused == startused) && !memcmp(autobuf,startbuf,startused)) ? "same" : "different");
+  CHECK(saved);
+  CHECK(loaded);
+  CHECK(autoused == startused);
+  CHECK(autolength == startlength);
+  CHECK(!memcmp(autobuf,startbuf,startused));
+  CHECK(!memcmp(autorecorded,startrecorded,sizeof(autorecorded)));
+
+  printf("damaged recordings:\n");
+  long len=sim_fs_get("slot16.auto",goodfile,sizeof(goodfile));
+  CHECK(len == AUTO_HEADER+startused);
+  static const uint8_t up[]={0,0,0x90,0x03},down[]={0,0,0x8f,0x03},nocontrol[]={0,AUTO_CONTROLS,0};  // +200, -200
+  damage("start value 200",len,AUTO_HEADER-AUTO_CONTROLS+1,200,0,0);
+  damage("event up by 200",len,-1,0,up,sizeof(up));
+  damage("event down by 200",len,-1,0,down,sizeof(down));
+  damage("control past the last",len,-1,0,nocontrol,sizeof(nocontrol));
+  damage("cut off mid event",len,-1,0,up,sizeof(up)-1);
+  damage("loop of no length",len,4,0,0,0);  // the loop is one bar, so its length is all in the first byte
+  damage("loop a tick past a bar",len,4,AUTO_BAR+1,0,0);
+  CHECK(sim_fs_put("slot16.auto",goodfile,len));
+  sim_call(0,load);
+  CHECK(loaded);
+  CHECK(autoused == startused);
+  return report_done(wallstart);
+}
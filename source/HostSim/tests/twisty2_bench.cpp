@@ -0,0 +1,63 @@
+// the bench.h microbenchmarks run on the host
+// times are the simulated RP2040 time, so they only count what the simulator charges for - the mux settling delays, I2C
+// display frames, NeoPixel updates and flash writes. what this checks is that the benchmarks leave the unit as they found it:
+// the scan benchmark doesn't touch the scan alarm, loadconfig doesn't change the live settings and the hot paths don't
+// allocate
+
+#define BENCHMARK
+#include "Twisty2.cpp"
+#include "report.h"
+#include "bench.h"
+
+static uint32_t alarmbefore,alarmafter;
+
+static void scanonly(void) {
+  irq_set_enabled(ALARM_IRQ,false);
+  alarmbefore=timer_hw->alarm[ALARM_NUM].value;
+  for (int i=0; i<1000; ++i) scan_encoders();
+  alarmafter=timer_hw->alarm[ALARM_NUM].value;
+  irq_set_enabled(ALARM_IRQ,true);
+}
+
+// the state loadconfig replaces, with values a save and load wouldn't give back
+static void oddstate(void) {
+  morphpos[0]=77;
+  controls[0].encoder[3].value=33;
+  controls[1].encswitch[2].colorindex=4;
+  macros[2][1].channel=9;
+  custompoints[2]=11;
+}
+
+int main() {
+  uint64_t wallstart=wallns();
+  sim_boot();  // setup() runs them once
+  printf("at power on:\n");
+  static const char * const allocok[]={"saveconfig","loadconfig"};
+  CHECK(benchresults(allocok,2) > 0);
+
+  sim_call(0,scanonly);
+  CHECK(alarmafter == alarmbefore);
+
+  sim_call(0,oddstate);
+  static struct controllerpage controlsbefore[CONTROLLER_PAGES];
+  static int16_t morphbefore[CONTROLLER_PAGES];
+  static struct macrotarget macrosbefore[NUM_MACROS][MACRO_TARGETS];
+  static int16_t pointsbefore[CUSTOM_POINTS];
+  memcpy(controlsbefore,controls,sizeof(controls));
+  memcpy(morphbefore,morphpos,sizeof(morphpos));
+  memcpy(macrosbefore,macros,sizeof(macros));
+  memcpy(pointsbefore,custompoints,sizeof(custompoints));
+  sim_serial_clear();
+  uint64_t irqs=simirq.count;
+  sim_call(0,runbenchmarks);
+  printf("again with odd settings:\n");
+  benchresults(allocok,2);
+  CHECK(!memcmp(controlsbefore,controls,sizeof(controls)));
+  CHECK(!memcmp(morphbefore,morphpos,sizeof(morphpos)));
+  CHECK(!memcmp(macrosbefore,macros,sizeof(macros)));
+  CHECK(!memcmp(pointsbefore,custompoints,sizeof(custompoints)));
+  CHECK(!LittleFS.exists("slot99.json"));
+  sim_run(10000);
+  CHECK(simirq.count > irqs);  // the scan carries on afterwards
+  return report_done(wallstart);
+}
@@ -0,0 +1,116 @@
+// Twisty2 boot - how soon after power on the unit takes MIDI in and sends MIDI out, and what the session puts back
+// the filesystem holds a slot with some controls on narrow and reversed ranges, and a session snapshot played on that slot
+// whose values are outside them, the way a snapshot from an older setup or a damaged file could be
+// - reports the time each boot phase ended, to the first MIDI message taken in and to the first CC sent
+// - a CC waiting on USB and DIN at power on is taken in within BOOT_MIDI_MS and lands on its control
+// - the encoder turned as soon as the unit is up takes the power on message down straight away
+// - the session brings the slot back and each control's value is kept to that control's range, either way round, as the
+//   page and the thru routes are
+
+#include "Twisty2.cpp"
+#include "report.h"
+
+#define SLOT 3
+#define BOOT_MIDI_MS 100  // MIDI in and out working this soon after power on
+#define NARROW 0      // page 1 encoder 1 on 10 to 20
+#define REVERSED 1    // page 1 encoder 2 on 100 down to 30
+#define INRANGE 2     // page 1 encoder 3 left as it was played
+#define LISTENER 5    // page 1 encoder 6 takes the CC waiting at power on
+#define TURNED 8      // turned as soon as the unit is up
+#define TOGGLE_SW 4   // page 1 switch 5 on 0 and 64
+
+static int16_t expected[CONTROLLER_PAGES][NUMENCODERS];
+static int16_t expectedsw[CONTROLLER_PAGES][NUMENCODERS];
+
+// the slot and the snapshot, written straight into the filesystem before power on
+static void prepare(void) {
+  initmacros();
+  initcontrols();
+  initscenes();
+  controls[0].encoder[NARROW].minvalue=10;
+  controls[0].encoder[NARROW].maxvalue=20;
+  controls[0].encoder[REVERSED].minvalue=100;
+  controls[0].encoder[REVERSED].maxvalue=30;
+  controls[0].encswitch[TOGGLE_SW].minvalue=0;
+  controls[0].encswitch[TOGGLE_SW].maxvalue=64;
+  uint64_t erase=simflasherase,prog=simflashprog;
+  simflasherase=simflashprog=0;  // nothing has powered on yet
+  CHECK(saveconfig(SLOT));
+  simflasherase=erase;
+  simflashprog=prog;
+
+  struct sessiondata s;
+  memset(&s,0,sizeof(s));
+  memcpy(s.id,"TWS1",4);
+  s.slot=SLOT;
+  s.page=CONTROLLER_PAGES+3;
+  for (int16_t p=0; p<CONTROLLER_PAGES; ++p) {
+    for (int16_t i=0; i<NUMENCODERS; ++i) {
+      s.encoder[p][i]=(i & 1) ? -40 : 300;  // all out of range but the ones set below
+      s.encswitch[p][i]=(i & 1) ? -1 : 1000;
+      expected[p][i]=(i & 1) ? 0 : 127;
+      expectedsw[p][i]=(i & 1) ? 0 : 127;
+    }
+  }
+  s.encoder[0][NARROW]=127;
+  expected[0][NARROW]=20;
+  s.encoder[0][REVERSED]=5;
+  expected[0][REVERSED]=30;
+  s.encoder[0][INRANGE]=77;
+  expected[0][INRANGE]=77;
+  s.encswitch[0][TOGGLE_SW]=127;
+  expectedsw[0][TOGGLE_SW]=64;
+  for (int16_t port=0; port<NUM_PORTS; ++port) s.thruroute[port]=(port & 1) ? -2 : 9;
+  CHECK(sim_fs_put(SESSION_FILE,(const uint8_t *)&s,sizeof(s)));
+}
+
+int main() {
+  uint64_t wallstart=wallns();
+  prepare();
+  uint8_t channel=controls[0].encoder[LISTENER].channel;
+  uint8_t cc=controls[0].encoder[LISTENER].ccnumber;
+  sim_midiin3(SIM_USB,0,0xb0 | (channel-1),cc,99);  // waiting when the unit powers on
+  sim_midiin3(SIM_DIN,0,0xb0 | (channel-1),cc,99);
+
+  sim_boot();
+  uint64_t up=sim_us();
+  static uint8_t splash[sizeof(simpanel)];
+  memcpy(splash,simpanel,sizeof(splash));
+  sim_spin(TURNED,1,2000,5);
+  sim_run(BOOT_MIDI_MS*1000);
+  uint64_t firstout=0;
+  if (simmidi[SIM_USB].count) firstout=simmidi[SIM_USB].log[0].ns/1000;
+
+  printf("setup() returned at %.1f ms\n",up/1e3);
+  for (int16_t i=0; i<NUM_BOOT_PHASES; ++i) {
+    if (boottime[i]) printf("  %-14s %8.3f ms\n",bootnames[i],boottime[i]/1e3);
+    else printf("  %-14s        -\n",bootnames[i]);
+  }
+  printf("  %-14s %8.3f ms\n","first CC out",firstout/1e3);
+  CHECK(boottime[BOOT_MIDI] && (boottime[BOOT_MIDI] < BOOT_MIDI_MS*1000));
+  CHECK(boottime[BOOT_FIRSTMIDI] && (boottime[BOOT_FIRSTMIDI] < BOOT_MIDI_MS*1000));
+  CHECK(firstout && (firstout < up+BOOT_MIDI_MS*1000));
+  CHECK(controls[0].encoder[LISTENER].value == 99);
+  CHECK(memcmp(simpanel,splash,sizeof(splash)));  // the turn took the power on message down
+
+  // the session against the slot's ranges
+  uint32_t wrong=0;
+  for (int16_t p=0; p<CONTROLLER_PAGES; ++p) {
+    for (int16_t i=0; i<NUMENCODERS; ++i) {
+      if ((p == 0) && ((i == LISTENER) || (i == TURNED))) continue;  // moved since
+      wrong+=(controls[p].encoder[i].value != expected[p][i]);
+      wrong+=(controls[p].encswitch[i].value != expectedsw[p][i]);
+    }
+  }
+  uint32_t badroutes=0;
+  for (int16_t port=0; port<NUM_PORTS; ++port) badroutes+=!cfg_inrange(thruroute[port],0,3);
+  printf("session on slot %d: encoder 1 %d (10 to 20), encoder 2 %d (100 to 30), encoder 3 %d, switch 5 %d (0 to 64), page %d, %u values outside their range, %u thru routes out of range\n",
+    sessionslot,controls[0].encoder[NARROW].value,controls[0].encoder[REVERSED].value,controls[0].encoder[INRANGE].value,
+    controls[0].encswitch[TOGGLE_SW].value,page+1,(unsigned)wrong,(unsigned)badroutes);
+  CHECK(sessionslot == SLOT);
+  CHECK(controls[0].encoder[NARROW].minvalue == 10);
+  CHECK(wrong == 0);
+  CHECK(page == CONTROLLER_PAGES-1);
+  CHECK(badroutes == 0);
+  return report_done(wallstart);
+}
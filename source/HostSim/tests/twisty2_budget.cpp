@@ -0,0 +1,105 @@
+// DIN output budget - a hand-turned control, a morph sweep and a thru flood all going out on DIN at once, each wanting
+// more than its share: the morph moves all 16 CCs every 10 ms and 3000 bytes/s of notes come in on USB for DIN
+// - the firmware never hands the UART more than the port's budget in any second, so nothing backs up behind the wire
+// - morph and thru share what the control leaves - both get a fair part of it, and the control is never held back
+// - when it's all over, the last CC on DIN for each encoder on both pages is the value it ended on
+// the sweep is on page 2, moved with morphto() rather than the menu encoder, whose display redraws would slow the loop
+// down so far that the loop and not the budget sets the pace. the encoder is turned by hand on page 1
+
+#include "Twisty2.cpp"
+#include "report.h"
+
+#define SECONDS 4
+#define WINDOW_US 1000000
+#define STEP_US 10000
+#define HANDSPUN 3  // the encoder turned by hand
+#define MORPHPAGE 1
+
+static int16_t target;
+static void morphstep(void) { morphto(MORPHPAGE,target); }
+
+// bytes the firmware sent to DIN in the busiest WINDOW_US between from and to
+static uint32_t busiest(uint64_t from, uint64_t to) {
+  simport &din=simmidi[SIM_DIN];
+  uint32_t most=0,bytes=0;
+  size_t first=0;
+  for (size_t i=0; i<din.count; ++i) {
+    if ((din.log[i].queued < from) || (din.log[i].queued >= to)) continue;
+    bytes+=din.log[i].len;
+    while (din.log[first].queued+WINDOW_US*1000ull <= din.log[i].queued) {
+      if (din.log[first].queued >= from) bytes-=din.log[first].len;
+      ++first;
+    }
+    if (bytes > most) most=bytes;
+  }
+  return most;
+}
+
+static bool iscc(const simmsg &m, int p, int e) {
+  return (m.data[0] == (0xb0 | (controls[p].encoder[e].channel-1))) && (m.data[1] == controls[p].encoder[e].ccnumber);
+}
+
+int main() {
+  uint64_t wallstart=wallns();
+  sim_boot();
+  sim_run(3000000);  // past the power on message
+  CHECK(UI_state == UI_SEND_MIDI);
+
+  // page 2 scenes from all 0 to all 127, and USB passed on to DIN only
+  for (int i=0; i<NUMENCODERS; ++i) {
+    scenevalues[MORPHPAGE][SCENE_A][i]=0;
+    scenevalues[MORPHPAGE][SCENE_B][i]=127;
+  }
+  morphpos[MORPHPAGE]=0;
+  thruroute[PORT_USB]=1;  // DIN
+  sim_midi_clear();
+
+  uint64_t start=sim_us();
+  for (int i=0; i<SECONDS*1000; ++i) sim_midiin3(SIM_USB,start+1000+i*1000,0x9f,i & 0x7f,100);
+  sim_spin(HANDSPUN,1,100000,SECONDS*10);  // 10 detents a second
+  for (int s=0; s<SECONDS*1000000/STEP_US; ++s) {
+    target=(s & 32) ? MORPH_MAX-(s & 31)*8 : (s & 31)*8;  // end to end in 320 ms
+    sim_call(0,morphstep);
+    sim_run(STEP_US);
+  }
+  uint64_t end=sim_us();
+  target=MORPH_MAX;
+  sim_call(0,morphstep);
+  sim_run(2000000);
+
+  simport &din=simmidi[SIM_DIN];
+  uint32_t notes=0,morphccs=0,handccs=0;
+  timestat wire={};
+  for (size_t i=0; i<din.count; ++i) {
+    simmsg &m=din.log[i];
+    if (m.queued/1000 >= end) continue;
+    wire.add(m.ns-m.queued);
+    if (m.data[0] == 0x9f) ++notes;
+    handccs+=iscc(m,0,HANDSPUN);
+    for (int e=0; e<NUMENCODERS; ++e) morphccs+=iscc(m,MORPHPAGE,e);
+  }
+  uint32_t most=busiest(start*1000,end*1000);
+  printf("%d s on DIN: %u bytes in the busiest second (budget %u, wire 3125). %u morph CCs, %u thru notes, %u CCs from the encoder turned by hand\n",
+    SECONDS,(unsigned)most,(unsigned)portbudget[PORT_DIN],(unsigned)morphccs,(unsigned)notes,(unsigned)handccs);
+  printf("  sent to out on the wire %.0f us mean %.0f us max. %u thru messages dropped\n",wire.mean()/1e3,wire.max/1e3,(unsigned)thrudrops);
+  CHECK(most <= portbudget[PORT_DIN]+portburst[PORT_DIN]);
+  CHECK(most <= 3125);
+  CHECK(most > portbudget[PORT_DIN]*9/10);  // the budget is what held them back
+  CHECK(wire.max < 20000000);  // a UART FIFO and a message, not a backlog
+  CHECK(morphccs > notes/3);  // a fair share each
+  CHECK(notes > morphccs/3);
+  CHECK(handccs >= SECONDS*10*3/4);  // acceleration may merge a few detents, but nothing waits for the budget
+
+  // the last value sent for the encoders that moved is the one they ended on
+  uint32_t stale=0;
+  for (int e=0; e<=NUMENCODERS; ++e) {
+    int p=(e < NUMENCODERS) ? MORPHPAGE : 0;
+    int i=(e < NUMENCODERS) ? e : HANDSPUN;
+    int16_t last=-1;
+    for (size_t n=0; n<din.count; ++n) if (iscc(din.log[n],p,i)) last=din.log[n].data[2];
+    stale+=(last != controls[p].encoder[i].value);
+  }
+  printf("after the sweep: %u of %d encoders last sent something other than their value\n",(unsigned)stale,NUMENCODERS+1);
+  CHECK(stale == 0);
+  return report_done(wallstart);
+}
@@ -0,0 +1,3 @@
+// the (channel, CC) lookup on the 4 pages the unit has - see cclookup.h
+
+#include "cclookup.h"
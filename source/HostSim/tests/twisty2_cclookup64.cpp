@@ -0,0 +1,4 @@
+// the (channel, CC) lookup with 64 pages of controls - see cclookup.h
+
+#define CONTROLLER_PAGES 64
+#include "cclookup.h"
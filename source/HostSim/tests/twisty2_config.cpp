@@ -0,0 +1,423 @@
+// Twisty2 slot files - what loadconfig() takes, what it turns away, and the memory it needs
+// - a slot saved, loaded and saved again comes out byte for byte the same, and the settings it loads are the ones saved
+// - malformed files - cut short anywhere, bad tokens, unclosed strings, nesting deeper than CFG_DEPTH, bad numbers and
+//   trailing garbage - are all refused and leave the live settings as they were
+// - a scene stored for some of a page's encoders and not others is refused. a stored scene value outside its encoder's
+//   range - the range edited after the scene was stored - loads kept to the range, either way round
+// - every field in cfgfields[] is refused one past either end of its range, where the parser reads it, and taken at
+//   either end. the same for the custom curve points
+// - oversized files load the same settings - white space, long strings and arrays under keys it doesn't know, more pages,
+//   controls, macros and curve points than there are, and numbers too long to fit
+// - reports CONFIG_LOAD_BYTES, the stack a load used and that no load allocated
+
+#include "Twisty2.cpp"
+#include "report.h"
+
+#define SLOT 3
+#define TRIAL 8        // slot the test files go in
+#define TRUNC_STEP 37  // a cut every this many bytes, plus each of the last few
+#define MAX_FILE 600000
+
+// the settings a slot holds
+struct settings {
+  struct controllerpage controls[CONTROLLER_PAGES];
+  int16_t scenevalues[CONTROLLER_PAGES][2][NUMENCODERS];
+  struct macrotarget macros[NUM_MACROS][MACRO_TARGETS];
+  int16_t custompoints[CUSTOM_POINTS];
+};
+
+static void getsettings(settings &s) {
+  memcpy(s.controls,controls,sizeof(controls));
+  memcpy(s.scenevalues,scenevalues,sizeof(scenevalues));
+  memcpy(s.macros,macros,sizeof(macros));
+  memcpy(s.custompoints,custompoints,sizeof(custompoints));
+}
+
+static void putsettings(const settings &s) {
+  memcpy(controls,s.controls,sizeof(controls));
+  memcpy(scenevalues,s.scenevalues,sizeof(scenevalues));
+  memcpy(macros,s.macros,sizeof(macros));
+  memcpy(custompoints,s.custompoints,sizeof(custompoints));
+}
+
+static bool same(const settings &a, const settings &b) {
+  return !memcmp(&a,&b,sizeof(settings));
+}
+
+static settings saved,other,now;
+static char original[65536],text[MAX_FILE],resaved[65536];
+static long origlen;
+
+static void save(void) { saveconfig(SLOT); }
+static int16_t loadresult;
+static void load(void) {
+  sim_stackmark();
+  loadresult=loadconfig(TRIAL);
+}
+
+// one file through loadconfig() with the live settings at other. returns what it did
+static size_t maxstack;
+static uint32_t mallocs;
+static uint64_t maxloadns;
+static int16_t tryload(const char * data, size_t len) {
+  CHECK(sim_fs_put("slot8.json",(const uint8_t *)data,len));
+  putsettings(other);
+  uint32_t m=simmallocs;
+  uint64_t t=wallns();
+  sim_call(0,load);
+  maxloadns=max(maxloadns,wallns()-t);
+  mallocs+=simmallocs-m;
+  maxstack=max(maxstack,sim_stackused(0));
+  getsettings(now);
+  return loadresult;
+}
+
+// a refused file leaves everything as it was
+static bool refused(const char * data, size_t len) {
+  return !tryload(data,len) && same(now,other);
+}
+
+// text is the original with s put in place of n bytes at at
+static size_t splice(size_t at, size_t n, const char * s) {
+  size_t sl=strlen(s);
+  memcpy(text,original,at);
+  memcpy(text+at,s,sl);
+  memcpy(text+at+sl,original+at+n,origlen-at-n);
+  return origlen-n+sl;
+}
+
+static size_t find(const char * s) {
+  const char * p=strstr(original,s);
+  CHECK(p);
+  return p ? p-original : 0;
+}
+
+// text is the original with the numbers after key, from its first'th time in the file for count times, replaced by with
+static size_t replacekey(const char * key, const char * with, int first, int count) {
+  size_t len=0,from=0,n=strlen(key),wl=strlen(with);
+  for (int i=0; i<first+count; ++i) {
+    const char * p=strstr(original+from,key);
+    CHECK(p);
+    if (!p) break;
+    size_t at=p-original,end=at+n;
+    if (i < first) {  // not this one - kept as it is
+      memcpy(text+len,original+from,end-from);
+      len+=end-from;
+      from=end;
+      continue;
+    }
+    while ((original[end] == '-') || ((original[end] >= '0') && (original[end] <= '9'))) ++end;
+    memcpy(text+len,original+from,at-from);
+    len+=at-from;
+    memcpy(text+len,with,wl);
+    len+=wl;
+    from=end;
+  }
+  memcpy(text+len,original+from,origlen-from);
+  return len+origlen-from;
+}
+
+// ----------------------------------------------------------------------------- malformed
+
+// each put just inside the top object, in place of the first n bytes after the found text, or on the end
+struct broken {
+  const char * name;
+  const char * after;  // 0 for the end of the file
+  size_t n;
+  const char * with;
+};
+
+static const broken brokens[]={
+  {"empty file","",0,0},
+  {"no colon",",\n\"page\" ",1,""},
+  {"equals for a colon","\"Version\" ",1,"="},
+  {"missing comma","{ \"Version\"",0,"\"x\":1 \"y\":2,"},
+  {"trailing comma in an object","{ \"Version\"",0,"\"x\":1,}"},
+  {"trailing comma in an array","{ \"Version\"",0,"\"x\":[1,2,],"},
+  {"bracket for a brace","{ \"Version\"",0,"\"x\":[1},"},
+  {"unquoted key","{ \"Version\"",0,"x:1,"},
+  {"single quotes","{ \"Version\"",0,"'x':1,"},
+  {"unclosed string","{ \"Version\"",0,"\"x\":\"abc"},
+  {"newline in a string","{ \"Version\"",0,"\"x\":\"a\nb\","},
+  {"tru","{ \"Version\"",0,"\"x\":tru,"},
+  {"nul","{ \"Version\"",0,"\"x\":nul,"},
+  {"True","{ \"Version\"",0,"\"x\":True,"},
+  {"minus on its own","{ \"Version\"",0,"\"x\":-,"},
+  {"plus sign","{ \"Version\"",0,"\"x\":+1,"},
+  {"leading point","{ \"Version\"",0,"\"x\":.5,"},
+  {"nothing after the point","{ \"Version\"",0,"\"x\":1.,"},
+  {"nothing after the e","{ \"Version\"",0,"\"x\":1e,"},
+  {"hex","{ \"Version\"",0,"\"x\":0x10,"},
+  {"nested one past CFG_DEPTH","{ \"Version\"",0,"\"x\":[[[[[[[[1]]]]]]]],"},
+  {"an object nested past it","{ \"Version\"",0,"\"x\":[[[[[[[{\"y\":1}]]]]]]],"},
+  {"a second top value",0,0,"{}"},
+  {"trailing garbage",0,0,"x"},
+  {"a stray brace on the end",0,0,"}"},
+};
+
+// ----------------------------------------------------------------------------- ranges
+
+// every key cfgfields[] has, and the place in the file the first one is
+struct fieldkey {
+  const char * name;
+  const char * replaces;  // legacy names don't appear in a saved file - put in place of this one
+};
+
+static const fieldkey fieldkeys[]={
+  {"EncoderType",0},{"EncoderChannel",0},{"EncoderCCNumber",0},{"EncoderMinValue",0},{"EncoderMaxValue",0},
+  {"EncoderValue",0},{"EncoderColorIndex",0},{"EncoderLabelIndex",0},{"EncoderRed",0},{"EncoderGreen",0},
+  {"EncoderBlue",0},{"EncoderMacro",0},{"EncoderPorts",0},{"SceneA",0},{"SceneB",0},{"SwitchMode",0},{"SwitchType",0},
+  {"SwitchChannel",0},{"SwitchCC",0},{"SwitchCCNumber","SwitchCC"},{"SwitchMinValue",0},{"SwitchMaxValue",0},
+  {"SwitchValue",0},{"SwitchColorIndex",0},{"SwitchLabelIndex",0},{"SwitchPorts",0},{"Channel",0},{"CCNumber",0},
+  {"MinValue",0},{"MaxValue",0},{"Curve",0},
+};
+#define FIELDKEYS (sizeof(fieldkeys)/sizeof(fieldkeys[0]))
+
+// the first field's value in the file set to v. every key is first met on page 1 control 1 or macro 1 target 1
+// a scene is set for all of page 1, since one stored for some encoders and not others is refused
+static size_t withvalue(const fieldkey &k, int16_t v) {
+  char key[40],with[60];
+  snprintf(key,sizeof(key),"\"%s\":",k.replaces ? k.replaces : k.name);
+  snprintf(with,sizeof(with),"\"%s\":%d",k.name,v);
+  return replacekey(key,with,0,strncmp(k.name,"Scene",5) ? 1 : NUMENCODERS);
+}
+
+// where that field landed in cfgarena
+static int16_t loaded(const cfgfield * f) {
+  if (f->target == CFG_ENCODER) return ((int16_t *)&cfgarena.controls[0].encoder[0])[f->index];
+  if (f->target == CFG_SWITCH) return ((int16_t *)&cfgarena.controls[0].encswitch[0])[f->index];
+  if (f->target == CFG_SCENE) return cfgarena.scenevalues[0][f->index][0];
+  return ((int16_t *)&cfgarena.macros[0][0])[f->index];
+}
+
+// refused for range while it was being read, and said so
+static bool rejected(const char * data, size_t len) {
+  size_t serial=simseriallen;
+  bool r=refused(data,len) && cfgarena.rejected;
+  return r && strstr(simserial+serial,"out of range") && !strstr(simserial+serial,"not valid JSON");
+}
+
+// ----------------------------------------------------------------------------- oversized
+
+static size_t append(size_t len, const char * s) {
+  size_t n=strlen(s);
+  if (len+n < MAX_FILE) memcpy(text+len,s,n);
+  return len+n;
+}
+
+// the original with what's made by fill put just inside the top object
+static size_t inside(void (*fill)(size_t *)) {
+  size_t at=find("{ \"Version\"")+1;
+  memcpy(text,original,at);
+  size_t len=at;
+  fill(&len);
+  memcpy(text+len,original+at,origlen-at);
+  return len+origlen-at;
+}
+
+static void whitespace(size_t * len) {
+  for (int i=0; i<100000; ++i) *len=append(*len,(i % 61) ? " " : "\r\n\t");
+}
+
+static void longstring(size_t * len) {
+  *len=append(*len,"\"Notes\":\"");
+  for (int i=0; i<200000; ++i) *len=append(*len,(i % 100) ? "a" : "\\\"");
+  *len=append(*len,"\",");
+}
+
+static void longarray(size_t * len) {
+  *len=append(*len,"\"Extra\":[");
+  for (int i=0; i<30000; ++i) {
+    char n[16];
+    snprintf(n,sizeof(n),i ? ",%d" : "%d",i % 1000-500);
+    *len=append(*len,n);
+  }
+  *len=append(*len,"],\"Nested\":[[[[[[{\"EncoderChannel\":99}]]]]]],");  // as deep as it goes, and nowhere a value lands
+}
+
+static void longnumbers(size_t * len) {
+  *len=append(*len,"\"Big\":");
+  for (int i=0; i<20000; ++i) *len=append(*len,"9");
+  *len=append(*len,",\"Small\":-");
+  for (int i=0; i<20000; ++i) *len=append(*len,"9");
+  *len=append(*len,".5e-400,\"Exact\":1.0000000000000000000001e0,");
+}
+
+// more controls, pages, targets, macros and curve points than there are - each put on the end of its array
+static size_t extra(void) {
+  static const struct {
+    const char * before;  // the array's closing bracket and what follows it, found from the start of the file
+    size_t skip;          // bytes of it to keep ahead of what's put in
+    const char * with;
+    int n;
+  } ends[]={
+    {"}\n    ]\n  }\n],\n\"macro\"",1,",\n    { \"EncoderChannel\":99,\"SwitchPorts\":99 }",50},
+    {"\n],\n\"macro\"",0,",\n  { \"control\" : [ { \"EncoderChannel\":99,\"SceneA\":300 } ] }",50},
+    {"}\n    ]\n  }\n],\n\"CustomCurve\"",1,",\n    { \"Curve\":99 }",50},
+    {"\n],\n\"CustomCurve\"",0,",\n  { \"target\" : [ { \"Channel\":99 } ] }",50},
+    {"]\n}\n",0,",999",1000},
+  };
+  size_t len=0,from=0;
+  for (size_t i=0; i<sizeof(ends)/sizeof(ends[0]); ++i) {
+    size_t at=find(ends[i].before)+ends[i].skip;
+    CHECK(at >= from);
+    memcpy(text+len,original+from,at-from);
+    len+=at-from;
+    for (int n=0; n<ends[i].n; ++n) len=append(len,ends[i].with);
+    from=at;
+  }
+  memcpy(text+len,original+from,origlen-from);
+  return len+origlen-from;
+}
+
+int main() {
+  uint64_t wallstart=wallns();
+  sim_boot();
+  sim_run(3000000);  // past the power on message
+
+  // a slot with something in every kind of setting, loaded once so the palette colors are filled in as a load does
+  controls[0].encoder[0].ccnumber=99;
+  controls[1].encoder[5].labelindex=NUM_LABELS-1;
+  controls[2].encswitch[3].ports=1 << PORT_DIN;
+  for (int16_t i=0; i<NUMENCODERS; ++i) scenevalues[1][SCENE_B][i]=40+i;
+  controls[1].encoder[3].minvalue=100;  // reversed, scene B's 43 inside it
+  controls[1].encoder[3].maxvalue=30;
+  macros[2][1].channel=5;
+  macros[2][1].curve=NUM_CURVES-1;
+  custompoints[2]=100;
+  sim_call(0,save);
+  origlen=sim_fs_get("slot3.json",(uint8_t *)original,sizeof(original)-1);
+  CHECK(origlen > 0);
+  getsettings(other);
+  CHECK(tryload(original,origlen));
+  saved=now;
+  for (int16_t p=0; p<CONTROLLER_PAGES; ++p) other.controls[p].encoder[0].ccnumber=p+1;  // what a broken load mustn't touch
+  other.custompoints[1]=1;
+
+  // round trip
+  putsettings(saved);
+  sim_call(0,save);
+  long relen=sim_fs_get("slot3.json",(uint8_t *)resaved,sizeof(resaved));
+  printf("slot %d: %ld bytes, saved again %ld bytes, %s\n",SLOT,origlen,relen,
+    ((relen == origlen) && !memcmp(resaved,original,origlen)) ? "the same" : "different");
+  CHECK((relen == origlen) && !memcmp(resaved,original,origlen));
+  CHECK(tryload(original,origlen) && same(now,saved));
+  CHECK(now.controls[2].encswitch[3].ports == 1 << PORT_DIN);
+  CHECK(now.macros[2][1].curve == NUM_CURVES-1);
+  CHECK(now.custompoints[2] == 100);
+
+  // malformed
+  uint32_t cuts=0,cutstaken=0;
+  for (long n=0; n<origlen; n+=(n < origlen-8) ? TRUNC_STEP : 1) {
+    ++cuts;
+    cutstaken+=!refused(original,n);
+  }
+  printf("%u files cut short, %u taken\n",(unsigned)cuts,(unsigned)cutstaken);
+  CHECK(cutstaken == 0);
+  printf("malformed files:\n");
+  for (size_t b=0; b<sizeof(brokens)/sizeof(brokens[0]); ++b) {
+    const broken &k=brokens[b];
+    size_t len;
+    if (!k.with) len=0;
+    else if (!k.after) {
+      memcpy(text,original,origlen);
+      len=origlen+strlen(k.with);
+      memcpy(text+origlen,k.with,strlen(k.with));
+    }
+    else len=splice(find(k.after)+strlen(k.after),k.n,k.with);
+    bool r=refused(text,len);
+    printf("  %-28s %s\n",k.name,r ? "refused" : "TAKEN");
+    CHECK(r);
+  }
+
+  // scenes stored for some of a page and not the rest, and ranges that have moved since a scene was stored
+  printf("scenes:\n");
+  struct {
+    const char * name;
+    const char * key;
+    const char * with;
+    int at;           // the key's at'th time in the file
+    int16_t page,encoder,loads;  // what the scene value loads as. -2 for refused
+  } scenes[]={
+    {"page 2 scene B missing one","\"SceneB\":","\"SceneB\":-1",NUMENCODERS+3,1,3,-2},
+    {"page 1 scene A just one","\"SceneA\":","\"SceneA\":64",2,0,2,-2},
+    {"range moved below it","\"EncoderMaxValue\":","\"EncoderMaxValue\":20",NUMENCODERS+4,1,4,20},
+    {"reversed range moved above","\"EncoderMaxValue\":","\"EncoderMaxValue\":60",NUMENCODERS+3,1,3,60},
+  };
+  for (size_t i=0; i<sizeof(scenes)/sizeof(scenes[0]); ++i) {
+    size_t len=replacekey(scenes[i].key,scenes[i].with,scenes[i].at,1);
+    size_t serial=simseriallen;
+    bool ok;
+    if (scenes[i].loads == -2) {
+      ok=refused(text,len) && strstr(simserial+serial,"scene");
+      printf("  %-28s %s\n",scenes[i].name,ok ? "refused" : "TAKEN");
+    }
+    else {
+      ok=tryload(text,len);
+      int16_t v=now.scenevalues[scenes[i].page][SCENE_B][scenes[i].encoder];
+      printf("  %-28s %s as %d\n",scenes[i].name,ok ? "loaded" : "REFUSED",v);
+      ok=ok && (v == scenes[i].loads);
+    }
+    CHECK(ok);
+  }
+
+  // each field one past its range, and at each end
+  uint32_t covered=0;
+  for (size_t i=0; i<CFG_FIELDS; ++i) {
+    for (size_t j=0; j<FIELDKEYS; ++j) covered+=(cfgfields[i].hash == cfghash(fieldkeys[j].name));
+  }
+  CHECK(covered == CFG_FIELDS);
+  CHECK(FIELDKEYS == CFG_FIELDS);
+  printf("each field refused one past its range and taken at each end:\n");
+  uint32_t wrong=0;
+  for (size_t j=0; j<FIELDKEYS; ++j) {
+    const cfgfield * f=cfgfields;
+    while ((f < cfgfields+CFG_FIELDS) && (f->hash != cfghash(fieldkeys[j].name))) ++f;
+    if (f == cfgfields+CFG_FIELDS) continue;
+    bool below=rejected(text,withvalue(fieldkeys[j],f->min-1));
+    bool above=rejected(text,withvalue(fieldkeys[j],f->max+1));
+    bool lo=tryload(text,withvalue(fieldkeys[j],f->min)) && (loaded(f) == f->min);
+    bool hi=tryload(text,withvalue(fieldkeys[j],f->max)) && (loaded(f) == f->max);
+    printf("  %-18s %4d to %4d: %s %s, %s %s\n",fieldkeys[j].name,f->min,f->max,below ? "refused" : "TAKEN",above ? "refused" : "TAKEN",
+      lo ? "taken" : "REFUSED",hi ? "taken" : "REFUSED");
+    wrong+=!below+!above+!lo+!hi;
+  }
+  size_t at=find("\"CustomCurve\" : [")+strlen("\"CustomCurve\" : [");
+  size_t n=strcspn(original+at,",");
+  bool below=rejected(text,splice(at,n,"-1"));
+  bool above=rejected(text,splice(at,n,"128"));
+  bool lo=tryload(text,splice(at,n,"0")) && (cfgarena.custompoints[0] == 0);
+  bool hi=tryload(text,splice(at,n,"127")) && (cfgarena.custompoints[0] == 127);
+  printf("  %-18s %4d to %4d: %s %s, %s %s\n","CustomCurve",0,127,below ? "refused" : "TAKEN",above ? "refused" : "TAKEN",
+    lo ? "taken" : "REFUSED",hi ? "taken" : "REFUSED");
+  wrong+=!below+!above+!lo+!hi;
+  CHECK(wrong == 0);
+
+  // oversized
+  printf("oversized files:\n");
+  struct {
+    const char * name;
+    size_t len;
+  } big[]={
+    {"white space",inside(whitespace)},
+    {"a long string",0},
+    {"a long array",0},
+    {"long numbers",0},
+    {"past every array's end",0},
+  };
+  for (size_t b=0; b<sizeof(big)/sizeof(big[0]); ++b) {
+    if (b == 1) big[b].len=inside(longstring);
+    else if (b == 2) big[b].len=inside(longarray);
+    else if (b == 3) big[b].len=inside(longnumbers);
+    else if (b == 4) big[b].len=extra();
+    CHECK(big[b].len < MAX_FILE);
+    bool ok=tryload(text,big[b].len) && same(now,saved);
+    printf("  %-24s %7u bytes %s\n",big[b].name,(unsigned)big[b].len,ok ? "loaded the same settings" : "NOT LOADED");
+    CHECK(ok);
+  }
+
+  printf("a load uses %u bytes of static RAM (CONFIG_LOAD_BYTES), at most %u bytes of stack and made %u allocations. longest load %.1f ms host time\n",
+    (unsigned)CONFIG_LOAD_BYTES,(unsigned)maxstack,(unsigned)mallocs,maxloadns/1e6);
+  CHECK(mallocs == 0);
+  return report_done(wallstart);
+}
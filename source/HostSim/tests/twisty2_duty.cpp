@@ -0,0 +1,8 @@
+// Twisty 2 active duty cycle for idle, light and heavy use - see duty.h
+
+#include "Twisty2.cpp"
+#include "duty.h"
+
+int main() {
+  return dutymain(true);
+}
@@ -0,0 +1,144 @@
+// LED colours - the ledscale[] LUT and cached page frames against the formula showencoderLED() used before them
+// - every palette colour at every value 0-127 comes out on the LED exactly as the old divide and multiply gave
+// - values changed on pages that aren't shown, by the encoders and by incoming CCs, are right when the page is flipped to,
+//   in the encoder and the switch view
+// - reports host time for one LED update and a page flip both ways
+
+#include "Twisty2.cpp"
+#include "report.h"
+
+#define CALLS 100000
+
+// showencoderLED() and showswitchLED() colours before the LUT
+static uint32_t oldencodercolor(int16_t p, int16_t i) {
+  int32_t color=colorpalette[controls[p].encoder[i].colorindex];
+  color=color/31;
+  color=color*brightness_table[(controls[p].encoder[i].value>>2 & 0x1f)];
+  return color;
+}
+
+static uint32_t oldswitchcolor(int16_t p, int16_t i) {
+  return (controls[p].encswitch[i].value == controls[p].encswitch[i].maxvalue) ? LED_WHITE : LED_BLACK;
+}
+
+static void oldshowencoderLED(int16_t p, int16_t i) {
+  LEDS.setPixelColor(i,oldencodercolor(p,i));
+}
+
+static void oldshowencoderLEDs(int16_t p) {
+  for (int16_t i=0; i<NUMPIXELS; ++i) oldshowencoderLED(p,i);
+}
+
+static uint32_t lutmismatches,lutcases;
+static timestat lutns,oldns,flipns,oldflipns;
+
+static void palette(void) {
+  controllerencoder saved=controls[0].encoder[0];
+  for (int16_t c=0; c<8; ++c) {
+    controls[0].encoder[0].colorindex=c;
+    setpalettecolor(&controls[0].encoder[0]);
+    for (int16_t v=0; v<128; ++v) {
+      controls[0].encoder[0].value=v;
+      showencoderLED(0,0);
+      ++lutcases;
+      if (LEDS.getPixelColor(0) != oldencodercolor(0,0)) {
+        if (!lutmismatches) printf("  colour %d value %d: LUT %06x, was %06x\n",c,v,(unsigned)LEDS.getPixelColor(0),(unsigned)oldencodercolor(0,0));
+        ++lutmismatches;
+      }
+    }
+  }
+  controls[0].encoder[0]=saved;
+  showencoderLED(0,0);
+
+  // one LED update and a whole page, host time per call
+  volatile int16_t i=3;
+  uint64_t t0=wallns();
+  for (int n=0; n<CALLS; ++n) showencoderLED(0,i);
+  uint64_t t1=wallns();
+  for (int n=0; n<CALLS; ++n) oldshowencoderLED(0,i);
+  uint64_t t2=wallns();
+  for (int n=0; n<CALLS/16; ++n) showencoderLEDs(0);
+  uint64_t t3=wallns();
+  for (int n=0; n<CALLS/16; ++n) oldshowencoderLEDs(0);
+  uint64_t t4=wallns();
+  lutns.add((t1-t0)/CALLS);
+  oldns.add((t2-t1)/CALLS);
+  flipns.add((t3-t2)*16/CALLS);
+  oldflipns.add((t4-t3)*16/CALLS);
+}
+
+// the LEDs as last shown against the old formula for the page and view on show
+static uint32_t ledmismatches(void) {
+  uint32_t n=0;
+  for (int16_t i=0; i<NUMPIXELS; ++i) {
+    uint32_t want=displaySwitchLEDs ? oldswitchcolor(page,i) : oldencodercolor(page,i);
+    n+=(simleds[i] != want);
+  }
+  return n;
+}
+
+static void doubleclick(int e) {
+  for (int i=0; i<2; ++i) {
+    sim_button(e,true);
+    sim_run(30000);
+    sim_button(e,false);
+    sim_run(100000);
+  }
+  sim_run(600000);
+}
+
+int main() {
+  uint64_t wallstart=wallns();
+  sim_boot();
+  sim_run(3000000);  // past the power on message
+  CHECK(UI_state == UI_SEND_MIDI);
+
+  sim_call(0,palette);
+  printf("8 palette colours at 128 values: %u LED colours differ from the old formula\n",(unsigned)lutmismatches);
+  printf("host ns: one LED LUT %.0f, old formula %.0f. page of 16 frame copy %.0f, old formula %.0f\n",lutns.mean(),oldns.mean(),
+    flipns.mean(),oldflipns.mean());
+  CHECK(lutcases == 8*128);
+  CHECK(lutmismatches == 0);
+  CHECK(flipns.mean() < oldflipns.mean());
+
+  // values move on page 0 from the encoders and on every page from the DAW, then flip through the pages both views
+  for (int e=0; e<NUMENCODERS; ++e) sim_spin(e,(e & 1) ? -1 : 1,3000,e*3);
+  uint64_t at=sim_us()+1000;
+  for (int16_t p=1; p<CONTROLLER_PAGES; ++p) {
+    for (int16_t i=0; i<NUMENCODERS; i+=p) {
+      sim_midiin3(SIM_USB,at,0xb0 | (controls[p].encoder[i].channel-1),controls[p].encoder[i].ccnumber,(i*9+p*17) & 0x7f);
+      sim_midiin3(SIM_USB,at,0xb0 | (controls[p].encswitch[i].channel-1),controls[p].encswitch[i].ccnumber,controls[p].encswitch[i].maxvalue);
+      at+=1000;
+    }
+  }
+  sim_run(ECHO_HOLDOFF_MS*1000+500000);
+  uint32_t moved=0,on=0;
+  for (int16_t p=0; p<CONTROLLER_PAGES; ++p) {
+    for (int16_t i=0; i<NUMENCODERS; ++i) {
+      moved+=(controls[p].encoder[i].value != 64);
+      on+=(controls[p].encswitch[i].value == controls[p].encswitch[i].maxvalue);
+    }
+  }
+  printf("%u encoder values moved, %u switches on\n",(unsigned)moved,(unsigned)on);
+  CHECK(moved > NUMENCODERS);
+  CHECK(on > 0);
+  uint32_t bad=ledmismatches();
+  printf("page 1 after encoder moves: %u LEDs wrong\n",(unsigned)bad);
+  CHECK(bad == 0);
+  for (int16_t p=1; p<CONTROLLER_PAGES; ++p) {
+    sim_turn(SIM_LMENU,1);
+    sim_run(200000);
+    bad=ledmismatches();
+    printf("flipped to page %d: %u LEDs wrong", page+1,(unsigned)bad);
+    CHECK(page == p);
+    CHECK(bad == 0);
+    doubleclick(SIM_LMENU);
+    CHECK(displaySwitchLEDs);
+    bad=ledmismatches();
+    printf(", switch view %u wrong\n",(unsigned)bad);
+    CHECK(bad == 0);
+    doubleclick(SIM_LMENU);
+    CHECK(!displaySwitchLEDs);
+  }
+  return report_done(wallstart);
+}
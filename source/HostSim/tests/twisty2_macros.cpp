@@ -0,0 +1,172 @@
+// macro controls - the curve tables, the fan-out from an encoder and from a morph, and what a fan-out costs
+// - every curve table is within one Q15 step of the formula it was built from, runs from its start to its end and
+//   only goes one way, and the custom curve goes through its breakpoints
+// - macrovalue() lands exactly on each target's min and max at the ends of the encoder's range, either way round
+// - turning a Macro encoder sends each active target and not the encoder's own CC, all of a step in one USB transfer
+// - morphing a page with a Macro encoder on it sends the macro's targets too, whole, on every port
+// - reports host time for all 8 targets of all 16 macros, worked out and sent
+
+#include "Twisty2.cpp"
+#include "report.h"
+
+#define CALLS 20000
+#define MACROENC 5
+
+static double reference(int16_t curve, int16_t i) {
+  double x=i/127.0;
+  switch (curve) {
+    case CURVE_LINEAR: return x;
+    case CURVE_LOG: return log10(1.0+9.0*x);
+    case CURVE_EXP: return (pow(10.0,x)-1.0)/9.0;
+    case CURVE_INVERT: return 1.0-x;
+    case CURVE_SCURVE: return x*x*(3.0-2.0*x);
+    default: return 0;
+  }
+}
+
+static uint32_t tableerrors,endserrors,customerrors;
+
+static void curves(void) {
+  for (int16_t c=0; c<CURVE_CUSTOM; ++c) {
+    for (int16_t i=0; i<128; ++i) {
+      double want=reference(c,i)*CURVE_ONE;
+      if (fabs(curvetable[c][i]-want) > 1.0) {
+        if (!tableerrors) printf("  curve %d at %d: %u, formula %.1f\n",c,i,(unsigned)curvetable[c][i],want);
+        ++tableerrors;
+      }
+      if (i && ((c == CURVE_INVERT) ? (curvetable[c][i] > curvetable[c][i-1]) : (curvetable[c][i] < curvetable[c][i-1]))) ++tableerrors;
+    }
+  }
+  for (int16_t i=0; i<CUSTOM_POINTS; ++i) {
+    int16_t x=(i == CUSTOM_POINTS-1) ? 127 : i*32;
+    struct macrotarget t={1,0,0,127,CURVE_CUSTOM};
+    customerrors+=(macrovalue(&t,x) != custompoints[i]);
+  }
+
+  // every curve and a spread of ranges, the right way round and reversed
+  static const int16_t ranges[][2]={{0,127},{127,0},{10,20},{100,37},{64,64},{0,1}};
+  for (int16_t c=0; c<NUM_CURVES; ++c) {
+    for (size_t r=0; r<sizeof(ranges)/sizeof(ranges[0]); ++r) {
+      struct macrotarget t={1,0,ranges[r][0],ranges[r][1],c};
+      bool inverted=(c == CURVE_INVERT);
+      endserrors+=(macrovalue(&t,0) != (inverted ? t.maxvalue : t.minvalue));
+      endserrors+=(macrovalue(&t,127) != (inverted ? t.minvalue : t.maxvalue));
+    }
+  }
+}
+
+static uint64_t fanns,sendns;
+static volatile int16_t sink;
+
+static void fanout(void) {
+  irq_set_enabled(ALARM_IRQ,false);
+  uint64_t t0=wallns();
+  for (int n=0; n<CALLS/16; ++n) for (int m=0; m<NUM_MACROS; ++m) for (int t=0; t<MACRO_TARGETS; ++t) sink=macrovalue(&macros[m][t],n & 0x7f);
+  fanns=(wallns()-t0)*16/CALLS;
+  t0=wallns();
+  for (int n=0; n<CALLS/16; ++n) {
+    for (int m=0; m<NUM_MACROS; ++m) sendmacro(1 << PORT_USB,m,n & 0x7f);
+    usbflush();
+  }
+  sendns=(wallns()-t0)*16/CALLS;
+  irq_set_enabled(ALARM_IRQ,true);
+}
+
+// the CCs logged on a port for a macro target from entry first on
+static uint32_t targetccs(int port, size_t first, struct macrotarget * t, int16_t * last) {
+  uint32_t n=0;
+  for (size_t i=first; i<simmidi[port].count; ++i) {
+    simmsg &m=simmidi[port].log[i];
+    if ((m.data[0] != (0xb0 | (t->channel-1))) || (m.data[1] != t->ccnumber)) continue;
+    ++n;
+    if (last) *last=m.data[2];
+  }
+  return n;
+}
+
+static uint32_t owncc(int port) {
+  uint32_t n=0;
+  for (size_t i=0; i<simmidi[port].count; ++i) {
+    simmsg &m=simmidi[port].log[i];
+    n+=(m.data[0] == (0xb0 | (controls[0].encoder[MACROENC].channel-1))) && (m.data[1] == controls[0].encoder[MACROENC].ccnumber);
+  }
+  return n;
+}
+
+int main() {
+  uint64_t wallstart=wallns();
+  sim_boot();
+  sim_run(3000000);  // past the power on message
+  CHECK(UI_state == UI_SEND_MIDI);
+
+  sim_call(0,curves);
+  printf("curve tables: %u entries off the formula or out of order, %u custom breakpoints missed, %u range ends missed\n",
+    (unsigned)tableerrors,(unsigned)customerrors,(unsigned)endserrors);
+  CHECK(tableerrors == 0);
+  CHECK(customerrors == 0);
+  CHECK(endserrors == 0);
+
+  // all 16 macros with all 8 targets on for the timing
+  for (int m=0; m<NUM_MACROS; ++m) {
+    for (int t=0; t<MACRO_TARGETS; ++t) {
+      macros[m][t].channel=1+(m & 15);
+      macros[m][t].ccnumber=20+t;
+      macros[m][t].minvalue=t*4;
+      macros[m][t].maxvalue=127-t*4;
+      macros[m][t].curve=t % NUM_CURVES;
+    }
+  }
+  sim_call(0,fanout);
+  printf("16 macros x 8 targets, host time: %.0f ns to work out, %.0f ns to work out and send over USB\n",(double)fanns,(double)sendns);
+  CHECK(fanns < sendns);
+
+  // macro 3 with three targets on encoder 6
+  initmacros();
+  struct macrotarget * t=macros[2];
+  t[0]=(struct macrotarget){2,74,0,127,CURVE_LINEAR};
+  t[1]=(struct macrotarget){2,71,20,90,CURVE_LOG};
+  t[2]=(struct macrotarget){3,10,127,0,CURVE_EXP};
+  controls[0].encoder[MACROENC].type=MACROTYPE;
+  controls[0].encoder[MACROENC].macro=3;
+  sim_midi_clear();
+  sim_spin(MACROENC,1,20000,20);
+  sim_run(1000000);
+  simport &usb=simmidi[SIM_USB];
+  uint32_t split=0;
+  for (size_t i=0; i+2<usb.count; i+=3) split+=(usb.log[i].ns != usb.log[i+2].ns);
+  int16_t last[3];
+  uint32_t sent[3];
+  for (int i=0; i<3; ++i) sent[i]=targetccs(SIM_USB,0,&t[i],&last[i]);
+  int16_t v=controls[0].encoder[MACROENC].value;
+  printf("macro encoder turned 20 detents to %d: %u, %u and %u target CCs, last %d %d %d, %u on its own CC, %u steps split across transfers\n",
+    v,(unsigned)sent[0],(unsigned)sent[1],(unsigned)sent[2],last[0],last[1],last[2],(unsigned)owncc(SIM_USB),(unsigned)split);
+  CHECK(sent[0] > 0);
+  CHECK((sent[0] == sent[1]) && (sent[1] == sent[2]));
+  CHECK(usb.count == sent[0]*3);
+  for (int i=0; i<3; ++i) CHECK(last[i] == macrovalue(&t[i],v));
+  CHECK(owncc(SIM_USB) == 0);
+  CHECK(split == 0);
+
+  // a morph over the page takes the macro encoder from 0 to 127
+  for (int i=0; i<NUMENCODERS; ++i) {
+    scenevalues[0][SCENE_A][i]=0;
+    scenevalues[0][SCENE_B][i]=127;
+  }
+  morphpos[0]=0;
+  sim_midi_clear();
+  sim_spin(SIM_RMENU,1,5000,MORPH_MAX/MORPH_STEP);
+  sim_run(2000000);
+  CHECK(morphpos[0] == MORPH_MAX);
+  CHECK(controls[0].encoder[MACROENC].value == 127);
+  const int ports[]={SIM_USB,SIM_DIN};
+  for (int p=0; p<2; ++p) {
+    for (int i=0; i<3; ++i) sent[i]=targetccs(ports[p],0,&t[i],&last[i]);
+    printf("morph to scene B on %s: %u, %u and %u target CCs, last %d %d %d, %u on the macro encoder's own CC\n",portnames[ports[p]],
+      (unsigned)sent[0],(unsigned)sent[1],(unsigned)sent[2],last[0],last[1],last[2],(unsigned)owncc(ports[p]));
+    CHECK(sent[0] > 0);
+    CHECK((sent[0] == sent[1]) && (sent[1] == sent[2]));  // a macro goes out whole or waits
+    for (int i=0; i<3; ++i) CHECK(last[i] == macrovalue(&t[i],127));
+    CHECK(owncc(ports[p]) == 0);
+  }
+  return report_done(wallstart);
+}
@@ -0,0 +1,139 @@
+// Twisty2 menu buttons held down - the loop and MIDI keep running while the UI waits for a button to be let go
+// notes come in on DIN and are passed on to USB, CCs for a control come in on USB, and an encoder is turned, while a
+// menu button is held for 2 s
+// - the right button held on an edit menu item, which used to sit in a delay loop in domenus() till it was let go
+// - the left button held down on the controls page - a long press that starts automation recording when it's let go
+// - the same traffic is run first with no button held. with the button held every note is still passed on, no later
+//   than without, every CC lands on its control, the turned encoder's CCs go out, and the loop and the LEDs keep going
+// - reports the notes passed on, how late, the longest gap in them and the longest loop pass, held and not
+
+#include "Twisty2.cpp"
+#include "report.h"
+
+#define HOLD_US 2000000
+#define NOTE_US 50000  // a note in on DIN this often
+#define CC_US 20000    // a CC in on USB this often
+#define LISTENER 3     // page 1 encoder 4 takes the CCs
+#define TURNED 9       // page 1 encoder 10 is turned in the controls page hold
+#define PRESS_US 100000
+#define SLACK_US 5000  // held against not held - a loop pass or so
+
+struct holdresult {
+  uint32_t notesin,notesout;
+  uint64_t late;       // latest a note was passed on, us
+  uint64_t gap;        // longest gap in the notes passed on, us
+  uint64_t loopmax;    // longest loop() pass, us
+  uint32_t ccsin,ccsout;
+  uint64_t passes,ledshows;
+  int16_t last;        // value the listener ended on
+  int16_t lastsent;    // last CC value sent in
+};
+
+// the traffic for HOLD_US with the button held down, or with none for -1. the press has been acted on - and the
+// display redrawn for it - before the traffic starts
+static holdresult hold(int button, bool turn) {
+  holdresult r={};
+  if (button >= 0) sim_button(button,true);
+  sim_run(PRESS_US);
+  sim_midi_clear();
+  sim_loopstats_reset();
+  uint32_t shows=simledshows;
+  uint64_t start=sim_us()+1000;
+  uint8_t channel=controls[0].encoder[LISTENER].channel;
+  uint8_t cc=controls[0].encoder[LISTENER].ccnumber;
+  for (uint64_t t=0; t<HOLD_US; t+=NOTE_US) {
+    sim_midiin3(SIM_DIN,start+t,0x90,60+(t/NOTE_US) % 12,100);
+    sim_midiin3(SIM_DIN,start+t+NOTE_US/2,0x80,60+(t/NOTE_US) % 12,0);
+    r.notesin+=2;
+  }
+  for (uint64_t t=0; t<HOLD_US; t+=CC_US) {
+    r.lastsent=(t/CC_US*7) & 0x7f;
+    sim_midiin3(SIM_USB,start+t,0xb0 | (channel-1),cc,r.lastsent);
+    ++r.ccsin;
+  }
+  if (turn) sim_spin(TURNED,1,HOLD_US/40,40);
+  sim_run(HOLD_US+1000);
+  r.passes=simloops[0].passes;
+  r.loopmax=simloops[0].simmax/1000;
+  r.ledshows=simledshows-shows;
+  if (button >= 0) sim_button(button,false);
+  sim_run(200000);
+
+  // DIN notes as they reached USB, against when they came in
+  simport &usb=simmidi[SIM_USB];
+  uint64_t prev=start;
+  for (size_t i=0; i<usb.count; ++i) {
+    uint8_t status=usb.log[i].data[0] & 0xf0;
+    if ((status == 0xb0) && (usb.log[i].data[1] == controls[0].encoder[TURNED].ccnumber)) ++r.ccsout;
+    if ((status != 0x90) && (status != 0x80)) continue;
+    uint64_t t=usb.log[i].queued/1000;
+    uint64_t due=start+r.notesout/2*NOTE_US+((r.notesout & 1) ? NOTE_US/2 : 0);
+    if ((t > due) && (t-due > r.late)) r.late=t-due;
+    if (t-prev > r.gap) r.gap=t-prev;
+    prev=t;
+    ++r.notesout;
+  }
+  r.last=controls[0].encoder[LISTENER].value;
+  return r;
+}
+
+static void report(const char * name, const holdresult &r) {
+  printf("  %-10s %2u of %2u notes passed on, %4.1f ms late at worst, longest gap %4.1f ms. %u CCs in, control at %3d (sent %3d). %2u CCs turned out. %4llu loop passes, longest %4.1f ms, %3llu LED updates\n",
+    name,(unsigned)r.notesout,(unsigned)r.notesin,r.late/1e3,r.gap/1e3,(unsigned)r.ccsin,r.last,r.lastsent,(unsigned)r.ccsout,
+    (unsigned long long)r.passes,r.loopmax/1e3,(unsigned long long)r.ledshows);
+}
+
+// held against the same traffic with nothing held
+static void compare(const holdresult &held, const holdresult &free) {
+  CHECK(held.notesout == held.notesin);
+  CHECK(held.late <= free.late+SLACK_US);
+  CHECK(held.gap <= free.gap+SLACK_US);
+  CHECK(held.last == held.lastsent);
+  CHECK(held.ccsout == free.ccsout);
+  CHECK(held.passes >= free.passes*9/10);
+  CHECK(held.loopmax <= free.loopmax+SLACK_US);
+  CHECK(held.ledshows >= free.ledshows*9/10);
+}
+
+int main() {
+  uint64_t wallstart=wallns();
+  sim_boot();
+  sim_run(3000000);  // past the power on message
+  thruroute[PORT_DIN]=1 << PORT_USB;  // DIN passed on to USB only
+  CHECK(UI_state == UI_SEND_MIDI);
+
+  // into the edit menu and the right button held on its first item
+  sim_button(SIM_LMENU,true);
+  sim_run(50000);
+  sim_button(SIM_LMENU,false);
+  sim_run(600000);
+  CHECK(UI_state == UI_EDIT);
+  printf("right button held 2 s on an edit menu item:\n");
+  holdresult free=hold(-1,false);
+  report("not held",free);
+  holdresult held=hold(SIM_RMENU,false);
+  report("held",held);
+  compare(held,free);
+  CHECK(menustate == PARAM_INPUT);
+  CHECK(!menuhold);  // let go, so the menu takes the encoder again
+  CHECK(held.ledshows > 0);  // the control being edited flashes
+
+  // back out to the controls page
+  sim_button(SIM_LMENU,true);
+  sim_run(50000);
+  sim_button(SIM_LMENU,false);
+  sim_run(600000);
+  CHECK(UI_state == UI_SEND_MIDI);
+
+  // the left button held on the controls page while an encoder is turned
+  printf("left button held 2 s on the controls page, an encoder turned:\n");
+  free=hold(-1,true);
+  report("not held",free);
+  CHECK(autostate == AUTO_OFF);
+  held=hold(SIM_LMENU,true);
+  report("held",held);
+  compare(held,free);
+  CHECK(held.ccsout > 0);
+  CHECK(autostate == AUTO_RECORD);  // the long press did its job once it was let go
+  return report_done(wallstart);
+}
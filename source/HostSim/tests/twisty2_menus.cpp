@@ -0,0 +1,16 @@
+// Twisty2 menus drawn as they were - every menu screen against a recording made before the tables moved to flash
+// - see menus.h for the screens. run build/twisty2_menus record to make a new recording after a menu is meant to change
+
+#include "Twisty2.cpp"
+#include "report.h"
+
+#define MENUS_FILE "tests/twisty2_menus.txt"
+#include "menus.h"
+
+int main(int argc, char ** argv) {
+  uint64_t wallstart=wallns();
+  sim_boot();
+  sim_run(3000000);  // past the power on message
+  CHECK(checkmenus((argc > 1) && !strcmp(argv[1],"record")) == 0);
+  return report_done(wallstart);
+}
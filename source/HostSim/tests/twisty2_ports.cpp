@@ -0,0 +1,223 @@
+// Twisty2 per-control output ports - each encoder and switch only sends on the ports in its mask
+// page 1 has every mask on two encoders and two switches, each control on a channel and CC of its own so its messages can
+// be told apart on every port's log
+// - encoders turned, switches pressed as CCs, program changes and notes, a macro encoder's targets and a morph of the
+//   page: each control's messages are on every port in its mask and on no other, and the same messages in the same
+//   order on each of them
+// - a note switch on USB alone held while one on DIN alone is pressed and let go: each note off goes out on the ports and
+//   channel its note on went to
+// - a representative preset - 12 encoders for the computer on USB and 4 for a synth on USB and DIN - all turned by hand
+//   for SECONDS, against the same with every control on All. reports the bytes sent on each port and the DIN byte rate
+//   the masks save
+
+#include "Twisty2.cpp"
+#include "report.h"
+
+#define SECONDS 2
+#define FIRSTCC 20       // encoder i sends CC FIRSTCC+i on channel i+1, switch i CC SWITCHCC+i on channel i+1
+#define SWITCHCC 60
+#define MACROENC 15      // this encoder is a macro with two targets
+#define MACRO 3
+#define MACROCC 100      // its targets' CCs, on channel 16
+#define SYNTH 4          // the preset's first encoders go to a synth on DIN as well
+#define MAX_SEEN 256
+
+static const int ports[]={SIM_USB,SIM_DIN,SIM_BLE};
+static const int16_t portbits[]={1 << PORT_USB,1 << PORT_DIN,1 << PORT_BLE};
+
+// what each control sent on each port, in order - encoders then switches
+static uint32_t seen[2*NUMENCODERS][SIM_PORTS][MAX_SEEN];
+static uint32_t nseen[2*NUMENCODERS][SIM_PORTS];
+static uint32_t strays;  // messages no control sends
+
+static void morphup(void) { morphto(0,MORPH_MAX); }
+
+static void preparepage(void) {
+  for (int i=0; i<NUMENCODERS; ++i) {
+    struct controllerencoder &e=controls[0].encoder[i];
+    e.type=CCTYPE;
+    e.channel=i+1;
+    e.ccnumber=FIRSTCC+i;
+    e.minvalue=0;
+    e.maxvalue=127;
+    e.value=64;
+    e.ports=i % (ALL_PORTS+1);
+    struct controllerswitch &s=controls[0].encswitch[i];
+    s.mode=MOMENTARY;
+    s.type=i % 3;  // CC, program change or note
+    s.channel=i+1;
+    s.ccnumber=SWITCHCC+i;
+    s.minvalue=0;
+    s.maxvalue=SWITCHCC+i;
+    s.ports=(i+3) % (ALL_PORTS+1);
+  }
+  struct controllerencoder &m=controls[0].encoder[MACROENC];
+  m.type=MACROTYPE;
+  m.macro=MACRO;
+  m.ports=(1 << PORT_USB) | (1 << PORT_BLE);
+  for (int t=0; t<MACRO_TARGETS; ++t) {
+    macros[MACRO-1][t].channel=(t < 2) ? 16 : 0;
+    macros[MACRO-1][t].ccnumber=MACROCC+t;
+    macros[MACRO-1][t].minvalue=0;
+    macros[MACRO-1][t].maxvalue=127;
+    macros[MACRO-1][t].curve=CURVE_LINEAR;
+  }
+}
+
+// which control sent it - -1 for none
+static int sender(const simmsg &m) {
+  if (m.sysex || (m.data[0] < 0x80) || (m.data[0] >= 0xf0)) return -1;
+  uint8_t status=m.data[0] & 0xf0;
+  int ch=m.data[0] & 0x0f;
+  if ((status == 0xb0) && (ch == 15) && (m.data[1] >= MACROCC) && (m.data[1] < MACROCC+2)) return MACROENC;
+  if ((status == 0xb0) && (m.data[1] == FIRSTCC+ch)) return ch;
+  if ((status == 0xb0) && (m.data[1] == SWITCHCC+ch)) return NUMENCODERS+ch;
+  if ((status == 0xc0) || (status == 0x90) || (status == 0x80)) return NUMENCODERS+ch;
+  return -1;
+}
+
+// every port's log sorted out by control, then checked against the masks. returns the messages
+static uint32_t sortout(const char * name) {
+  memset(nseen,0,sizeof(nseen));
+  strays=0;
+  uint32_t total=0;
+  for (int p=0; p<SIM_PORTS; ++p) {
+    simport &log=simmidi[ports[p]];
+    for (size_t i=0; i<log.count; ++i) {
+      int c=sender(log.log[i]);
+      if (c < 0) {
+        ++strays;
+        continue;
+      }
+      if (nseen[c][p] < MAX_SEEN) seen[c][p][nseen[c][p]]=log.log[i].data[0] << 16 | log.log[i].data[1] << 8 | log.log[i].data[2];
+      ++nseen[c][p];
+      ++total;
+    }
+  }
+  uint32_t outside=0,missing=0,differ=0,controlssent=0;
+  for (int c=0; c<2*NUMENCODERS; ++c) {
+    int16_t mask=(c < NUMENCODERS) ? controls[0].encoder[c].ports : controls[0].encswitch[c-NUMENCODERS].ports;
+    int first=-1;
+    bool any=false;
+    for (int p=0; p<SIM_PORTS; ++p) any|=(nseen[c][p] > 0);
+    if (!any) continue;
+    ++controlssent;
+    for (int p=0; p<SIM_PORTS; ++p) {
+      if (!(mask & portbits[p])) {
+        outside+=nseen[c][p];
+        continue;
+      }
+      if (!nseen[c][p]) ++missing;
+      if (first < 0) first=p;
+      else if ((nseen[c][p] != nseen[c][first]) || memcmp(seen[c][p],seen[c][first],min(nseen[c][p],(uint32_t)MAX_SEEN)*4)) ++differ;
+    }
+  }
+  printf("  %-24s %3u controls, %4u messages over all ports. USB %4llu bytes, DIN %4llu, BLE %4llu. %u on a port outside the mask, %u ports in a mask sent nothing, %u ports that differ\n",
+    name,(unsigned)controlssent,(unsigned)total,(unsigned long long)simmidi[SIM_USB].bytes,(unsigned long long)simmidi[SIM_DIN].bytes,
+    (unsigned long long)simmidi[SIM_BLE].bytes,(unsigned)outside,(unsigned)missing,(unsigned)differ);
+  CHECK(outside == 0);
+  CHECK(missing == 0);
+  CHECK(differ == 0);
+  CHECK(strays == 0);
+  return total;
+}
+
+// the preset's encoders turned by hand for SECONDS
+static void turnall(void) {
+  sim_midi_clear();
+  for (int i=0; i<NUMENCODERS; ++i) sim_spin(i,(i & 1) ? 1 : -1,50000+i*1000,SECONDS*18);
+  sim_run(SECONDS*1000000+200000);
+}
+
+int main() {
+  uint64_t wallstart=wallns();
+  sim_boot();
+  sim_run(3000000);  // past the power on message
+  CHECK(UI_state == UI_SEND_MIDI);
+  CHECK(page == 0);
+  preparepage();
+
+  printf("page 1, every mask on two encoders and two switches:\n");
+  sim_midi_clear();
+  for (int i=0; i<NUMENCODERS; ++i) sim_spin(i,1,30000,5);
+  sim_run(500000);
+  uint32_t n=sortout("encoders turned");
+  CHECK(n > 0);
+  CHECK(nseen[MACROENC][0] > 0);  // its targets went out
+
+  sim_midi_clear();
+  for (int i=0; i<NUMENCODERS; ++i) {
+    sim_button(i,true);
+    sim_run(60000);
+    sim_button(i,false);
+    sim_run(60000);
+  }
+  sortout("switches pressed");
+  for (int i=0; i<NUMENCODERS; ++i) {  // each one sent on press and on release wherever it sends
+    for (int p=0; p<SIM_PORTS; ++p) if (controls[0].encswitch[i].ports & portbits[p]) CHECK(nseen[NUMENCODERS+i][p] >= 2);
+  }
+
+  // two note switches on different ports and channels, one held while the other is played
+  struct controllerswitch keep[2]={controls[0].encswitch[0],controls[0].encswitch[1]};
+  for (int i=0; i<2; ++i) {
+    struct controllerswitch &s=controls[0].encswitch[i];
+    s.mode=MOMENTARY;
+    s.type=NOTEMESSAGE;
+    s.channel=i+1;
+    s.minvalue=0;
+    s.maxvalue=60+i*10;
+    s.ports=i ? 1 << PORT_DIN : 1 << PORT_USB;
+  }
+  sim_midi_clear();
+  sim_button(0,true);
+  sim_run(60000);
+  sim_button(1,true);
+  sim_run(60000);
+  sim_button(0,false);
+  sim_run(60000);
+  sim_button(1,false);
+  sim_run(60000);
+  static const uint8_t usbnotes[][3]={{0x90,60,DEFAULT_VELOCITY},{0x80,60,0}},dinnotes[][3]={{0x91,70,DEFAULT_VELOCITY},{0x81,70,0}};
+  bool notesok=(simmidi[SIM_USB].count == 2) && (simmidi[SIM_DIN].count == 2) && (simmidi[SIM_BLE].count == 0);
+  for (int i=0; notesok && (i<2); ++i) {
+    notesok=!memcmp(simmidi[SIM_USB].log[i].data,usbnotes[i],3) && !memcmp(simmidi[SIM_DIN].log[i].data,dinnotes[i],3);
+  }
+  printf("  %-24s USB %u messages, DIN %u, BLE %u - %s\n","overlapping note switches",(unsigned)simmidi[SIM_USB].count,
+    (unsigned)simmidi[SIM_DIN].count,(unsigned)simmidi[SIM_BLE].count,notesok ? "each note off where its note on went" : "NOTE OFFS WRONG");
+  CHECK(notesok);
+  controls[0].encswitch[0]=keep[0];
+  controls[0].encswitch[1]=keep[1];
+
+  sim_midi_clear();
+  for (int i=0; i<NUMENCODERS; ++i) {
+    scenevalues[0][SCENE_A][i]=controls[0].encoder[i].value;
+    scenevalues[0][SCENE_B][i]=(controls[0].encoder[i].value+40) % 128;
+  }
+  morphpos[0]=0;
+  sim_call(0,morphup);
+  sim_run(500000);
+  sortout("morphed");
+  for (int i=0; i<NUMENCODERS; ++i) CHECK(controls[0].encoder[i].value == scenevalues[0][SCENE_B][i]);
+
+  // the representative preset against every control on All
+  printf("%d encoders turned by hand for %d s, %d of them for a synth on DIN:\n",NUMENCODERS,SECONDS,SYNTH);
+  controls[0].encoder[MACROENC].type=CCTYPE;
+  for (int i=0; i<NUMENCODERS; ++i) controls[0].encoder[i].ports=ALL_PORTS;
+  turnall();
+  sortout("every control on All");
+  uint64_t allusb=simmidi[SIM_USB].bytes,alldin=simmidi[SIM_DIN].bytes,allble=simmidi[SIM_BLE].bytes;
+  CHECK(alldin == allusb);
+  for (int i=0; i<NUMENCODERS; ++i) controls[0].encoder[i].ports=(i < SYNTH) ? (1 << PORT_USB) | (1 << PORT_DIN) : 1 << PORT_USB;
+  turnall();
+  sortout("the preset");
+  uint64_t usb=simmidi[SIM_USB].bytes,din=simmidi[SIM_DIN].bytes;
+  uint64_t synthbytes=0;
+  for (int i=0; i<SYNTH; ++i) synthbytes+=nseen[i][0]*3;
+  printf("DIN %.0f bytes/s with every control on All, %.0f with the preset - %.0f%% saved. USB %.0f and %.0f bytes/s, BLE %.0f and 0\n",
+    (double)alldin/SECONDS,(double)din/SECONDS,alldin ? 100.0*(alldin-din)/alldin : 0,(double)allusb/SECONDS,(double)usb/SECONDS,
+    (double)allble/SECONDS);
+  CHECK(din == synthbytes);
+  CHECK(simmidi[SIM_BLE].bytes == 0);
+  CHECK(din*2 < alldin);  // 4 of 16 controls
+  return report_done(wallstart);
+}
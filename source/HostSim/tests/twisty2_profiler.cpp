@@ -0,0 +1,100 @@
+// profiler windows - known samples fed through prof_add() and PROF_OVERRUN, then published by prof_tick()
+// built with PROFILE. the hand fed windows are ticked from the test between sim_run() calls, with the loop held, so
+// their samples are the only ones in them
+// - a tick a millisecond short of the window publishes nothing, one on the window publishes min/avg/max, the ISR
+//   overruns and loops per second and starts the next window from nothing
+// - a window that ran long gives loops per second over the time it really took, values past int16 are clipped and an
+//   empty window shows zeros
+// - then the loop runs on its own: each window's loops per second is the loop passes the sim counted in it
+
+#define PROFILE
+#include "Twisty2.cpp"
+#include "report.h"
+
+#define SAMPLES 10    // each stage gets SAMPLES runs of STAGEUS*(stage+1)+k us, k from 0
+#define STAGEUS 100
+#define LOOPS 2500    // loop runs in a window
+#define WINDOWS 3
+
+// each stage's hand fed runs, the loop's LOOPS of them
+static void feed(void) {
+  for (int16_t s=0; s<NUM_PROF_STAGES; ++s) {
+    int n=(s == PROF_LOOP) ? LOOPS : SAMPLES;
+    for (int k=0; k<n; ++k) prof_add(&profstats[s],STAGEUS*(s+1)+k % SAMPLES);
+  }
+}
+
+// publishes the window if it has been ms long
+static bool tickafter(uint32_t ms) {
+  profwindowstart=millis()-ms;
+  return prof_tick();
+}
+
+int main() {
+  uint64_t wallstart=wallns();
+  sim_boot();
+  sim_run(3000000);  // past the power on message
+  CHECK(UI_state == UI_SEND_MIDI);
+
+  printf("hand fed window:\n");
+  prof_init();
+  feed();
+  proflast[PROF_ISR]=30;
+  for (int i=0; i<4; ++i) {
+    if (i < 3) PROF_OVERRUN(PROF_ISR,25);  // over - one inside an if/else has to count too
+    else PROF_OVERRUN(PROF_ISR,30);        // not over
+  }
+  int16_t before=profavg[PROF_MIDI];
+  CHECK(!tickafter(PROF_WINDOW_MS-1));
+  CHECK(profavg[PROF_MIDI] == before);
+  CHECK(profoverruns == 3);
+  CHECK(tickafter(PROF_WINDOW_MS));
+  uint32_t bad=0;
+  for (int16_t s=0; s<NUM_PROF_STAGES; ++s) {
+    if (s == PROF_LOOP) continue;
+    int16_t base=STAGEUS*(s+1);
+    printf("  %-12s min %5d avg %5d max %5d\n",profnames[s],profmin[s],profavg[s],profmax[s]);
+    if ((profmin[s] != base) || (profavg[s] != base+(SAMPLES-1)/2) || (profmax[s] != base+SAMPLES-1)) ++bad;
+  }
+  printf("  %d loops/s, %d ISR overruns\n",profloops,profoverrun);
+  CHECK(bad == 0);
+  CHECK(profloops == LOOPS);
+  CHECK(profoverrun == 3);
+  CHECK(profoverruns == 0);
+  CHECK(profstats[PROF_MIDI].count == 0);  // the next window starts from nothing
+
+  printf("long window, clipped and empty:\n");
+  for (int16_t s=0; s<NUM_PROF_STAGES; ++s) prof_clear(&profstats[s]);
+  feed();
+  prof_add(&profstats[PROF_DISPLAY],40000);
+  CHECK(tickafter(2*PROF_WINDOW_MS));
+  printf("  %d loops/s over %d ms, display max %d\n",profloops,2*PROF_WINDOW_MS,profmax[PROF_DISPLAY]);
+  CHECK(profloops == LOOPS/2);
+  CHECK(profmax[PROF_DISPLAY] == 32767);
+  for (int16_t s=0; s<NUM_PROF_STAGES; ++s) prof_clear(&profstats[s]);
+  CHECK(tickafter(PROF_WINDOW_MS));
+  CHECK((profmin[PROF_MIDI] == 0) && (profavg[PROF_MIDI] == 0) && (profmax[PROF_MIDI] == 0));
+  CHECK((profloops == 0) && (profoverrun == 0));
+
+  // the loop on its own - passes between two window starts against what the window published
+  printf("loop running:\n");
+  prof_init();
+  uint32_t start=profwindowstart;
+  uint64_t passes=simloops[0].passes;
+  for (int w=0; w<WINDOWS; ) {
+    sim_run(1000);
+    if (profwindowstart == start) continue;
+    uint64_t counted=simloops[0].passes-passes;
+    uint32_t elapsed=profwindowstart-start;
+    printf("  window %d: %u ms, %llu passes counted, %u in the window, %d loops/s\n",w,(unsigned)elapsed,
+      (unsigned long long)counted,(unsigned)profwindow[PROF_LOOP].count,profloops);
+    CHECK((elapsed >= PROF_WINDOW_MS) && (elapsed <= PROF_WINDOW_MS+1));
+    CHECK(profloops == (int16_t)(profwindow[PROF_LOOP].count*1000/elapsed));
+    CHECK((profwindow[PROF_LOOP].count+1 >= counted) && (profwindow[PROF_LOOP].count <= counted+1));
+    CHECK(profloops > 0);
+    start=profwindowstart;
+    passes=simloops[0].passes;
+    ++w;
+  }
+  return report_done(wallstart);
+}
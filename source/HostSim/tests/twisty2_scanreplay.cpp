@@ -0,0 +1,139 @@
+// encoder scan replay - fast spins of all 16 encoders played against scan_encoders() at fixed scan rates, then the real ISR
+// - each rate gets the same waveforms: every encoder spun 100 detents at 50 to 800 detents a second, the encoders starting
+//   a little apart so they aren't in step with each other or the scan. reports the detents counted against those turned,
+//   steps counted the wrong way and the invalid transitions the decoder saw
+// - a spin that skips states shows up in the decoder's error count, so Lost Steps on the Stats page means something. it
+//   can't catch all of them - a whole detent between two scans looks like no movement at all, as 800 detents a second
+//   at 1kHz shows
+// - the ISR with its adaptive rate misses no state of the 400 detents a second spin that 1kHz gets wrong, and keeps
+//   its deadlines - scans in a window of the fast rate are the window over the period, not fewer for the ISR's own time
+
+#include "Twisty2.cpp"
+#include "report.h"
+
+#define DETENTS 100
+#define STAGGER_US 37
+
+static const uint32_t rates[]={1000,2000,4000,8000};
+static const uint32_t speeds[]={50,100,200,400,800};  // detents a second
+
+struct replayresult {
+  uint32_t turned,counted,reversed,errors,lost;
+};
+
+static uint32_t rate,speed;
+static replayresult result;
+
+static uint32_t errortotal(void) {
+  uint32_t n=0;
+  for (int e=0; e<NUMENCODERS; ++e) n+=enc[e].getErrors();
+  return n;
+}
+
+static uint32_t losttotal(void) {
+  uint32_t n=0;
+  for (int e=0; e<NUMENCODERS; ++e) n+=simenc[e].lost;
+  return n;
+}
+
+// scan every period us until the spins are done and a little after
+static void scanspins(uint32_t period, int32_t * counted, uint32_t * reversed) {
+  uint64_t deadline=sim_us();
+  uint64_t end=0;
+  while (!end || (sim_us() < end)) {
+    scan_encoders();
+    for (int e=0; e<NUMENCODERS; ++e) {
+      int16_t v=enc[e].getValue();
+      if (counted) counted[e]+=v;
+      if (reversed && v && ((v > 0) != !(e & 1))) ++*reversed;
+    }
+    if (!end && !sim_spinning()) end=sim_us()+10000;  // a few more scans for the last states
+    deadline+=period;
+    if (deadline > sim_us()) delayMicroseconds(deadline-sim_us());
+  }
+}
+
+// on core 0 with the scan interrupt off - scan on absolute deadlines at rate and add up what the decoders report
+static void replay(void) {
+  irq_set_enabled(ALARM_IRQ,false);
+  for (int e=0; e<NUMENCODERS; ++e) {
+    enc[e].setAccelerationEnabled(false);  // count detents, not what the acceleration makes of them
+    sim_spin(e,1,50000,1);  // a slow detent puts a decoder that lost track after the last replay back in step
+  }
+  scanspins(100,0,0);
+  uint32_t errors=errortotal(),lost=losttotal();
+  int32_t counted[NUMENCODERS]={};
+  uint32_t reversed=0;
+  for (int e=0; e<NUMENCODERS; ++e) {
+    sim_spin(e,(e & 1) ? -1 : 1,1000000/speed,DETENTS);
+    delayMicroseconds(STAGGER_US);
+  }
+  scanspins(1000000/rate,counted,&reversed);
+  result.turned=NUMENCODERS*DETENTS;
+  result.counted=0;
+  for (int e=0; e<NUMENCODERS; ++e) result.counted+=(counted[e] < 0) ? -counted[e] : counted[e];
+  result.reversed=reversed;
+  result.errors=errortotal()-errors;
+  result.lost=losttotal()-lost;
+  for (int e=0; e<NUMENCODERS; ++e) enc[e].setAccelerationEnabled(true);
+  irq_set_enabled(ALARM_IRQ,true);
+}
+
+int main() {
+  uint64_t wallstart=wallns();
+  sim_boot();
+  sim_run(3000000);  // past the power on message
+
+  printf("%d encoders x %d detents at each scan rate and spin speed - detents counted %% / reversed / decoder errors / states missed\n",
+    NUMENCODERS,DETENTS);
+  printf("  scans/s");
+  for (size_t s=0; s<sizeof(speeds)/sizeof(speeds[0]); ++s) printf("   %4u det/s        ",(unsigned)speeds[s]);
+  printf("\n");
+  uint32_t at1k400=0;
+  for (size_t r=0; r<sizeof(rates)/sizeof(rates[0]); ++r) {
+    rate=rates[r];
+    printf("  %7u",(unsigned)rate);
+    for (size_t s=0; s<sizeof(speeds)/sizeof(speeds[0]); ++s) {
+      speed=speeds[s];
+      sim_call(0,replay);
+      sim_run(100000);
+      printf("   %5.1f%% %3u %4u %4u",100.0*result.counted/result.turned,(unsigned)result.reversed,(unsigned)result.errors,
+        (unsigned)result.lost);
+      CHECK((result.lost == 0) || (result.errors > 0));  // missed states don't go unreported
+      // a scan sees every state while states come slower than scans - 4 a detent
+      if (speed*4 < rate) {
+        CHECK(result.counted == result.turned);
+        CHECK(result.reversed == 0);
+        CHECK(result.errors == 0);
+      }
+      if ((rate == 1000) && (speed == 400)) at1k400=result.counted;
+    }
+    printf("\n");
+  }
+  CHECK(at1k400 < NUMENCODERS*DETENTS);  // the case the adaptive rate is there for
+
+  // the real ISR - idle rate first, then the same 400 detents a second spin it speeds up for
+  sim_run(1000000);
+  uint64_t irqs=simirq.count;
+  uint64_t start=sim_us();
+  sim_run(1000000);
+  printf("ISR idle: %llu scans in 1 s\n",(unsigned long long)(simirq.count-irqs));
+  simirq.latemax=0;
+  uint32_t errors=errortotal(),lost=losttotal();
+  for (int e=0; e<NUMENCODERS; ++e) sim_spin(e,(e & 1) ? -1 : 1,1000000/400,DETENTS);
+  sim_run(50000);  // up to speed
+  irqs=simirq.count;
+  start=sim_us();
+  sim_run(200000);
+  uint64_t fastscans=simirq.count-irqs;
+  uint64_t window=sim_us()-start;
+  sim_run(500000);
+  printf("ISR 400 det/s spin: %llu scans in %.0f ms at %u us a scan, %u decoder errors, %u states missed, late by %.1f us at most\n",
+    (unsigned long long)fastscans,window/1e3,(unsigned)TIMER_MICROS_FAST,(unsigned)(errortotal()-errors),(unsigned)(losttotal()-lost),
+    simirq.latemax/1e3);
+  CHECK(fastscans >= window/TIMER_MICROS_FAST-1);
+  CHECK(fastscans <= window/TIMER_MICROS_FAST+1);
+  CHECK(losttotal() == lost);
+  CHECK(errortotal() == errors);
+  return report_done(wallstart);
+}
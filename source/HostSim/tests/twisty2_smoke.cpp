@@ -0,0 +1,55 @@
+// Twisty2 boots, shows its page, and turning an encoder sends its CC on the ports it's set to
+// also a lighter version of the Rhythmicon stress - every encoder spinning - reporting missed steps and loop times
+
+#include "Twisty2.cpp"
+#include "report.h"
+
+int main() {
+  uint64_t wallstart=wallns();
+  sim_boot();
+  sim_run(3000000);  // past the power on message
+  char text[256];
+  sim_display_text(text,sizeof(text));
+  printf("display after boot:\n%s",text);
+  sim_display_dump(stdout);
+  CHECK(simframes > 0);
+  CHECK(simpanelon);
+
+  // one encoder turned 5 detents - detents that go by while the loop is redrawing are sent together as the latest value
+  sim_midi_clear();
+  int16_t before=controls[0].encoder[0].value;
+  uint64_t start=sim_ns();
+  sim_turn(0,5);
+  sim_run(200000);
+  int16_t after=controls[0].encoder[0].value;
+  printf("encoder 0: %d -> %d\n",before,after);
+  CHECK(after == before+5);
+  for (int port=0; port<SIM_PORTS; ++port) {
+    simport &p=simmidi[port];
+    uint32_t ccs=0;
+    uint8_t last=0;
+    for (size_t i=0; i<p.count; ++i) {
+      if ((p.log[i].data[0] & 0xf0) != 0xb0) continue;
+      ++ccs;
+      last=p.log[i].data[2];
+    }
+    printf("  %s: %u CCs", portnames[port],(unsigned)ccs);
+    if (p.count) printf(", last out %.2f ms after the turn started",(p.log[p.count-1].ns-start)/1e6);
+    printf("\n");
+    if (controls[0].encoder[0].ports & (1 << port)) {
+      CHECK(ccs > 0);
+      CHECK(last == after);
+    }
+  }
+  sim_midi_dump(stdout,SIM_USB);
+
+  // everything at once
+  sim_loopstats_reset();
+  uint32_t lost=sim_lost();
+  for (int e=0; e<NUMENCODERS; ++e) sim_spin(e,(e & 1) ? -1 : 1,2000,1000);
+  sim_run(2100000);
+  printf("all encoders, a detent per 2 ms: %u states missed by the scan\n",(unsigned)(sim_lost()-lost));
+  report_loops();
+  CHECK(sim_lost() == lost);
+  return report_done(wallstart);
+}
@@ -0,0 +1,71 @@
+// Twisty2 power on message - it stays up for SPLASH_MS while the unit already works behind it
+// nothing is touched. the DAW sends CCs for the control on show and another one while the message is up
+// - the panel is the power on message and no frame is sent until SPLASH_MS, then the controls come up within LATE_MS
+// - the CCs were taken in meanwhile and land on their controls, and the controls page that comes up is the same as
+//   one drawn from scratch, with the value the DAW set last
+
+#include "Twisty2.cpp"
+#include "report.h"
+
+#define SHOWN 0      // the control on show at power on
+#define OTHER 6
+#define STEP_US 1000
+#define LATE_MS 20   // the controls are on the panel this soon after SPLASH_MS - a frame and a loop pass
+
+static uint8_t splash[sizeof(simpanel)],page1[sizeof(simpanel)];
+
+static void redraw(void) {
+  display.clearDisplay();
+  showencoder(page,SHOWN);
+  updatedisplay();
+}
+
+static void cc(int port, uint64_t atus, int e, uint8_t value) {
+  sim_midiin3(port,atus,0xb0 | (controls[0].encoder[e].channel-1),controls[0].encoder[e].ccnumber,value);
+}
+
+int main() {
+  uint64_t wallstart=wallns();
+  sim_boot();
+  uint64_t up=sim_us();
+  uint64_t down=splashstart*1000ull+SPLASH_MS*1000;  // when the message is due to come down
+  memcpy(splash,simpanel,sizeof(splash));
+  uint32_t frames=simframes;
+  uint32_t lit=0;
+  for (size_t i=0; i<sizeof(splash); ++i) lit+=(splash[i] != 0);
+  CHECK(lit > 0);  // the message is on the panel
+
+  cc(SIM_USB,up+100000,SHOWN,99);
+  cc(SIM_DIN,up+300000,OTHER,33);
+  cc(SIM_DIN,down-200000,SHOWN,42);  // the last one before the message comes down
+
+  // until SPLASH_MS the panel doesn't change
+  uint64_t changed=0;
+  uint32_t pushed=0;
+  while (sim_us() < down+LATE_MS*1000) {
+    sim_run(STEP_US);
+    if (simframes != frames) {
+      if (!pushed) changed=sim_us();
+      pushed+=simframes-frames;
+      frames=simframes;
+    }
+    if (!changed && memcmp(simpanel,splash,sizeof(splash))) changed=sim_us();
+  }
+  printf("setup() returned at %.1f ms. first MIDI in at %.1f ms, the power on message was due down at %.1f ms and the controls were up at %.1f ms, %u frames sent\n",
+    up/1e3,boottime[BOOT_FIRSTMIDI]/1e3,down/1e3,changed/1e3,(unsigned)pushed);
+  printf("values set by CCs while it was up: %d and %d\n",controls[0].encoder[SHOWN].value,controls[0].encoder[OTHER].value);
+  CHECK(changed >= down);
+  CHECK(changed <= down+LATE_MS*1000);
+  CHECK(pushed == 1);
+  CHECK(boottime[BOOT_FIRSTMIDI] && (boottime[BOOT_FIRSTMIDI] < down));
+  CHECK(controls[0].encoder[SHOWN].value == 42);
+  CHECK(controls[0].encoder[OTHER].value == 33);
+
+  memcpy(page1,simpanel,sizeof(page1));
+  sim_call(0,redraw);
+  sim_run(STEP_US);
+  bool same=!memcmp(simpanel,page1,sizeof(page1));
+  printf("the controls page that came up is %s one drawn from scratch\n",same ? "the same as" : "different from");
+  CHECK(same);
+  return report_done(wallstart);
+}
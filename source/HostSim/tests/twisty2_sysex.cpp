@@ -0,0 +1,206 @@
+// SysEx preset transfer - the harness plays a librarian that ACKs every packet
+// - dumps a slot over USB and DIN and imports it back, reporting how long each took and the most stack the unit used
+// - dumps it paced over DIN, with no ACKs, and checks the bytes per second stay within DIN's budget
+// - checks the unit doesn't allocate during a transfer and counts every SysEx packet it sends to USB
+// - imports slots with settings out of range and checks each is refused and leaves the slot as it was
+
+#include "Twisty2.cpp"
+#include "report.h"
+
+#define REPLY_US 1000       // librarian turnaround
+#define TIMEOUT_US 30000000
+
+static size_t seen[SIM_PORTS];  // unit output already looked at
+
+static void send(int port, uint8_t command, uint8_t slot, uint16_t seq, const uint8_t * payload, uint16_t n, uint64_t atus) {
+  uint8_t packet[SX_MAX_PACKET];
+  uint16_t len=sx_build(packet,command,slot,seq,payload,n);
+  sim_midiin(port,atus,packet,len);
+}
+
+// next of our packets the unit sent on a port. false if there are none
+static bool nextpacket(int port, uint8_t * command, uint8_t * slot, uint16_t * seq, uint8_t * payload, int16_t * n, uint64_t * atus) {
+  simport &p=simmidi[port];
+  while (seen[port] < p.count) {
+    simmsg &m=p.log[seen[port]++];
+    if (!m.sysex) continue;
+    *n=sx_parse(m.sysex,m.len,command,slot,seq,payload);
+    *atus=m.ns/1000;
+    if (*n >= 0) return true;
+  }
+  return false;
+}
+
+static void skipoutput(void) {
+  for (int port=0; port<SIM_PORTS; ++port) seen[port]=simmidi[port].count;
+}
+
+// ask for a slot and ACK it through, or just take it in if it's paced. returns the us it took, 0 if it didn't finish
+static uint64_t dump(int port, uint8_t slot, uint8_t mode, uint8_t * out, size_t size, size_t * len) {
+  uint8_t command,s,payload[SX_CHUNK];
+  uint16_t seq;
+  int16_t n;
+  uint64_t at,start=sim_us();
+  *len=0;
+  skipoutput();
+  send(port,SX_DUMP_REQUEST,slot,0,&mode,1,start);
+  while (sim_us()-start < TIMEOUT_US) {
+    sim_run(1000);
+    while (nextpacket(port,&command,&s,&seq,payload,&n,&at)) {
+      if (command == SX_DONE) return at-start;
+      if (command == SX_DATA) {
+        if (*len+n <= size) memcpy(out+*len,payload,n);
+        *len+=n;
+      }
+      if (mode == SX_ACKED) send(port,SX_ACK,s,seq,0,0,at+REPLY_US);
+    }
+  }
+  return 0;
+}
+
+// send one packet and wait for the unit to answer it. returns SX_ACK or SX_NAK, 0 if it didn't
+static uint8_t exchange(int port, uint8_t command, uint8_t slot, uint16_t seq, const uint8_t * payload, uint16_t n) {
+  uint8_t c,s,reply[SX_CHUNK];
+  uint16_t q;
+  int16_t rn;
+  uint64_t at,start=sim_us();
+  skipoutput();
+  send(port,command,slot,seq,payload,n,start);
+  while (sim_us()-start < TIMEOUT_US/10) {
+    sim_run(500);
+    while (nextpacket(port,&c,&s,&q,reply,&rn,&at)) {
+      if ((s == slot) && ((c == SX_ACK) || (c == SX_NAK))) return c;
+    }
+  }
+  return 0;
+}
+
+// send a slot file to the unit. returns the answer to END - SX_ACK if the unit took it
+static uint8_t upload(int port, uint8_t slot, const uint8_t * data, size_t len, uint64_t * us) {
+  uint64_t start=sim_us();
+  uint8_t size[4]={(uint8_t)len,(uint8_t)(len >> 8),(uint8_t)(len >> 16),(uint8_t)(len >> 24)};
+  if (exchange(port,SX_BEGIN,slot,0,size,4) != SX_ACK) return 0;
+  uint16_t seq=1;
+  for (size_t i=0; i<len; i+=SX_CHUNK,++seq) {
+    uint16_t n=(len-i < SX_CHUNK) ? len-i : SX_CHUNK;
+    if (exchange(port,SX_DATA,slot,seq,data+i,n) != SX_ACK) return 0;
+  }
+  uint8_t reply=exchange(port,SX_END,slot,seq,0,0);
+  *us=sim_us()-start;
+  return reply;
+}
+
+static void save3(void) { saveconfig(3); }
+static void mark(void) { sim_stackmark(); }
+
+static uint8_t original[65536],copy[65536],bad[65536];
+static int16_t loadresult;
+static void load8(void) { loadresult=loadconfig(8); }
+
+int main() {
+  uint64_t wallstart=wallns();
+  sim_boot();
+  sim_run(3000000);  // past the power on message
+  sim_call(0,save3);
+  long len=sim_fs_get("slot3.json",original,sizeof(original));
+  printf("slot 3: %ld bytes\n",len);
+  CHECK(len > 0);
+
+  for (int port=SIM_USB; port<=SIM_DIN; ++port) {
+    uint32_t mallocs=simmallocs;
+    uint32_t packets=usbpackets;
+    size_t sent=simmidi[SIM_USB].count;
+    sim_call(0,mark);
+    size_t got;
+    uint64_t us=dump(port,3,SX_ACKED,copy,sizeof(copy),&got);
+    uint32_t dumpmallocs=simmallocs-mallocs;
+    size_t stack=sim_stackused(0);
+    printf("%s dump: %u bytes in %.0f ms, %.0f bytes/s, core 0 stack %u bytes, %u allocations\n",portnames[port],(unsigned)got,us/1e3,
+      us ? got*1e6/us : 0,(unsigned)stack,(unsigned)dumpmallocs);
+    CHECK(us > 0);
+    CHECK((long)got == len);
+    CHECK(!memcmp(copy,original,len));
+    CHECK(dumpmallocs == 0);
+    if (port == SIM_USB) {  // every packet the unit sent went through usbflush()'s count
+      uint32_t expected=0;
+      for (size_t i=sent; i<simmidi[SIM_USB].count; ++i) expected+=(simmidi[SIM_USB].log[i].len+2)/3;
+      printf("  %u USB event packets sent, %u counted\n",(unsigned)expected,(unsigned)(usbpackets-packets));
+      CHECK(usbpackets-packets == expected);
+    }
+
+    mallocs=simmallocs;
+    sim_call(0,mark);
+    uint8_t reply=upload(port,7,original,len,&us);
+    uint32_t uploadmallocs=simmallocs-mallocs;
+    stack=sim_stackused(0);
+    printf("%s import: %ld bytes in %.0f ms, %.0f bytes/s, core 0 stack %u bytes, %u allocations\n",portnames[port],len,us/1e3,
+      len*1e6/us,(unsigned)stack,(unsigned)uploadmallocs);
+    CHECK(reply == SX_ACK);
+    CHECK(sim_fs_get("slot7.json",copy,sizeof(copy)) == len);
+    CHECK(!memcmp(copy,original,len));
+    CHECK(uploadmallocs == 0);
+  }
+
+  // paced over DIN - the average from the first packet to the last, and the most bytes starting in any second
+  size_t first=simmidi[SIM_DIN].count,got;
+  uint64_t us=dump(SIM_DIN,3,SX_PACED,copy,sizeof(copy),&got);
+  CHECK(us > 0);
+  CHECK((long)got == len);
+  CHECK(!memcmp(copy,original,len));
+  simport &din=simmidi[SIM_DIN];
+  uint64_t bytes=0,worst=0;
+  for (size_t i=first; i<din.count; ++i) {
+    uint64_t insecond=0;
+    for (size_t j=i; (j<din.count) && (din.log[j].ns-din.log[i].ns < 1000000000); ++j) insecond+=din.log[j].len;
+    if (insecond > worst) worst=insecond;
+    if (i+1 < din.count) bytes+=din.log[i].len;  // the last packet's time isn't in the span
+  }
+  double span=(din.log[din.count-1].ns-din.log[first].ns)/1e9;
+  printf("DIN paced dump: %u packets in %.0f ms, %.0f bytes/s, most in a second %u bytes, budget %u bytes/s, %d ms spacing\n",
+    (unsigned)(din.count-first),us/1e3,bytes/span,(unsigned)worst,(unsigned)portbudget[PORT_DIN],SX_PACE_MS);
+  CHECK(bytes/span <= portbudget[PORT_DIN]);
+  CHECK(worst <= portbudget[PORT_DIN]+SX_MAX_PACKET);  // a second can catch a packet at each end
+  CHECK(worst < 3125);  // DIN's wire speed
+
+  printf("static RAM: %u bytes of transfer state, %u bytes to check a received slot\n",
+    (unsigned)(sizeof(sxpacket)+sizeof(sxfile)+sizeof(sxrxfile)),(unsigned)CONFIG_LOAD_BYTES);
+
+  // settings out of range are refused - over SysEx and when loading a slot that's already there
+  static const char * const bad_settings[][2]={
+    {"\"EncoderLabelIndex\":0","\"EncoderLabelIndex\":500"},
+    {"\"SwitchLabelIndex\":0","\"SwitchLabelIndex\":-1"},
+    {"\"EncoderChannel\":1","\"EncoderChannel\":0"},
+    {"\"SwitchChannel\":2","\"SwitchChannel\":17"},
+    {"\"EncoderCCNumber\":16","\"EncoderCCNumber\":300"},
+    {"\"EncoderColorIndex\":0","\"EncoderColorIndex\":40"},
+    {"\"EncoderType\":0","\"EncoderType\":5"},
+    {"\"SwitchType\":0","\"SwitchType\":9"},
+    {"\"EncoderPorts\":7","\"EncoderPorts\":255"},
+    {"\"EncoderMacro\":1","\"EncoderMacro\":0"},
+    {"\"Curve\":0","\"Curve\":77"},
+  };
+  int16_t label=controls[0].encoder[0].labelindex;
+  for (size_t b=0; b<sizeof(bad_settings)/sizeof(bad_settings[0]); ++b) {
+    const char * at=strstr((const char *)original,bad_settings[b][0]);
+    CHECK(at != 0);
+    if (!at) continue;
+    size_t pos=at-(const char *)original,oldlen=strlen(bad_settings[b][0]),newlen=strlen(bad_settings[b][1]);
+    memcpy(bad,original,pos);
+    memcpy(bad+pos,bad_settings[b][1],newlen);
+    memcpy(bad+pos+newlen,original+pos+oldlen,len-pos-oldlen);
+    size_t badlen=len-oldlen+newlen;
+    uint64_t us;
+    uint8_t reply=upload(SIM_USB,7,bad,badlen,&us);
+    bool kept=(sim_fs_get("slot7.json",copy,sizeof(copy)) == len) && !memcmp(copy,original,len);
+    sim_fs_put("slot8.json",bad,badlen);
+    sim_call(0,load8);
+    printf("  %s: import %s, slot %s, load %s\n",bad_settings[b][1],(reply == SX_NAK) ? "refused" : "taken",kept ? "kept" : "replaced",
+      loadresult ? "taken" : "refused");
+    CHECK(reply == SX_NAK);
+    CHECK(kept);
+    CHECK(sim_fs_get("slot7.tmp",copy,sizeof(copy)) < 0);
+    CHECK(loadresult == 0);
+    CHECK(controls[0].encoder[0].labelindex == label);
+  }
+  return report_done(wallstart);
+}
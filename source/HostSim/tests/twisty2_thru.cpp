@@ -0,0 +1,259 @@
+// MIDI thru and merge - how long forwarding adds, and that what's forwarded comes out whole and in order under a merge
+// USB and DIN are each passed on to the other
+// - one message at a time into an idle unit: reports the time from a message having arrived to it being sent on the
+//   other port, for each kind of message each way. all of them go on within a loop pass
+// - then both inputs busy at once for SECONDS - notes and CCs from USB with a 600 byte SysEx dump each second, notes from
+//   DIN, clock on both and an encoder turned between the dumps. each output's bytes are parsed back into messages: every
+//   message from the other input is there byte for byte, in the order it came in, none is cut short or mixed with
+//   another, and nothing is dropped. clock may overtake what's queued but keeps its own order. every CC from the encoder
+//   goes out on both ports
+// - reports how long forwarded messages waited under the merge. behind a dump on DIN that's the dump's wire time, and
+//   USB is held back for it - the computer waits rather than anything being dropped
+
+#include "Twisty2.cpp"
+#include "report.h"
+
+#define DIN_BYTE_US 320
+#define TURNED 6
+#define TURNS 21  // detents over the merge - each one redraws the display
+#define DUMP_BYTES 600
+#define SECONDS 3
+
+static const int ports[]={SIM_USB,SIM_DIN};
+
+// ----------------------------------------------------------------------------- forwarding time, one at a time
+
+struct kind {
+  const char * name;
+  uint8_t data[8];
+  uint8_t len;
+};
+
+static const kind kinds[]={
+  {"note on",{0x92,60,100},3},
+  {"CC",{0xb4,7,99},3},
+  {"program change",{0xc1,12},2},
+  {"pitch bend",{0xe0,0,64},3},
+  {"song position",{0xf2,5,1},3},
+  {"clock",{0xf8},1},
+  {"short SysEx",{0xf0,0x00,0x21,0x09,0x01,0x02,0x03,0xf7},8},
+};
+
+// added time for one kind of message on one route - n of them into an idle unit at odd moments
+static timestat forwarding(int in, int out, const kind &k, int n) {
+  timestat t={};
+  sim_midi_clear();
+  uint64_t start=sim_us()+1000;
+  uint64_t arrived[64];
+  for (int i=0; i<n; ++i) {
+    uint64_t at=start+i*7919;  // a prime number of us apart so the loop is caught at every phase
+    sim_midiin(in,at,k.data,k.len);
+    arrived[i]=at+((in == SIM_DIN) ? k.len*DIN_BYTE_US : 0);
+  }
+  sim_run(n*7919+20000);
+  simport &p=simmidi[out];
+  int got=0;
+  for (size_t i=0; (i < p.count) && (got < n); ++i) {
+    const uint8_t * d=p.log[i].sysex ? p.log[i].sysex : p.log[i].data;
+    if ((p.log[i].len != k.len) || memcmp(d,k.data,k.len)) continue;
+    t.add((p.log[i].queued/1000-arrived[got])*1000);
+    ++got;
+  }
+  CHECK(got == n);
+  return t;
+}
+
+// ----------------------------------------------------------------------------- merge
+
+#define MAX_MSGS 4000
+#define MAX_LEN DUMP_BYTES
+
+struct msg {
+  uint8_t data[MAX_LEN];
+  uint16_t len;
+  uint64_t at;  // us it had all arrived, or the output byte that ended it went out
+};
+
+// what went in on each port, and what came out on each parsed back into messages
+static msg sent[SIM_PORTS][MAX_MSGS];
+static int nsent[SIM_PORTS];
+static msg parsed[SIM_PORTS][MAX_MSGS];
+static int nparsed[SIM_PORTS];
+static uint32_t malformed[SIM_PORTS];
+
+static void feed(int port, uint64_t at, const uint8_t * data, uint16_t len) {
+  sim_midiin(port,at,data,len);
+  msg &m=sent[port][nsent[port]++];
+  memcpy(m.data,data,len);
+  m.len=len;
+  m.at=at+((port == SIM_DIN) ? len*DIN_BYTE_US : 0);
+}
+
+// a port's output as a byte stream, back into messages. real time bytes come out as their own message wherever they are
+static void parse(int port) {
+  simport &p=simmidi[port];
+  msg cur={};
+  bool insysex=false;
+  uint16_t want=0;
+  for (size_t i=0; i<p.count; ++i) {
+    const uint8_t * d=p.log[i].sysex ? p.log[i].sysex : p.log[i].data;
+    for (uint16_t b=0; b<p.log[i].len; ++b) {
+      uint8_t c=d[b];
+      uint64_t t=p.log[i].queued/1000;
+      if (c >= 0xf8) {
+        parsed[port][nparsed[port]++]={{c},1,t};
+        continue;
+      }
+      if (c & 0x80) {
+        if ((cur.len && !insysex) || (insysex && (c != 0xf7))) ++malformed[port];  // cut short
+        if (c == 0xf7) {
+          if (!insysex) {
+            ++malformed[port];
+            continue;
+          }
+          cur.data[cur.len++]=c;
+          cur.at=t;
+          parsed[port][nparsed[port]++]=cur;
+          cur.len=0;
+          insysex=false;
+          continue;
+        }
+        cur.len=0;
+        cur.data[cur.len++]=c;
+        insysex=(c == 0xf0);
+        want=insysex ? 0 : thru_msglen(c);
+      }
+      else {
+        if (!cur.len || (cur.len >= MAX_LEN)) {  // a data byte with no status - thru never uses running status
+          ++malformed[port];
+          continue;
+        }
+        cur.data[cur.len++]=c;
+      }
+      if (!insysex && (cur.len == want)) {
+        cur.at=t;
+        parsed[port][nparsed[port]++]=cur;
+        cur.len=0;
+      }
+    }
+  }
+  if (cur.len) ++malformed[port];
+}
+
+static bool same(const msg &a, const msg &b) {
+  return (a.len == b.len) && !memcmp(a.data,b.data,a.len);
+}
+
+static bool local(const msg &m) {
+  struct controllerencoder &e=controls[0].encoder[TURNED];
+  return (m.len == 3) && (m.data[0] == (0xb0 | (e.channel-1))) && (m.data[1] == e.ccnumber);
+}
+
+int main() {
+  uint64_t wallstart=wallns();
+  sim_boot();
+  sim_run(3000000);  // past the power on message
+  thruroute[PORT_USB]=1;  // DIN
+  thruroute[PORT_DIN]=1;  // USB
+
+  printf("added forwarding time, one message at a time - mean / max us:\n");
+  printf("  %-16s %14s %14s\n","","USB to DIN","DIN to USB");
+  uint64_t worst=0;
+  for (size_t k=0; k<sizeof(kinds)/sizeof(kinds[0]); ++k) {
+    timestat a=forwarding(SIM_USB,SIM_DIN,kinds[k],40);
+    timestat b=forwarding(SIM_DIN,SIM_USB,kinds[k],40);
+    printf("  %-16s %6.0f / %5.0f %6.0f / %5.0f\n",kinds[k].name,a.mean()/1e3,a.max/1e3,b.mean()/1e3,b.max/1e3);
+    worst=max(worst,max(a.max,b.max));
+  }
+  sim_loopstats_reset();
+  sim_run(100000);
+  uint64_t pass=simloops[0].simmax;
+  CHECK(worst <= pass+10000);  // within the loop pass it arrived in or the next one
+
+  // both ways at once with the encoder turned
+  sim_midi_clear();
+  uint64_t start=sim_us()+1000;
+  uint32_t seed=1;
+  uint8_t dump[DUMP_BYTES];
+  for (uint64_t t=0; t<SECONDS*1000000ull; t+=5000) {  // DIN: notes on channel 3 and a clock now and then
+    uint8_t note[3]={0x92,(uint8_t)(36+(t/5000) % 48),(uint8_t)(1+(t/5000) % 127)};
+    feed(SIM_DIN,start+t,note,3);
+    if (!((t/5000) % 4)) {
+      uint8_t clock=0xf8;
+      feed(SIM_DIN,start+t+2500,&clock,1);
+    }
+  }
+  for (uint64_t t=0; t<SECONDS*1000000ull; t+=2000) {  // USB: CCs and notes on channel 2, a clock every 20 ms and the dumps
+    seed=seed*1103515245+12345;
+    uint8_t m[3]={(uint8_t)(((seed >> 20) & 1) ? 0xb1 : 0x91),(uint8_t)((seed >> 8) & 0x7f),(uint8_t)((seed >> 16) & 0x7f)};
+    feed(SIM_USB,start+t,m,3);
+    if (!((t/2000) % 10)) {
+      uint8_t clock=0xf8;
+      feed(SIM_USB,start+t+1000,&clock,1);
+    }
+    if (((t/2000) % 500) == 100) {
+      dump[0]=0xf0;
+      dump[1]=0x00;  // someone else's SysEx - a three byte manufacturer ID
+      dump[2]=0x21;
+      dump[3]=0x09;
+      for (int i=4; i<DUMP_BYTES-1; ++i) dump[i]=(i*7+t) & 0x7f;
+      dump[DUMP_BYTES-1]=0xf7;
+      feed(SIM_USB,start+t+1500,dump,DUMP_BYTES);
+    }
+  }
+  int16_t drops=thrudrops;
+  sim_loopstats_reset();
+  sim_run(start+700000-sim_us());
+  for (int s=0; s<SECONDS; ++s) {  // turned between the dumps - a control moved during one ends it early on DIN
+    sim_spin(TURNED,1,20000,TURNS/SECONDS);
+    sim_run(1000000);
+  }
+  sim_run(2000000);
+
+  uint64_t mergepass=simloops[0].simmax;
+  uint32_t localout[SIM_PORTS]={};
+  for (int i=0; i<2; ++i) {
+    int out=ports[i];
+    int in=ports[1-i];
+    parse(out);
+    int next[2]={0,0};  // the next message in from the other input - real time and the rest, which real time can overtake
+    uint32_t missing=0,wrong=0;
+    timestat wait={},clockwait={};
+    for (int j=0; j<nparsed[out]; ++j) {
+      msg &m=parsed[out][j];
+      if (local(m)) {
+        ++localout[out];
+        continue;
+      }
+      int rt=(m.data[0] >= 0xf8);
+      int &n=next[rt];
+      while ((n < nsent[in]) && (((sent[in][n].data[0] >= 0xf8) != rt) || !same(sent[in][n],m))) {  // everything from the input, in order
+        missing+=((sent[in][n].data[0] >= 0xf8) == rt);
+        ++n;
+      }
+      if (n == nsent[in]) {
+        ++wrong;
+        continue;
+      }
+      uint64_t w=(m.at > sent[in][n].at) ? m.at-sent[in][n].at : 0;
+      if (rt) clockwait.add(w*1000);
+      else if (m.len <= 3) wait.add(w*1000);
+      ++n;
+    }
+    for (int rt=0; rt<2; ++rt) {
+      for (int n=next[rt]; n<nsent[in]; ++n) missing+=((sent[in][n].data[0] >= 0xf8) == rt);
+    }
+    printf("%s to %s under a merge: %d messages in, %u missing, %u not sent or out of order, %u malformed bytes. waited %.1f ms mean %.1f ms max, clock %.1f ms max\n",
+      portnames[in],portnames[out],nsent[in],(unsigned)missing,(unsigned)wrong,(unsigned)malformed[out],wait.mean()/1e6,wait.max/1e6,clockwait.max/1e6);
+    CHECK(missing == 0);
+    CHECK(wrong == 0);
+    CHECK(malformed[out] == 0);
+    if (in == SIM_DIN) CHECK(clockwait.max <= mergepass+1000000);  // only the loop pass that reads it - not the queues
+  }
+  printf("longest loop pass during the merge %.1f ms\n",mergepass/1e6);
+  printf("encoder turned %d detents: %u CCs on USB, %u on DIN. %d thru messages dropped\n",TURNS,(unsigned)localout[SIM_USB],(unsigned)localout[SIM_DIN],thrudrops-drops);
+  CHECK(localout[SIM_USB] > 0);
+  CHECK(localout[SIM_DIN] == localout[SIM_USB]);
+  CHECK(thrudrops == drops);
+  return report_done(wallstart);
+}
@@ -0,0 +1,63 @@
+// USB MIDI packing - the simulator's USB endpoint stands in for the host controller, a transfer per flush or full buffer
+// - every encoder moved at once goes out in as few transfers as the 64 byte buffer allows
+// - the firmware's packet and transfer counters agree with what the endpoint saw
+// - clock passed through from DIN to USB goes out the moment it's sent, whatever the loop is busy with after
+
+#include "Twisty2.cpp"
+#include "report.h"
+
+static uint32_t count(int port, uint8_t status) {
+  uint32_t n=0;
+  for (size_t i=0; i<simmidi[port].count; ++i) n+=(simmidi[port].log[i].data[0] == status) || ((status < 0xf0) && ((simmidi[port].log[i].data[0] & 0xf0) == status));
+  return n;
+}
+
+int main() {
+  uint64_t wallstart=wallns();
+  sim_boot();
+  sim_run(3000000);  // past the power on message
+
+  // all 16 encoders a detent each, a few times over
+  for (int round=0; round<4; ++round) {
+    sim_midi_clear();
+    uint32_t packets=usbpackets,transfers=usbtransfers;
+    for (int e=0; e<NUMENCODERS; ++e) sim_spin(e,1,2000,1);
+    sim_run(100000);
+    uint32_t ccs=count(SIM_USB,0xb0);
+    printf("16 encoders a detent each: %u CCs in %llu USB transfers, firmware counted %u packets in %u transfers\n",(unsigned)ccs,
+      (unsigned long long)simmidi[SIM_USB].transfers,(unsigned)(usbpackets-packets),(unsigned)(usbtransfers-transfers));
+    CHECK(ccs == NUMENCODERS);
+    CHECK(usbpackets-packets == simmidi[SIM_USB].count);
+    CHECK(simmidi[SIM_USB].transfers <= 2);  // one transfer holds 16 packets
+    CHECK(usbtransfers-transfers <= simmidi[SIM_USB].transfers);
+  }
+
+  // MIDI clock from DIN to USB at 120 BPM in the edit menu, scrolling through the controls so it keeps redrawing the display.
+  // nothing else is sent to USB there until the end of the loop pass
+  sim_button(SIM_LMENU,true);
+  sim_run(50000);
+  sim_button(SIM_LMENU,false);
+  sim_run(1000000);
+  CHECK(UI_state == UI_EDIT);
+  thruroute[PORT_DIN]=1;  // USB
+  sim_midi_clear();
+  uint64_t start=sim_us()+1000;
+  for (int i=0; i<48; ++i) sim_midiin3(SIM_DIN,start+i*20833,0xf8);
+  sim_spin(SIM_LMENU,1,20000,50);
+  sim_run(1100000);
+  simport &usb=simmidi[SIM_USB];
+  timestat wait={};
+  uint32_t clocks=0,stuck=0;
+  for (size_t i=0; i<usb.count; ++i) {
+    if (usb.log[i].data[0] != 0xf8) continue;
+    ++clocks;
+    if (usb.log[i].ns < usb.log[i].queued) ++stuck;  // still in the buffer
+    else wait.add(usb.log[i].ns-usb.log[i].queued);
+  }
+  printf("48 clocks DIN to USB in the edit menu: %u passed on, %.1f us mean %.1f us max from sent to out, %u never sent\n",
+    (unsigned)clocks,wait.mean()/1e3,wait.max/1e3,(unsigned)stuck);
+  CHECK(clocks == 48);
+  CHECK(stuck == 0);
+  CHECK(wait.max == 0);
+  return report_done(wallstart);
+}
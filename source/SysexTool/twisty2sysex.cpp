@@ -0,0 +1,221 @@
+// Copyright 2026 Rich Heslip
+//
+// Author: Rich Heslip
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// See http://creativecommons.org/licenses/MIT/ for more information.
+//
+// -----------------------------------------------------------------------------
+
+// Twisty 2 preset SysEx tool
+// converts Twisty 2 slot files (the JSON the controller saves) to and from .syx files
+// send the .syx files with any SysEx librarian. set it to wait at least 20ms between messages so DIN MIDI keeps up
+//
+// build:  g++ -O2 -o twisty2sysex twisty2sysex.cpp
+//
+// twisty2sysex encode out.syx slot file.json [slot file.json ...]   make a dump that loads the files into those slots
+// twisty2sysex decode in.syx [directory]                             unpack a recorded dump into slotN.json files
+// twisty2sysex request out.syx slot|all                              make a dump request for a librarian to send
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include "../Twisty2/sysexcodec.h"
+
+typedef std::vector<uint8_t> bytes;
+
+static bool readfile(const char * name, bytes &data) {
+  FILE * f=fopen(name,"rb");
+  if (!f) {
+    fprintf(stderr,"can't open %s\n",name);
+    return false;
+  }
+  uint8_t buf[4096];
+  size_t n;
+  while ((n=fread(buf,1,sizeof(buf),f)) > 0) data.insert(data.end(),buf,buf+n);
+  fclose(f);
+  return true;
+}
+
+static bool writefile(const char * name, const bytes &data) {
+  FILE * f=fopen(name,"wb");
+  if (!f) {
+    fprintf(stderr,"can't create %s\n",name);
+    return false;
+  }
+  bool ok=fwrite(data.data(),1,data.size(),f) == data.size();
+  if (fclose(f) != 0) ok=false;
+  if (!ok) fprintf(stderr,"error writing %s\n",name);
+  return ok;
+}
+
+static void addpacket(bytes &out, uint8_t command, uint8_t slot, uint16_t seq, const uint8_t * payload, uint16_t n) {
+  uint8_t packet[SX_MAX_PACKET];
+  uint16_t len=sx_build(packet,command,slot,seq,payload,n);
+  out.insert(out.end(),packet,packet+len);
+}
+
+static int encode(int argc, char ** argv) {
+  bytes out;
+  if ((argc < 5) || (argc % 2 == 0)) {
+    fprintf(stderr,"usage: twisty2sysex encode out.syx slot file.json [slot file.json ...]\n");
+    return 1;
+  }
+  for (int a=3; a<argc; a+=2) {
+    int slot=atoi(argv[a]);
+    if ((slot < 1) || (slot > 16)) {
+      fprintf(stderr,"slot must be 1 to 16\n");
+      return 1;
+    }
+    bytes json;
+    if (!readfile(argv[a+1],json)) return 1;
+    if (json.empty() || (json[0] != '{')) {
+      fprintf(stderr,"%s doesn't look like a Twisty 2 slot file\n",argv[a+1]);
+      return 1;
+    }
+    if (json.size()/SX_CHUNK+2 > 0x3fff) {  // sequence numbers are 14 bits
+      fprintf(stderr,"%s is too big\n",argv[a+1]);
+      return 1;
+    }
+    uint32_t size=json.size();
+    uint8_t sizebytes[4]={(uint8_t)size,(uint8_t)(size >> 8),(uint8_t)(size >> 16),(uint8_t)(size >> 24)};
+    uint16_t seq=0;
+    addpacket(out,SX_BEGIN,slot,seq,sizebytes,4);
+    for (size_t i=0; i<json.size(); i+=SX_CHUNK) {
+      size_t n=json.size()-i;
+      if (n > SX_CHUNK) n=SX_CHUNK;
+      addpacket(out,SX_DATA,slot,++seq,&json[i],n);
+    }
+    addpacket(out,SX_END,slot,++seq,0,0);
+    printf("slot %d: %u bytes in %u packets\n",slot,(unsigned)size,(unsigned)seq+1);
+  }
+  if (!writefile(argv[2],out)) return 1;
+  printf("%u bytes of SysEx, about %.1f seconds over DIN MIDI\n",(unsigned)out.size(),out.size()/3125.0);
+  return 0;
+}
+
+static int decode(int argc, char ** argv) {
+  if (argc < 3) {
+    fprintf(stderr,"usage: twisty2sysex decode in.syx [directory]\n");
+    return 1;
+  }
+  const char * dir=(argc > 3) ? argv[3] : ".";
+  bytes in;
+  if (!readfile(argv[2],in)) return 1;
+
+  bytes file;
+  int slot=-1;
+  uint16_t expected=0;
+  uint32_t size=0;
+  int saved=0,errors=0;
+  size_t start=0;
+  while (start < in.size()) {
+    if (in[start] != 0xf0) {  // skip anything between messages
+      ++start;
+      continue;
+    }
+    size_t end=start+1;
+    while ((end < in.size()) && (in[end] != 0xf7)) ++end;
+    if (end >= in.size()) break;
+    uint8_t command,pslot;
+    uint16_t seq;
+    uint8_t payload[SX_CHUNK];
+    int16_t n=sx_parse(&in[start],end-start+1,&command,&pslot,&seq,payload);
+    start=end+1;
+    if (n < 0) continue;  // someone else's SysEx or damaged - a damaged DATA packet shows up as a sequence error
+    switch (command) {
+      case SX_BEGIN:
+        if (slot >= 0) {
+          fprintf(stderr,"slot %d is incomplete\n",slot);
+          ++errors;
+        }
+        slot=pslot;
+        expected=1;
+        size=(n == 4) ? payload[0] | (payload[1] << 8) | ((uint32_t)payload[2] << 16) | ((uint32_t)payload[3] << 24) : 0;
+        file.clear();
+        break;
+      case SX_DATA:
+        if ((slot != pslot) || (seq != expected)) {
+          if (slot == pslot) fprintf(stderr,"slot %d: packet %u missing\n",slot,expected);
+          if (slot >= 0) ++errors;
+          slot=-1;
+          break;
+        }
+        file.insert(file.end(),payload,payload+n);
+        ++expected;
+        break;
+      case SX_END:
+        if ((slot != pslot) || (seq != expected) || (file.size() != size)) {
+          if (slot == pslot) {
+            fprintf(stderr,"slot %d: got %u of %u bytes\n",slot,(unsigned)file.size(),(unsigned)size);
+            ++errors;
+          }
+          slot=-1;
+          break;
+        }
+        {
+          char name[1024];
+          snprintf(name,sizeof(name),"%s/slot%d.json",dir,slot);
+          if (writefile(name,file)) {
+            printf("%s: %u bytes\n",name,(unsigned)file.size());
+            ++saved;
+          }
+          else ++errors;
+        }
+        slot=-1;
+        break;
+      default:  // requests, ACKs and the end of dump marker
+        break;
+    }
+  }
+  if (slot >= 0) {
+    fprintf(stderr,"slot %d is incomplete\n",slot);
+    ++errors;
+  }
+  if (!saved && !errors) fprintf(stderr,"no Twisty 2 slots found in %s\n",argv[2]);
+  return (errors || !saved) ? 1 : 0;
+}
+
+static int request(int argc, char ** argv) {
+  if (argc < 4) {
+    fprintf(stderr,"usage: twisty2sysex request out.syx slot|all\n");
+    return 1;
+  }
+  int slot=strcmp(argv[3],"all") == 0 ? SX_ALLSLOTS : atoi(argv[3]);
+  if ((slot != SX_ALLSLOTS) && ((slot < 1) || (slot > 16))) {
+    fprintf(stderr,"slot must be 1 to 16 or all\n");
+    return 1;
+  }
+  bytes out;
+  uint8_t mode=SX_PACED;  // a librarian won't send ACKs
+  addpacket(out,SX_DUMP_REQUEST,slot,0,&mode,1);
+  return writefile(argv[2],out) ? 0 : 1;
+}
+
+int main(int argc, char ** argv) {
+  if (argc > 1) {
+    if (strcmp(argv[1],"encode") == 0) return encode(argc,argv);
+    if (strcmp(argv[1],"decode") == 0) return decode(argc,argv);
+    if (strcmp(argv[1],"request") == 0) return request(argc,argv);
+  }
+  fprintf(stderr,"usage: twisty2sysex encode|decode|request ...\n");
+  return 1;
+}
@@ -9,18 +9,19 @@
 // http://www.mikrocontroller.net/articles/Drehgeber
 // ----------------------------------------------------------------------------
 // RH added button edge events which are needed sometimes Dec 2025
+// RH service() returns true when the encoder moved and counts invalid transitions so the scan rate can follow the encoders
 
 #include "ClickEncoder.h"
 
 // ----------------------------------------------------------------------------
-// Button configuration (values for 1ms timer service calls)
+// Button configuration (in milliseconds - independent of the service call rate)
 //
 #define ENC_BUTTONINTERVAL    10  // check button every x milliseconds, also debouce time
 #define ENC_DOUBLECLICKTIME  800  // second click within 00ms
 #define ENC_HOLDTIME        500  // report held button after .5s
 
 // ----------------------------------------------------------------------------
-// Acceleration configuration (for 1000Hz calls to ::service())
+// Acceleration configuration - increment per step, decrement per millisecond
 //
 #define ENC_ACCEL_TOP      3072   // max. acceleration: *12 (val >> 8)
 #define ENC_ACCEL_INC        50
@@ -65,19 +66,19 @@ ClickEncoder::ClickEncoder(uint8_t A, uint8_t B, uint8_t BTN, uint8_t stepsPerNo
 }
 
 // ----------------------------------------------------------------------------
-// call this every 1 millisecond via timer ISR
+// call this every millisecond or faster via timer ISR
+// returns true if the encoder moved
 //
-void ClickEncoder::service(void)
+bool ClickEncoder::service(void)
 {
   bool moved = false;
   unsigned long now = millis();
 
-  if (accelerationEnabled) { // decelerate every tick
-    acceleration -= ENC_ACCEL_DEC;
-    if (acceleration & 0x8000) { // handle overflow of MSB is set
-      acceleration = 0;
-    }
+  if (accelerationEnabled && (now != lastAccelDecay)) { // decelerate every millisecond whatever the scan rate
+    uint32_t dec = (now - lastAccelDecay) * ENC_ACCEL_DEC;
+    acceleration = (acceleration > dec) ? acceleration - dec : 0;
   }
+  lastAccelDecay = now;
 
 #if ENC_DECODER == ENC_FLAKY
   last = (last << 2) & 0x0F;
@@ -95,6 +96,9 @@ void ClickEncoder::service(void)
     delta += tbl;
     moved = true;
   }
+  else if ((((last >> 2) ^ last) & 3) == 3) { // both inputs changed - scanned too slowly to see the step
+    ++errors;
+  }
 #elif ENC_DECODER == ENC_NORMAL
   int8_t curr = 0;
 
@@ -112,6 +116,11 @@ void ClickEncoder::service(void)
     last = curr;
     delta += (diff & 2) - 1; // bit 1 = direction (+/-)
     moved = true;
+    errorState = -1;
+  }
+  else if (diff && (curr != errorState)) { // skipped a state - scanned too slowly to tell which way it went
+    ++errors;
+    errorState = curr;       // count it once, last stays put until a valid step
   }
 #else
 # error "Error: define ENC_DECODER to ENC_NORMAL or ENC_FLAKY"
@@ -184,6 +193,7 @@ void ClickEncoder::service(void)
   }
 #endif // WITHOUT_BUTTON
 
+  return moved;
 }
 
 // ----------------------------------------------------------------------------
@@ -0,0 +1,143 @@
+// MIDI input handling for Twisty 2
+// when the DAW or synth changes a parameter it usually sends the CC back out. we use that to keep controls[].value in sync
+// so the next twist of the encoder carries on from the real value instead of jumping
+//
+// incoming CCs are looked up in a reverse index from (channel, CC) to the control slots mapped to it
+// the index is rebuilt only when mappings change - init, config load and leaving the edit menu
+// each (channel, CC) entry is the head of a chain through ccnext[] so several controls can share a CC
+// the callbacks only update values and LEDs. the control on show is redrawn once per loop pass if ccfeedbackdirty is set -
+// a display update takes ~12ms and a DAW can send dozens of CCs in one USB transfer
+
+#define NUMSLOTS (CONTROLLER_PAGES*NUMENCODERS*2)  // an encoder and a switch per control
+#if NUMSLOTS > 255
+typedef uint16_t ccslot_t;  // more pages than slot numbers fit in a byte
+#define NOSLOT 0xffff  // end of a slot chain
+#else
+typedef uint8_t ccslot_t;
+#define NOSLOT 0xff
+#endif
+
+#define ECHO_HOLDOFF_MS 250  // ignore incoming values for a control this long after we sent it - stops the DAW echo fighting the encoder
+
+ccslot_t ccindex[16][128];  // first slot mapped to each channel and CC
+ccslot_t ccnext[NUMSLOTS];  // next slot mapped to the same channel and CC
+bool ccfeedbackdirty;      // an incoming CC changed the control on the display
+uint32_t lastlocalcc[NUMSLOTS];  // time we last sent a CC for each slot, 0 if we haven't - so CCs at power on aren't held off
+
+// MIDI clock and transport from the DAW - the automation recorder follows these
+uint32_t midiclocks;      // clocks received and not yet counted by the recorder
+uint32_t midiclocktime;   // time of the last clock
+bool midirunning=true;    // false after a Stop until a Start or Continue
+bool midistarted;         // a Start came in since the recorder last looked
+
+// slot number for a control. kind is ENCODER or BUTTON
+ccslot_t ccslot(int16_t p, int16_t kind, int16_t index) {
+  return (p*2+kind)*NUMENCODERS+index;
+}
+
+// add a slot to the chain for its channel and CC
+void addccslot(ccslot_t slot, int16_t channel, int16_t cc) {
+  if ((channel < 1) || (channel > 16) || (cc < 0) || (cc > 127)) return;
+  ccnext[slot]=ccindex[channel-1][cc];
+  ccindex[channel-1][cc]=slot;
+}
+
+// rebuild the reverse index - call whenever channel, CC or switch type mappings change
+void buildccindex(void) {
+  memset(ccindex,NOSLOT,sizeof(ccindex));
+  for (int16_t p=0;p<CONTROLLER_PAGES;++p) {
+    for (int16_t i=0; i<NUMENCODERS;++i) {
+      if (controls[p].encoder[i].type == CCTYPE) addccslot(ccslot(p,ENCODER,i),controls[p].encoder[i].channel,controls[p].encoder[i].ccnumber);
+      if (controls[p].encswitch[i].type == CCMESSAGE) addccslot(ccslot(p,BUTTON,i),controls[p].encswitch[i].channel,controls[p].encswitch[i].ccnumber);
+    }
+  }
+}
+
+// note that we just sent a CC for a control so its echo is ignored
+void markccsent(int16_t p, int16_t kind, int16_t index) {
+  lastlocalcc[ccslot(p,kind,index)]=millis() | 1;  // never 0
+}
+
+// apply an incoming CC to every control mapped to it
+// values are never sent back out from here so there is no feedback loop
+void ccfeedback(uint8_t channel, uint8_t cc, uint8_t value) {
+  for (ccslot_t slot=ccindex[channel & 0x0f][cc & 0x7f]; slot != NOSLOT; slot=ccnext[slot]) {
+    if (lastlocalcc[slot] && ((millis()-lastlocalcc[slot]) < ECHO_HOLDOFF_MS)) continue; // we're sending this one ourselves
+    int16_t p=slot/(NUMENCODERS*2);
+    int16_t index=slot%NUMENCODERS;
+    if ((slot/NUMENCODERS)%2 == ENCODER) {
+      int16_t v=value;
+      int16_t lo=min(controls[p].encoder[index].minvalue,controls[p].encoder[index].maxvalue); // range may be reversed
+      int16_t hi=max(controls[p].encoder[index].minvalue,controls[p].encoder[index].maxvalue);
+      v=constrain(v,lo,hi);
+      if (controls[p].encoder[index].value == v) continue;
+      controls[p].encoder[index].value=v;
+      if ((p == page) && !displaySwitchLEDs) showencoderLED(p,index);
+      else setencoderframe(p,index);  // keep the page's LED frame current for when it's shown
+      if (p != page) continue;  // not visible
+      if ((UI_state == UI_SEND_MIDI) && (index == lastcontrol) && (lastcontroltype == ENCODER)) ccfeedbackdirty=true;
+    }
+    else {
+      if (controls[p].encswitch[index].value == value) continue;
+      controls[p].encswitch[index].value=value;
+      if ((p == page) && displaySwitchLEDs) showswitchLED(p,index);
+      else setswitchframe(p,index);
+      if (p != page) continue;  // not visible
+      if ((UI_state == UI_SEND_MIDI) && (index == lastcontrol) && (lastcontroltype == BUTTON)) ccfeedbackdirty=true;
+    }
+  }
+}
+
+// Control Surface callbacks - these run inside MIDI_Interface::updateAll() in the main loop
+struct MyMIDI_Callbacks : FineGrainedMIDI_Callbacks<MyMIDI_Callbacks> {
+
+  // everything is offered to the thru router first, then split up into the handlers below
+  void onChannelMessage(MIDI_Interface &midi, ChannelMessage msg) override {
+    thru_message(midi,msg.header,msg.data1,msg.data2);
+    FineGrainedMIDI_Callbacks<MyMIDI_Callbacks>::onChannelMessage(midi,msg);
+  }
+
+  void onSysCommonMessage(MIDI_Interface &midi, SysCommonMessage msg) override {
+    thru_message(midi,msg.header,msg.data1,msg.data2);
+    FineGrainedMIDI_Callbacks<MyMIDI_Callbacks>::onSysCommonMessage(midi,msg);
+  }
+
+  void onRealTimeMessage(MIDI_Interface &midi, RealTimeMessage msg) override {
+    thru_realtime(midi,msg);
+    FineGrainedMIDI_Callbacks<MyMIDI_Callbacks>::onRealTimeMessage(midi,msg);
+  }
+
+  void onControlChange(Channel channel, uint8_t controller, uint8_t value, Cable cable) {
+    bootstamp(BOOT_FIRSTMIDI);
+    ccfeedback(channel.getRaw(),controller,value);
+  }
+
+  void onClock(Cable cable) {
+    bootstamp(BOOT_FIRSTMIDI);
+    ++midiclocks;
+    midiclocktime=millis();
+  }
+
+  void onStart(Cable cable) {
+    bootstamp(BOOT_FIRSTMIDI);
+    midiclocks=0;
+    midirunning=true;
+    midistarted=true;
+  }
+
+  void onContinue(Cable cable) {
+    midirunning=true;
+  }
+
+  void onStop(Cable cable) {
+    midirunning=false;
+  }
+
+  // SysEx needs the port it came in on so replies go back the same way - onSystemExclusive() doesn't get that
+  void onSysExMessage(MIDI_Interface &midi, SysExMessage msg) override {
+    bootstamp(BOOT_FIRSTMIDI);
+    thru_sysex(midi,msg);
+    sysex_receive(midi,msg);
+  }
+
+} callback;
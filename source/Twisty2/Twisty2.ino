@@ -41,10 +41,9 @@
 #include <Adafruit_SSD1306.h>
 #include <Adafruit_TinyUSB.h>  
 #include <MIDI.h>
-#include "Clickencoder.h"
+#include "ClickEncoder.h"
 //#include "StepSeq.h"
 #include <Adafruit_NeoPixel.h>
-#include <ArduinoJson.h>
 #include "LittleFS.h"
 #include <Control_Surface.h>
 
@@ -53,6 +52,9 @@
 #include <MIDI_Interfaces/BluetoothMIDI_Interface.hpp>
 #endif
 
+//#define BENCHMARK  // define to run the microbenchmarks in bench.h at startup - results are printed to USB serial
+//#define PROFILE  // define to time the ISR and main loop stages - results show on the Stats page (double click the right encoder) and on USB serial
+
 #define TRUE 1
 #define FALSE 0
 
@@ -95,6 +97,7 @@ Adafruit_SSD1306 display(SCREEN_WIDTH, SCREEN_HEIGHT, &Wire1, OLED_RESET);
 #define DISPLAY_BLANK_MS 120*1000  // display blanking time
 #define LEDFLASH_EDIT  250   // LED flash while editing
 int32_t displaytimer ; // display blanking timer
+bool displayblanked=false;  // the panel is switched off
 int32_t LEDtimer; // LED flash timer
 bool LEDstate;   // for LED flash
 #define OLED_DISPLAY   // for graphics conditionals
@@ -155,13 +158,23 @@ BluetoothMIDI_Interface bleMIDI;
 
 #define BASE_CC 16  // lowest default CC number to use
 #define DEFAULT_VELOCITY 127
+#ifndef CONTROLLER_PAGES
 #define CONTROLLER_PAGES 4  // number of pages
+#endif
 #define DEFAULT_ENCODER_CHANNEL 1  // default MIDI channel for encoders
 #define DEFAULT_SWITCH_CHANNEL 2  // default MIDI channel for encoders
+#define ALL_PORTS 7  // control sends on USB, DIN and BLE - bit for each of the ports enum below
 uint16_t page=0; // CC page 0-3
-uint8_t lastnotesent=0; // keeps track of last note sent when switch sends note messages
+// the note each switch that sends notes has sounding, and the ports and channel it went out on. its note off goes the same
+// way even if the page or the switch's settings have changed since
+struct switchnote {
+  int16_t ports;  // 0 when there's no note sounding
+  uint8_t channel;
+  uint8_t note;
+};
+struct switchnote lastnotesent[NUMENCODERS];
 bool displaySwitchLEDs;    // toggle to show switch or encoder states
-enum encodertypes {CCTYPE};
+enum encodertypes {CCTYPE,MACROTYPE};
 enum switchmodes {MOMENTARY,TOGGLE};
 enum switchtypes {CCMESSAGE,PCMESSAGE,NOTEMESSAGE,SETENC};
 
@@ -174,6 +187,11 @@ struct controllerencoder {
   int16_t value;
   int16_t colorindex;  // index into color lookup table leds are 8 bits R, G and B
   int16_t labelindex; // index of label
+  int16_t red;    // LED color - set from colorindex or edited directly
+  int16_t green;
+  int16_t blue;
+  int16_t macro;  // macro number 1-16 for MACROTYPE
+  int16_t ports;  // bit mask of the MIDI outputs it sends on
 };
 
 struct controllerswitch {
@@ -186,6 +204,7 @@ struct controllerswitch {
   int16_t value;
   int16_t colorindex;
   int16_t labelindex; // index of label
+  int16_t ports;
 };
 
 struct controllerpage {
@@ -212,6 +231,9 @@ void initcontrols(void) {
       controls[p].encoder[i].value=64;
       controls[p].encoder[i].colorindex=p;
       controls[p].encoder[i].labelindex=0;  // label index 0 is "CC"
+      setpalettecolor(&controls[p].encoder[i]);
+      controls[p].encoder[i].macro=i+1;
+      controls[p].encoder[i].ports=ALL_PORTS;
       controls[p].encswitch[i].mode=TOGGLE;
       controls[p].encswitch[i].type=CCTYPE;
       controls[p].encswitch[i].channel=DEFAULT_SWITCH_CHANNEL;
@@ -221,6 +243,7 @@ void initcontrols(void) {
       controls[p].encswitch[i].value=0;
       controls[p].encswitch[i].colorindex=p;  // not used for now
       controls[p].encswitch[i].labelindex=0;  // label index 0 is "CC"
+      controls[p].encswitch[i].ports=ALL_PORTS;
       ++ccnum;
     }  
   }
@@ -233,6 +256,7 @@ int16_t saverestore_confirm=0; // take/don't take action
 
 enum control {ENCODER,BUTTON};
 int16_t lastcontrol=0; // keeps track of last used control
+int16_t lastcontroltype=ENCODER; // and whether it was the encoder or the switch
 
 // copy encoder parameters to temporary parameters for editing
 // this allows one menu for all encoders vs 64 almost identical menus
@@ -244,6 +268,12 @@ void copy_to_editbuffer(int16_t page,int16_t index) {
   editbuffer.encoder.maxvalue=controls[page].encoder[index].maxvalue;
   editbuffer.encoder.colorindex=controls[page].encoder[index].colorindex;
   editbuffer.encoder.labelindex=controls[page].encoder[index].labelindex;
+  editbuffer.encoder.red=controls[page].encoder[index].red;
+  editbuffer.encoder.green=controls[page].encoder[index].green;
+  editbuffer.encoder.blue=controls[page].encoder[index].blue;
+  editbuffer.encoder.macro=controls[page].encoder[index].macro;
+  editbuffer.encoder.ports=controls[page].encoder[index].ports;
+  loadmacroedit();
   editbuffer.encswitch.mode=controls[page].encswitch[index].mode;
   editbuffer.encswitch.type=controls[page].encswitch[index].type;
   editbuffer.encswitch.channel=controls[page].encswitch[index].channel;
@@ -252,6 +282,7 @@ void copy_to_editbuffer(int16_t page,int16_t index) {
   editbuffer.encswitch.maxvalue=controls[page].encswitch[index].maxvalue;
   editbuffer.encswitch.colorindex=controls[page].encswitch[index].colorindex;
   editbuffer.encswitch.labelindex=controls[page].encswitch[index].labelindex;
+  editbuffer.encswitch.ports=controls[page].encswitch[index].ports;
 }
 
 // copy edited temporary parameters to encoder parameters
@@ -263,6 +294,11 @@ void restore_from_editbuffer(int16_t page,int16_t index) {
   controls[page].encoder[index].maxvalue=editbuffer.encoder.maxvalue;
   controls[page].encoder[index].colorindex=editbuffer.encoder.colorindex;
   controls[page].encoder[index].labelindex=editbuffer.encoder.labelindex;
+  controls[page].encoder[index].red=editbuffer.encoder.red;
+  controls[page].encoder[index].green=editbuffer.encoder.green;
+  controls[page].encoder[index].blue=editbuffer.encoder.blue;
+  controls[page].encoder[index].macro=editbuffer.encoder.macro;
+  controls[page].encoder[index].ports=editbuffer.encoder.ports;
   controls[page].encswitch[index].mode=editbuffer.encswitch.mode;
   controls[page].encswitch[index].type=editbuffer.encswitch.type;
   controls[page].encswitch[index].channel=editbuffer.encswitch.channel;
@@ -271,166 +307,301 @@ void restore_from_editbuffer(int16_t page,int16_t index) {
   controls[page].encswitch[index].maxvalue=editbuffer.encswitch.maxvalue;
   controls[page].encswitch[index].colorindex=editbuffer.encswitch.colorindex;
   controls[page].encswitch[index].labelindex=editbuffer.encswitch.labelindex;
+  controls[page].encswitch[index].ports=editbuffer.encswitch.ports;
 }
 
-enum ui_states {UI_SEND_MIDI,UI_EDIT,UI_LOADSAVE};
+enum ui_states {UI_SEND_MIDI,UI_EDIT,UI_LOADSAVE,UI_STATS,UI_WAIT,UI_FATAL};  // UI_WAIT - a task puts the UI back
 int16_t UI_state=UI_SEND_MIDI;
 
-#define TIMER_MICROS 1000 // interrupt period
+#define TIMER_MICROS 1000 // scan period when the encoders are idle
+#define SCAN_SLEEP_MICROS 2000 // scan period once nothing has moved for SCAN_SLEEP_HOLD_MICROS - buttons are only checked every 10ms anyway
+#define TIMER_MICROS_FAST 250 // scan period while any encoder is turning - a full scan takes roughly 100us so 4kHz keeps it under half of core 0
+#define SCAN_HOLD_MICROS 250000 // stay at the fast rate this long after the last step
+#define SCAN_SLEEP_HOLD_MICROS 10000000 // drop to the sleep rate after this long without a step
+#define SCAN_MIN_LEAD 10  // an alarm set less than this far ahead could be missed
+
+// stages timed by the profiler - order must match the Stats menu page
+#ifdef PROFILE
+enum profstages {PROF_ISR,PROF_LOOP,PROF_MIDI,PROF_ENCODERS,PROF_SWITCHES,PROF_MENU,PROF_DISPLAY,PROF_LEDSHOW,NUM_PROF_STAGES};
+const char * const profnames[NUM_PROF_STAGES]={"alarm_irq","loop","MIDI update","encoders","switches","menu","display","LEDS.show"};
+#endif
+#include "boot.h"
+#include "profiler.h"
 
 // RP2040 timer code from https://github.com/raspberrypi/pico-examples/blob/master/timer/timer_lowlevel/timer_lowlevel.c
 // Use alarm 0
 #define ALARM_NUM 0
 #define ALARM_IRQ timer_hardware_alarm_get_irq_num(timer_hw, ALARM_NUM)
 
+// the scan runs on absolute deadlines - each one is the last plus the period so the ISR's own run time doesn't stretch the period
+uint32_t scandeadline;  // timer count of the next scan
+uint32_t scanperiod=TIMER_MICROS;
+uint32_t scanidle;      // us since any encoder last moved
+
 static void alarm_in_us(uint32_t delay_us) {
   hw_set_bits(&timer_hw->inte, 1u << ALARM_NUM);
   irq_set_exclusive_handler(ALARM_IRQ, alarm_irq);
   irq_set_enabled(ALARM_IRQ, true);
+  scandeadline=timer_hw->timerawl;
   alarm_in_us_arm(delay_us);
 }
 
 static void alarm_in_us_arm(uint32_t delay_us) {
-  uint64_t target = timer_hw->timerawl + delay_us;
-  timer_hw->alarm[ALARM_NUM] = (uint32_t) target;
+  scandeadline+=delay_us;
+  int32_t ahead=scandeadline-timer_hw->timerawl;
+  if ((ahead < SCAN_MIN_LEAD) || (ahead > (int32_t)delay_us)) scandeadline=timer_hw->timerawl+delay_us; // fell behind (or was called outside the ISR) - start over rather than bunch up scans
+  timer_hw->alarm[ALARM_NUM] = scandeadline;
 }
 
-// timer interrupt handler
-// scans thru the multiplexed encoders and handles the menu encoders
-
-static void alarm_irq(void) {
+// one pass over all the encoders - true if any of them moved
+static bool scan_encoders(void) {
+  bool moved=false;
   for (int addr=0; addr< NUMENCODERS;++addr) {
     digitalWrite(A_MUX_0, addr & 1);
     digitalWrite(A_MUX_1, addr & 2);
     digitalWrite(A_MUX_2, addr & 4);
     digitalWrite(A_MUX_3, addr & 8); 
     delayMicroseconds(4);         // address settling time 
-    enc[addr].service();    // check the encoder inputs
+    moved|=enc[addr].service();    // check the encoder inputs
   } 
-  lmenuenc.service(); // handle the menu encoders which are on different port pins
-  rmenuenc.service(); // 
+  moved|=lmenuenc.service(); // handle the menu encoders which are on different port pins
+  moved|=rmenuenc.service(); // 
+  return moved;
+}
+
+// timer interrupt handler
+// scans thru the multiplexed encoders and handles the menu encoders
+// scans at TIMER_MICROS_FAST while anything is turning so fast spins don't skip quadrature states, TIMER_MICROS otherwise
+// and SCAN_SLEEP_MICROS when the unit has been left alone. the first step seen puts it straight back to the fast rate
+
+static void alarm_irq(void) {
+  PROF_START(PROF_ISR);
+  bool moved=scan_encoders();
+  if (moved) scanidle=0;
+  else if (scanidle < SCAN_SLEEP_HOLD_MICROS) scanidle+=scanperiod;
+  if (scanidle < SCAN_HOLD_MICROS) scanperiod=TIMER_MICROS_FAST;
+  else if (scanidle < SCAN_SLEEP_HOLD_MICROS) scanperiod=TIMER_MICROS;
+  else scanperiod=SCAN_SLEEP_MICROS;
   hw_clear_bits(&timer_hw->intr, 1u << ALARM_NUM); // clear IRQ flag
-  alarm_in_us_arm(TIMER_MICROS);  // reschedule interrupt
+  alarm_in_us_arm(scanperiod);  // reschedule interrupt
+  PROF_END(PROF_ISR);
+  PROF_OVERRUN(PROF_ISR,scanperiod);
 }
 
+// invalid quadrature transitions seen by all the encoders - each one is a step that was missed
+uint16_t encodererrors(void) {
+  uint16_t errors=lmenuenc.getErrors()+rmenuenc.getErrors();
+  for (int16_t i=0; i< NUMENCODERS;++i) errors+=enc[i].getErrors();
+  return errors;
+}
+
+enum ports {PORT_USB,PORT_DIN,PORT_BLE,NUM_PORTS};  // MIDI outputs
+int16_t thruroute[NUM_PORTS];  // where each input is passed on to - see thru.h
+int16_t thrudrops;             // messages thru.h dropped because a queue was full - stops at 32767
+
+#include "budget.h"  // one output budget per port - needs the ports and the MIDI interfaces
+
+// USB MIDI event packets are collected in the Control Surface USB buffer instead of each going out as its own USB transfer
+// usbflush() sends everything collected as one transfer - call it at the end of each batch of sends
+// real time messages go through sendrealtime() which sends straight away
+uint32_t usbpending;    // event packets waiting in the buffer
+uint32_t usbpackets;    // event packets sent
+uint32_t usbtransfers;  // flushes that had something to send
+
+void usbflush(void) {
+  usbMIDI.sendNow();
+  if (usbpending) {
+    usbpackets+=usbpending;
+    ++usbtransfers;
+    usbpending=0;
+  }
+}
+
+void sendrealtime(MIDIMessageType message) {
+  usbMIDI.sendRealTime(message);
+  ++usbpending;
+  usbflush();
+  budget_spend(PORT_USB,1);
+  serialMIDI.sendRealTime(message);
+  budget_spend(PORT_DIN,1);
+#ifdef BLUETOOTH
+  bleMIDI.sendRealTime(message);
+  budget_spend(PORT_BLE,1);
+#endif
+}
+
+#ifdef PROFILE
+int16_t usbperxfer;  // event packets per USB transfer - shown as a float in thousandths
+int16_t usbxfers;    // USB transfers in the last stats window
+uint32_t usblastpackets,usblasttransfers;
+
+// publish the USB counters - call when prof_tick() starts a new window
+void usbstats(void) {
+  uint32_t packets=usbpackets-usblastpackets;
+  uint32_t transfers=usbtransfers-usblasttransfers;
+  usblastpackets+=packets;
+  usblasttransfers+=transfers;
+  usbperxfer=transfers ? prof_clip(packets*1000/transfers) : 0;
+  usbxfers=prof_clip(transfers);
+}
+
+int16_t scanrate;     // encoder scans in the last stats window
+int16_t loststeps;    // invalid encoder transitions in the last stats window
+uint16_t lastencerrors;
+
+// publish the scan counters - call when prof_tick() starts a new window
+void scanstats(void) {
+  uint16_t errors=encodererrors();
+  loststeps=prof_clip((uint16_t)(errors-lastencerrors));
+  lastencerrors=errors;
+  scanrate=prof_clip(profwindow[PROF_ISR].count);
+}
+#endif
+
 // set up as include files because I'm too lazy to create proper header and .cpp files
+#include "fasttext.h"
+#include "idle.h"
+#include "tasks.h"
+#include "macros.h"
 #include "menusystem.h"  // has to come after display and encoder objects creation
+#include "sysexcodec.h"
+#include "sysex.h"
+#include "thru.h"
+#include "MIDIcallbacks.h"
+#include "morph.h"
+#include "automation.h"
 #include "fileio.h"
+#include "session.h"
 
  // midi related stuff
-
-void sendnoteOn(uint8_t channel,uint8_t pitch, uint8_t velocity) {
-  MIDIAddress midiaddress ={pitch,Channel_1 + (channel-1)}; // control surface library requires this form of MIDI addressing -I'm not a fan of the design but its the only Arduino BLE MIDI library I could find
-  usbMIDI.sendNoteOn(midiaddress, velocity);
-  serialMIDI.sendNoteOn(midiaddress, velocity);
+// each message is put together once as a channel message and handed to just the outputs in the control's ports mask
+
+// the controls go out straight away and are charged to each port's budget so morph and thru know what's left
+void sendmessage(int16_t ports, ChannelMessage msg) {
+  uint16_t len=msg.hasTwoDataBytes() ? 3 : 2;
+  if (ports & (1 << PORT_USB)) {
+    usbMIDI.send(msg);
+    ++usbpending;
+    budget_spend(PORT_USB,len);
+  }
+  if (ports & (1 << PORT_DIN)) {
+    serialMIDI.send(msg);
+    budget_spend(PORT_DIN,len);
+  }
 #ifdef BLUETOOTH
-  bleMIDI.sendNoteOn(midiaddress, velocity);
+  if (ports & (1 << PORT_BLE)) {
+    bleMIDI.send(msg);
+    budget_spend(PORT_BLE,len);
+  }
 #endif
 }
 
-void sendnoteOff(uint8_t channel, uint8_t pitch,uint8_t velocity) {
-  MIDIAddress midiaddress= {pitch,Channel_1 + (channel-1)};
-  usbMIDI.sendNoteOff(midiaddress, velocity);
-  serialMIDI.sendNoteOff(midiaddress, velocity);
-#ifdef BLUETOOTH
-  bleMIDI.sendNoteOff(midiaddress, velocity);
-#endif
+void sendnoteOn(int16_t ports, uint8_t channel,uint8_t pitch, uint8_t velocity) {
+  sendmessage(ports,ChannelMessage(0x90 | ((channel-1) & 0x0f),pitch,velocity));
+}
+
+void sendnoteOff(int16_t ports, uint8_t channel, uint8_t pitch,uint8_t velocity) {
+  sendmessage(ports,ChannelMessage(0x80 | ((channel-1) & 0x0f),pitch,velocity));
 }
 
 // message 0x0B control change.
 // 2nd parameter is the control number number (0-119).
 // 3rd parameter is the control value (0-127).
 
-void sendcontrolChange(uint8_t channel, uint8_t control, uint8_t value) {
-  MIDIAddress midiaddress= {control,Channel_1 + (channel-1)};  
-  usbMIDI.sendControlChange(midiaddress, value); 
-  serialMIDI.sendControlChange(midiaddress, value); 
-#ifdef BLUETOOTH
-  bleMIDI.sendControlChange(midiaddress, value); 
-#endif
+void sendcontrolChange(int16_t ports, uint8_t channel, uint8_t control, uint8_t value) {
+  sendmessage(ports,ChannelMessage(0xb0 | ((channel-1) & 0x0f),control,value));
+}
+
+// play a switch's value as a note and remember where it went
+void switchnoteOn(int16_t p, int16_t i) {
+  struct controllerswitch * s=&controls[p].encswitch[i];
+  sendnoteOn(s->ports,s->channel,s->value,DEFAULT_VELOCITY);
+  lastnotesent[i].ports=s->ports;
+  lastnotesent[i].channel=s->channel;
+  lastnotesent[i].note=s->value;
+}
+
+// turn off the note a switch has sounding, if it has one
+void switchnoteOff(int16_t i) {
+  if (lastnotesent[i].ports) sendnoteOff(lastnotesent[i].ports,lastnotesent[i].channel,lastnotesent[i].note,0);
+  lastnotesent[i].ports=0;
+}
+
+// send an encoder's value out some of its ports - its own CC or its macro targets
+void sendencoderports(int16_t ports, int16_t p, int16_t index) {
+  if (controls[p].encoder[index].type == MACROTYPE) sendmacro(ports,controls[p].encoder[index].macro-1,controls[p].encoder[index].value);
+  else sendcontrolChange(ports,controls[p].encoder[index].channel,controls[p].encoder[index].ccnumber,controls[p].encoder[index].value);
+}
+
+// send an encoder's value out all its ports
+void sendencoder(int16_t p, int16_t index) {
+  sendencoderports(controls[p].encoder[index].ports,p,index);
 }
 
 // message program change.
 // 2nd parameter is the PC value (0-127).
 
-void sendprogramChange(uint8_t channel, uint8_t value) {
-  MIDIAddress midiaddress= {value,Channel_1 + (channel-1)};  // confusing way of sending MIDI messages
-  usbMIDI.sendProgramChange(midiaddress); 
-  serialMIDI.sendProgramChange(midiaddress); 
-#ifdef BLUETOOTH
-  bleMIDI.sendProgramChange(midiaddress); 
-#endif
+void sendprogramChange(int16_t ports, uint8_t channel, uint8_t value) {
+  sendmessage(ports,ChannelMessage(0xc0 | ((channel-1) & 0x0f),value,0));
 }
 
 // turn off the display to avoid burn in but keep the display buffer intact
-// the next call to display.display() will automagically restore what was there plus whatver has been drawn since
+// the panel is just switched off - the next display update switches it back on with what was there plus whatever has
+// been drawn since
 
 void blankdisplay(void) {
-  uint8_t tempbuf[SCREEN_BUFFER_SIZE];
-  uint8_t * buf, * tbuf;
-  buf=display.getBuffer();
-  tbuf= tempbuf;
-  memcpy(tbuf,buf,SCREEN_BUFFER_SIZE); // copy frame buffer to temp storage
-  display.clearDisplay();
-  display.display();  // turn off the OLEDs
-  memcpy(buf,tbuf,SCREEN_BUFFER_SIZE); // restore the old frame buffer
+  if (displayblanked) return;
+  display.ssd1306_command(SSD1306_DISPLAYOFF);
+  displayblanked=true;
 }
 
 // update the display and reset the display blanking timer
 void updatedisplay(){
+  if (splashing) return;  // drawn behind the power on message - it all shows when that comes down
+  PROF_START(PROF_DISPLAY);
   display.display();
+  if (displayblanked) {
+    display.ssd1306_command(SSD1306_DISPLAYON);  // after the update so the old picture doesn't flash up
+    displayblanked=false;
+  }
+  PROF_END(PROF_DISPLAY);
   displaytimer=millis();
 }
 
 // show CC value of encoder on display
 void showencodercc(int16_t page, int16_t encoder){
-  display.setTextSize(2);
-  display.setCursor(0,16);
-  display.print("              ");
-  display.setCursor(0,16);
+  ft_clear(0,16,SCREEN_WIDTH,2);
   // the default label 0 "CC" is a special case where we show the CC number in large font, otherwise we show a custom label
-  if (controls[page].encoder[encoder].labelindex ==0) display.printf("%s %d %d","CC",controls[page].encoder[encoder].ccnumber,controls[page].encoder[encoder].value);
-  else display.printf("%s %d",labels[controls[page].encoder[encoder].labelindex],controls[page].encoder[encoder].value);
-  display.setTextSize(1);
+  if ((controls[page].encoder[encoder].labelindex ==0) && (controls[page].encoder[encoder].type == MACROTYPE)) ft_printf(0,16,2,"%s %d %d","Mac",controls[page].encoder[encoder].macro,controls[page].encoder[encoder].value);
+  else if (controls[page].encoder[encoder].labelindex ==0) ft_printf(0,16,2,"%s %d %d","CC",controls[page].encoder[encoder].ccnumber,controls[page].encoder[encoder].value);
+  else ft_printf(0,16,2,"%s %d",labels[controls[page].encoder[encoder].labelindex],controls[page].encoder[encoder].value);
   updatedisplay();  
 }
 
 // show CC value of switch on display
 void showswitchcc(int16_t page, int16_t button){
-  display.setTextSize(2);
-  display.setCursor(0,16);
-  display.print("              ");
-  display.setCursor(0,16);
+  ft_clear(0,16,SCREEN_WIDTH,2);
   // the default label 0 "CC" is a special case where we show the CC number in large font, otherwise we show a custom label
-  if (controls[page].encswitch[button].labelindex ==0) display.printf("%s %d %d","CC",controls[page].encswitch[button].ccnumber,controls[page].encswitch[button].value);
-  else display.printf("%s %d",labels[controls[page].encswitch[button].labelindex],controls[page].encswitch[button].value);
-  display.setTextSize(1);
+  if (controls[page].encswitch[button].labelindex ==0) ft_printf(0,16,2,"%s %d %d","CC",controls[page].encswitch[button].ccnumber,controls[page].encswitch[button].value);
+  else ft_printf(0,16,2,"%s %d",labels[controls[page].encswitch[button].labelindex],controls[page].encswitch[button].value);
   updatedisplay();  
 }
 
 // show page number on display
 void showpage(int16_t page){
-  display.setTextSize(1);
-  display.setCursor(0,0);
-  display.print("                     "); // erase the whole line
-  display.setCursor(0,0);
-  display.printf("Pg %d",page);
-  display.setTextSize(1);
+  ft_clear(0,0,SCREEN_WIDTH,1); // erase the whole line
+  ft_printf(0,0,1,"Pg %d",page);
 //  updatedisplay();  
 }
 
 // show CC number on display
 void showcc(int16_t cc){
-  display.setTextSize(1);
-  display.setCursor(32,0);
-  display.printf("CC %d",cc);
+  ft_printf(32,0,1,"CC %d",cc);
 //  updatedisplay();  
 }
 // show MIDI channel on display
 void showchannel(int16_t channel){
-  display.setTextSize(1);
-  display.setCursor(80,0);
-  display.printf("Ch %d",channel);
+  ft_printf(80,0,1,"Ch %d",channel);
   updatedisplay(); 
 }
 
@@ -446,42 +617,38 @@ void showencoder(int16_t page,int16_t controlindex) {
 // this got a bit messy after I added multiple switch types
 void showswitch(int16_t page,int16_t controlindex) {
   showpage(page+1);  // for display use 1 based indices
-  display.setCursor(32,0);
   switch (controls[page].encswitch[controlindex].type) {
     case CCMESSAGE:
-      display.printf("CC %d",controls[page].encswitch[controlindex].ccnumber);
+      ft_printf(32,0,1,"CC %d",controls[page].encswitch[controlindex].ccnumber);
       break;
     case PCMESSAGE:
-      display.printf("Program");
+      ft_print(32,0,"Program",1);
       break;   
     case NOTEMESSAGE:
-      display.printf("Note");
+      ft_print(32,0,"Note",1);
       break;   
     case SETENC:
-      display.printf("SetEnc");
+      ft_print(32,0,"SetEnc",1);
       break;
     default:
       break;      
   }
   if (controls[page].encswitch[controlindex].type == SETENC) showchannel(controls[page].encoder[controlindex].channel); // if we just set the encoder value show its channel
   else showchannel(controls[page].encswitch[controlindex].channel); // otherwise show the switch MIDI channel
-  display.setTextSize(2);
-  display.setCursor(0,16);
-  display.print("              ");
-  display.setCursor(0,16);
+  ft_clear(0,16,SCREEN_WIDTH,2);
   switch (controls[page].encswitch[controlindex].type) {
     case CCMESSAGE:
   // the default label 0 "CC" is a special case where we show the CC number in large font, otherwise we show a custom label
-    if (controls[page].encswitch[controlindex].labelindex ==0) display.printf("%s %d %d","CC",controls[page].encswitch[controlindex].ccnumber,controls[page].encswitch[controlindex].value);
-    else display.printf("%s %d",labels[controls[page].encswitch[controlindex].labelindex],controls[page].encswitch[controlindex].value);
+    if (controls[page].encswitch[controlindex].labelindex ==0) ft_printf(0,16,2,"%s %d %d","CC",controls[page].encswitch[controlindex].ccnumber,controls[page].encswitch[controlindex].value);
+    else ft_printf(0,16,2,"%s %d",labels[controls[page].encswitch[controlindex].labelindex],controls[page].encswitch[controlindex].value);
     break;
     case PCMESSAGE:
-      if (controls[page].encswitch[controlindex].labelindex ==0) display.printf("%s %d","Prog",controls[page].encswitch[controlindex].value);
-      else display.printf("%s %d",labels[controls[page].encswitch[controlindex].labelindex],controls[page].encswitch[controlindex].value);
+      if (controls[page].encswitch[controlindex].labelindex ==0) ft_printf(0,16,2,"%s %d","Prog",controls[page].encswitch[controlindex].value);
+      else ft_printf(0,16,2,"%s %d",labels[controls[page].encswitch[controlindex].labelindex],controls[page].encswitch[controlindex].value);
       break;
     case NOTEMESSAGE:
-      if (controls[page].encswitch[controlindex].labelindex ==0) display.printf("%s %d","Note",controls[page].encswitch[controlindex].value);
-      else display.printf("%s %d",labels[controls[page].encswitch[controlindex].labelindex],controls[page].encswitch[controlindex].value);
+      if (controls[page].encswitch[controlindex].labelindex ==0) ft_printf(0,16,2,"%s %d","Note",controls[page].encswitch[controlindex].value);
+      else ft_printf(0,16,2,"%s %d",labels[controls[page].encswitch[controlindex].labelindex],controls[page].encswitch[controlindex].value);
       break;  
     case SETENC:  // show the encoder value since it was just set
       showencodercc(page,controlindex);
@@ -489,27 +656,111 @@ void showswitch(int16_t page,int16_t controlindex) {
     default:
       break;
   }       
-  display.setTextSize(1);
   updatedisplay();  
 }
 
+// LED colors
+// each encoder has its own 8 bit red, green and blue. the LED brightness follows the encoder value through brightness_table[]
+// ledscale[] is brightness_table[] indexed directly by the 0-127 value and premultiplied so scaling a color is a multiply and a shift
+// full brightness of a 255 color component comes out at 127, the same as the old palette colors
+// the LED colors of every page are kept in ledframes[] in NeoPixel wire order (GRB) for both the encoder and switch views
+// a value change updates one pixel of a frame and a page flip or view change just copies a frame into the NeoPixel buffer
+
+uint32_t ledscale[128];
+uint8_t ledframes[2][CONTROLLER_PAGES][NUMPIXELS*3];  // [ENCODER or BUTTON view][page][pixel bytes]
+
+void initledscale(void) {
+  for (int16_t v=0;v<128;++v) ledscale[v]=brightness_table[(v>>2) & 0x1f]*257;
+}
+
+// scale a color component by a ledscale[] value. exact for 0 and 255 so palette colors come out exactly as before
+uint8_t ledcomponent(int16_t c, uint32_t scale) {
+  return ((uint32_t)c*scale+257) >> 16;
+}
+
+// set an encoder's red, green and blue from its palette color index
+void setpalettecolor(struct controllerencoder * e) {
+  int32_t color=colorpalette[constrain(e->colorindex,0,7)];
+  e->red=((color >> 16) & 0xff)*255/0x1f;  // palette colors are 5 bits
+  e->green=((color >> 8) & 0xff)*255/0x1f;
+  e->blue=(color & 0xff)*255/0x1f;
+}
+
+// menu handler - picking a palette color sets the red, green and blue being edited
+void editcolorchanged(void) {
+  setpalettecolor(&editbuffer.encoder);
+  drawsubmenus();  // show the new red, green and blue values
+  draweditselector(menupos[topmenuindex].submenuindex);  // still editing the color
+}
+
+// put the macro target being edited in macroedit
+void loadmacroedit(void) {
+  macroedit=macros[constrain(editbuffer.encoder.macro,1,NUM_MACROS)-1][edittarget-1];
+}
+
+// macro or target number changed in the edit menu - show that target
+void loadmacrotarget(void) {
+  loadmacroedit();
+  drawsubmenus();
+  draweditselector(menupos[topmenuindex].submenuindex);
+}
+
+// store a color in a frame
+void setframepixel(uint8_t * pixel, uint8_t r, uint8_t g, uint8_t b) {
+  pixel[0]=g;  // NEO_GRB order
+  pixel[1]=r;
+  pixel[2]=b;
+}
+
+// recalculate an encoder LED in its page frame
+void setencoderframe(int16_t page,int16_t encoder) {
+  struct controllerencoder * e=&controls[page].encoder[encoder];
+  uint32_t scale=ledscale[e->value & 0x7f];
+  setframepixel(&ledframes[ENCODER][page][encoder*3],ledcomponent(e->red,scale),ledcomponent(e->green,scale),ledcomponent(e->blue,scale));
+}
+
+// recalculate a switch LED in its page frame
+void setswitchframe(int16_t page,int16_t button) {
+  uint8_t level=(controls[page].encswitch[button].value == controls[page].encswitch[button].maxvalue) ? 0x1f : 0;  // white or off
+  setframepixel(&ledframes[BUTTON][page][button*3],level,level,level);
+}
+
+// rebuild every frame - call when colors or values change wholesale (init, config load, edits)
+void buildledframes(void) {
+  for (int16_t p=0;p<CONTROLLER_PAGES;++p) {
+    for (int16_t i=0;i<NUMENCODERS;++i) {
+      setencoderframe(p,i);
+      setswitchframe(p,i);
+    }
+  }
+}
+
+// copy a frame pixel to the LED
+void showframepixel(int16_t view,int16_t page,int16_t index) {
+  uint8_t * pixel=&ledframes[view][page][index*3];
+  LEDS.setPixelColor(index,pixel[1],pixel[0],pixel[2]);
+}
+
 // show the LED associated with a encoder
 void showencoderLED(int16_t page,int16_t encoder) {
-  int32_t color=colorpalette[controls[page].encoder[encoder].colorindex];
-  color=color/31; // scale color down to 1 bit **** this isn't going to work with custom colors
-  color=color*brightness_table[(controls[page].encoder[encoder].value>>2 & 0x1f)]; // scale the brightness by the CC value
-  LEDS.setPixelColor(encoder,color);
+  setencoderframe(page,encoder);
+  showframepixel(ENCODER,page,encoder);
 }
 
 // show the LED associated with a switch
 void showswitchLED(int16_t page,int16_t button) {
-  if (controls[page].encswitch[button].value == controls[page].encswitch[button].maxvalue) LEDS.setPixelColor(button,LED_WHITE);
-  else LEDS.setPixelColor(button,LED_BLACK);
+  setswitchframe(page,button);
+  showframepixel(BUTTON,page,button);
 }
 
 // show all the encoder LEDs on a page
 void showencoderLEDs(int16_t page) {
-  for (int16_t i=0;i< NUMPIXELS;++i) showencoderLED(page,i);
+  memcpy(LEDS.getPixels(),ledframes[ENCODER][page],NUMPIXELS*3);
+}
+
+// show all the switch LEDs on a page
+void showswitchLEDs(int16_t page) {
+  memcpy(LEDS.getPixels(),ledframes[BUTTON][page],NUMPIXELS*3);
 }
 
 // flush all encoder messages 
@@ -530,55 +781,87 @@ void flush_encoders(void) {
   rmenuenc.getValue();
 }
 
-void fatalerror(const char * errorstring){
-  display.clearDisplay();
-  display.setTextSize(1);
-  display.setCursor(0,0);
-  display.printf("FATAL ERROR\n\n%s", errorstring);
-  updatedisplay();
+// flash all the encoder LEDs red - the loop sends them
+void fatalflash(void) {
+  static bool on=false;
+  on=!on;
+  for (int16_t i=0;i<NUMENCODERS;++i) LEDS.setPixelColor(i,on ? LED_RED : LED_BLACK);
+}
 
-  while (1) {
-    for (int16_t i=0;i<NUMENCODERS;++i) LEDS.setPixelColor(i,LED_RED); // flashing red
-    LEDS.show();
-    delay(75);
-    for (int16_t i=0;i<NUMENCODERS;++i) LEDS.setPixelColor(i,LED_BLACK); // 
-    LEDS.show();
-    delay(75);
-  } 
+// stop the UI with an error message and flashing red LEDs. MIDI keeps running
+void fatalerror(const char * errorstring){
+  splashing=false;
+  if (display.getBuffer()) {  // not if it's the display that failed
+    display.clearDisplay();
+    display.setTextSize(1);
+    display.setCursor(0,0);
+    display.printf("FATAL ERROR\n\n%s", errorstring);
+    updatedisplay();
+  }
+  UI_state=UI_FATAL;
+  task_every(75,fatalflash);
 }
 
 // ***** Menu handler functions *****
 
+// UI waits - the loop keeps MIDI running while the UI is in UI_WAIT and one of these ends it
+// back to sending MIDI once the left menu button has been let go
+void ui_resume(void) {
+  flush_encoders();   // toss any encoder messages
+  UI_state=UI_SEND_MIDI;
+}
+
+// the save/restore message has been up long enough
+void save_restore_done(void) {
+  display.clearDisplay();
+  showencoder(page,lastcontrol);   // restore the display
+  updatedisplay();
+  ui_resume();
+}
+
 // menu function to handle save/restore menus - called when user clicks "Confirm?" menu value
 void save_restore(void) {
-  display.clearDisplay();
-  display.setCursor(0,12);
+  int16_t action=saverestore_action;
+  char message[32];
   if ((saverestore_action == 1) && (saverestore_confirm ==1)) {
-    if (saveconfig(saverestore_slot)) display.printf("Saved to Slot %d", saverestore_slot);
-    else display.printf("File Write Error");
+    if (saveconfig(saverestore_slot) && saveautomation(saverestore_slot)) {
+      sessionslot=saverestore_slot;  // power on comes back to this slot
+      sprintf(message,"Saved to Slot %d", saverestore_slot);
+    }
+    else sprintf(message,"File Write Error");
   } 
   if ((saverestore_action == 0) && (saverestore_confirm ==1)) {
-    if (loadconfig(saverestore_slot)) display.printf("Restored from Slot %d", saverestore_slot);
-    else display.printf("File Read Error");     
+    if (loadconfig(saverestore_slot)) {
+      buildccindex();
+      memset(morphpending,0,sizeof(morphpending));  // queued values belong to the old setup
+      loadautomation(saverestore_slot);  // or clear it if the slot has no recording
+      sessionslot=saverestore_slot;
+      buildledframes();
+      sprintf(message,"Restored from Slot %d", saverestore_slot);
+    }
+    else sprintf(message,"File Read Error");     
   }
   if ((saverestore_action == 2) && (saverestore_confirm ==1)) {
     LittleFS.format();
-    display.printf("FFS ReFormatted");       
+    sessionslot=0;
+    memset(&sessionsaved,0,sizeof(sessionsaved));  // the snapshot went too - write it again
+    sprintf(message,"FFS ReFormatted");       
   }
-  if (saverestore_confirm == 0) display.printf("Aborted Save/Restore"); 
-  display.display();
+  if ((saverestore_action >= 3) && (saverestore_confirm ==1)) {
+    storescene(page,saverestore_action-3+SCENE_A);
+    sprintf(message,"Page %d Scene %c Stored",page+1,(saverestore_action == 3) ? 'A' : 'B');
+  }
+  if (saverestore_confirm == 0) sprintf(message,"Aborted Save/Restore"); 
   saverestore_action=saverestore_confirm=0; // reset the menu
-  UI_state=UI_SEND_MIDI;  // put the UI back to default state
-  page=lastcontrol=0;
+  if (action < 3) page=lastcontrol=0;  // storing a scene stays on the page
   showencoderLEDs(page); // update the LEDs
-  LEDS.show();
-  delay(3000);     // delay here to show above fail/success message
-  display.clearDisplay();
-  showencoder(page,lastcontrol);   // restore the display
-  updatedisplay();
-  flush_encoders();   // toss any encoder messages
+  UI_state=UI_WAIT;  // the message stays up for a while but MIDI keeps going
+  toast(message,TOAST_MS,save_restore_done);
 }
 
+#ifdef BENCHMARK
+#include "bench.h"
+#endif
 
 void setup() {
   Serial.begin(115200);
@@ -596,20 +879,58 @@ void setup() {
   pinMode(RMENU_ENCB_IN, INPUT_PULLUP);    
   pinMode(RMENU_ENCSW_IN, INPUT_PULLUP); 
 
+// set up timer interrupt - the encoders are being scanned from here on
+  alarm_in_us(TIMER_MICROS);
+  bootstamp(BOOT_INPUTS);
+
+  initmacros();
+  initcontrols(); // set up default encoder and switch values 
+  initscenes();
+  buildccindex();  // incoming CCs need this as soon as the callbacks are attached
+  initledscale();
+  buildledframes();
+
+// MIDI comes up before anything slow so the unit is playable as soon as possible after power on
+  usbMIDI.disableTimeout();  // USB MIDI is only sent at usbflush()
+  usbMIDI.begin();
+  serialMIDI.begin();
+
+  // attach MIDI message handler functions - incoming CCs update the controls
+  initthru();
+  usbMIDI.setCallbacks(callback);
+  serialMIDI.setCallbacks(callback);
+  bootstamp(BOOT_MIDI);
+
+#ifdef BLUETOOTH
+  bleMIDI.setName("Twisty 2");
+  bleMIDI.begin();  // the radio takes a while to start so it goes after the wired ports
+  bleMIDI.setCallbacks(callback);
+#endif
+
+//  Control_Surface.begin(); // Initialize the Control Surface MIDI interfaces
+
+  bool fsok=LittleFS.begin(); // start up filesystem - an error can't be shown till the display is up
+  if (fsok) loadsession();  // back to the setup and control values from before power off
+  initsession();
+  bootstamp(BOOT_SESSION);
+
 // set up I2C pins - meant to use I2C0 controller but messed up the schematic pins so have to use I2C1
   Wire1.setSDA(PIN_WIRE_SDA);
   Wire1.setSCL(PIN_WIRE_SCL);
   Wire1.begin();
 
-// set up timer interrupt 
-  alarm_in_us(TIMER_MICROS);
- 
+  LEDS.begin(); // INITIALIZE NeoPixel strip object (REQUIRED)
+  showencoderLEDs(page); // show the encoder LED colors
+  LEDS.show();
+
   // SSD1306_SWITCHCAPVCC = generate display voltage from 3.3V internally
   if(!display.begin(SSD1306_SWITCHCAPVCC, SCREEN_ADDRESS)) {
     Serial.println(F("SSD1306 allocation failed"));
-    fatalerror(""); // Don't proceed, loop forever
+    fatalerror(""); // Don't proceed - MIDI still runs
+    return;
   }
   display.setRotation(2);
+  ft_init();  // fast text font table has to match the rotation
   display.clearDisplay();
   display.setTextSize(2);
 
@@ -617,46 +938,66 @@ void setup() {
   display.setCursor(20,0);
   display.printf("Twisty 2\n"); // power on message
   display.display();
-  delay(3000);
-
-  initcontrols(); // set up default encoder and switch values 
-
-  LEDS.begin(); // INITIALIZE NeoPixel strip object (REQUIRED)
-  showencoderLEDs(0); // show page 0 encoder LED colors
-  LEDS.show();
-
-  if (!LittleFS.begin()) fatalerror("Can't mount FS"); // start up filesystem
-
-#ifdef BLUETOOTH
-  bleMIDI.setName("Twisty 2");
-#endif
-
-  MIDI_Interface::beginAll();
-
-//  Control_Surface.begin(); // Initialize the Control Surface MIDI interfaces
+  if (!fsok) {
+    fatalerror("Can't mount FS");
+    return;
+  }
 
+  // the controls are drawn in the buffer behind the power on message. the loop shows them after SPLASH_MS
+  // or as soon as a control is used, along with whatever that drew
+  splashing=true;
+  splashstart=millis();
   display.clearDisplay();
   display.setTextSize(1);  
-  showencoder(0,0);   // put first encoder values on the display
-  updatedisplay();
+  showencoder(page,0);
+  bootstamp(BOOT_DISPLAY);
 
   flush_encoders();  // clear any initial junk from encoders
 
   displaytimer=millis(); // reset display blanking timer
 
+#ifdef PROFILE
+  prof_init();
+#endif
+
+#ifdef BENCHMARK
+  runbenchmarks();
+#endif
 }
 
 void loop() {
   ClickEncoder::Button button;
   ClickEncoder::ButtonEvent event;
   int16_t t,n;
+  bool moved;  // a control was used - update the display once after all the MIDI has gone out
+  static bool morphfirst;
 
-  MIDI_Interface::updateAll(); // Update the Control Surface MIDI interfaces
-
-  if ((millis()-displaytimer) > DISPLAY_BLANK_MS) blankdisplay(); // protect the OLED from burnin
+  PROF_START(PROF_LOOP);
+  PROF_START(PROF_MIDI);
+  if (!thru_hold(PORT_USB)) usbMIDI.update();  // the computer waits while what it is passing through is backed up
+  serialMIDI.update();
+#ifdef BLUETOOTH
+  bleMIDI.update();
+#endif
+  // thru and morph share what the controls leave of each port's budget - they take turns going first so a flood
+  // through one can't starve the other
+  if (morphfirst) morph_service();  // morph CCs that fit in each port's budget
+  thru_service();   // pass on what came in, within each port's budget
+  if (!morphfirst) morph_service();
+  morphfirst=!morphfirst;
+  sysex_service();  // send the next packet of a preset dump if one is running
+  automation_service();  // play back recorded moves on the MIDI clock
+  PROF_END(PROF_MIDI);
+
+  tasks_run();  // timers and UI waits
+  if (((millis()-displaytimer) > DISPLAY_BLANK_MS) && (UI_state != UI_FATAL)) blankdisplay(); // protect the OLED from burnin
+  if (splashdone()) updatedisplay();  // power on message has been up long enough
+  session_service();  // save where the controls were left once they settle
 
   switch (UI_state) {
     case UI_SEND_MIDI:  // process encoders
+      PROF_START(PROF_ENCODERS);
+      moved=false;
       for (int i=0;i<NUMENCODERS;++i) {
         if ((t=enc[i].getValue()) !=0) { // if encoder has moved process it
           if (controls[page].encoder[i].minvalue < controls[page].encoder[i].maxvalue ) { // normal direction
@@ -668,14 +1009,27 @@ void loop() {
             if (controls[page].encoder[i].value > controls[page].encoder[i].minvalue) controls[page].encoder[i].value = controls[page].encoder[i].minvalue;
             if (controls[page].encoder[i].value < controls[page].encoder[i].maxvalue) controls[page].encoder[i].value = controls[page].encoder[i].maxvalue;            
           }
-          sendcontrolChange(controls[page].encoder[i].channel, controls[page].encoder[i].ccnumber,controls[page].encoder[i].value);
+          sendencoder(page,i);
+          markccsent(page,ENCODER,i);
+          morphcancel(page,i);  // this value supersedes any morph value still waiting
+          auto_live(page,i);    // record it, and hold off playback on this control
           lastcontrol=i;  // save index of the last used encoder 
+          lastcontroltype=ENCODER;
           showencoderLED(page,lastcontrol);
-          showencoder(page,lastcontrol);
-          updatedisplay();       
+          moved=true;
         }
       }
+      usbflush();  // everything the encoders sent goes out in one USB transfer, before the slow display update
+      if (moved) {
+        splashing=false;  // a control was used - the power on message comes down
+        showencoder(page,lastcontrol);
+        updatedisplay();
+        ccfeedbackdirty=false;  // drawn with the latest value
+      }
+      PROF_END(PROF_ENCODERS);
         // process switches
+      PROF_START(PROF_SWITCHES);
+      moved=false;
       for (int i=0;i<NUMENCODERS;++i) {
         event=enc[i].getButtonEvent();
         if (event == ClickEncoder::ActiveEdge) { // switch just pressed, send MIDI message and update LEDs        
@@ -684,14 +1038,14 @@ void loop() {
               controls[page].encswitch[i].value=controls[page].encswitch[i].maxvalue; 
               switch (controls[page].encswitch[i].type) {
                 case CCMESSAGE:
-                  sendcontrolChange(controls[page].encswitch[i].channel, controls[page].encswitch[i].ccnumber,controls[page].encswitch[i].value); 
+                  sendcontrolChange(controls[page].encswitch[i].ports,controls[page].encswitch[i].channel, controls[page].encswitch[i].ccnumber,controls[page].encswitch[i].value); 
                   break;
                 case PCMESSAGE:
-                  sendprogramChange(controls[page].encswitch[i].channel, controls[page].encswitch[i].value); 
+                  sendprogramChange(controls[page].encswitch[i].ports,controls[page].encswitch[i].channel, controls[page].encswitch[i].value); 
                   break;
                 case NOTEMESSAGE:
-                  sendnoteOn(controls[page].encswitch[i].channel, controls[page].encswitch[i].value, DEFAULT_VELOCITY);
-                  lastnotesent=controls[page].encswitch[i].value;
+                  switchnoteOff(i);  // one still sounding from another page
+                  switchnoteOn(page,i);
                   break;
                 case SETENC:
                  // controls[page].encoder[i].value=controls[page].encswitch[i].maxvalue;  // do this on button release
@@ -705,18 +1059,18 @@ void loop() {
               else controls[page].encswitch[i].value = controls[page].encswitch[i].minvalue;
               switch (controls[page].encswitch[i].type) {
                 case CCMESSAGE:
-                  sendcontrolChange(controls[page].encswitch[i].channel, controls[page].encswitch[i].ccnumber,controls[page].encswitch[i].value); 
+                  sendcontrolChange(controls[page].encswitch[i].ports,controls[page].encswitch[i].channel, controls[page].encswitch[i].ccnumber,controls[page].encswitch[i].value); 
                   break;
                 case PCMESSAGE:
-                  sendprogramChange(controls[page].encswitch[i].channel, controls[page].encswitch[i].value); 
+                  sendprogramChange(controls[page].encswitch[i].ports,controls[page].encswitch[i].channel, controls[page].encswitch[i].value); 
                   break;
                 case NOTEMESSAGE:
-                  sendnoteOff(controls[page].encswitch[i].channel, lastnotesent,0); // turn off the last note that was sent
-                  sendnoteOn(controls[page].encswitch[i].channel, controls[page].encswitch[i].value, DEFAULT_VELOCITY);
-                  lastnotesent=controls[page].encswitch[i].value; 
+                  switchnoteOff(i); // turn off the last note that was sent
+                  switchnoteOn(page,i);
                   break;
                 case SETENC:
                   controls[page].encoder[i].value=controls[page].encswitch[i].maxvalue; 
+                  setencoderframe(page,i);  // keep the LED frame current
                   break;
                 default:
                   break;
@@ -725,46 +1079,78 @@ void loop() {
             default:
               break;
           }  // end switch
+          markccsent(page,BUTTON,i);
           lastcontrol=i;  // save index of the last used encoder or switch
+          lastcontroltype=BUTTON;
           showswitchLED(page,lastcontrol);
-          showswitch(page,lastcontrol);
-          updatedisplay();       
+          moved=true;
         }
         if ((event == ClickEncoder::InActiveEdge) && (controls[page].encswitch[i].mode==MOMENTARY)) { // button just released, send MIDI message and update LEDs 
           controls[page].encswitch[i].value=controls[page].encswitch[i].minvalue;
           switch (controls[page].encswitch[i].type) {
             case CCMESSAGE:
-              sendcontrolChange(controls[page].encswitch[i].channel, controls[page].encswitch[i].ccnumber,controls[page].encswitch[i].value); 
+              sendcontrolChange(controls[page].encswitch[i].ports,controls[page].encswitch[i].channel, controls[page].encswitch[i].ccnumber,controls[page].encswitch[i].value); 
               break;
             case PCMESSAGE:
-              sendprogramChange(controls[page].encswitch[i].channel, controls[page].encswitch[i].value); 
+              sendprogramChange(controls[page].encswitch[i].ports,controls[page].encswitch[i].channel, controls[page].encswitch[i].value); 
               break;
             case NOTEMESSAGE:
-              sendnoteOff(controls[page].encswitch[i].channel, lastnotesent,0); // turn off the last note that was sent
+              switchnoteOff(i); // turn off the last note that was sent
               break;
             case SETENC:
               controls[page].encoder[i].value=controls[page].encswitch[i].maxvalue; 
+              setencoderframe(page,i);  // keep the LED frame current
               break;
             default:
               break;
           }
+          markccsent(page,BUTTON,i);
           lastcontrol=i;  // save index of the last used encoder or switch
+          lastcontroltype=BUTTON;
           showswitchLED(page,lastcontrol);
-          showswitch(page,lastcontrol);
-          updatedisplay();    
+          moved=true;
         }
       }
+      usbflush();
+      if (moved) {
+        splashing=false;
+        showswitch(page,lastcontrol);
+        updatedisplay();
+        ccfeedbackdirty=false;
+      }
+      PROF_END(PROF_SWITCHES);
+
+      if (ccfeedbackdirty) {  // the DAW changed the control on show - one redraw however many CCs came in
+        ccfeedbackdirty=false;
+        if (lastcontroltype == ENCODER) showencoder(page,lastcontrol);  // these send the frame themselves
+        else showswitch(page,lastcontrol);
+      }
+
+      if ((t=rmenuenc.getValue()) !=0) { // right encoder morphs the page between its two scenes
+        splashing=false;
+        morphto(page,morphpos[page]+t*MORPH_STEP);
+        showmorph(page);
+        updatedisplay();
+      }
 
       if ((t=lmenuenc.getValue()) !=0) { // left encoder changes controls page
+        splashing=false;
         page=constrain(page+t,0,CONTROLLER_PAGES-1);
         showencoder(page,0);
-        showencoderLEDs(page);
+        if (displaySwitchLEDs) showswitchLEDs(page);
+        else showencoderLEDs(page);
       }
 
       button=lmenuenc.getButton();
+      if (button == ClickEncoder::Released) { // left encoder long press starts and stops recording
+        if (autostate == AUTO_RECORD) auto_play();  // loop what was just recorded
+        else auto_record();
+        showauto();
+      }
+
       if (button == ClickEncoder::DoubleClicked) { // left encoder double click shows switch states
-        if (!displaySwitchLEDs) for (int sw=0; sw<NUMENCODERS;sw++) {
-          showswitchLED(page,sw);
+        if (!displaySwitchLEDs) {
+          showswitchLEDs(page);
           displaySwitchLEDs=1; // toggle display mode
         }
         else {
@@ -774,30 +1160,54 @@ void loop() {
       }
 
       if (button == ClickEncoder::Clicked) { // click to enter edit menu
+        splashing=false;  // the menu takes over the display straight away
         display.clearDisplay();
         topmenuindex=0;  // not using top menu, just submenus
         menustate=SUBSELECT; // do submenu when button is released
         copy_to_editbuffer(page,lastcontrol); //copy encoder parameters for editing
-        topmenu[topmenuindex].submenuindex=0;  // start from the first item
+        menupos[topmenuindex].submenuindex=0;  // start from the first item
         drawsubmenus();
-        drawselector(topmenu[topmenuindex].submenuindex);
+        drawselector(menupos[topmenuindex].submenuindex);
         updatedisplay();
         flush_encoders();   // toss any encoder messages
         UI_state=UI_EDIT;
       }
 
-      if (rmenuenc.getButton() == ClickEncoder::Clicked) { // click to enter save and restore menu
+      button=rmenuenc.getButton();
+      if (button == ClickEncoder::Released) { // right encoder long press starts and stops playback
+        if (autostate == AUTO_OFF) auto_play();
+        else auto_stop();
+        showauto();
+      }
+
+      if (button == ClickEncoder::Clicked) { // click to enter save and restore menu
+        splashing=false;
         display.clearDisplay();
         topmenuindex=1;  // not using top menu, just submenus
         menustate=SUBSELECT; // do submenu when button is released
         copy_to_editbuffer(page,lastcontrol); //copy encoder parameters for editing
-        topmenu[topmenuindex].submenuindex=0;  // start from the first item
+        menupos[topmenuindex].submenuindex=0;  // start from the first item
         drawsubmenus();
-        drawselector(topmenu[topmenuindex].submenuindex);
+        drawselector(menupos[topmenuindex].submenuindex);
         updatedisplay();
         flush_encoders();   // toss any encoder messages
         UI_state=UI_LOADSAVE;
       }
+#ifdef PROFILE
+      if (button == ClickEncoder::DoubleClicked) { // double click to show the profiler stats
+        splashing=false;
+        display.clearDisplay();
+        topmenuindex=2;  // not using top menu, just submenus
+        menustate=SUBSELECT;
+        menupos[topmenuindex].submenuindex=0;
+        drawsubmenus();
+        drawselector(menupos[topmenuindex].submenuindex);
+        updatedisplay();
+        flush_encoders();   // toss any encoder messages
+        prof_dump();
+        UI_state=UI_STATS;
+      }
+#endif
       break;
 
     case UI_EDIT:  // do edit menu 
@@ -806,31 +1216,36 @@ void loop() {
       }
       if ((n< NUMENCODERS) || ((t=lmenuenc.getValue()) !=0)) { // button press or scroll thru controls with left encoder
         restore_from_editbuffer(page,lastcontrol); // copy edited values back to the encoder parameters
+        buildccindex(); // mappings may have changed
+        setswitchframe(page,lastcontrol);  // switch min/max may have changed
         showencoderLED(page,lastcontrol); // restore control color  
         if (n<NUMENCODERS) lastcontrol=n;    
         else lastcontrol=constrain(lastcontrol+t,0,NUMENCODERS-1);
         copy_to_editbuffer(page,lastcontrol); //copy encoder parameters for editing
         drawsubmenus();
-        drawselector(topmenu[topmenuindex].submenuindex);
+        drawselector(menupos[topmenuindex].submenuindex);
         updatedisplay();
       }
       if (lmenuenc.getButton() == ClickEncoder::Clicked) { // click to exit menu
         display.clearDisplay();
         restore_from_editbuffer(page,lastcontrol); // copy edited values back to the encoder parameters
+        buildccindex(); // mappings may have changed
+        setswitchframe(page,lastcontrol);  // switch min/max may have changed
         showencoder(page,lastcontrol); // redraw the encoder display
         showencoderLED(page,lastcontrol); // update the LED too
         updatedisplay();
-        UI_state=UI_SEND_MIDI;
-        while(!digitalRead(LMENU_ENCSW_IN)) delay(10); // loop here till button released 
-        flush_encoders();   // toss any encoder messages
+        UI_state=UI_WAIT;  // till the button is let go
+        task_onrelease(LMENU_ENCSW_IN,ui_resume);
       }
       else {
+        PROF_START(PROF_MENU);
         domenus();
+        PROF_END(PROF_MENU);
         if ((millis()-LEDtimer) > LEDFLASH_EDIT) {
           LEDtimer=millis();
           if (LEDstate) {
             LEDstate=0;
-            LEDS.setPixelColor(lastcontrol,colorpalette[editbuffer.encoder.colorindex]); // flash LED in the current editing color at full brightness
+            LEDS.setPixelColor(lastcontrol,editbuffer.encoder.red >> 3,editbuffer.encoder.green >> 3,editbuffer.encoder.blue >> 3); // flash LED in the current editing color at palette brightness
           }
           else {
             LEDstate=1;
@@ -845,15 +1260,51 @@ void loop() {
         showencoder(page,lastcontrol); // redraw the encoder display
         showencoderLED(page,lastcontrol); // update the LED too
         updatedisplay();
-        UI_state=UI_SEND_MIDI;
-        while(!digitalRead(LMENU_ENCSW_IN)) delay(10); // loop here till button released 
-        flush_encoders();   // toss any encoder messages
+        UI_state=UI_WAIT;  // till the button is let go
+        task_onrelease(LMENU_ENCSW_IN,ui_resume);
+      }
+      else {
+        PROF_START(PROF_MENU);
+        domenus();
+        PROF_END(PROF_MENU);
+      }
+      break;
+#ifdef PROFILE
+    case UI_STATS:  // profiler stats page - the menu is just used for scrolling
+      if (lmenuenc.getButton() == ClickEncoder::Clicked) { // click to exit
+        display.clearDisplay();
+        showencoder(page,lastcontrol); // redraw the encoder display
+        updatedisplay();
+        UI_state=UI_WAIT;  // till the button is let go
+        task_onrelease(LMENU_ENCSW_IN,ui_resume);
+      }
+      else {
+        PROF_START(PROF_MENU);
+        domenus();
+        PROF_END(PROF_MENU);
       }
-      else domenus();
       break;
+#endif
     default:
       break;
   }  // end switch
 
-  LEDS.show();
+  usbflush();  // anything else queued this pass - SysEx replies etc.
+  PROF_START(PROF_LEDSHOW);
+  showleds();  // only if something changed
+  PROF_END(PROF_LEDSHOW);
+  PROF_END(PROF_LOOP);
+
+#ifdef PROFILE
+  if (prof_tick()) {
+    usbstats();
+    scanstats();
+    idlestats();
+    if ((UI_state == UI_STATS) && (menustate == SUBSELECT)) { // new stats - redraw unless a value is being "edited"
+      drawsubmenus();
+      drawselector(menupos[topmenuindex].submenuindex);
+    }
+  }
+#endif
+  idle_wait();  // sleep till the next scan, MIDI or USB interrupt
 }
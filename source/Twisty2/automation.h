@@ -0,0 +1,307 @@
+// automation recorder for Twisty 2
+// records encoder moves against MIDI clock and loops them back
+// each move is stored as three varints - ticks since the last event, control number, and the change in value since that control's last event
+// small numbers take one byte so a typical event is 3 bytes and AUTO_BUFSIZE holds thousands of them
+// moves within the same clock tick on the same control are merged so a fast twist costs at most one event per tick
+// playback goes through the same send path as the encoders. a control that was turned by hand in the last AUTO_LIVE_HOLD_MS
+// is left alone so live input always wins
+// without MIDI clock the recorder runs from an internal clock at 120 BPM
+// recordings are saved next to the slot's setup as slotN.auto:
+//   "TWA1" <loop length ticks, 4 bytes> <data bytes, 2 bytes> <start value of each control> <events>  (little endian)
+
+#define AUTO_BUFSIZE 16384
+#define AUTO_CONTROLS (CONTROLLER_PAGES*NUMENCODERS)
+#define AUTO_PPQN 24      // MIDI clocks per quarter note
+#define AUTO_BAR (AUTO_PPQN*4)  // loops are whole 4/4 bars
+#define AUTO_LIVE_HOLD_MS 1000  // playback leaves a control alone this long after it was turned by hand
+#define AUTO_CLOCK_TIMEOUT_MS 500  // no MIDI clock for this long - run from the internal clock
+#define AUTO_INTERNAL_US 20833  // internal clock tick - 24 PPQN at 120 BPM
+#define AUTO_HEADER (4+4+2+AUTO_CONTROLS)
+
+enum autostates {AUTO_OFF,AUTO_RECORD,AUTO_PLAY};
+int16_t autostate=AUTO_OFF;
+
+uint8_t autobuf[AUTO_BUFSIZE];
+uint16_t autoused;        // bytes recorded
+uint32_t autolength;      // loop length in ticks
+uint8_t autostart[AUTO_CONTROLS];  // encoder values when recording started
+uint8_t autovalue[AUTO_CONTROLS];  // each control's value as of the last event written or read
+uint32_t autotick;        // ticks since recording or the loop started
+uint32_t autolasttick;    // tick of the last event written or read
+uint16_t autopos;         // playback read position
+uint32_t autotouched[AUTO_CONTROLS];  // time each control was last turned by hand
+uint32_t autorecorded[(AUTO_CONTROLS+31)/32];  // bit for each control with an event in the recording
+
+// a recorded move is held here until we know a later move in the same tick won't replace it
+bool autopending;
+uint32_t autopendtick;
+uint8_t autopendctl;
+uint8_t autopendvalue;
+
+uint32_t autointernal;    // time of the last internal clock tick in us
+
+void auto_play(void);
+
+// varint codec - plain C so it can be checked off the device
+// unsigned LEB128 - 7 bits per byte, high bit set on all but the last. returns the number of bytes written
+uint16_t auto_putvarint(uint8_t * buf, uint32_t v) {
+  uint16_t n=0;
+  while (v >= 0x80) {
+    buf[n++]=(v & 0x7f) | 0x80;
+    v >>= 7;
+  }
+  buf[n++]=v;
+  return n;
+}
+
+// read a varint from buf[pos] up to end. returns the number of bytes read, 0 if it runs off the end
+uint16_t auto_getvarint(const uint8_t * buf, uint16_t pos, uint16_t end, uint32_t * v) {
+  uint16_t n=0;
+  *v=0;
+  while ((pos+n < end) && (n < 5)) {
+    uint8_t b=buf[pos+n];
+    *v |= (uint32_t)(b & 0x7f) << (7*n);
+    ++n;
+    if (!(b & 0x80)) return n;
+  }
+  return 0;
+}
+
+// signed deltas are zigzag coded so small negative numbers stay small
+uint32_t auto_zigzag(int32_t d) {
+  return ((uint32_t)d << 1) ^ (uint32_t)(d >> 31);
+}
+
+int32_t auto_unzigzag(uint32_t v) {
+  return (int32_t)(v >> 1) ^ -(int32_t)(v & 1);
+}
+
+// append an event. returns false if the buffer is full
+bool auto_writeevent(uint32_t tick, uint8_t ctl, uint8_t value) {
+  uint8_t event[11];
+  uint16_t n=auto_putvarint(event,tick-autolasttick);
+  event[n++]=ctl;
+  n+=auto_putvarint(&event[n],auto_zigzag((int16_t)value-autovalue[ctl]));
+  if (autoused+n > AUTO_BUFSIZE) return false;
+  memcpy(&autobuf[autoused],event,n);
+  autoused+=n;
+  autolasttick=tick;
+  autovalue[ctl]=value;
+  autorecorded[ctl >> 5] |= 1ul << (ctl & 31);
+  return true;
+}
+
+// read the event at autopos without consuming it. returns false at the end of the recording, or at an event that
+// doesn't make sense - a control that isn't there or a value outside 0..127
+bool auto_peekevent(uint32_t * tick, uint8_t * ctl, uint8_t * value, uint16_t * len) {
+  uint32_t dt,zz;
+  uint16_t pos=autopos,n;
+  if ((n=auto_getvarint(autobuf,pos,autoused,&dt)) == 0) return false;
+  pos+=n;
+  if (pos >= autoused) return false;
+  *ctl=autobuf[pos++];
+  if ((*ctl >= AUTO_CONTROLS) || ((n=auto_getvarint(autobuf,pos,autoused,&zz)) == 0)) return false;
+  pos+=n;
+  int32_t v=autovalue[*ctl]+auto_unzigzag(zz);
+  if ((v < 0) || (v > 127)) return false;
+  *tick=autolasttick+dt;
+  *value=v;
+  *len=pos-autopos;
+  return true;
+}
+
+// set a control from playback unless it's being played live
+void auto_apply(uint8_t ctl, uint8_t value) {
+  int16_t p=ctl/NUMENCODERS;
+  int16_t i=ctl%NUMENCODERS;
+  if ((millis()-autotouched[ctl]) < AUTO_LIVE_HOLD_MS) return;
+  if (controls[p].encoder[i].value == value) return;
+  controls[p].encoder[i].value=value;
+  if ((p == page) && !displaySwitchLEDs) showencoderLED(p,i);
+  else setencoderframe(p,i);
+  sendencoder(p,i);
+  markccsent(p,ENCODER,i);
+}
+
+// go back to the start of the loop and put the controls the recording moves back where it started
+// the others may have been changed since by hand or by the DAW and are left alone
+void auto_rewind(void) {
+  autotick=0;
+  autolasttick=0;
+  autopos=0;
+  memcpy(autovalue,autostart,sizeof(autovalue));
+  for (int16_t ctl=0; ctl< AUTO_CONTROLS;++ctl) if (autorecorded[ctl >> 5] & (1ul << (ctl & 31))) auto_apply(ctl,autostart[ctl]);
+}
+
+// set autorecorded[] from the events in the buffer - after loading a recording
+// returns false if the events don't all read back with values in range, or the loop isn't a whole number of bars
+bool auto_markrecorded(void) {
+  uint32_t tick;
+  uint8_t ctl,value;
+  uint16_t len;
+  memset(autorecorded,0,sizeof(autorecorded));
+  memcpy(autovalue,autostart,sizeof(autovalue));
+  autopos=0;
+  autolasttick=0;
+  while (auto_peekevent(&tick,&ctl,&value,&len)) {
+    autopos+=len;
+    autolasttick=tick;
+    autovalue[ctl]=value;
+    autorecorded[ctl >> 5] |= 1ul << (ctl & 31);
+  }
+  bool ok=(autopos == autoused) && (autolength > 0) && ((autolength % AUTO_BAR) == 0);
+  autopos=0;
+  autolasttick=0;
+  return ok;
+}
+
+void auto_flushpending(void) {
+  if (!autopending) return;
+  autopending=false;
+  if (!auto_writeevent(autopendtick,autopendctl,autopendvalue)) { // out of room - the loop ends here
+    autotick=autopendtick;
+    auto_play();
+  }
+}
+
+// a control was turned by hand - call after its value has been updated
+void auto_live(int16_t p, int16_t i) {
+  uint8_t ctl=p*NUMENCODERS+i;
+  autotouched[ctl]=millis();
+  if (autostate != AUTO_RECORD) return;
+  if (autopending && ((autopendctl != ctl) || (autopendtick != autotick))) auto_flushpending();
+  if (autostate != AUTO_RECORD) return;  // the buffer just filled up
+  autopending=true;
+  autopendtick=autotick;
+  autopendctl=ctl;
+  autopendvalue=constrain(controls[p].encoder[i].value,0,127);
+}
+
+void auto_record(void) {
+  for (int16_t ctl=0; ctl< AUTO_CONTROLS;++ctl) autostart[ctl]=constrain(controls[ctl/NUMENCODERS].encoder[ctl%NUMENCODERS].value,0,127);
+  memcpy(autovalue,autostart,sizeof(autovalue));
+  memset(autorecorded,0,sizeof(autorecorded));
+  autoused=0;
+  autotick=0;
+  autolasttick=0;
+  autopending=false;
+  autostate=AUTO_RECORD;
+}
+
+// finish a recording if there is one and loop it
+void auto_play(void) {
+  if (autostate == AUTO_RECORD) {
+    autostate=AUTO_OFF;
+    auto_flushpending();
+    autolength=((autotick/AUTO_BAR)+1)*AUTO_BAR;  // round up to whole bars
+  }
+  if (autoused == 0) {
+    autostate=AUTO_OFF;
+    return;
+  }
+  autostate=AUTO_PLAY;
+  auto_rewind();
+}
+
+void auto_stop(void) {
+  if (autostate == AUTO_RECORD) auto_play();  // keep what was recorded
+  autostate=AUTO_OFF;
+}
+
+// one clock tick
+void auto_tick(void) {
+  if (autostate == AUTO_RECORD) {
+    ++autotick;
+    return;
+  }
+  if (autostate != AUTO_PLAY) return;
+  uint32_t tick;
+  uint8_t ctl,value;
+  uint16_t len;
+  while (auto_peekevent(&tick,&ctl,&value,&len) && (tick <= autotick)) {
+    autopos+=len;
+    autolasttick=tick;
+    autovalue[ctl]=value;
+    auto_apply(ctl,value);
+  }
+  if (++autotick >= autolength) auto_rewind();
+}
+
+// run the clock - call from the main loop
+void automation_service(void) {
+  uint32_t ticks=0;
+  uint32_t now=micros();
+  if (midistarted) {  // MIDI Start - back to the top of the loop
+    midistarted=false;
+    if (autostate == AUTO_PLAY) auto_rewind();
+  }
+  if ((millis()-midiclocktime) < AUTO_CLOCK_TIMEOUT_MS) { // following MIDI clock
+    if (midirunning) ticks=midiclocks;
+    midiclocks=0;
+    autointernal=now;
+  }
+  else {
+    if ((now-autointernal) > 4*AUTO_INTERNAL_US) autointernal=now-AUTO_INTERNAL_US; // don't try to catch up after a long stall
+    while ((now-autointernal) >= AUTO_INTERNAL_US) {
+      autointernal+=AUTO_INTERNAL_US;
+      ++ticks;
+    }
+  }
+  if (autostate == AUTO_OFF) return;
+  while (ticks--) auto_tick();
+}
+
+// save the recording alongside a setup slot. a slot with no recording has its old one removed
+bool saveautomation(int16_t slot) {
+  char filename[20];
+  uint8_t header[AUTO_HEADER-AUTO_CONTROLS];
+  sprintf(filename,"slot%d.auto",slot);
+  if (LittleFS.exists(filename)) LittleFS.remove(filename);
+  if (autostate == AUTO_RECORD) auto_play();
+  if (autoused == 0) return true;
+  File file=LittleFS.open(filename,"w");
+  if (!file) return false;
+  memcpy(header,"TWA1",4);
+  for (int16_t i=0; i< 4;++i) header[4+i]=autolength >> (8*i);
+  header[8]=autoused;
+  header[9]=autoused >> 8;
+  bool ok=(file.write(header,sizeof(header)) == sizeof(header)) && (file.write(autostart,AUTO_CONTROLS) == AUTO_CONTROLS)
+    && (file.write(autobuf,autoused) == autoused);
+  file.close();
+  return ok;
+}
+
+// load the recording saved with a setup slot, if there is one. playback starts stopped
+// a file with a start value or an event outside 0..127, or a loop that isn't whole bars, is refused and nothing is loaded
+bool loadautomation(int16_t slot) {
+  char filename[20];
+  uint8_t header[AUTO_HEADER-AUTO_CONTROLS];
+  autostate=AUTO_OFF;
+  autoused=0;
+  sprintf(filename,"slot%d.auto",slot);
+  File file=LittleFS.open(filename,"r");
+  if (!file) return false;
+  bool ok=(file.read(header,sizeof(header)) == sizeof(header)) && !memcmp(header,"TWA1",4);
+  uint16_t used=header[8] | (header[9] << 8);
+  ok=ok && (used <= AUTO_BUFSIZE) && (file.read(autostart,AUTO_CONTROLS) == AUTO_CONTROLS) && (file.read(autobuf,used) == used);
+  file.close();
+  for (int16_t ctl=0; ok && (ctl< AUTO_CONTROLS);++ctl) ok=(autostart[ctl] <= 127);
+  if (ok) {
+    autoused=used;
+    autolength=header[4] | (header[5] << 8) | ((uint32_t)header[6] << 16) | ((uint32_t)header[7] << 24);
+    ok=auto_markrecorded();
+  }
+  if (ok) return true;
+  autoused=0;
+  memset(autorecorded,0,sizeof(autorecorded));
+  Serial.printf("automation for slot %d is damaged, not loaded\n",slot);
+  return false;
+}
+
+// show the recorder state in the big text line
+void showauto(void) {
+  static const char * const states[]={"Auto Off","Auto Rec","Auto Play"};
+  ft_clear(0,16,SCREEN_WIDTH,2);
+  ft_print(0,16,states[autostate],2);
+  updatedisplay();
+}
@@ -0,0 +1,163 @@
+// Copyright 2026 Rich Heslip
+//
+// Author: Rich Heslip
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// See http://creativecommons.org/licenses/MIT/ for more information.
+//
+// -----------------------------------------------------------------------------
+
+// microbenchmarks for the Twisty 2 hot paths
+// uncomment #define BENCHMARK in the main source file to run these once at the end of setup()
+// the RP2040 microsecond timer is the clock. the encoder scan interrupt is turned off while timing so it doesn't skew the numbers
+// results go out the USB serial port as one JSON object per line so runs from different revisions can be diffed or parsed by a script
+// allocs is how many times the run called new - none of the hot paths should. new and delete are replaced here to count
+// them, which catches LittleFS File objects and String. a plain malloc() isn't counted
+// the first line is the memory map from the linker: flash is the whole image, data is initialized RAM (copied from flash
+// at power on), bss is zeroed RAM and heap is what's left for malloc
+// the last line is a checksum of what the benchmarks that work something out came up with - printing it is what stops the
+// compiler from throwing that work away
+
+#define BENCH_SLOT 99  // scratch config slot so we don't trash the user's saved setups
+
+uint32_t bench_start_us;
+uint32_t benchallocs;  // calls to new since power on
+uint32_t bench_start_allocs;
+
+void * operator new(size_t size) {
+  ++benchallocs;
+  return malloc(size);
+}
+
+void * operator new[](size_t size) {
+  ++benchallocs;
+  return malloc(size);
+}
+
+void operator delete(void * p) noexcept { free(p); }
+void operator delete[](void * p) noexcept { free(p); }
+void operator delete(void * p, size_t) noexcept { free(p); }
+void operator delete[](void * p, size_t) noexcept { free(p); }
+
+void bench_begin(void) {
+  bench_start_allocs=benchallocs;
+  bench_start_us=timer_hw->timerawl;
+}
+
+void bench_end(const char * name, uint32_t iterations) {
+  uint32_t elapsed=timer_hw->timerawl - bench_start_us;
+  uint32_t allocs=benchallocs - bench_start_allocs;
+  Serial.printf("{\"fw\":\"Twisty2\",\"build\":\"%s %s\",\"bench\":\"%s\",\"iters\":%lu,\"ns_per_op\":%lu,\"allocs\":%lu}\n",
+    __DATE__,__TIME__,name,(unsigned long)iterations,(unsigned long)((uint64_t)elapsed*1000/iterations),(unsigned long)allocs);
+}
+
+// run statement s n times and report it
+#define BENCH(name,n,s) { bench_begin(); for (uint32_t _i=0;_i<(n);++_i) { s; } bench_end(name,n); }
+
+// the settings loadconfig overwrites
+struct {
+  struct controllerpage controls[CONTROLLER_PAGES];
+  int16_t scenevalues[CONTROLLER_PAGES][2][NUMENCODERS];
+  int16_t morphpos[CONTROLLER_PAGES];
+  struct macrotarget macros[NUM_MACROS][MACRO_TARGETS];
+  int16_t custompoints[CUSTOM_POINTS];
+} benchsaved;
+
+// section bounds from the linker script
+extern "C" char __flash_binary_start[],__flash_binary_end[];
+extern "C" char __data_start__[],__data_end__[],__bss_start__[],__bss_end__[];
+
+void bench_memory(void) {
+  Serial.printf("{\"fw\":\"Twisty2\",\"build\":\"%s %s\",\"flash\":%lu,\"data\":%lu,\"bss\":%lu,\"heap_free\":%d,\"config_load\":%u}\n",
+    __DATE__,__TIME__,(unsigned long)(__flash_binary_end-__flash_binary_start),(unsigned long)(__data_end__-__data_start__),
+    (unsigned long)(__bss_end__-__bss_start__),rp2040.getFreeHeap(),(unsigned)CONFIG_LOAD_BYTES);
+}
+
+uint32_t benchsum;  // results folded together for the checksum line
+
+void bench_checksum(void) {
+  Serial.printf("{\"fw\":\"Twisty2\",\"build\":\"%s %s\",\"checksum\":%lu}\n",__DATE__,__TIME__,(unsigned long)benchsum);
+}
+
+void runbenchmarks(void) {
+  int16_t savedpage=page;
+  int16_t savedcontrol=lastcontrol;
+
+  while (!Serial) delay(10);  // wait for USB connection so the results aren't lost
+  bench_memory();
+  irq_set_enabled(ALARM_IRQ, false);  // stop the encoder scan while timing
+
+  BENCH("ClickEncoder::service",10000,enc[0].service());
+  BENCH("ClickEncoder::service x18",1000,for (int e=0;e<NUMENCODERS;++e) enc[e].service(); lmenuenc.service(); rmenuenc.service());
+  BENCH("ClickEncoder::getValue",10000,enc[0].getValue());
+  BENCH("scan_encoders",1000,scan_encoders());  // the scan alarm_irq does, mux settling delays and all, without rearming the alarm
+
+  BENCH("showencoderLED",10000,showencoderLED(0,0));
+  BENCH("showencoderLEDs",1000,showencoderLEDs(0));
+  BENCH("showswitchLED",10000,showswitchLED(0,0));
+  BENCH("LEDS.show",100,LEDS.show());
+
+  // these all end in a display update so they include the I2C transfer
+  BENCH("showpage",100,showpage(1));
+  BENCH("showencodercc",100,showencodercc(0,0));
+  BENCH("showencoder",100,showencoder(0,0));
+  BENCH("showswitch",100,showswitch(0,0));
+  topmenuindex=0;
+  menupos[topmenuindex].submenuindex=0;
+  copy_to_editbuffer(0,0);
+  BENCH("drawsubmenu",100,drawsubmenu(0));
+  BENCH("drawsubmenus",100,drawsubmenus());
+  BENCH("display.display",100,display.display());
+
+  // text drawing into the frame buffer only - fast path against GFX for the big value line
+  BENCH("ft_printf size 2",1000,ft_printf(0,16,2,"%s %d %d","CC",64,127));
+  BENCH("GFX printf size 2",1000,display.setTextSize(2); display.setCursor(0,16); display.printf("%s %d %d","CC",64,127); display.setTextSize(1));
+  BENCH("ft_printf size 1",1000,ft_printf(32,0,1,"CC %d",64));
+  BENCH("GFX printf size 1",1000,display.setCursor(32,0); display.printf("CC %d",64));
+
+  // macro fan out without the MIDI sends - every target of every macro as if all 16 encoders turned at once
+  BENCH("macro fan-out 16x8",1000,for (int m=0;m<NUM_MACROS;++m) for (int t=0;t<MACRO_TARGETS;++t) benchsum+=macrovalue(&macros[m][t],_i & 0x7f));
+
+  // loadconfig replaces the live settings - keep a copy and put it back afterwards
+  BENCH("saveconfig",10,saveconfig(BENCH_SLOT));
+  memcpy(benchsaved.controls,controls,sizeof(controls));
+  memcpy(benchsaved.scenevalues,scenevalues,sizeof(scenevalues));
+  memcpy(benchsaved.morphpos,morphpos,sizeof(morphpos));
+  memcpy(benchsaved.macros,macros,sizeof(macros));
+  memcpy(benchsaved.custompoints,custompoints,sizeof(custompoints));
+  BENCH("loadconfig",10,loadconfig(BENCH_SLOT));
+  memcpy(controls,benchsaved.controls,sizeof(controls));
+  memcpy(scenevalues,benchsaved.scenevalues,sizeof(scenevalues));
+  memcpy(morphpos,benchsaved.morphpos,sizeof(morphpos));
+  memcpy(macros,benchsaved.macros,sizeof(macros));
+  memcpy(custompoints,benchsaved.custompoints,sizeof(custompoints));
+  buildcustomcurve();
+  char filename[20];
+  sprintf(filename,"slot%d.json",BENCH_SLOT);
+  LittleFS.remove(filename);
+
+  irq_set_enabled(ALARM_IRQ, true);
+  page=savedpage;
+  lastcontrol=savedcontrol;
+  display.clearDisplay();
+  showencoderLEDs(page);
+  showencoder(page,lastcontrol);
+  bench_checksum();
+}
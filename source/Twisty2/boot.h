@@ -0,0 +1,37 @@
+// boot timing
+// setup() brings things up in the order they matter on stage: input scanning, then the MIDI ports, then the saved
+// session, and only then the display and LEDs. nothing waits on the splash screen - it's drawn and the loop takes it
+// down after SPLASH_MS, or as soon as a control is used
+// each phase is stamped with micros() since power on so a slow boot can be tracked down. with PROFILE the times are
+// on the Stats menu and in the 's' dump
+
+#define SPLASH_MS 1500
+
+enum bootphases {BOOT_INPUTS,BOOT_MIDI,BOOT_SESSION,BOOT_DISPLAY,BOOT_FIRSTMIDI,NUM_BOOT_PHASES};
+const char * const bootnames[NUM_BOOT_PHASES]={"inputs","MIDI ready","session","display","first MIDI in"};
+uint32_t boottime[NUM_BOOT_PHASES];  // micros() at the end of each phase, 0 if it hasn't happened yet
+int16_t bootms[NUM_BOOT_PHASES];     // the same in ms for the Stats menu
+
+bool splashing=false;  // splash screen is up
+uint32_t splashstart;
+
+// note the end of a boot phase. only the first call for each phase counts
+void bootstamp(int16_t phase) {
+  if (boottime[phase]) return;
+  boottime[phase]=micros() | 1;  // never 0
+  bootms[phase]=(boottime[phase]+500)/1000;
+}
+
+// true once when the splash screen should come down
+bool splashdone(void) {
+  if (!splashing || ((millis()-splashstart) < SPLASH_MS)) return false;
+  splashing=false;
+  return true;
+}
+
+void bootreport(void) {
+  for (int16_t i=0; i< NUM_BOOT_PHASES;++i) {
+    if (boottime[i]) Serial.printf("boot %-14s %7lu us\n",bootnames[i],(unsigned long)boottime[i]);
+    else Serial.printf("boot %-14s       -\n",bootnames[i]);
+  }
+}
@@ -0,0 +1,45 @@
+// MIDI output budget for Twisty 2
+// each output port has one token bucket that everything sent on it draws from, so the traffic all together stays under
+// what the port can carry. DIN is 3125 bytes/s on the wire - the budget is a little under so the UART never backs up
+// - controls moved by hand, switches and SysEx replies go out straight away whatever the bucket holds. budget_spend()
+//   charges them anyway, which can run the bucket into debt
+// - morph CCs and forwarded thru messages can wait, so they only go out while budget_bytes() says there's credit for
+//   them, and are charged the same way. they get what the controls leave over, and nothing when the controls use it all
+// the credit is in byte-microseconds - bytes * 1000000 - so refilling is a multiply by the time since the last refill
+
+#define BUDGET_MAX_GAP_US 100000  // refill is capped at this much idle time
+#define BUDGET_MAX_DEBT_S 1       // the controls can run a port at most this many seconds of budget into debt
+
+const uint32_t portbudget[NUM_PORTS]={42000,3000,3000};  // bytes per second - USB, DIN, BLE
+const uint32_t portburst[NUM_PORTS]={64,24,24};          // most bytes that can go out at once after a quiet spell - a DIN burst fits the UART FIFO
+int64_t porttokens[NUM_PORTS];   // credit left, negative when the controls have overspent
+uint32_t portrefill[NUM_PORTS];  // time of the last refill
+
+// the port a MIDI interface sends on
+int16_t midiport(MIDI_Interface &midi) {
+  if (&midi == (MIDI_Interface *)&usbMIDI) return PORT_USB;
+  if (&midi == (MIDI_Interface *)&serialMIDI) return PORT_DIN;
+  return PORT_BLE;
+}
+
+// add credit for the time since the last refill
+void budget_refill(int16_t port) {
+  uint32_t now=micros();
+  uint32_t gap=now-portrefill[port];
+  portrefill[port]=now;
+  if (gap > BUDGET_MAX_GAP_US) gap=BUDGET_MAX_GAP_US;
+  porttokens[port]+=(int64_t)gap*portbudget[port];
+  if (porttokens[port] > (int64_t)portburst[port]*1000000) porttokens[port]=(int64_t)portburst[port]*1000000;
+}
+
+// charge bytes that have been sent regardless of the budget
+void budget_spend(int16_t port, uint16_t bytes) {
+  budget_refill(port);
+  porttokens[port]-=(int64_t)bytes*1000000;
+  if (porttokens[port] < -(int64_t)portbudget[port]*1000000*BUDGET_MAX_DEBT_S) porttokens[port]=-(int64_t)portbudget[port]*1000000*BUDGET_MAX_DEBT_S;
+}
+
+// whole bytes of credit a port has - call budget_refill() first
+uint32_t budget_bytes(int16_t port) {
+  return (porttokens[port] > 0) ? porttokens[port]/1000000 : 0;
+}
@@ -28,13 +28,149 @@
 // file operations for Twisty 2
 //  settings of encoders and switches saved and loaded in JSON format
 // JSON allows adding features without breaking old settings
-// using the LittleFFS filesystem in Pico Arduino 
+// using the LittleFFS filesystem in Pico Arduino
 // you have to set up an FFS partition in Arduino tools menu or file operations will fail
+//
+// nothing here touches the heap. a load streams the file through a small buffer and a parser that only keeps the path to
+// the value it's on - no document is built. each key is hashed as it goes by and looked up in cfgfields[], each value is
+// checked against its field's range, and the values land in a copy of the settings in cfgarena, so a file that turns out
+// to be broken part way through changes nothing.
+// that copy, the buffer and the path are all the memory a load uses however big the file is - CONFIG_LOAD_BYTES
+// a save formats into the same buffer and writes it out whenever it fills
 
 #define VERSION 100 // file format version in case it changes at some point
+#define CFG_IOBUF 128  // file read/write buffer
+#define CFG_DEPTH 8    // deepest nesting of objects and arrays a file can have
+
+// FNV-1a hash of a key - the compiler works out the ones in cfgfields[], the parser works them out a byte at a time
+#define CFG_HASH_START 2166136261u
+
+constexpr uint32_t cfghashbyte(uint32_t h, uint8_t c) {
+  return (h ^ c)*16777619u;
+}
+
+constexpr uint32_t cfghash(const char * key) {
+  uint32_t h=CFG_HASH_START;
+  while (*key) h=cfghashbyte(h,*key++);
+  return h;
+}
+
+// where a key's value goes
+enum cfgtargets {CFG_ENCODER,CFG_SWITCH,CFG_SCENE,CFG_TARGET};
+
+struct cfgfield {
+  uint32_t hash;
+  uint8_t target;
+  uint8_t index;  // int16 field in the struct, or the scene
+  int16_t min;    // a value outside these rejects the file
+  int16_t max;
+};
+
+#define CFG_ENC(f) CFG_ENCODER,offsetof(controllerencoder,f)/sizeof(int16_t)
+#define CFG_SW(f) CFG_SWITCH,offsetof(controllerswitch,f)/sizeof(int16_t)
+#define CFG_TGT(f) CFG_TARGET,offsetof(macrotarget,f)/sizeof(int16_t)
+
+constexpr struct cfgfield cfgfields[] = {
+  cfghash("EncoderType"),CFG_ENC(type),CCTYPE,MACROTYPE,
+  cfghash("EncoderChannel"),CFG_ENC(channel),1,16,
+  cfghash("EncoderCCNumber"),CFG_ENC(ccnumber),0,127,
+  cfghash("EncoderMinValue"),CFG_ENC(minvalue),0,127,
+  cfghash("EncoderMaxValue"),CFG_ENC(maxvalue),0,127,
+  cfghash("EncoderValue"),CFG_ENC(value),0,127,
+  cfghash("EncoderColorIndex"),CFG_ENC(colorindex),0,NUM_LEDCOLORS-1,
+  cfghash("EncoderLabelIndex"),CFG_ENC(labelindex),0,NUM_LABELS-1,
+  cfghash("EncoderRed"),CFG_ENC(red),-1,255,
+  cfghash("EncoderGreen"),CFG_ENC(green),-1,255,
+  cfghash("EncoderBlue"),CFG_ENC(blue),-1,255,
+  cfghash("EncoderMacro"),CFG_ENC(macro),1,NUM_MACROS,
+  cfghash("EncoderPorts"),CFG_ENC(ports),0,ALL_PORTS,
+  cfghash("SceneA"),CFG_SCENE,SCENE_A,-1,127,
+  cfghash("SceneB"),CFG_SCENE,SCENE_B,-1,127,
+  cfghash("SwitchMode"),CFG_SW(mode),MOMENTARY,TOGGLE,
+  cfghash("SwitchType"),CFG_SW(type),CCMESSAGE,SETENC,
+  cfghash("SwitchChannel"),CFG_SW(channel),1,16,
+  cfghash("SwitchCC"),CFG_SW(ccnumber),0,127,        // what saveconfig writes
+  cfghash("SwitchCCNumber"),CFG_SW(ccnumber),0,127,  // what the loader used to look for
+  cfghash("SwitchMinValue"),CFG_SW(minvalue),0,127,
+  cfghash("SwitchMaxValue"),CFG_SW(maxvalue),0,127,
+  cfghash("SwitchValue"),CFG_SW(value),0,127,
+  cfghash("SwitchColorIndex"),CFG_SW(colorindex),0,NUM_LEDCOLORS-1,
+  cfghash("SwitchLabelIndex"),CFG_SW(labelindex),0,NUM_LABELS-1,
+  cfghash("SwitchPorts"),CFG_SW(ports),0,ALL_PORTS,
+  cfghash("Channel"),CFG_TGT(channel),0,16,
+  cfghash("CCNumber"),CFG_TGT(ccnumber),0,127,
+  cfghash("MinValue"),CFG_TGT(minvalue),0,127,
+  cfghash("MaxValue"),CFG_TGT(maxvalue),0,127,
+  cfghash("Curve"),CFG_TGT(curve),0,NUM_CURVES-1,
+};
+
+#define CFG_FIELDS (sizeof(cfgfields)/sizeof(struct cfgfield))
+
+// keys on the way down to the values
+#define CFG_KEY_PAGE cfghash("page")
+#define CFG_KEY_CONTROL cfghash("control")
+#define CFG_KEY_MACRO cfghash("macro")
+#define CFG_KEY_TARGET cfghash("target")
+#define CFG_KEY_CUSTOMCURVE cfghash("CustomCurve")
+
+// a hash clash would send a value to the wrong place - make sure there isn't one
+constexpr bool cfgunique(void) {
+  for (size_t i=0; i< CFG_FIELDS;++i) {
+    for (size_t j=i+1; j< CFG_FIELDS;++j) if (cfgfields[i].hash == cfgfields[j].hash) return false;
+  }
+  return true;
+}
+static_assert(cfgunique(),"two config keys have the same hash");
+
+// one open object or array on the path to the value being read
+struct cfglevel {
+  uint32_t key;   // objects - hash of the key being read
+  int16_t index;  // arrays - element being read
+  bool array;
+};
+
+// everything a load or save uses
+struct configarena {
+  struct controllerpage controls[CONTROLLER_PAGES];  // the settings being loaded
+  int16_t scenevalues[CONTROLLER_PAGES][2][NUMENCODERS];
+  struct macrotarget macros[NUM_MACROS][MACRO_TARGETS];
+  int16_t custompoints[CUSTOM_POINTS];
+  struct cfglevel path[CFG_DEPTH];
+  int16_t depth;   // levels of path in use
+  File * file;
+  uint8_t buf[CFG_IOBUF];
+  uint16_t len;    // bytes in buf
+  uint16_t pos;    // next byte to read from buf
+  bool ok;         // no write has failed
+  bool rejected;   // a value was out of range - the load stopped there
+} cfgarena;
+
+#define CONFIG_LOAD_BYTES sizeof(configarena)  // all the RAM a load needs - it's static so it's always there
 
 // save current settings to filesystem in JSON format
 
+// write whatever is in the buffer to the file
+void cfg_flush(void) {
+  if (cfgarena.len && (cfgarena.file->write(cfgarena.buf,cfgarena.len) != cfgarena.len)) cfgarena.ok=false;
+  cfgarena.len=0;
+}
+
+// printf to the file through the buffer - one piece has to fit in CFG_IOBUF
+void cfg_printf(const char * format, ...) {
+  va_list args;
+  for (int16_t tries=0; tries < 2;++tries) {
+    va_start(args,format);
+    int n=vsnprintf((char *)cfgarena.buf+cfgarena.len,CFG_IOBUF-cfgarena.len,format,args);
+    va_end(args);
+    if ((n >= 0) && (n < (CFG_IOBUF-cfgarena.len))) {
+      cfgarena.len+=n;
+      return;
+    }
+    cfg_flush();  // didn't fit - make room and try again
+  }
+  cfgarena.ok=false;
+}
+
 int16_t saveconfig(int16_t slot) {
   char filename[20];
   sprintf(filename,"slot%d.json",slot);
@@ -46,96 +182,385 @@ int16_t saveconfig(int16_t slot) {
     Serial.println("file open failed");
     return 0;
   }
+  cfgarena.file=&file;
+  cfgarena.len=0;
+  cfgarena.ok=true;
 
-  file.printf("{ \"Version\" : %d ,\n",VERSION);
-  file.printf("\"page\" :  [\n");
+  cfg_printf("{ \"Version\" : %d ,\n",VERSION);
+  cfg_printf("\"page\" :  [\n");
 
   for (int16_t p=0;p<CONTROLLER_PAGES;++p) {
-    file.printf("  { \"control\" : [ \n");
+    cfg_printf("  { \"control\" : [ \n");
     for (int16_t c=0; c< NUMENCODERS;c++) {
-    //  file.printf("  { \"control\" : [ {");
-      file.printf("    { \"EncoderType\":%d,",controls[p].encoder[c].type);
-      file.printf("\"EncoderChannel\":%d,",controls[p].encoder[c].channel);
-      file.printf("\"EncoderCCNumber\":%d,",controls[p].encoder[c].ccnumber);
-      file.printf("\"EncoderMinValue\":%d,",controls[p].encoder[c].minvalue);
-      file.printf("\"EncoderMaxValue\":%d,",controls[p].encoder[c].maxvalue);
-      file.printf("\"EncoderValue\":%d,",controls[p].encoder[c].value);
-      file.printf("\"EncoderColorIndex\":%d,",controls[p].encoder[c].colorindex);
-      file.printf("\"EncoderLabelIndex\":%d,",controls[p].encoder[c].labelindex);
-      file.printf("\"SwitchMode\":%d,",controls[p].encswitch[c].mode);
-      file.printf("\"SwitchType\":%d,",controls[p].encswitch[c].type);
-      file.printf("\"SwitchChannel\":%d,",controls[p].encswitch[c].channel);
-      file.printf("\"SwitchCC\":%d,",controls[p].encswitch[c].ccnumber);
-      file.printf("\"SwitchMinValue\":%d,",controls[p].encswitch[c].minvalue);
-      file.printf("\"SwitchMaxValue\":%d,",controls[p].encswitch[c].maxvalue);
-      file.printf("\"SwitchValue\":%d,",controls[p].encswitch[c].value);
-      file.printf("\"SwitchColorIndex\":%d,",controls[p].encswitch[c].colorindex);
-      file.printf("\"SwitchLabelIndex\":%d",controls[p].encswitch[c].labelindex);
-      if (c == (NUMENCODERS-1)) file.printf("}\n");
-      else file.printf("},\n");
+      struct controllerencoder * e=&controls[p].encoder[c];
+      struct controllerswitch * s=&controls[p].encswitch[c];
+      cfg_printf("    { \"EncoderType\":%d,\"EncoderChannel\":%d,\"EncoderCCNumber\":%d,",e->type,e->channel,e->ccnumber);
+      cfg_printf("\"EncoderMinValue\":%d,\"EncoderMaxValue\":%d,\"EncoderValue\":%d,",e->minvalue,e->maxvalue,e->value);
+      cfg_printf("\"EncoderColorIndex\":%d,\"EncoderLabelIndex\":%d,",e->colorindex,e->labelindex);
+      cfg_printf("\"EncoderRed\":%d,\"EncoderGreen\":%d,\"EncoderBlue\":%d,",e->red,e->green,e->blue);
+      cfg_printf("\"EncoderMacro\":%d,\"EncoderPorts\":%d,",e->macro,e->ports);
+      cfg_printf("\"SceneA\":%d,\"SceneB\":%d,",scenevalues[p][SCENE_A][c],scenevalues[p][SCENE_B][c]);
+      cfg_printf("\"SwitchMode\":%d,\"SwitchType\":%d,\"SwitchChannel\":%d,\"SwitchCC\":%d,",s->mode,s->type,s->channel,s->ccnumber);
+      cfg_printf("\"SwitchMinValue\":%d,\"SwitchMaxValue\":%d,\"SwitchValue\":%d,",s->minvalue,s->maxvalue,s->value);
+      cfg_printf("\"SwitchColorIndex\":%d,\"SwitchLabelIndex\":%d,\"SwitchPorts\":%d",s->colorindex,s->labelindex,s->ports);
+      if (c == (NUMENCODERS-1)) cfg_printf("}\n");
+      else cfg_printf("},\n");
+    }
+    if (p == (CONTROLLER_PAGES-1)) cfg_printf("    ]\n  }\n");
+    else cfg_printf("    ]\n  },\n");
+  }
+  cfg_printf("],\n");
+  cfg_printf("\"macro\" :  [\n");
+  for (int16_t m=0;m<NUM_MACROS;++m) {
+    cfg_printf("  { \"target\" : [ \n");
+    for (int16_t t=0; t< MACRO_TARGETS;t++) {
+      cfg_printf("    { \"Channel\":%d,\"CCNumber\":%d,",macros[m][t].channel,macros[m][t].ccnumber);
+      cfg_printf("\"MinValue\":%d,\"MaxValue\":%d,\"Curve\":%d",macros[m][t].minvalue,macros[m][t].maxvalue,macros[m][t].curve);
+      if (t == (MACRO_TARGETS-1)) cfg_printf("}\n");
+      else cfg_printf("},\n");
     }
-    if (p == (CONTROLLER_PAGES-1)) file.printf("    ]\n  }\n");
-    else file.printf("    ]\n  },\n");
+    if (m == (NUM_MACROS-1)) cfg_printf("    ]\n  }\n");
+    else cfg_printf("    ]\n  },\n");
   }
-  file.printf("]\n}\n");
+  cfg_printf("],\n");
+  cfg_printf("\"CustomCurve\" : [");
+  for (int16_t i=0; i< CUSTOM_POINTS;++i) cfg_printf((i == (CUSTOM_POINTS-1)) ? "%d" : "%d,",custompoints[i]);
+  cfg_printf("]\n}\n");
+  cfg_flush();
   file.close();
-  return 1;
+  if (!cfgarena.ok) Serial.println("file write failed");
+  return cfgarena.ok;
 }
 
 
-// read and deserialize JSON settings file
+// read and parse JSON settings file
 
-int16_t loadconfig(int16_t slot) {
-  char filename[20];
-  sprintf(filename,"slot%d.json",slot);
+// next byte of the file without using it up, -1 at the end
+int16_t cfg_peek(void) {
+  if (cfgarena.pos >= cfgarena.len) {
+    int n=cfgarena.file->read(cfgarena.buf,CFG_IOBUF);
+    cfgarena.len=(n > 0) ? n : 0;
+    cfgarena.pos=0;
+    if (!cfgarena.len) return -1;
+  }
+  return cfgarena.buf[cfgarena.pos];
+}
 
-  File file = LittleFS.open(filename, "r");
-  if (!file) {
-    Serial.println("file open failed");
-    return 0;
+int16_t cfg_get(void) {
+  int16_t c=cfg_peek();
+  if (c >= 0) ++cfgarena.pos;
+  return c;
+}
+
+// next byte that isn't white space
+int16_t cfg_token(void) {
+  int16_t c;
+  do c=cfg_get(); while ((c == ' ') || (c == '\t') || (c == '\n') || (c == '\r'));
+  return c;
+}
+
+// read the rest of a string after its opening quote. returns the hash of what's in it - escapes are hashed as they
+// are written, which is fine for keys since none of ours have any. false if the file ends first
+bool cfg_string(uint32_t * hash) {
+  uint32_t h=CFG_HASH_START;
+  int16_t c;
+  while ((c=cfg_get()) != '"') {
+    if (c < 0x20) return false;  // end of file or a control character
+    h=cfghashbyte(h,c);
+    if (c == '\\') {
+      if ((c=cfg_get()) < 0x20) return false;
+      h=cfghashbyte(h,c);
+    }
   }
-  if (!file) {
-    Serial.println("Failed to open file for reading");
-    return 0;
+  *hash=h;
+  return true;
+}
+
+// read the rest of true, false or null
+bool cfg_literal(const char * rest) {
+  while (*rest) if (cfg_get() != *rest++) return false;
+  return true;
+}
+
+// read a number that starts with c. only whole numbers that fit an int16 are used - anything else is read past and
+// *whole is cleared so the setting keeps its default
+bool cfg_number(int16_t c, int16_t * value, bool * whole) {
+  bool negative=(c == '-');
+  if (negative) c=cfg_get();
+  if ((c < '0') || (c > '9')) return false;
+  int32_t v=0;
+  *whole=true;
+  for (;;) {
+    if (v <= 32768) v=v*10+c-'0';
+    else *whole=false;
+    if ((cfg_peek() < '0') || (cfg_peek() > '9')) break;
+    c=cfg_get();
+  }
+  if (cfg_peek() == '.') {
+    cfg_get();
+    *whole=false;
+    if ((cfg_peek() < '0') || (cfg_peek() > '9')) return false;
+    while ((cfg_peek() >= '0') && (cfg_peek() <= '9')) cfg_get();
   }
+  if ((cfg_peek() == 'e') || (cfg_peek() == 'E')) {
+    cfg_get();
+    *whole=false;
+    if ((cfg_peek() == '+') || (cfg_peek() == '-')) cfg_get();
+    if ((cfg_peek() < '0') || (cfg_peek() > '9')) return false;
+    while ((cfg_peek() >= '0') && (cfg_peek() <= '9')) cfg_get();
+  }
+  if (negative) v=-v;
+  if ((v < -32768) || (v > 32767)) *whole=false;
+  *value=v;
+  return true;
+}
 
-  // Allocate the JSON document 
-  JsonDocument doc;
+// true if path level i is the key'th member of an object
+bool cfg_at(int16_t i, uint32_t key) {
+  return !cfgarena.path[i].array && (cfgarena.path[i].key == key);
+}
 
-  // Deserialize JSON document from file
-  DeserializationError error = deserializeJson(doc, file);
+bool cfg_inrange(int16_t v, int16_t lo, int16_t hi) {
+  return (v >= lo) && (v <= hi);
+}
+
+// put a number where the path says it goes - values in places we don't know about are skipped. false if it's out of range
+// for its field, which rejects the file - it's never stored
+bool cfg_store(int16_t value) {
+  struct cfglevel * path=cfgarena.path;
+  if ((cfgarena.depth == 2) && cfg_at(0,CFG_KEY_CUSTOMCURVE) && path[1].array) {
+    if (path[1].index >= CUSTOM_POINTS) return true;
+    if (!cfg_inrange(value,0,127)) {
+      Serial.printf("config custom curve point %d is out of range\n",path[1].index+1);
+      return false;
+    }
+    cfgarena.custompoints[path[1].index]=value;
+    return true;
+  }
+  if ((cfgarena.depth != 5) || !path[1].array || !path[3].array || path[4].array) return true;
+  int16_t i=path[1].index;
+  int16_t j=path[3].index;
+  const struct cfgfield * f;
+  for (f=cfgfields; f < cfgfields+CFG_FIELDS;++f) if (f->hash == path[4].key) break;
+  if (f == cfgfields+CFG_FIELDS) return true;
+  if (cfg_at(0,CFG_KEY_PAGE) && cfg_at(2,CFG_KEY_CONTROL) && (f->target != CFG_TARGET)) {
+    if ((i >= CONTROLLER_PAGES) || (j >= NUMENCODERS)) return true;
+    if (!cfg_inrange(value,f->min,f->max)) {
+      Serial.printf("config page %d control %d has %d, out of range\n",i+1,j+1,value);
+      return false;
+    }
+    if (f->target == CFG_ENCODER) ((int16_t *)&cfgarena.controls[i].encoder[j])[f->index]=value;
+    else if (f->target == CFG_SWITCH) ((int16_t *)&cfgarena.controls[i].encswitch[j])[f->index]=value;
+    else cfgarena.scenevalues[i][f->index][j]=value;
+  }
+  else if (cfg_at(0,CFG_KEY_MACRO) && cfg_at(2,CFG_KEY_TARGET) && (f->target == CFG_TARGET)) {
+    if ((i >= NUM_MACROS) || (j >= MACRO_TARGETS)) return true;
+    if (!cfg_inrange(value,f->min,f->max)) {
+      Serial.printf("config macro %d target %d has %d, out of range\n",i+1,j+1,value);
+      return false;
+    }
+    ((int16_t *)&cfgarena.macros[i][j])[f->index]=value;
+  }
+  return true;
+}
+
+// settings a file doesn't have - older files have no colors, scenes or macros
+void cfg_defaults(void) {
+  memset(cfgarena.controls,0,sizeof(cfgarena.controls));
+  for (int16_t p=0;p<CONTROLLER_PAGES;++p) {
+    for (int16_t c=0; c< NUMENCODERS;c++) {
+      cfgarena.controls[p].encoder[c].red=-1;  // the palette color is used if there isn't one
+      cfgarena.controls[p].encoder[c].green=-1;
+      cfgarena.controls[p].encoder[c].blue=-1;
+      cfgarena.controls[p].encoder[c].macro=c+1;
+      cfgarena.controls[p].encoder[c].ports=ALL_PORTS;  // older files send everything everywhere
+      cfgarena.controls[p].encswitch[c].ports=ALL_PORTS;
+    }
+  }
+  memset(cfgarena.scenevalues,0xff,sizeof(cfgarena.scenevalues));  // all -1
+  for (int16_t m=0;m<NUM_MACROS;++m) {
+    for (int16_t t=0; t< MACRO_TARGETS;t++) {
+      cfgarena.macros[m][t].channel=0;
+      cfgarena.macros[m][t].ccnumber=0;
+      cfgarena.macros[m][t].minvalue=0;
+      cfgarena.macros[m][t].maxvalue=127;
+      cfgarena.macros[m][t].curve=CURVE_LINEAR;
+    }
+  }
+  for (int16_t i=0; i< CUSTOM_POINTS;++i) cfgarena.custompoints[i]=i*127/(CUSTOM_POINTS-1);
+}
+
+// check everything a file set before it goes live - the defaults for what it didn't set as well as what it did. indexes
+// out of range would be read past the end of labels[], the palette or macros[], and a file that came in over SysEx is no
+// more trusted than that. false rejects the whole file
+bool cfg_valid(void) {
+  for (int16_t p=0;p<CONTROLLER_PAGES;++p) {
+    for (int16_t c=0; c< NUMENCODERS;c++) {
+      struct controllerencoder * e=&cfgarena.controls[p].encoder[c];
+      struct controllerswitch * s=&cfgarena.controls[p].encswitch[c];
+      bool ok=cfg_inrange(e->type,CCTYPE,MACROTYPE) && cfg_inrange(e->channel,1,16) && cfg_inrange(e->ccnumber,0,127) &&
+        cfg_inrange(e->minvalue,0,127) && cfg_inrange(e->maxvalue,0,127) && cfg_inrange(e->colorindex,0,NUM_LEDCOLORS-1) &&
+        cfg_inrange(e->labelindex,0,NUM_LABELS-1) && cfg_inrange(e->red,-1,255) && cfg_inrange(e->green,-1,255) &&
+        cfg_inrange(e->blue,-1,255) && cfg_inrange(e->macro,1,NUM_MACROS) && cfg_inrange(e->ports,0,ALL_PORTS) &&
+        cfg_inrange(s->mode,MOMENTARY,TOGGLE) && cfg_inrange(s->type,CCMESSAGE,SETENC) && cfg_inrange(s->channel,1,16) &&
+        cfg_inrange(s->ccnumber,0,127) && cfg_inrange(s->minvalue,0,127) && cfg_inrange(s->maxvalue,0,127) &&
+        cfg_inrange(s->colorindex,0,NUM_LEDCOLORS-1) && cfg_inrange(s->labelindex,0,NUM_LABELS-1) && cfg_inrange(s->ports,0,ALL_PORTS);
+      if (!ok) {
+        Serial.printf("config page %d control %d is out of range\n",p+1,c+1);
+        return false;
+      }
+    }
+    // a scene is stored for all the encoders or none - morphto() only looks at the first
+    for (int16_t sc=SCENE_A; sc<= SCENE_B;++sc) {
+      int16_t * v=cfgarena.scenevalues[p][sc];
+      bool ok=true;
+      for (int16_t c=0; c< NUMENCODERS;c++) ok=ok && ((v[0] < 0) ? (v[c] == -1) : cfg_inrange(v[c],0,127));
+      if (!ok) {
+        Serial.printf("config page %d scene %c is out of range\n",p+1,'A'+sc);
+        return false;
+      }
+    }
+  }
+  for (int16_t m=0;m<NUM_MACROS;++m) {
+    for (int16_t t=0; t< MACRO_TARGETS;t++) {
+      struct macrotarget * g=&cfgarena.macros[m][t];
+      if (!cfg_inrange(g->channel,0,16) || !cfg_inrange(g->ccnumber,0,127) || !cfg_inrange(g->minvalue,0,127) ||
+        !cfg_inrange(g->maxvalue,0,127) || !cfg_inrange(g->curve,0,NUM_CURVES-1)) {
+        Serial.printf("config macro %d target %d is out of range\n",m+1,t+1);
+        return false;
+      }
+    }
+  }
+  for (int16_t i=0; i< CUSTOM_POINTS;++i) {
+    if (!cfg_inrange(cfgarena.custompoints[i],0,127)) {
+      Serial.println("config custom curve is out of range");
+      return false;
+    }
+  }
+  return true;
+}
+
+// parser states - what can come next
+enum cfgstates {CFG_VALUE,CFG_FIRST_VALUE,CFG_KEY,CFG_FIRST_KEY,CFG_NEXT};
 
+// parse the whole file into cfgarena. false if it isn't valid JSON
+bool cfg_parse(void) {
+  int16_t state=CFG_VALUE;
+  int16_t c;
+  uint32_t hash;
+  cfgarena.depth=0;
+  for (;;) {
+    c=cfg_token();
+    if ((state == CFG_NEXT) && (cfgarena.depth == 0)) return c < 0;  // nothing but white space after the top value
+    if (c < 0) return false;
+    struct cfglevel * top=&cfgarena.path[cfgarena.depth ? cfgarena.depth-1 : 0];  // innermost open object or array
+    switch (state) {
+      case CFG_FIRST_KEY:
+        if (c == '}') {
+          --cfgarena.depth;
+          state=CFG_NEXT;
+          break;
+        }
+        // fall through
+      case CFG_KEY:
+        if ((c != '"') || !cfg_string(&top->key) || (cfg_token() != ':')) return false;
+        state=CFG_VALUE;
+        break;
+      case CFG_FIRST_VALUE:
+        if (c == ']') {
+          --cfgarena.depth;
+          state=CFG_NEXT;
+          break;
+        }
+        // fall through
+      case CFG_VALUE:
+        if ((c == '{') || (c == '[')) {
+          if (cfgarena.depth >= CFG_DEPTH) return false;
+          top=&cfgarena.path[cfgarena.depth++];
+          top->array=(c == '[');
+          top->index=0;
+          top->key=0;
+          state=top->array ? CFG_FIRST_VALUE : CFG_FIRST_KEY;
+          break;
+        }
+        if (c == '"') {
+          if (!cfg_string(&hash)) return false;
+        }
+        else if (c == 't') {
+          if (!cfg_literal("rue")) return false;
+        }
+        else if (c == 'f') {
+          if (!cfg_literal("alse")) return false;
+        }
+        else if (c == 'n') {
+          if (!cfg_literal("ull")) return false;
+        }
+        else {
+          int16_t value;
+          bool whole;
+          if (!cfg_number(c,&value,&whole)) return false;
+          if (whole && !cfg_store(value)) {
+            cfgarena.rejected=true;
+            return false;
+          }
+        }
+        state=CFG_NEXT;
+        break;
+      case CFG_NEXT:
+        if (c == ',') {
+          if (top->array && (top->index < 32767)) ++top->index;
+          state=top->array ? CFG_VALUE : CFG_KEY;
+        }
+        else if (c == (top->array ? ']' : '}')) --cfgarena.depth;
+        else return false;
+        break;
+    }
+  }
+}
+
+// read a settings file into cfgarena and check it. nothing live changes - false if it can't be used
+bool cfg_read(const char * filename) {
+  File file = LittleFS.open(filename, "r");
+  if (!file) {
+    Serial.println("file open failed");
+    return false;
+  }
+  cfgarena.file=&file;
+  cfgarena.len=0;
+  cfgarena.pos=0;
+  cfgarena.rejected=false;
+  cfg_defaults();
+  bool ok=cfg_parse();
   file.close();
 
-  if (error) {
-    Serial.print(F("deserializeJson() failed: "));
-    Serial.println(error.f_str());
-    return 0;
-  } else {
-    // Data has been deserialized successfully, restore settings 
-
-    for (int16_t p=0;p<CONTROLLER_PAGES;++p) {
-      for (int16_t c=0; c< NUMENCODERS;c++) {
-        controls[p].encoder[c].type=doc["page"][p]["control"][c]["EncoderMode"];
-        controls[p].encoder[c].channel=doc["page"][p]["control"][c]["EncoderChannel"];
-        controls[p].encoder[c].ccnumber=doc["page"][p]["control"][c]["EncoderCCNumber"];
-        controls[p].encoder[c].minvalue=doc["page"][p]["control"][c]["EncoderMinValue"];
-        controls[p].encoder[c].maxvalue=doc["page"][p]["control"][c]["EncoderMaxValue"];
-        controls[p].encoder[c].value=doc["page"][p]["control"][c]["EncoderValue"];
-        controls[p].encoder[c].colorindex=doc["page"][p]["control"][c]["EncoderColorIndex"];
-        controls[p].encoder[c].labelindex=doc["page"][p]["control"][c]["EncoderLabelIndex"];
-        controls[p].encswitch[c].mode=doc["page"][p]["control"][c]["SwitchMode"];
-        controls[p].encswitch[c].type=doc["page"][p]["control"][c]["SwitchType"];
-        controls[p].encswitch[c].channel=doc["page"][p]["control"][c]["SwitchChannel"];
-        controls[p].encswitch[c].ccnumber=doc["page"][p]["control"][c]["SwitchCCNumber"];
-        controls[p].encswitch[c].minvalue=doc["page"][p]["control"][c]["SwitchMinValue"];
-        controls[p].encswitch[c].maxvalue=doc["page"][p]["control"][c]["SwitchMaxValue"];
-        controls[p].encswitch[c].value=doc["page"][p]["control"][c]["SwitchValue"];
-        controls[p].encswitch[c].colorindex=doc["page"][p]["control"][c]["SwitchColorIndex"];
-        controls[p].encswitch[c].labelindex=doc["page"][p]["control"][c]["SwitchLabelIndex"];
+  if (!ok) {
+    if (!cfgarena.rejected) Serial.println("config file is not valid JSON");
+    return false;
+  }
+  return cfg_valid();
+}
+
+int16_t loadconfig(int16_t slot) {
+  char filename[20];
+  sprintf(filename,"slot%d.json",slot);
+  if (!cfg_read(filename)) return 0;
+  // the file was read successfully, restore settings
+  memcpy(controls,cfgarena.controls,sizeof(controls));
+  memcpy(scenevalues,cfgarena.scenevalues,sizeof(scenevalues));
+  memcpy(macros,cfgarena.macros,sizeof(macros));
+  memcpy(custompoints,cfgarena.custompoints,sizeof(custompoints));
+  for (int16_t p=0;p<CONTROLLER_PAGES;++p) {
+    for (int16_t c=0; c< NUMENCODERS;c++) {
+      struct controllerencoder * e=&controls[p].encoder[c];
+      if (e->red < 0) setpalettecolor(e); // older files only have the palette color
+      int16_t lo=min(e->minvalue,e->maxvalue),hi=max(e->minvalue,e->maxvalue);
+      for (int16_t sc=SCENE_A; sc<= SCENE_B;++sc) {  // a range edited after the scene was stored - morphs stay inside it
+        if (scenevalues[p][sc][c] >= 0) scenevalues[p][sc][c]=constrain(scenevalues[p][sc][c],lo,hi);
       }
     }
+    morphpos[p]=0;
   }
+  buildcustomcurve();  // the other curves never change
   return 1;
 }
 
@@ -0,0 +1,42 @@
+// idle governor
+// the main loop sleeps with __wfi() until the next interrupt instead of spinning
+// the encoder scan alarm fires at least every SCAN_SLEEP_MICROS so nothing in the loop that polls millis() waits longer than that
+// USB, serial MIDI and BLE all interrupt too, so incoming MIDI wakes the loop straight away
+// showleds() only sends the pixels to the LEDs when they have changed since the last time
+
+uint8_t ledshown[NUMPIXELS*3];  // pixel bytes last sent to the LEDs
+bool ledsvalid=false;           // ledshown[] has been filled in
+
+// send the pixel buffer to the LEDs if it changed. returns true if it was sent
+bool showleds(void) {
+  if (ledsvalid && !memcmp(LEDS.getPixels(),ledshown,NUMPIXELS*3)) return false;
+  memcpy(ledshown,LEDS.getPixels(),NUMPIXELS*3);
+  ledsvalid=true;
+  LEDS.show();
+  return true;
+}
+
+#ifdef PROFILE
+uint32_t idlemicros;        // time the loop spent asleep this stats window
+uint32_t idlewindowstart;
+int16_t loopbusy;           // percent of the last stats window the loop was awake
+
+// publish the sleep time - call when prof_tick() starts a new window
+void idlestats(void) {
+  uint32_t elapsed=timer_hw->timerawl-idlewindowstart;
+  idlewindowstart+=elapsed;
+  loopbusy=elapsed ? 100-(uint64_t)idlemicros*100/elapsed : 0;
+  idlemicros=0;
+}
+#endif
+
+// sleep until the next interrupt - call at the end of the main loop
+void idle_wait(void) {
+#ifdef PROFILE
+  uint32_t start=timer_hw->timerawl;
+  __wfi();
+  idlemicros+=timer_hw->timerawl-start;
+#else
+  __wfi();
+#endif
+}
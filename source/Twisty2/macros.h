@@ -0,0 +1,101 @@
+// macro controls for Twisty 2
+// an encoder set to the Macro type drives up to MACRO_TARGETS CCs at once instead of its own CC
+// each target has its own channel, CC, output range and response curve
+// curves are 128 entry tables of Q15 fractions built once at startup (or when the custom curve is edited)
+// so a twist costs a table lookup, a multiply and a shift per target - the floats are only used to build the tables
+// all the target CCs are queued together and go out in the one USB transfer at the end of the encoder scan
+
+#define NUM_MACROS 16
+#define MACRO_TARGETS 8
+#define CURVE_ONE 32768     // Q15 1.0
+#define CUSTOM_POINTS 5     // custom curve breakpoints at 0, 25, 50, 75 and 100% of the encoder range
+
+enum curvetypes {CURVE_LINEAR,CURVE_LOG,CURVE_EXP,CURVE_INVERT,CURVE_SCURVE,CURVE_CUSTOM,NUM_CURVES};
+
+struct macrotarget {
+  int16_t channel;  // 0 is off
+  int16_t ccnumber;
+  int16_t minvalue;
+  int16_t maxvalue;
+  int16_t curve;
+} macros[NUM_MACROS][MACRO_TARGETS];
+
+uint16_t curvetable[NUM_CURVES][128];  // encoder value to Q15 output fraction
+int16_t custompoints[CUSTOM_POINTS]={0,32,64,96,127};  // custom curve output at each breakpoint
+
+// macro target being edited - the menu can only point at fixed variables so targets are edited through this
+// the macro is the one picked for the encoder being edited
+int16_t edittarget=1;  // 1 based for display
+struct macrotarget macroedit;
+
+// build the custom curve by joining the breakpoints with straight lines
+void buildcustomcurve(void) {
+  int16_t span=127/(CUSTOM_POINTS-1)+1;  // 32 encoder steps per segment
+  for (int16_t i=0; i< 128;++i) {
+    int16_t seg=min(i/span,CUSTOM_POINTS-2);
+    int32_t y0=custompoints[seg],y1=custompoints[seg+1];
+    int32_t x=i-seg*span;
+    int32_t len=(seg == CUSTOM_POINTS-2) ? 127-seg*span : span;
+    curvetable[CURVE_CUSTOM][i]=((y0*len+(y1-y0)*x)*CURVE_ONE)/(len*127);
+  }
+}
+
+void buildcurves(void) {
+  for (int16_t i=0; i< 128;++i) {
+    float x=i/127.0f;
+    curvetable[CURVE_LINEAR][i]=x*CURVE_ONE+0.5f;
+    curvetable[CURVE_LOG][i]=log10f(1.0f+9.0f*x)*CURVE_ONE+0.5f;       // fast at the start, slow at the end
+    curvetable[CURVE_EXP][i]=(powf(10.0f,x)-1.0f)/9.0f*CURVE_ONE+0.5f; // slow at the start, fast at the end
+    curvetable[CURVE_INVERT][i]=CURVE_ONE-curvetable[CURVE_LINEAR][i];
+    curvetable[CURVE_SCURVE][i]=x*x*(3.0f-2.0f*x)*CURVE_ONE+0.5f;
+  }
+  buildcustomcurve();
+}
+
+void initmacros(void) {
+  for (int16_t m=0; m< NUM_MACROS;++m) {
+    for (int16_t t=0; t< MACRO_TARGETS;++t) {
+      macros[m][t].channel=0;  // all targets off
+      macros[m][t].ccnumber=0;
+      macros[m][t].minvalue=0;
+      macros[m][t].maxvalue=127;
+      macros[m][t].curve=CURVE_LINEAR;
+    }
+  }
+  for (int16_t i=0; i< CUSTOM_POINTS;++i) custompoints[i]=i*127/(CUSTOM_POINTS-1);
+  buildcurves();
+}
+
+// target output for an encoder value
+int16_t macrovalue(struct macrotarget * t, int16_t value) {
+  uint32_t f=curvetable[t->curve][value & 0x7f];
+  return t->minvalue+(((int32_t)(t->maxvalue-t->minvalue)*(int32_t)f+CURVE_ONE/2) >> 15);
+}
+
+// targets of a macro that are switched on
+int16_t macrotargets(int16_t macro) {
+  struct macrotarget * t=macros[constrain(macro,0,NUM_MACROS-1)];
+  int16_t n=0;
+  for (int16_t i=0; i< MACRO_TARGETS;++i,++t) n+=(t->channel != 0);
+  return n;
+}
+
+// send every active target of a macro for an encoder value, out the encoder's ports
+void sendmacro(int16_t ports, int16_t macro, int16_t value) {
+  struct macrotarget * t=macros[constrain(macro,0,NUM_MACROS-1)];
+  value=constrain(value,0,127);
+  for (int16_t i=0; i< MACRO_TARGETS;++i,++t) {
+    if (t->channel == 0) continue;
+    sendcontrolChange(ports,t->channel,t->ccnumber,macrovalue(t,value));
+  }
+}
+
+// menu handlers
+// a target field changed - store it straight away
+void savemacrotarget(void) {
+  macros[constrain(editbuffer.encoder.macro,1,NUM_MACROS)-1][edittarget-1]=macroedit;
+}
+
+void customcurvechanged(void) {
+  buildcustomcurve();
+}
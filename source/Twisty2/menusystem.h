@@ -78,37 +78,53 @@ struct submenu {
   int16_t max;  // max value of parameter
   int16_t step; // step size. if 0, don't print ie spacer
   enum paramtype ptype; // how its displayed
-  const char ** ptext;   // points to array of text for text display
+  const char * const * ptext;   // points to array of text for text display
   int16_t *parameter; // value to modify
   void (*handler)(void);  // function to call on value change
   void (*exithandler)(void);  // function to call on exiting value change
 };
 
 // top menus
+// the menu tables and the text they point to are all const so they stay in flash - the only thing that changes as the
+// menus are used is which item is selected, and that's kept in menupos[]
 struct menu {
    const char *name; // menu text
-   struct submenu * submenus; // points to submenus for this menu
-   int8_t submenuindex;   // stores the index of the submenu we are currently using
+   const struct submenu * submenus; // points to submenus for this menu
    int8_t numsubmenus; // number of submenus - not sure why this has to be int but it crashes otherwise. compiler bug?
 };
 
+struct menuposition {
+   int8_t submenuindex;   // stores the index of the submenu we are currently using
+};
+
+// number of items in a submenu array, checked at compile time against the int8_t indexes
+template <size_t N> constexpr int8_t menuitems(const struct submenu (&)[N]) {
+  static_assert(N < 128,"too many items for one menu");
+  return N;
+}
+
 // ********** menu structs that build the menu system below *********
 
 // text arrays used for submenu TYPE_TEXT fields
 // making everything 6 letters justifies text to right side of display
-const char * onoff[] = {"   Off","    On"};
-const char * ledcolors[] = {"   Red","Orange"," Green","  Aqua","  Blue","Violet"," White"};
-const char * actions[] ={"  Load","  Save","Format"};
-const char * no_yes[] ={"    No","   Yes"};
-const char * enctypes[] ={"    CC"};
-const char * switchmodes[] ={"Moment","Toggle"};
-const char * switchtypes[] ={"    CC","    PC","  Note","SetEnc"};
+const char * const onoff[] = {"   Off","    On"};
+const char * const ledcolors[] = {"   Red","Orange"," Green","  Aqua","  Blue","Violet"," White"};
+const char * const actions[] ={"  Load","  Save","Format","SceneA","SceneB"};
+const char * const no_yes[] ={"    No","   Yes"};
+const char * const usbthru[] ={"   Off","   DIN","   BLE","  Both"};  // outputs for each input's MIDI thru
+const char * const dinthru[] ={"   Off","   USB","   BLE","  Both"};
+const char * const blethru[] ={"   Off","   USB","   DIN","  Both"};
+const char * const portmasks[] ={"   Off","   USB","   DIN"," U+DIN","   BLE"," U+BLE"," D+BLE","   All"};  // outputs a control sends on
+const char * const enctypes[] ={"    CC"," Macro"};
+const char * const curvenames[] ={"Linear","   Log","   Exp","Invert","SCurve","Custom"};
+const char * const switchmodes[] ={"Moment","Toggle"};
+const char * const switchtypes[] ={"    CC","    PC","  Note","SetEnc"};
 
 // encoder and switch labels that can be assigned via the menus. 
 // NOTE: label 0 must be "CC" because its the only one that shows the CC number - special case
 // labels must be 6 characters or they will interfere with the value display and for the table size calculation to work
 
-const char * labels[] ={
+const char * const labels[] ={
 "    CC","   Arp","Attack","Alloff","  Band","Bandwi","  Bank","  Bass","  Bend","Bounce","   BPM","Breath","  Chan","Chorus"," Color","  Comp",
 " Crush","   Cut","Dampng"," Decay"," Delay",
 "Densty","DeTune"," Depth","Distrt"," Drive","  Duck","Effect","  Fade","Feedbk","Filter","Flange","    FM","  Freq","   End","    EQ","Expres","  Gain","  Gate"," Glide",
@@ -120,18 +136,36 @@ const char * labels[] ={
 "  XPos","  YPos"
 };
 #define NUM_LABELS sizeof(labels)/sizeof(labels[0])
+#define NUM_LEDCOLORS sizeof(ledcolors)/sizeof(ledcolors[0])
 
 
-struct submenu controlparams[] = {
+const struct submenu controlparams[] = {
   // name,min,max,step,type,*textfield,*parameter,*handler,*exithandler
   "Enc MIDI Chan.",1,16,1,TYPE_INTEGER,0,&editbuffer.encoder.channel,0,0,
-//  "Enc Type",0,0,1,TYPE_TEXT,enctypes,&editbuffer.encoder.type,0,0,  // encoder supports just CC messages for now
+  "Enc Ports",0,ALL_PORTS,1,TYPE_TEXT,portmasks,&editbuffer.encoder.ports,0,0,
+  "Enc Type",0,1,1,TYPE_TEXT,enctypes,&editbuffer.encoder.type,0,0,
   "Enc CC No.",0,127,1,TYPE_INTEGER,0,&editbuffer.encoder.ccnumber,0,0,
   "Enc Label",0,NUM_LABELS-1,1,TYPE_TEXT,labels,&editbuffer.encoder.labelindex,0,0, 
-  "Enc Color",0,5,1,TYPE_TEXT,ledcolors,&editbuffer.encoder.colorindex,0,0,
+  "Enc Color",0,5,1,TYPE_TEXT,ledcolors,&editbuffer.encoder.colorindex,editcolorchanged,0,
+  "Enc Red",0,255,1,TYPE_INTEGER,0,&editbuffer.encoder.red,0,0,
+  "Enc Green",0,255,1,TYPE_INTEGER,0,&editbuffer.encoder.green,0,0,
+  "Enc Blue",0,255,1,TYPE_INTEGER,0,&editbuffer.encoder.blue,0,0,
   "Enc Min",0,127,1,TYPE_INTEGER,0,&editbuffer.encoder.minvalue,0,0, 
   "Enc Max",0,127,1,TYPE_INTEGER,0,&editbuffer.encoder.maxvalue,0,0,    
+  "Enc Macro",1,NUM_MACROS,1,TYPE_INTEGER,0,&editbuffer.encoder.macro,loadmacrotarget,0,  // macro targets are shared by every encoder using that macro
+  "Macro Target",1,MACRO_TARGETS,1,TYPE_INTEGER,0,&edittarget,loadmacrotarget,0,
+  "Tgt MIDI Chan.",0,16,1,TYPE_INTEGER,0,&macroedit.channel,savemacrotarget,0,  // 0 turns the target off
+  "Tgt CC No.",0,127,1,TYPE_INTEGER,0,&macroedit.ccnumber,savemacrotarget,0,
+  "Tgt Min",0,127,1,TYPE_INTEGER,0,&macroedit.minvalue,savemacrotarget,0,
+  "Tgt Max",0,127,1,TYPE_INTEGER,0,&macroedit.maxvalue,savemacrotarget,0,
+  "Tgt Curve",0,NUM_CURVES-1,1,TYPE_TEXT,curvenames,&macroedit.curve,savemacrotarget,0,
+  "Custom 0%",0,127,1,TYPE_INTEGER,0,&custompoints[0],customcurvechanged,0,  // the Custom curve is shared by all macros
+  "Custom 25%",0,127,1,TYPE_INTEGER,0,&custompoints[1],customcurvechanged,0,
+  "Custom 50%",0,127,1,TYPE_INTEGER,0,&custompoints[2],customcurvechanged,0,
+  "Custom 75%",0,127,1,TYPE_INTEGER,0,&custompoints[3],customcurvechanged,0,
+  "Custom 100%",0,127,1,TYPE_INTEGER,0,&custompoints[4],customcurvechanged,0,
   "Switch MIDI Chan.",1,16,1,TYPE_INTEGER,0,&editbuffer.encswitch.channel,0,0,
+  "Switch Ports",0,ALL_PORTS,1,TYPE_TEXT,portmasks,&editbuffer.encswitch.ports,0,0,
   "Switch Mode",0,1,1,TYPE_TEXT,switchmodes,&editbuffer.encswitch.mode,0,0,  // 
   "Switch Type",0,3,1,TYPE_TEXT,switchtypes,&editbuffer.encswitch.type,0,0,  // 
   "Switch CC No.",0,127,1,TYPE_INTEGER,0,&editbuffer.encswitch.ccnumber,0,0,
@@ -141,22 +175,72 @@ struct submenu controlparams[] = {
   "Switch Max",0,127,1,TYPE_INTEGER,0,&editbuffer.encswitch.maxvalue,0,0,       
 };
 
-struct submenu loadsave[] = {
+const struct submenu loadsave[] = {
   // name,min,max,step,type,*textfield,*parameter,*handler
   "Slot",1,16,1,TYPE_INTEGER,0,&saverestore_slot,0,0,
-  "Action",0,2,1,TYPE_TEXT,actions,&saverestore_action,0,0,
+  "Action",0,4,1,TYPE_TEXT,actions,&saverestore_action,0,0,
   "Confirm?",0,1,1,TYPE_TEXT,no_yes,&saverestore_confirm,0,save_restore,
+  "USB Thru To",0,3,1,TYPE_TEXT,usbthru,&thruroute[PORT_USB],0,0,
+  "DIN Thru To",0,3,1,TYPE_TEXT,dinthru,&thruroute[PORT_DIN],0,0,
+  "BLE Thru To",0,3,1,TYPE_TEXT,blethru,&thruroute[PORT_BLE],0,0,
 };
 
+#ifdef PROFILE
+// profiler results - these are display only, the values are refreshed every PROF_WINDOW_MS
+const struct submenu statsparams[] = {
+  // name,min,max,step,type,*textfield,*parameter,*handler,*exithandler
+  "kLoops/s",0,0,1,TYPE_FLOAT,0,&profloops,0,0,
+  "ISR Overruns",0,0,1,TYPE_INTEGER,0,&profoverrun,0,0,
+  "Loop Busy %",0,0,1,TYPE_INTEGER,0,&loopbusy,0,0,
+  "Scans/s",0,0,1,TYPE_INTEGER,0,&scanrate,0,0,
+  "Lost Steps",0,0,1,TYPE_INTEGER,0,&loststeps,0,0,
+  "USB Pkts/Xfer",0,0,1,TYPE_FLOAT,0,&usbperxfer,0,0,
+  "USB Xfers/s",0,0,1,TYPE_INTEGER,0,&usbxfers,0,0,
+  "Thru Drops",0,0,1,TYPE_INTEGER,0,&thrudrops,0,0,
+  "ISR min us",0,0,1,TYPE_INTEGER,0,&profmin[PROF_ISR],0,0,
+  "ISR avg us",0,0,1,TYPE_INTEGER,0,&profavg[PROF_ISR],0,0,
+  "ISR max us",0,0,1,TYPE_INTEGER,0,&profmax[PROF_ISR],0,0,
+  "Loop min us",0,0,1,TYPE_INTEGER,0,&profmin[PROF_LOOP],0,0,
+  "Loop avg us",0,0,1,TYPE_INTEGER,0,&profavg[PROF_LOOP],0,0,
+  "Loop max us",0,0,1,TYPE_INTEGER,0,&profmax[PROF_LOOP],0,0,
+  "MIDI min us",0,0,1,TYPE_INTEGER,0,&profmin[PROF_MIDI],0,0,
+  "MIDI avg us",0,0,1,TYPE_INTEGER,0,&profavg[PROF_MIDI],0,0,
+  "MIDI max us",0,0,1,TYPE_INTEGER,0,&profmax[PROF_MIDI],0,0,
+  "Enc min us",0,0,1,TYPE_INTEGER,0,&profmin[PROF_ENCODERS],0,0,
+  "Enc avg us",0,0,1,TYPE_INTEGER,0,&profavg[PROF_ENCODERS],0,0,
+  "Enc max us",0,0,1,TYPE_INTEGER,0,&profmax[PROF_ENCODERS],0,0,
+  "Switch min us",0,0,1,TYPE_INTEGER,0,&profmin[PROF_SWITCHES],0,0,
+  "Switch avg us",0,0,1,TYPE_INTEGER,0,&profavg[PROF_SWITCHES],0,0,
+  "Switch max us",0,0,1,TYPE_INTEGER,0,&profmax[PROF_SWITCHES],0,0,
+  "Menu min us",0,0,1,TYPE_INTEGER,0,&profmin[PROF_MENU],0,0,
+  "Menu avg us",0,0,1,TYPE_INTEGER,0,&profavg[PROF_MENU],0,0,
+  "Menu max us",0,0,1,TYPE_INTEGER,0,&profmax[PROF_MENU],0,0,
+  "Disp min us",0,0,1,TYPE_INTEGER,0,&profmin[PROF_DISPLAY],0,0,
+  "Disp avg us",0,0,1,TYPE_INTEGER,0,&profavg[PROF_DISPLAY],0,0,
+  "Disp max us",0,0,1,TYPE_INTEGER,0,&profmax[PROF_DISPLAY],0,0,
+  "LEDs min us",0,0,1,TYPE_INTEGER,0,&profmin[PROF_LEDSHOW],0,0,
+  "LEDs avg us",0,0,1,TYPE_INTEGER,0,&profavg[PROF_LEDSHOW],0,0,
+  "LEDs max us",0,0,1,TYPE_INTEGER,0,&profmax[PROF_LEDSHOW],0,0,
+  "Boot MIDI ms",0,0,1,TYPE_INTEGER,0,&bootms[BOOT_MIDI],0,0,
+  "Boot Load ms",0,0,1,TYPE_INTEGER,0,&bootms[BOOT_SESSION],0,0,
+  "Boot Disp ms",0,0,1,TYPE_INTEGER,0,&bootms[BOOT_DISPLAY],0,0,
+  "1st MIDI ms",0,0,1,TYPE_INTEGER,0,&bootms[BOOT_FIRSTMIDI],0,0,
+};
+#endif
+
 // top level menu structure - each top level menu contains one submenu
-struct menu mainmenu[] = {
-  // name,submenu *,initial submenu index,number of submenus
-  "",controlparams,0,sizeof(controlparams)/sizeof(submenu),
-  "",loadsave,0,sizeof(loadsave)/sizeof(submenu),
+const struct menu mainmenu[] = {
+  // name,submenu *,number of submenus
+  "",controlparams,menuitems(controlparams),
+  "",loadsave,menuitems(loadsave),
+#ifdef PROFILE
+  "",statsparams,menuitems(statsparams),
+#endif
  };
 
 #define NUM_MAIN_MENUS sizeof(mainmenu)/ sizeof(menu)
-menu * topmenu=mainmenu;  // points at current menu
+const menu * topmenu=mainmenu;  // points at current menu
+menuposition menupos[NUM_MAIN_MENUS];  // selected item in each menu
 
 // highlight the currently selected menu item
 void drawselector( int8_t index) {
@@ -206,7 +290,7 @@ void drawtopmenu( int8_t index) {
 // index is the index into the current top menu's submenu array
 
 void drawsubmenu( int8_t index) {
-    submenu * sub;
+    const submenu * sub;
     sub=topmenu[topmenuindex].submenus; //get pointer to the submenu array
     // print the name text
     int y= SUBMENU_Y+DISPLAY_Y_MENUPAD+(index % SUBMENU_LINES)*(DISPLAY_CHAR_HEIGHT+DISPLAY_Y_MENUPAD); // Y position of this menu index
@@ -222,12 +306,12 @@ void drawsubmenu( int8_t index) {
       char temp[7];
       switch (sub[index].ptype) {
         case TYPE_INTEGER:   // print the value as an unsigned integer    
-          sprintf(temp,"%6d",val); // lcd.print doesn't seem to print uint8 properly
+          ft_format(temp,sizeof(temp),"%6d",val); // lcd.print doesn't seem to print uint8 properly
           display.print(temp);  
           display.print(" ");  // blank out any garbage
           break;
         case TYPE_FLOAT:   // print the int value as a float  
-          sprintf(temp,"%1.2f",(float)val/1000); // menu should have int value between -1000 to +1000 so float is -1 to +1
+          ft_format(temp,sizeof(temp),"%s%d.%02d",(val < 0) ? "-" : "",abs(val)/1000,abs(val)%1000/10); // menu should have int value between -1000 to +1000 so float is -1 to +1
           display.print(temp);  
           display.print(" ");  // blank out any garbage
           break;
@@ -250,9 +334,9 @@ void drawsubmenu( int8_t index) {
 
 void drawsubmenus() {
     int8_t index,len;
-    index= topmenu[topmenuindex].submenuindex; // submenu field index
+    index= menupos[topmenuindex].submenuindex; // submenu field index
     len= topmenu[topmenuindex].numsubmenus; // number of submenu items
-    submenu * sub=topmenu[topmenuindex].submenus; //get pointer to the current submenu array
+    const submenu * sub=topmenu[topmenuindex].submenus; //get pointer to the current submenu array
     display.fillScreen(BLACK);
     display.setCursor(0,DISPLAY_Y_OFFSET);
 //    display.printf("%s",topmenu[topmenuindex].name); // show the menu we came from at top of screen
@@ -268,8 +352,14 @@ void drawsubmenus() {
 } 
 
 
+bool menuhold=false;  // the menu button was pressed and hasn't been let go yet
+
+void menurelease(void) {
+  menuhold=false;
+}
+
 // menu handler
-// a run to completion state machine - it never blocks except while waiting for encoder button release
+// a run to completion state machine - it never blocks. after a button press it does nothing till the button is let go
 // allows the rest of the application to run while parameters are adjusted
 // Dec 2025 - modded for Twisty 2 menus - only submenu level is used
 
@@ -282,34 +372,36 @@ void domenus(void) {
   static int16_t lastfile=0;  // index of last file we looked at  
   bool exitflag;
   
+  if (menuhold) return;  // encoder moves wait till the button is let go
   enc=rmenuenc.getValue();
 
   switch (menustate) {
 
     case SUBSELECT:  // 
       if (enc !=0 ) { // move selector
-        int submenupage = topmenu[topmenuindex].submenuindex / SUBMENU_LINES;  
-        undrawselector(topmenu[topmenuindex].submenuindex);
-        topmenu[topmenuindex].submenuindex+=enc;
-        if (topmenu[topmenuindex].submenuindex <0) topmenu[topmenuindex].submenuindex=0;  // we don't wrap menus around, just stop at the ends
-        if (topmenu[topmenuindex].submenuindex >=(topmenu[topmenuindex].numsubmenus -1) ) topmenu[topmenuindex].submenuindex=topmenu[topmenuindex].numsubmenus -1; 
-        if ((topmenu[topmenuindex].submenuindex / SUBMENU_LINES) != submenupage) {
+        int submenupage = menupos[topmenuindex].submenuindex / SUBMENU_LINES;  
+        undrawselector(menupos[topmenuindex].submenuindex);
+        menupos[topmenuindex].submenuindex+=enc;
+        if (menupos[topmenuindex].submenuindex <0) menupos[topmenuindex].submenuindex=0;  // we don't wrap menus around, just stop at the ends
+        if (menupos[topmenuindex].submenuindex >=(topmenu[topmenuindex].numsubmenus -1) ) menupos[topmenuindex].submenuindex=topmenu[topmenuindex].numsubmenus -1; 
+        if ((menupos[topmenuindex].submenuindex / SUBMENU_LINES) != submenupage) {
           drawsubmenus();  // redraw if we scrolled beyond the menu page
         }
-        drawselector(topmenu[topmenuindex].submenuindex);   
+        drawselector(menupos[topmenuindex].submenuindex);   
       } 
       if (!digitalRead(RMENU_ENCSW_IN)) { // submenu item has been selected so either go back to top or go to change parameter state
-	      submenu * sub;
+	      const submenu * sub;
 		    sub=topmenu[topmenuindex].submenus; //get pointer to the submenu array
-        undrawselector(topmenu[topmenuindex].submenuindex);
-        draweditselector(topmenu[topmenuindex].submenuindex); // show we are editing
+        undrawselector(menupos[topmenuindex].submenuindex);
+        draweditselector(menupos[topmenuindex].submenuindex); // show we are editing
         menustate=PARAM_INPUT;  // change the submenu parameter
-        while(!digitalRead(RMENU_ENCSW_IN)) delay(10); // loop here till button released 
+        menuhold=true;  // ignore the button till it's let go
+        task_onrelease(RMENU_ENCSW_IN,menurelease);
       }  
       break;
     case PARAM_INPUT:  // changing value of a parameter
-      submenu * sub=topmenu[topmenuindex].submenus; //get pointer to the current submenu array
-      index= topmenu[topmenuindex].submenuindex; // submenu field index
+      const submenu * sub=topmenu[topmenuindex].submenus; //get pointer to the current submenu array
+      index= menupos[topmenuindex].submenuindex; // submenu field index
       if (enc !=0 ) { // change value      
         int16_t temp=*sub[index].parameter + enc*sub[index].step; // menu code uses ints - convert to floats when needed
         if (temp < (int16_t)sub[index].min) temp=sub[index].min;
@@ -319,11 +411,12 @@ void domenus(void) {
         drawsubmenu(index);
       }
       if (!digitalRead(RMENU_ENCSW_IN)) { // stop changing parameter
-        undrawselector(topmenu[topmenuindex].submenuindex);
-        drawselector(topmenu[topmenuindex].submenuindex); // show we are selecting again
+        undrawselector(menupos[topmenuindex].submenuindex);
+        drawselector(menupos[topmenuindex].submenuindex); // show we are selecting again
         menustate=SUBSELECT;
         if (sub[index].exithandler != 0) (*sub[index].exithandler)();  // call the exit handler function
-        while(!digitalRead(RMENU_ENCSW_IN)) delay(10); // loop till button released
+        menuhold=true;
+        task_onrelease(RMENU_ENCSW_IN,menurelease);
         
       }   
       break;
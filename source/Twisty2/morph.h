@@ -0,0 +1,105 @@
+// scene morphing for Twisty 2
+// each page can hold two scenes - snapshots of its 16 encoder values stored from the Save/Load menu
+// turning the right menu encoder crossfades the page's encoders from scene A to scene B, each control between its own two values
+// the morph position is 0-MORPH_MAX in 8 bit fixed point so the ends land exactly on the stored values
+//
+// a sweep changes up to 16 CCs at once, far more than DIN MIDI can carry, so morph CCs aren't sent straight away
+// each port has a bitmap of controls waiting to go out. morph_service() sends the latest value of waiting controls while
+// the port's budget (budget.h) has room - a slow port just sees fewer, coarser steps
+// a Macro encoder morphs like any other and sends its macro targets, all of them in one go
+
+#define MORPH_MAX 256   // morph position for scene B
+#define MORPH_STEP 4    // morph position change per encoder detent - 64 detents from A to B
+#define MORPH_CC_BYTES 3  // a CC on the wire
+
+enum scenes {SCENE_A,SCENE_B};
+
+int16_t scenevalues[CONTROLLER_PAGES][2][NUMENCODERS];  // -1 if the scene hasn't been stored
+int16_t morphpos[CONTROLLER_PAGES];  // 0 is scene A, MORPH_MAX is scene B
+
+uint16_t morphpending[NUM_PORTS][CONTROLLER_PAGES];  // controls waiting to go out on each port
+int16_t morphnext[NUM_PORTS];       // round robin position so every control gets a turn
+
+void initscenes(void) {
+  memset(scenevalues,0xff,sizeof(scenevalues));  // all -1
+  memset(morphpos,0,sizeof(morphpos));
+}
+
+bool scenestored(int16_t p, int16_t scene) {
+  return scenevalues[p][scene][0] >= 0;
+}
+
+// store the page's encoder values as scene A or B. the morph position moves to that end since that's where the values are
+void storescene(int16_t p, int16_t scene) {
+  for (int16_t i=0; i< NUMENCODERS;++i) scenevalues[p][scene][i]=controls[p].encoder[i].value;
+  morphpos[p]=(scene == SCENE_A) ? 0 : MORPH_MAX;
+}
+
+// value between a and b at position pos - exact at both ends, rounds to nearest in between
+int16_t morphvalue(int16_t a, int16_t b, int16_t pos) {
+  return a+(((int32_t)(b-a)*pos+MORPH_MAX/2) >> 8);
+}
+
+// move the page's encoders to morph position pos and queue any that changed on each of their ports
+// returns false if the page doesn't have both scenes
+bool morphto(int16_t p, int16_t pos) {
+  if (!scenestored(p,SCENE_A) || !scenestored(p,SCENE_B)) return false;
+  morphpos[p]=constrain(pos,0,MORPH_MAX);
+  for (int16_t i=0; i< NUMENCODERS;++i) {
+    int16_t v=morphvalue(scenevalues[p][SCENE_A][i],scenevalues[p][SCENE_B][i],morphpos[p]);
+    if (v == controls[p].encoder[i].value) continue;
+    controls[p].encoder[i].value=v;
+    if ((p == page) && !displaySwitchLEDs) showencoderLED(p,i);
+    else setencoderframe(p,i);
+    for (int16_t port=0; port< NUM_PORTS;++port) if (controls[p].encoder[i].ports & (1 << port)) morphpending[port][p] |= 1 << i;
+  }
+  return true;
+}
+
+// bytes an encoder's value takes on the wire - its CC, or a CC for each of its macro's targets
+uint16_t morphbytes(int16_t p, int16_t i) {
+  if (controls[p].encoder[i].type != MACROTYPE) return MORPH_CC_BYTES;
+  return MORPH_CC_BYTES*macrotargets(controls[p].encoder[i].macro-1);
+}
+
+// send waiting morph CCs within each port's budget - call from the main loop
+void morph_service(void) {
+  for (int16_t port=0; port< NUM_PORTS;++port) {
+    budget_refill(port);
+#ifndef BLUETOOTH
+    if (port == PORT_BLE) {
+      memset(morphpending[port],0,sizeof(morphpending[port]));
+      continue;
+    }
+#endif
+    bool full=false;  // out of budget - morphnext is on the control that goes first next time
+    for (int16_t p=0; (p< CONTROLLER_PAGES) && !full;++p) {
+      while (morphpending[port][p] && !full) {
+        int16_t i=morphnext[port];
+        morphnext[port]=(i+1)%NUMENCODERS;
+        if (!(morphpending[port][p] & (1 << i))) continue;
+        if (budget_bytes(port) < morphbytes(p,i)) {  // a macro sends all its targets or waits
+          morphnext[port]=i;
+          full=true;
+          continue;
+        }
+        morphpending[port][p] &= ~(1 << i);
+        sendencoderports(1 << port,p,i);
+        markccsent(p,ENCODER,i);
+      }
+    }
+  }
+}
+
+// a control that was moved by hand goes out directly - drop any morph value still waiting for it
+void morphcancel(int16_t p, int16_t index) {
+  for (int16_t port=0; port< NUM_PORTS;++port) morphpending[port][p] &= ~(1 << index);
+}
+
+// show the morph position on the display
+void showmorph(int16_t p) {
+  showpage(p+1);
+  ft_clear(0,16,SCREEN_WIDTH,2);
+  if (scenestored(p,SCENE_A) && scenestored(p,SCENE_B)) ft_printf(0,16,2,"Morph %d%%",(morphpos[p]*100+MORPH_MAX/2) >> 8);
+  else ft_printf(0,16,2,"No Scene %c",scenestored(p,SCENE_A) ? 'B' : 'A');
+}
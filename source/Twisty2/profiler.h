@@ -0,0 +1,142 @@
+// Copyright 2026 Rich Heslip
+//
+// Author: Rich Heslip
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// See http://creativecommons.org/licenses/MIT/ for more information.
+//
+// -----------------------------------------------------------------------------
+
+// CPU budget profiler
+// wrap a piece of code in PROF_START(stage) / PROF_END(stage) to accumulate its run time in microseconds
+// stages are the profstages enum and profnames[] table in the main source file
+// every PROF_WINDOW_MS the accumulated min/avg/max are published to the Stats menu page and the counters start over
+// when PROFILE isn't defined the macros are empty so the instrumented code is exactly what it was before
+
+#ifdef PROFILE
+
+#define PROF_WINDOW_MS 1000  // stats are published once a second
+
+// accumulator for one stage. plain C with no hardware dependencies
+struct profstat {
+  uint32_t min;   // shortest run in us
+  uint32_t max;   // longest run in us
+  uint32_t total; // total run time in us
+  uint32_t count; // number of runs
+};
+
+void prof_clear(profstat * p) {
+  p->min=0xffffffff;
+  p->max=0;
+  p->total=0;
+  p->count=0;
+}
+
+void prof_add(profstat * p, uint32_t us) {
+  if (us < p->min) p->min=us;
+  if (us > p->max) p->max=us;
+  p->total+=us;
+  ++p->count;
+}
+
+uint32_t prof_avg(const profstat * p) {
+  if (p->count == 0) return 0;
+  return p->total/p->count;
+}
+
+profstat profstats[NUM_PROF_STAGES];   // accumulating now
+uint32_t profstart[NUM_PROF_STAGES];   // start time of the current run of each stage
+uint32_t proflast[NUM_PROF_STAGES];    // duration of the last run of each stage
+profstat profwindow[NUM_PROF_STAGES];  // last complete window
+volatile uint32_t profoverruns;   // scan ISRs that took longer than the scan period
+uint32_t profwindowoverruns;
+uint32_t profwindowstart;
+
+// values shown on the Stats menu page - the menu system only does int16
+int16_t profmin[NUM_PROF_STAGES];
+int16_t profavg[NUM_PROF_STAGES];
+int16_t profmax[NUM_PROF_STAGES];
+int16_t profloops;    // main loop iterations per second - shown as a float in thousands
+int16_t profoverrun;  // ISR overruns in the last window
+
+void prof_end(int16_t stage) {
+  proflast[stage]=timer_hw->timerawl-profstart[stage];
+  prof_add(&profstats[stage],proflast[stage]);
+}
+
+#define PROF_START(s) profstart[s]=timer_hw->timerawl
+#define PROF_END(s) prof_end(s)
+#define PROF_OVERRUN(s,us) do { if (proflast[s] > (us)) ++profoverruns; } while (0)
+
+int16_t prof_clip(uint32_t v) {
+  return (v > 32767) ? 32767 : v;
+}
+
+void prof_init(void) {
+  for (int16_t i=0; i< NUM_PROF_STAGES;++i) {
+    prof_clear(&profstats[i]);
+    prof_clear(&profwindow[i]);
+  }
+  profwindowstart=millis();
+}
+
+// print the last window out the USB serial port
+void prof_dump(void) {
+  Serial.printf("stage          min    avg    max  count (us)\n");
+  for (int16_t i=0; i< NUM_PROF_STAGES;++i) {
+    Serial.printf("%-12s %5lu  %5lu  %5lu  %5lu\n",profnames[i],
+      (unsigned long)(profwindow[i].count ? profwindow[i].min : 0),(unsigned long)prof_avg(&profwindow[i]),
+      (unsigned long)profwindow[i].max,(unsigned long)profwindow[i].count);
+  }
+  Serial.printf("ISR overruns %lu\n",(unsigned long)profwindowoverruns);
+  bootreport();
+}
+
+// call from the main loop. returns true when a new window has been published
+bool prof_tick(void) {
+  if (Serial.available() && (Serial.read() == 's')) prof_dump(); // send an 's' to dump the stats
+  if ((millis()-profwindowstart) < PROF_WINDOW_MS) return false;
+  uint32_t elapsed=millis()-profwindowstart;
+  profwindowstart=millis();
+  noInterrupts();  // the scan ISR updates its stage on this core
+  for (int16_t i=0; i< NUM_PROF_STAGES;++i) {
+    profwindow[i]=profstats[i];
+    prof_clear(&profstats[i]);
+  }
+  profwindowoverruns=profoverruns;
+  profoverruns=0;
+  interrupts();
+  for (int16_t i=0; i< NUM_PROF_STAGES;++i) {
+    profmin[i]=prof_clip(profwindow[i].count ? profwindow[i].min : 0);
+    profavg[i]=prof_clip(prof_avg(&profwindow[i]));
+    profmax[i]=prof_clip(profwindow[i].max);
+  }
+  profloops=prof_clip(profwindow[PROF_LOOP].count*1000/elapsed);
+  profoverrun=prof_clip(profwindowoverruns);
+  return true;
+}
+
+#else
+
+#define PROF_START(s)
+#define PROF_END(s)
+#define PROF_OVERRUN(s,us)
+
+#endif
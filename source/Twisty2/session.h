@@ -0,0 +1,106 @@
+// session snapshot for Twisty 2
+// the setup itself lives in the slot files. the snapshot is just where every control was left and which slot the setup
+// came from, so the unit powers up the way it was left instead of on the defaults
+//   "TWS1" <slot, 0 for the defaults> <page> <encoder values> <switch values> <thru routes>  - 270 bytes, one small file write
+// the live values are compared with the saved ones every SESSION_CHECK_MS and written once they have been left alone for
+// SESSION_QUIET_MS. there's only one core so a write holds up the loop for as long as the flash takes - waiting for a
+// quiet spell keeps that away from anyone playing, and nothing is written while a SysEx transfer is going
+
+#define SESSION_FILE "session.bin"
+#define SESSION_CHECK_MS 500    // how often the live values are compared with the saved ones
+#define SESSION_QUIET_MS 5000   // a save waits this long after the last change
+#define SESSION_RETRY_MS 10000  // wait before trying again after a failed write
+
+struct sessiondata {
+  char id[4];
+  int16_t slot;
+  int16_t page;
+  int16_t encoder[CONTROLLER_PAGES][NUMENCODERS];
+  int16_t encswitch[CONTROLLER_PAGES][NUMENCODERS];
+  int16_t thruroute[NUM_PORTS];
+};
+
+int16_t sessionslot=0;  // slot the current setup was loaded from or saved to, 0 for the defaults
+struct sessiondata sessionsaved;  // last written - or loaded - snapshot
+struct sessiondata sessionlast;   // snapshot at the last check
+uint32_t sessioncheck;    // time of the last check
+uint32_t sessionchanged;  // time the values last changed
+uint32_t sessionretry;    // time of the last failed write
+
+void getsession(struct sessiondata * s) {
+  memset(s,0,sizeof(struct sessiondata));
+  memcpy(s->id,"TWS1",4);
+  s->slot=sessionslot;
+  s->page=page;
+  for (int16_t p=0; p< CONTROLLER_PAGES;++p) {
+    for (int16_t i=0; i< NUMENCODERS;++i) {
+      s->encoder[p][i]=controls[p].encoder[i].value;
+      s->encswitch[p][i]=controls[p].encswitch[i].value;
+    }
+  }
+  for (int16_t port=0; port< NUM_PORTS;++port) s->thruroute[port]=thruroute[port];
+}
+
+// restore the setup and control values from the last session - call from setup() after the MIDI ports are up
+// the values are only put back, nothing is sent. returns false if there was no usable snapshot
+bool loadsession(void) {
+  struct sessiondata s;
+  File file=LittleFS.open(SESSION_FILE,"r");
+  if (!file) return false;
+  bool ok=(file.size() == sizeof(s)) && (file.read((uint8_t *)&s,sizeof(s)) == sizeof(s)) && !memcmp(s.id,"TWS1",4);
+  file.close();
+  if (!ok) return false;
+  if (s.slot) {  // the values only make sense with the setup they were played on
+    if (!loadconfig(s.slot)) return false;
+    buildccindex();
+    loadautomation(s.slot);
+    sessionslot=s.slot;
+  }
+  for (int16_t p=0; p< CONTROLLER_PAGES;++p) {  // kept to each control's range - it may be reversed
+    for (int16_t i=0; i< NUMENCODERS;++i) {
+      int16_t lo=min(controls[p].encoder[i].minvalue,controls[p].encoder[i].maxvalue);
+      int16_t hi=max(controls[p].encoder[i].minvalue,controls[p].encoder[i].maxvalue);
+      controls[p].encoder[i].value=constrain(s.encoder[p][i],lo,hi);
+      lo=min(controls[p].encswitch[i].minvalue,controls[p].encswitch[i].maxvalue);
+      hi=max(controls[p].encswitch[i].minvalue,controls[p].encswitch[i].maxvalue);
+      controls[p].encswitch[i].value=constrain(s.encswitch[p][i],lo,hi);
+    }
+  }
+  page=constrain(s.page,0,CONTROLLER_PAGES-1);
+  for (int16_t port=0; port< NUM_PORTS;++port) thruroute[port]=constrain(s.thruroute[port],0,3);
+  buildledframes();
+  return true;
+}
+
+bool savesession(struct sessiondata * s) {
+  File file=LittleFS.open(SESSION_FILE,"w");  // "w" truncates - one write and no separate remove
+  if (!file) return false;
+  bool ok=file.write((uint8_t *)s,sizeof(struct sessiondata)) == sizeof(struct sessiondata);
+  file.close();
+  return ok;
+}
+
+// save the snapshot once things have settled - call from loop
+void session_service(void) {
+  if ((millis()-sessioncheck) < SESSION_CHECK_MS) return;
+  sessioncheck=millis();
+  struct sessiondata s;
+  getsession(&s);
+  if (memcmp(&s,&sessionlast,sizeof(s))) {  // changed since the last check - wait for it to settle
+    sessionlast=s;
+    sessionchanged=millis();
+  }
+  if (!memcmp(&sessionlast,&sessionsaved,sizeof(s))) return;
+  if ((millis()-sessionchanged) < SESSION_QUIET_MS) return;
+  if ((sxstate != SX_IDLE) || sxreceiving) return;
+  if (sessionretry && ((millis()-sessionretry) < SESSION_RETRY_MS)) return;
+  sessionretry=0;
+  if (savesession(&sessionlast)) sessionsaved=sessionlast;
+  else sessionretry=millis();
+}
+
+// the values as restored at power on count as saved
+void initsession(void) {
+  getsession(&sessionsaved);
+  sessionlast=sessionsaved;
+}
@@ -0,0 +1,274 @@
+// SysEx preset transfer for Twisty 2
+// slot files are sent and received as the JSON that fileio.h writes, chunked into the packets described in sysexcodec.h
+// incoming chunks are written straight to the filesystem as they arrive so a dump never has to fit in RAM
+// a received slot goes to a temporary file and only replaces the slot when the END packet checks out
+// sysex_service() runs the outgoing side from the main loop so a dump never blocks the UI
+
+#define SX_ACK_TIMEOUT_MS 250  // resend a packet if it isn't acknowledged in this time
+#define SX_RETRIES 5           // then give up
+#define SX_RX_TIMEOUT_MS 2000  // abandon a half received slot if the sender goes quiet
+
+enum sysexstates {SX_IDLE,SX_SEND_BEGIN,SX_SEND_DATA,SX_SEND_END,SX_SEND_DONE};
+
+// outgoing dump
+int16_t sxstate=SX_IDLE;
+MIDI_Interface * sxport;    // port the dump request came in on - the dump goes back out the same way
+bool sxacked;               // wait for ACKs, otherwise send every SX_PACE_MS
+bool sxallslots;            // dump every slot that has a file
+bool sxwaiting;             // last packet sent, waiting for its ACK
+int16_t sxslot;
+uint16_t sxseq;
+int16_t sxretries;
+uint32_t sxsent;            // time the last packet went out
+File sxfile;
+uint8_t sxpacket[SX_MAX_PACKET];  // kept for resends
+uint16_t sxpacketlen;
+
+// incoming slot
+bool sxreceiving=false;
+int16_t sxrxslot;
+uint16_t sxrxseq;           // next DATA sequence number we expect
+uint32_t sxrxsize;          // file size from the BEGIN packet
+uint32_t sxrxcount;         // bytes written so far
+uint32_t sxrxtime;          // time of the last packet
+File sxrxfile;
+
+bool cfg_read(const char * filename);  // fileio.h - a received slot has to load before it replaces the one there
+
+void sx_filename(char * filename, int16_t slot, bool temp) {
+  sprintf(filename,temp ? "slot%d.tmp" : "slot%d.json",slot);
+}
+
+// send a packet out a port. on USB it waits in the buffer for the next usbflush() like everything else
+void sx_send(MIDI_Interface &midi, const uint8_t * packet, uint16_t len) {
+  midi.sendSysEx(packet,len);
+  if (&midi == &usbMIDI) usbpending+=(len+2)/3;  // 3 SysEx bytes to an event packet
+  budget_spend(midiport(midi),len);
+}
+
+// send an ACK or NAK back to the port a packet came from
+void sx_reply(MIDI_Interface &midi, uint8_t command, uint8_t slot, uint16_t seq) {
+  uint8_t packet[SX_HEADER+2];
+  uint16_t len=sx_build(packet,command,slot,seq,0,0);
+  sx_send(midi,packet,len);
+}
+
+// send the packet in sxpacket[]
+void sx_sendpacket(void) {
+  sx_send(*sxport,sxpacket,sxpacketlen);
+  sxsent=millis();
+  sxwaiting=sxacked;
+}
+
+// find the next slot with a file and open it. returns false when there are no more
+bool sx_nextslot(void) {
+  char filename[20];
+  while (sxslot <= 16) {
+    sx_filename(filename,sxslot,false);
+    if (LittleFS.exists(filename)) {
+      sxfile=LittleFS.open(filename,"r");
+      if (sxfile) return true;
+    }
+    if (!sxallslots) return false;
+    ++sxslot;
+  }
+  return false;
+}
+
+void sx_startdump(MIDI_Interface &midi, uint8_t slot, uint8_t mode) {
+  if (sxstate != SX_IDLE) sxfile.close(); // a new request restarts the dump
+  sxport=&midi;
+  sxacked=(mode == SX_ACKED);
+  sxallslots=(slot == SX_ALLSLOTS);
+  sxslot=sxallslots ? 1 : slot;
+  sxwaiting=false;
+  sxstate=sx_nextslot() ? SX_SEND_BEGIN : SX_SEND_DONE;
+}
+
+// receive side
+void sx_rxabort(void) {
+  char filename[20];
+  sxrxfile.close();
+  sx_filename(filename,sxrxslot,true);
+  LittleFS.remove(filename);
+  sxreceiving=false;
+  Serial.printf("SysEx receive of slot %d abandoned\n",sxrxslot);
+}
+
+void sx_rxbegin(MIDI_Interface &midi, uint8_t slot, uint8_t * payload, int16_t n) {
+  char filename[20];
+  if (sxreceiving) sx_rxabort();
+  if ((slot < 1) || (slot > 16) || (n != 4)) {
+    sx_reply(midi,SX_NAK,slot,0);
+    return;
+  }
+  sx_filename(filename,slot,true);
+  sxrxfile=LittleFS.open(filename,"w");
+  if (!sxrxfile) {
+    sx_reply(midi,SX_NAK,slot,0);
+    return;
+  }
+  sxreceiving=true;
+  sxrxslot=slot;
+  sxrxseq=1;
+  sxrxsize=payload[0] | (payload[1] << 8) | ((uint32_t)payload[2] << 16) | ((uint32_t)payload[3] << 24);
+  sxrxcount=0;
+  sxrxtime=millis();
+  sx_reply(midi,SX_ACK,slot,0);
+}
+
+void sx_rxdata(MIDI_Interface &midi, uint8_t slot, uint16_t seq, uint8_t * payload, int16_t n) {
+  if (!sxreceiving || (slot != sxrxslot)) {
+    sx_reply(midi,SX_NAK,slot,0);
+    return;
+  }
+  sxrxtime=millis();
+  if (seq == sxrxseq-1) { // our ACK got lost and the sender repeated the packet
+    sx_reply(midi,SX_ACK,slot,seq);
+    return;
+  }
+  if ((seq != sxrxseq) || (sxrxcount+n > sxrxsize) || (sxrxfile.write(payload,n) != (size_t)n)) {
+    sx_reply(midi,SX_NAK,slot,sxrxseq);
+    return;
+  }
+  sxrxcount+=n;
+  ++sxrxseq;
+  sx_reply(midi,SX_ACK,slot,seq);
+}
+
+void sx_rxend(MIDI_Interface &midi, uint8_t slot, uint16_t seq) {
+  char filename[20],tempname[20];
+  if (!sxreceiving || (slot != sxrxslot) || (seq != sxrxseq) || (sxrxcount != sxrxsize)) {
+    if (sxreceiving && (slot == sxrxslot)) sx_rxabort();
+    sx_reply(midi,SX_NAK,slot,seq);
+    return;
+  }
+  sxrxfile.close();
+  sx_filename(filename,slot,false);
+  sx_filename(tempname,slot,true);
+  if (!cfg_read(tempname)) {  // arrived intact but isn't settings this build can use
+    LittleFS.remove(tempname);
+    sxreceiving=false;
+    sx_reply(midi,SX_NAK,slot,seq);
+    Serial.printf("SysEx slot %d rejected\n",slot);
+    return;
+  }
+  if (LittleFS.exists(filename)) LittleFS.remove(filename);
+  LittleFS.rename(tempname,filename);
+  sxreceiving=false;
+  sx_reply(midi,SX_ACK,slot,seq);
+  Serial.printf("SysEx received slot %d, %lu bytes\n",slot,(unsigned long)sxrxcount);
+}
+
+// the last outgoing packet is done with - move on
+void sx_advance(void) {
+  sxwaiting=false;
+  sxretries=0;
+  if (sxstate == SX_SEND_END) {
+    sxstate=SX_SEND_DONE;
+    if (sxallslots) {
+      ++sxslot;
+      if (sx_nextslot()) sxstate=SX_SEND_BEGIN;
+    }
+  }
+}
+
+void sx_acked(uint8_t slot, uint16_t seq) {
+  if ((sxstate == SX_IDLE) || !sxwaiting || (slot != sxslot) || (seq != sxseq)) return; // stale
+  sx_advance();
+}
+
+// handle a complete SysEx message from any port. called from the MIDI callbacks
+void sysex_receive(MIDI_Interface &midi, SysExMessage msg) {
+  uint8_t command,slot;
+  uint16_t seq;
+  uint8_t payload[SX_CHUNK];
+  if (!msg.isCompleteMessage()) return;  // ours always fit in one buffer
+  int16_t n=sx_parse(msg.data,msg.length,&command,&slot,&seq,payload);
+  if (n < 0) {
+    if ((msg.length > 5) && (msg.data[1] == SX_ID) && (msg.data[2] == SX_ID1) && (msg.data[3] == SX_ID2)) {
+      if (sxreceiving) sx_reply(midi,SX_NAK,sxrxslot,sxrxseq); // damaged - ask for it again
+    }
+    return;
+  }
+  switch (command) {
+    case SX_DUMP_REQUEST:
+      sx_startdump(midi,slot,(n > 0) ? payload[0] : (uint8_t)SX_PACED);
+      break;
+    case SX_BEGIN:
+      sx_rxbegin(midi,slot,payload,n);
+      break;
+    case SX_DATA:
+      sx_rxdata(midi,slot,seq,payload,n);
+      break;
+    case SX_END:
+      sx_rxend(midi,slot,seq);
+      break;
+    case SX_ACK:
+      sx_acked(slot,seq);
+      break;
+    case SX_NAK:
+      if ((sxstate != SX_IDLE) && sxwaiting && (slot == sxslot) && (seq == sxseq)) sx_sendpacket(); // resend now
+      break;
+    default:
+      break;
+  }
+}
+
+// run the outgoing dump - call from the main loop. sends at most one packet per call
+void sysex_service(void) {
+  uint8_t buf[SX_CHUNK];
+  if (sxreceiving && ((millis()-sxrxtime) > SX_RX_TIMEOUT_MS)) sx_rxabort();
+  if (sxstate == SX_IDLE) return;
+  if (sxwaiting) {
+    if ((millis()-sxsent) < SX_ACK_TIMEOUT_MS) return;
+    if (++sxretries > SX_RETRIES) {  // host has gone away
+      sxfile.close();
+      sxstate=SX_IDLE;
+      Serial.printf("SysEx dump of slot %d timed out\n",sxslot);
+      return;
+    }
+    sx_sendpacket();
+    return;
+  }
+  if (!sxacked) {  // paced - a full packet's time since the last one, and whatever else went out on the port paid for
+    if ((millis()-sxsent) < SX_PACE_MS) return;
+    budget_refill(midiport(*sxport));
+    if (porttokens[midiport(*sxport)] < 0) return;
+  }
+  switch (sxstate) {
+    case SX_SEND_BEGIN:
+      {
+        uint32_t size=sxfile.size();
+        buf[0]=size; buf[1]=size >> 8; buf[2]=size >> 16; buf[3]=size >> 24;
+        sxseq=0;
+        sxpacketlen=sx_build(sxpacket,SX_BEGIN,sxslot,sxseq,buf,4);
+        sxstate=SX_SEND_DATA;
+      }
+      break;
+    case SX_SEND_DATA:
+      {
+        int16_t n=sxfile.read(buf,SX_CHUNK);
+        if (n <= 0) {
+          sxfile.close();
+          ++sxseq;
+          sxpacketlen=sx_build(sxpacket,SX_END,sxslot,sxseq,0,0);
+          sxstate=SX_SEND_END;
+          break;
+        }
+        ++sxseq;
+        sxpacketlen=sx_build(sxpacket,SX_DATA,sxslot,sxseq,buf,n);
+      }
+      break;
+    case SX_SEND_END:  // paced mode doesn't wait for the ACK
+      sx_advance();
+      return;
+    case SX_SEND_DONE:
+      sxpacketlen=sx_build(sxpacket,SX_DONE,sxallslots ? SX_ALLSLOTS : sxslot,0,0,0);
+      sx_send(*sxport,sxpacket,sxpacketlen);
+      sxstate=SX_IDLE;
+      return;
+  }
+  sxretries=0;
+  sx_sendpacket();
+}
@@ -0,0 +1,102 @@
+// Twisty 2 SysEx preset transfer packet format
+// plain C++ with no Arduino dependencies so the host tool in source/SysexTool can use the same code
+//
+// a preset slot is sent as its JSON file, unchanged, split into chunks:
+//   BEGIN (slot, file size) - DATA (seq 1..n, up to SX_CHUNK bytes each) - END (seq n+1)
+// every packet is
+//   F0 7D 54 32 <version> <command> <slot> <seq lo> <seq hi> <payload> <checksum> F7
+// 7D is the non-commercial manufacturer ID and 54 32 is "T2"
+// the payload is 8 bit data packed 7 bytes into 8 - the first byte of each group holds the top bits of the next 7
+// the checksum is the XOR of the command through the end of the payload, masked to 7 bits
+//
+// the receiver answers each packet with ACK (seq) or NAK (seq it expected) on the port it came in on
+// the sender waits for the ACK before sending the next packet so the transfer runs at whatever rate the slowest link allows
+// a dump can also be requested "paced" for SysEx librarians that don't send ACKs - packets are then sent every SX_PACE_MS,
+// which is as long as a full packet takes at SX_PACE_RATE
+
+#ifndef __have__sysexcodec_h__
+#define __have__sysexcodec_h__
+
+#include <stdint.h>
+
+#define SX_ID 0x7d  // non-commercial manufacturer ID
+#define SX_ID1 0x54 // 'T'
+#define SX_ID2 0x32 // '2'
+#define SX_VERSION 1
+#define SX_HEADER 9   // F0 through seq hi
+#define SX_CHUNK 48   // raw file bytes per DATA packet
+#define SX_PACKED(n) ((n)+((n)+6)/7)  // size of n bytes after 7 bit packing
+#define SX_MAX_PACKET (SX_HEADER+SX_PACKED(SX_CHUNK)+2)  // fits the default Control Surface SysEx buffer
+#define SX_ALLSLOTS 0x7f  // slot number for "every slot" in a dump request
+#define SX_PACE_RATE 3000 // bytes/s for paced dumps - the DIN budget in budget.h, under the 3125 bytes/s on the wire
+#define SX_PACE_MS ((SX_MAX_PACKET*1000+SX_PACE_RATE-1)/SX_PACE_RATE)  // packet spacing for paced dumps - a full packet at SX_PACE_RATE
+
+enum sysexcommands {SX_DUMP_REQUEST=1,SX_BEGIN,SX_DATA,SX_END,SX_ACK,SX_NAK,SX_DONE};
+enum sysexdumpmodes {SX_PACED,SX_ACKED};  // payload byte of a dump request
+
+// pack n bytes of 8 bit data into 7 bit MIDI data. returns the packed length
+static inline uint16_t sx_pack(const uint8_t * in, uint16_t n, uint8_t * out) {
+  uint16_t len=0;
+  for (uint16_t i=0; i<n; i+=7) {
+    uint8_t * msbs=&out[len++];
+    *msbs=0;
+    for (uint16_t j=0; (j<7) && (i+j<n); ++j) {
+      if (in[i+j] & 0x80) *msbs |= 1 << j;
+      out[len++]=in[i+j] & 0x7f;
+    }
+  }
+  return len;
+}
+
+// unpack 7 bit MIDI data. returns the unpacked length
+static inline uint16_t sx_unpack(const uint8_t * in, uint16_t n, uint8_t * out) {
+  uint16_t len=0;
+  for (uint16_t i=0; i<n; i+=8) {
+    uint8_t msbs=in[i];
+    for (uint16_t j=0; (j<7) && (i+1+j<n); ++j) {
+      out[len++]=in[i+1+j] | ((msbs >> j) & 1) << 7;
+    }
+  }
+  return len;
+}
+
+static inline uint8_t sx_checksum(const uint8_t * data, uint16_t n) {
+  uint8_t sum=0;
+  for (uint16_t i=0; i<n; ++i) sum ^= data[i];
+  return sum & 0x7f;
+}
+
+// build a complete packet in out. returns its length
+static inline uint16_t sx_build(uint8_t * out, uint8_t command, uint8_t slot, uint16_t seq, const uint8_t * payload, uint16_t n) {
+  uint16_t len=0;
+  out[len++]=0xf0;
+  out[len++]=SX_ID;
+  out[len++]=SX_ID1;
+  out[len++]=SX_ID2;
+  out[len++]=SX_VERSION;
+  out[len++]=command;
+  out[len++]=slot & 0x7f;
+  out[len++]=seq & 0x7f;
+  out[len++]=(seq >> 7) & 0x7f;
+  len+=sx_pack(payload,n,&out[len]);
+  out[len]=sx_checksum(&out[5],len-5);
+  ++len;
+  out[len++]=0xf7;
+  return len;
+}
+
+// check a received packet. on success fills in the header fields, unpacks the payload and returns its length
+// returns -1 if it isn't one of ours or is damaged. payload must have room for SX_CHUNK bytes
+static inline int16_t sx_parse(const uint8_t * in, uint16_t n, uint8_t * command, uint8_t * slot, uint16_t * seq, uint8_t * payload) {
+  if ((n < SX_HEADER+2) || (in[0] != 0xf0) || (in[n-1] != 0xf7)) return -1;
+  if ((in[1] != SX_ID) || (in[2] != SX_ID1) || (in[3] != SX_ID2) || (in[4] != SX_VERSION)) return -1;
+  if (sx_checksum(&in[5],n-7) != in[n-2]) return -1;
+  uint16_t packed=n-SX_HEADER-2;
+  if (packed > SX_PACKED(SX_CHUNK)) return -1;
+  *command=in[5];
+  *slot=in[6];
+  *seq=in[7] | (in[8] << 7);
+  return sx_unpack(&in[SX_HEADER],packed,payload);
+}
+
+#endif // __have__sysexcodec_h__
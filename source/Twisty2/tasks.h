@@ -0,0 +1,101 @@
+// cooperative task scheduler
+// the UI used to wait for things - a button to be let go, a message to be read - by sitting in a delay loop, and while it
+// sat there no MIDI was read or sent. a wait is now a task: a function that tasks_run() calls from the loop once its
+// condition is met. tasks run to completion and never block, and a task can start other tasks
+//   task_after(ms,fn)      - call fn once, ms from now
+//   task_every(ms,fn)      - call fn every ms until it's cancelled
+//   task_defer(fn)         - call fn on the next pass of the loop
+//   task_onrelease(pin,fn) - call fn once the button on pin has read released for RELEASE_MS
+//   toast(text,ms,fn)      - show a message and call fn when it's been up for ms
+// starting a task for a function that's already waiting restarts it rather than adding a second one
+
+#define NUM_TASKS 8
+#define RELEASE_MS 20   // buttons bounce when they're let go
+#define TOAST_MS 3000   // how long a toast stays up
+
+typedef void (*taskfunc)(void);
+
+struct task {
+  taskfunc fn;      // 0 if the entry is free
+  uint32_t start;   // millis() when the wait started
+  uint32_t period;  // ms to wait
+  bool repeat;
+  int16_t pin;      // button that has to be released first, -1 for none
+};
+
+task tasks[NUM_TASKS];
+
+// returns false if the table is full
+bool task_start(taskfunc fn, uint32_t ms, bool repeat, int16_t pin) {
+  int16_t slot=-1;
+  for (int16_t i=0; i< NUM_TASKS;++i) {
+    if (tasks[i].fn == fn) {
+      slot=i;
+      break;
+    }
+    if (!tasks[i].fn && (slot < 0)) slot=i;
+  }
+  if (slot < 0) return false;
+  tasks[slot].start=millis();
+  tasks[slot].period=ms;
+  tasks[slot].repeat=repeat;
+  tasks[slot].pin=pin;
+  tasks[slot].fn=fn;
+  return true;
+}
+
+bool task_after(uint32_t ms, taskfunc fn) {
+  return task_start(fn,ms,false,-1);
+}
+
+bool task_every(uint32_t ms, taskfunc fn) {
+  return task_start(fn,ms,true,-1);
+}
+
+bool task_defer(taskfunc fn) {
+  return task_start(fn,0,false,-1);
+}
+
+bool task_onrelease(int16_t pin, taskfunc fn) {
+  return task_start(fn,RELEASE_MS,false,pin);
+}
+
+void task_cancel(taskfunc fn) {
+  for (int16_t i=0; i< NUM_TASKS;++i) {
+    if (tasks[i].fn == fn) tasks[i].fn=0;
+  }
+}
+
+bool task_waiting(taskfunc fn) {
+  for (int16_t i=0; i< NUM_TASKS;++i) {
+    if (tasks[i].fn == fn) return true;
+  }
+  return false;
+}
+
+// call whatever is due - call from the loop
+void tasks_run(void) {
+  uint32_t now=millis();
+  for (int16_t i=0; i< NUM_TASKS;++i) {
+    taskfunc fn=tasks[i].fn;
+    if (!fn) continue;
+    if ((tasks[i].pin >= 0) && !digitalRead(tasks[i].pin)) { // still held - the release time starts again
+      tasks[i].start=now;
+      continue;
+    }
+    if ((now-tasks[i].start) < tasks[i].period) continue;
+    if (tasks[i].repeat) tasks[i].start+=tasks[i].period;
+    else tasks[i].fn=0;  // free before the call so the task can start itself again
+    fn();
+  }
+}
+
+// show a one line message on a clear screen for ms, then call fn - which redraws whatever should be there
+void toast(const char * text, uint32_t ms, taskfunc fn) {
+  display.clearDisplay();
+  display.setTextSize(1);
+  display.setCursor(0,12);
+  display.print(text);
+  updatedisplay();
+  task_after(ms,fn);
+}
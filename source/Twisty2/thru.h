@@ -0,0 +1,235 @@
+// MIDI thru and merge for Twisty 2
+// messages coming in on one port can be passed on to either or both of the others, merged with what the controls send
+// thruroute[] - set from the Save/Load menu - picks the outputs for each input
+// - real time messages (clock, start, stop...) go straight out. they're one byte and their timing matters most
+// - everything else is queued whole, in a queue for each input on each output, so a message is never split up or
+//   mixed with another. each output takes one message from each input's queue in turn while the port's budget
+//   (budget.h) has room. a flood on one input only fills its own queues - the other inputs still get their turn, and
+//   the controls are sent directly so they never wait behind forwarded traffic
+// - SysEx is queued a chunk at a time as Control Surface hands it over, so a long dump never has to fit in memory.
+//   a SysEx that fits in the queue goes out once its F7 is in, in one go. a longer one starts when its queue fills and
+//   streams out as the rest arrives - nothing else from the other inputs goes out on that port till its F7 has gone.
+//   the controls still go straight out, so on DIN a control moved during a long forwarded dump ends the dump early
+// - a message that doesn't fit in its queue is dropped and counted. a SysEx that runs out of room is cut short with an
+//   F7 so the gear downstream isn't left waiting for one. USB MIDI is flow controlled, so while anything from USB is backed
+//   up the loop stops reading USB and the computer waits - a dump from the computer to DIN gear gets through whole, and
+//   so does what the computer sends after it
+// SysEx for Twisty 2 itself isn't passed on
+
+#define THRU_QSIZE 256    // bytes queued for each input on each output - must be a power of 2
+#define THRU_SYSEX_TIMEOUT_MS 500  // a SysEx that stops arriving part way through is closed off after this long
+
+struct thruqueue {
+  uint8_t buf[THRU_QSIZE];
+  uint16_t head;  // free running - masked when used
+  uint16_t tail;
+};
+
+thruqueue thruq[NUM_PORTS][NUM_PORTS];  // [output][input]
+int16_t thrunext[NUM_PORTS];     // round robin - the input that goes first on each output
+int16_t thruowner[NUM_PORTS];    // input with a SysEx going out on each output, -1 for none
+uint32_t thruownertime[NUM_PORTS];  // when that SysEx last sent anything
+
+enum thrusxstates {THRU_SX_OFF,THRU_SX_QUEUED,THRU_SX_CUT};  // none coming in or not passing it on, queueing it, ran out of room
+int16_t thrusx[NUM_PORTS][NUM_PORTS];  // state of the SysEx coming in on each input for each output [input][output]
+uint32_t thrusxtime[NUM_PORTS];        // when each input last had a SysEx chunk
+
+void thru_drop(void) {
+  if (thrudrops < 32767) ++thrudrops;
+}
+
+void initthru(void) {
+  for (int16_t out=0; out< NUM_PORTS;++out) thruowner[out]=-1;
+}
+
+MIDI_Interface * thru_iface(int16_t port) {
+  switch (port) {
+    case PORT_USB:
+      return &usbMIDI;
+    case PORT_DIN:
+      return &serialMIDI;
+#ifdef BLUETOOTH
+    case PORT_BLE:
+      return &bleMIDI;
+#endif
+    default:
+      return 0;
+  }
+}
+
+// each input's menu setting is a 2 bit mask of the other two ports in port order
+bool thru_routed(int16_t in, int16_t out) {
+  if ((in == out) || !thru_iface(in) || !thru_iface(out)) return false;
+  return (thruroute[in] >> ((out < in) ? out : out-1)) & 1;
+}
+
+// bytes in a message from its status byte
+uint16_t thru_msglen(uint8_t status) {
+  switch (status & 0xf0) {
+    case 0xc0:  // program change
+    case 0xd0:  // channel pressure
+      return 2;
+    case 0xf0:
+      if ((status == 0xf1) || (status == 0xf3)) return 2;  // MTC quarter frame, song select
+      if (status == 0xf2) return 3;  // song position
+      return 1;  // tune request
+    default:
+      return 3;
+  }
+}
+
+uint16_t thru_used(thruqueue * q) {
+  return q->head-q->tail;
+}
+
+void thru_put(thruqueue * q, const uint8_t * data, uint16_t n) {
+  for (uint16_t i=0; i< n;++i) q->buf[(q->head++) & (THRU_QSIZE-1)]=data[i];
+}
+
+// queue a channel or system common message for the outputs its input is routed to
+void thru_message(MIDI_Interface &midi, uint8_t status, uint8_t data1, uint8_t data2) {
+  uint8_t msg[3]={status,data1,data2};
+  uint16_t len=thru_msglen(status);
+  int16_t in=midiport(midi);
+  for (int16_t out=0; out< NUM_PORTS;++out) {
+    if (!thru_routed(in,out)) continue;
+    thruqueue * q=&thruq[out][in];
+    if (THRU_QSIZE-thru_used(q) >= len) thru_put(q,msg,len);
+    else thru_drop();
+  }
+}
+
+// real time messages skip the queues
+void thru_realtime(MIDI_Interface &midi, RealTimeMessage msg) {
+  int16_t in=midiport(midi);
+  for (int16_t out=0; out< NUM_PORTS;++out) {
+    if (!thru_routed(in,out)) continue;
+    thru_iface(out)->send(RealTimeMessage(msg.message));
+    budget_spend(out,1);
+    if (out == PORT_USB) {
+      ++usbpending;
+      usbflush();  // like sendrealtime() - clock can't wait for the end of the loop pass
+    }
+  }
+}
+
+// queue a SysEx chunk. the first chunk decides whether the message is passed on at all
+void thru_sysex(MIDI_Interface &midi, SysExMessage msg) {
+  int16_t in=midiport(midi);
+  thrusxtime[in]=millis();
+  if (msg.isFirstChunk()) {
+    bool ours=(msg.length > 3) && (msg.data[1] == SX_ID) && (msg.data[2] == SX_ID1) && (msg.data[3] == SX_ID2);
+    for (int16_t out=0; out< NUM_PORTS;++out) thrusx[in][out]=(!ours && thru_routed(in,out)) ? THRU_SX_QUEUED : THRU_SX_OFF;
+  }
+  for (int16_t out=0; out< NUM_PORTS;++out) {
+    if (thrusx[in][out] != THRU_SX_QUEUED) continue;
+    thruqueue * q=&thruq[out][in];
+    if (THRU_QSIZE-thru_used(q) > msg.length) thru_put(q,msg.data,msg.length);  // one byte is always kept for an F7
+    else {
+      if (!msg.isFirstChunk()) {  // part of it is queued already - close it off
+        uint8_t eox=0xf7;
+        thru_put(q,&eox,1);
+      }
+      thrusx[in][out]=THRU_SX_CUT;
+      thru_drop();
+    }
+  }
+  if (msg.isLastChunk()) {
+    for (int16_t out=0; out< NUM_PORTS;++out) thrusx[in][out]=THRU_SX_OFF;
+  }
+}
+
+// true if an input should stop being read for now - a queue it's going to is half full
+// only worth doing for USB - DIN and BLE keep coming whether they're read or not
+bool thru_hold(int16_t in) {
+  for (int16_t out=0; out< NUM_PORTS;++out) {
+    if (thru_routed(in,out) && (thru_used(&thruq[out][in]) >= THRU_QSIZE/2)) return true;
+  }
+  return false;
+}
+
+// true if the SysEx at the front of an input's queue can start - its F7 is in, the queue is full enough that it has
+// to stream, or the rest of it has stopped coming
+bool thru_sysexready(int16_t out, int16_t in) {
+  thruqueue * q=&thruq[out][in];
+  uint16_t used=thru_used(q);
+  if ((used >= THRU_QSIZE/2) || ((millis()-thrusxtime[in]) > THRU_SYSEX_TIMEOUT_MS)) return true;
+  for (uint16_t i=1; i< used;++i) {
+    if (q->buf[(q->tail+i) & (THRU_QSIZE-1)] == 0xf7) return true;
+  }
+  return false;
+}
+
+// send as much of the SysEx owning an output as is queued and fits the budget. returns true when its F7 has gone
+bool thru_sendsysex(int16_t out, int16_t in) {
+  thruqueue * q=&thruq[out][in];
+  bool done=false;
+  while (thru_used(q) && budget_bytes(out) && !done) {
+    uint16_t start=q->tail & (THRU_QSIZE-1);
+    uint16_t n=0;
+    uint16_t most=min((uint32_t)thru_used(q),(uint32_t)(THRU_QSIZE-start));  // up to the end of the buffer
+    most=min((uint32_t)most,budget_bytes(out));
+    while ((n < most) && !done) done=(q->buf[start+n++] == 0xf7);
+    thru_iface(out)->send(SysExMessage(&q->buf[start],n));
+    if (out == PORT_USB) ++usbpending;
+    q->tail+=n;
+    budget_spend(out,n);
+    thruownertime[out]=millis();
+  }
+  return done;
+}
+
+// send queued messages within each output's budget - call from the main loop
+void thru_service(void) {
+  for (int16_t out=0; out< NUM_PORTS;++out) {
+    budget_refill(out);
+    if (!thru_iface(out)) continue;
+    int16_t idle=0;  // inputs in a row that had nothing to send
+    while (idle < NUM_PORTS) {
+      if (thruowner[out] >= 0) {  // a SysEx is going out - nothing else till it's done
+        int16_t in=thruowner[out];
+        if (thru_sendsysex(out,in)) thruowner[out]=-1;
+        else if (!thru_used(&thruq[out][in]) && ((millis()-thruownertime[out]) > THRU_SYSEX_TIMEOUT_MS)) { // the rest isn't coming
+          uint8_t eox=0xf7;
+          thru_iface(out)->send(SysExMessage(&eox,1));
+          budget_spend(out,1);
+          if (thrusx[in][out] == THRU_SX_QUEUED) thrusx[in][out]=THRU_SX_CUT;
+          thruowner[out]=-1;
+        }
+        else break;  // waiting for more of it or for budget
+        idle=0;
+        continue;
+      }
+      int16_t in=thrunext[out];
+      thruqueue * q=&thruq[out][in];
+      thrunext[out]=(in+1)%NUM_PORTS;
+      if (!thru_used(q)) {
+        ++idle;
+        continue;
+      }
+      uint8_t status=q->buf[q->tail & (THRU_QSIZE-1)];
+      if (status == 0xf0) {
+        if (!thru_sysexready(out,in)) {
+          ++idle;
+          continue;
+        }
+        thruowner[out]=in;
+        thruownertime[out]=millis();
+        idle=0;
+        continue;
+      }
+      uint16_t len=thru_msglen(status);
+      if (budget_bytes(out) < len) {
+        thrunext[out]=in;  // out of budget - this input goes first next time
+        break;
+      }
+      uint8_t data[3]={0,0,0};
+      for (uint16_t i=0; i< len;++i) data[i]=q->buf[(q->tail++) & (THRU_QSIZE-1)];
+      if (status < 0xf0) thru_iface(out)->send(ChannelMessage(data[0],data[1],data[2]));
+      else thru_iface(out)->send(SysCommonMessage((MIDIMessageType)data[0],data[1],data[2]));
+      if (out == PORT_USB) ++usbpending;
+      budget_spend(out,len);
+      idle=0;
+    }
+  }
+}
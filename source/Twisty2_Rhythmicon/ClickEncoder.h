@@ -9,6 +9,7 @@
 // http://www.mikrocontroller.net/articles/Drehgeber
 // ----------------------------------------------------------------------------
 // RH added button edge events which are needed sometimes Dec 2025
+// RH service() returns true when the encoder moved and counts invalid transitions so the scan rate can follow the encoders
 
 #ifndef __have__ClickEncoder_h__
 #define __have__ClickEncoder_h__
@@ -66,8 +67,12 @@ public:
   ClickEncoder(uint8_t A, uint8_t B, uint8_t BTN = -1,
                uint8_t stepsPerNotch = 1, bool active = LOW);
 
-  void service(void);
+  bool service(void);
   int16_t getValue(void);
+  uint16_t getErrors(void)  // invalid transitions seen - both inputs changed between scans so a step was missed
+  {
+    return errors;
+  }
 
 #ifndef WITHOUT_BUTTON
 public:
@@ -112,6 +117,9 @@ private:
   uint8_t steps;
   volatile uint16_t acceleration;
   bool accelerationEnabled;
+  unsigned long lastAccelDecay = 0;
+  volatile uint16_t errors = 0;
+  int8_t errorState = -1;
 #if ENC_DECODER != ENC_NORMAL
   static const int8_t table[16];
 #endif
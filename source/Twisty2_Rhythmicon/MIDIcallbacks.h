@@ -6,6 +6,24 @@
 // there is some risk in processing MIDI start/stop etc on on core 0 since core 1 could also be using MIDI
 // core 0 syncing sequencers while core 1 is doing clocks is a bit dicey
 // idling core 1 when using these resources should work
+//
+// these run on core 1 in the middle of the sequencer timing so they have to be quick
+// anything that is only informational goes to the deferred logger in midilog.h instead of straight to Serial
+
+// incoming MIDI channel to track lookup - bit n is set if track n listens on that channel
+// rebuilt whenever a track's MIDI input channel is changed so note dispatch is a single table lookup
+// the menu rebuilds it on core 0 while core 1 is dispatching notes, so it's built off to the side and copied over in one go -
+// each entry only ever goes from its old value to its new one, never through zero
+uint8_t channeltracks[16];
+
+void buildchannelmap(void) {
+  uint8_t map[16];
+  for (int16_t ch=0; ch< 16;++ch) map[ch]=0;
+  for (int16_t i=0; i< NTRACKS;++i) {
+    if ((MIDIinputchannel[i] >=1) && (MIDIinputchannel[i] <=16)) map[MIDIinputchannel[i]-1] |= 1 << i;
+  }
+  memcpy(channeltracks,map,sizeof(channeltracks));
+}
 
 struct MyMIDI_Callbacks : FineGrainedMIDI_Callbacks<MyMIDI_Callbacks> {
   // Note how this ^ name is identical to the argument used here ^
@@ -17,32 +35,30 @@ struct MyMIDI_Callbacks : FineGrainedMIDI_Callbacks<MyMIDI_Callbacks> {
   // 
   void onNoteOn(Channel channel, uint8_t note, uint8_t velocity, Cable cable) {
   //  Serial.printf("ch %d noteon %d\n",channel.getRaw(),note);
-    for (int16_t i=0; i< NTRACKS;++i) {  // control surface "Channel" is a real pain in the ass to deal with
-      if (channel.getRaw()+1 == MIDIinputchannel[i])  {
-        notes[i].offset=(int8_t)note-MIDDLE_C; // incoming midi notes are used as a signed offset from middle C
-  //      Serial.printf("offset %d\n",(int8_t)note-MIDDLE_C);
-      }
+    bootstamp(BOOT_FIRSTMIDI);
+    uint8_t tracks=channeltracks[channel.getRaw() & 0x0f];  // control surface "Channel" is a real pain in the ass to deal with
+    for (int16_t i=0; tracks; ++i, tracks >>= 1) {
+      if (tracks & 1) notes[i].offset=(int8_t)note-MIDDLE_C; // incoming midi notes are used as a signed offset from middle C
     }
   }
 
   void onControlChange(Channel channel, uint8_t controller, uint8_t value,
                        Cable cable) {
-    Serial << "Control Change: " << channel << ", controller " << controller
-           << ", value " << value << ", " << cable << endl;
+    bootstamp(BOOT_FIRSTMIDI);
+    midilog_push(CONTROL_CHANGE,channel.getOneBased(),controller,value,0,cable.getRaw());
   }
 
   void onSystemExclusive(SysExMessage se) {
-    Serial << F("System Exclusive: [") << se.length << "] "
-           << AH::HexDump(se.data, se.length) << ", " << se.cable << endl;
+    midilog_push(SYSEX_START,0,(se.length > 1) ? se.data[1] : 0,(se.length > 2) ? se.data[2] : 0,se.length,se.cable.getRaw()); // just the manufacturer ID bytes
   }
   void onTimeCodeQuarterFrame(uint8_t data, Cable cable) {
-    Serial << "MTC Quarter Frame: " << data << ", " << cable << endl;
+    midilog_push(MTC_QUARTER_FRAME,0,data,0,0,cable.getRaw());
   }
   void onSongPosition(uint16_t beats, Cable cable) {
-    Serial << "Song Position Pointer: " << beats << ", " << cable << endl;
+    midilog_push(SONG_POSITION_POINTER,0,beats & 0x7f,beats >> 7,0,cable.getRaw());
   }
   void onSongSelect(uint8_t songnumber, Cable cable) {
-    Serial << "Song Select: " << songnumber << ", " << cable << endl;
+    midilog_push(SONG_SELECT,0,songnumber,0,0,cable.getRaw());
   }
 
   // process MIDI clock messages
@@ -51,6 +67,7 @@ struct MyMIDI_Callbacks : FineGrainedMIDI_Callbacks<MyMIDI_Callbacks> {
 
   void onClock(Cable cable) { 
     long qn,clockperiod;
+    bootstamp(BOOT_FIRSTMIDI);
     clockperiod= (long)(((60.0/(float)bpm)/PPQN)*1000); // for call to clocktick(). use calculated BPM which is more stable - MIDI clock has a lot of jitter
     --MIDIclocks;
     if (MIDIclocks ==0 ) {
@@ -86,6 +103,7 @@ struct MyMIDI_Callbacks : FineGrainedMIDI_Callbacks<MyMIDI_Callbacks> {
 
   void onStart(Cable cable) { 
   //  Serial.printf("Start\n");
+    bootstamp(BOOT_FIRSTMIDI);
     all_notes_off();  // in case notes are already playing
     sync_sequencers(); // sync all sequencers 
     MIDIsync=16; // sync BPM again
@@ -113,10 +131,10 @@ struct MyMIDI_Callbacks : FineGrainedMIDI_Callbacks<MyMIDI_Callbacks> {
   }
 
   void onActiveSensing(Cable cable) {
-    Serial << "Active Sensing: " << cable << endl;
+    midilog_push(ACTIVE_SENSING,0,0,0,0,cable.getRaw());
   }
   void onSystemReset(Cable cable) {
-    Serial << "System Reset: " << cable << endl;
+    midilog_push(SYSTEM_RESET,0,0,0,0,cable.getRaw());
   }
 
 } callback;
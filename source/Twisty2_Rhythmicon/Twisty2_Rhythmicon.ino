@@ -40,9 +40,10 @@
 #include <Adafruit_SSD1306.h>
 #include <Adafruit_TinyUSB.h>
 #include <MIDI.h>
-#include "Clickencoder.h"
+#include "ClickEncoder.h"
 #include <Adafruit_NeoPixel.h>
 #include <Control_Surface.h>
+#include "LittleFS.h"
 
 // BT MIDI works (with the exception of note messages) on the Twisty2 app but does not work here. maybe because I'm using both cores?
 #define BLUETOOTH  // define for bluetooth MIDI 
@@ -50,6 +51,9 @@
 #include <MIDI_Interfaces/BluetoothMIDI_Interface.hpp>
 #endif
 
+//#define BENCHMARK  // define to run the microbenchmarks in bench.h at startup - results are printed to USB serial
+//#define PROFILE  // define to time the ISR, UI and sequencer stages - results show on the Stats page (double click the right encoder) and on USB serial
+
 
 #define TRUE 1
 #define FALSE 0
@@ -70,6 +74,10 @@ bool menumode=0;  // when true we are in the text menu system
 #define BATTERY_SCALE 3300*2/1024  // 3.3v reference, 10 bit A/D with external 2:1 divider. * 1000 so menus can display as a float
 #define BATVOLTAGE 28  // battery voltage input 
 int16_t batteryvoltage; // integer but displayed as a float in menus
+#define BAT_SAMPLE_MS 100  // battery sample interval
+#define BAT_FILTER 3       // each sample moves the average 1/8 of the way - smooths out A/D noise over about a second
+uint32_t batfilter;        // filtered A/D reading << BAT_FILTER
+uint32_t battime;          // time of the last sample
 
 #define DEFAULT_VELOCITY 120
 #define NTRACKS 3 // number of sequencer tracks - each track has notes, gates etc
@@ -83,7 +91,7 @@ int16_t trackenabled[NTRACKS] = {1,1,1}; // 1 if track on is 1, 0 if off
 #define MAX_DIVIDER 128  // maximum clock divider
 bool rhythmclks[NTRACKS+1][NUM_CLOCKS]= {1,0,0,0,0,0,0,0,0,0,0,0,1,1,1,1}; // 1 to enable clock source to track. last 4 are always set to show divider LEDs
 
-const char * notenames[]={"C","C#","D","D#","E","F","F#","G","G#","A","A#","B","C"};
+const char * const notenames[]={"C","C#","D","D#","E","F","F#","G","G#","A","A#","B","C"};
 
 #define DISPLAY_BLANK_MS 120*1000  // display blanking time
 int32_t displaytimer ; // display blanking timer
@@ -91,7 +99,7 @@ int32_t displaytimer ; // display blanking timer
 #define TEMPO    120  // startup tempo
 #define PPQN 24  // clocks per quarter note
 #define PPQN_DIV 6 // divider for 16th notes
-#define GATE_DIV 3  // gate time is half the note duration
+#define GATE_PERCENT 66  // default gate time - what the old gate counted in clock ticks worked out to
 #define MIDDLE_C 60 // MIDI note used as default sequencer value and as a base for incoming MIDI offsets
 
 int16_t bpm = TEMPO;
@@ -193,41 +201,86 @@ HardwareSerialMIDI_Interface serialMIDI {Serial1, MIDI_BAUD};
 BluetoothMIDI_Interface bleMIDI;
 #endif
 
-#define TIMER_MICROS 1000 // interrupt period
+#define TIMER_MICROS 1000 // scan period when the encoders are idle
+#define SCAN_SLEEP_MICROS 2000 // scan period once nothing has moved for SCAN_SLEEP_HOLD_MICROS - buttons are only checked every 10ms anyway
+#define TIMER_MICROS_FAST 250 // scan period while any encoder is turning - a full scan takes roughly 100us so 4kHz keeps it under half of core 0
+#define SCAN_HOLD_MICROS 250000 // stay at the fast rate this long after the last step
+#define SCAN_SLEEP_HOLD_MICROS 10000000 // drop to the sleep rate after this long without a step
+#define SCAN_MIN_LEAD 10  // an alarm set less than this far ahead could be missed
+
+// stages timed by the profiler - order must match the Stats menu page
+#ifdef PROFILE
+enum profstages {PROF_ISR,PROF_LOOP,PROF_DISPLAY,PROF_LOOP1,PROF_CLOCKTICK,PROF_MIDI,PROF_LEDSHOW,NUM_PROF_STAGES};
+const char * const profnames[NUM_PROF_STAGES]={"alarm_irq","loop","display","loop1","clocktick","MIDI update","LEDS.show"};
+#endif
+#include "boot.h"
+#include "profiler.h"
 
 // RP2040 timer code from https://github.com/raspberrypi/pico-examples/blob/master/timer/timer_lowlevel/timer_lowlevel.c
 // Use alarm 0
 #define ALARM_NUM 0
 #define ALARM_IRQ timer_hardware_alarm_get_irq_num(timer_hw, ALARM_NUM)
 
+// the scan runs on absolute deadlines - each one is the last plus the period so the ISR's own run time doesn't stretch the period
+uint32_t scandeadline;  // timer count of the next scan
+uint32_t scanperiod=TIMER_MICROS;
+uint32_t scanidle;      // us since any encoder last moved
+
 static void alarm_in_us(uint32_t delay_us) {
   hw_set_bits(&timer_hw->inte, 1u << ALARM_NUM);
   irq_set_exclusive_handler(ALARM_IRQ, alarm_irq);
   irq_set_enabled(ALARM_IRQ, true);
+  scandeadline=timer_hw->timerawl;
   alarm_in_us_arm(delay_us);
 }
 
 static void alarm_in_us_arm(uint32_t delay_us) {
-  uint64_t target = timer_hw->timerawl + delay_us;
-  timer_hw->alarm[ALARM_NUM] = (uint32_t) target;
+  scandeadline+=delay_us;
+  int32_t ahead=scandeadline-timer_hw->timerawl;
+  if ((ahead < SCAN_MIN_LEAD) || (ahead > (int32_t)delay_us)) scandeadline=timer_hw->timerawl+delay_us; // fell behind (or was called outside the ISR) - start over rather than bunch up scans
+  timer_hw->alarm[ALARM_NUM] = scandeadline;
 }
 
-// timer interrupt handler
-// scans thru the multiplexed encoders and handles the menu encoders
-
-static void alarm_irq(void) {
+// one pass over all the encoders - true if any of them moved
+static bool scan_encoders(void) {
+  bool moved=false;
   for (int addr=0; addr< NUMENCODERS;++addr) {
     digitalWrite(A_MUX_0, addr & 1);
     digitalWrite(A_MUX_1, addr & 2);
     digitalWrite(A_MUX_2, addr & 4);
     digitalWrite(A_MUX_3, addr & 8); 
     delayMicroseconds(4);         // address settling time 
-    enc[addr].service();    // check the encoder inputs
+    moved|=enc[addr].service();    // check the encoder inputs
   } 
-  lmenuenc.service(); // handle the menu encoders which are on different port pins
-  rmenuenc.service(); // 
+  moved|=lmenuenc.service(); // handle the menu encoders which are on different port pins
+  moved|=rmenuenc.service(); // 
+  return moved;
+}
+
+// timer interrupt handler
+// scans thru the multiplexed encoders and handles the menu encoders
+// scans at TIMER_MICROS_FAST while anything is turning so fast spins don't skip quadrature states, TIMER_MICROS otherwise
+// and SCAN_SLEEP_MICROS when the unit has been left alone. the first step seen puts it straight back to the fast rate
+
+static void alarm_irq(void) {
+  PROF_START(PROF_ISR);
+  bool moved=scan_encoders();
+  if (moved) scanidle=0;
+  else if (scanidle < SCAN_SLEEP_HOLD_MICROS) scanidle+=scanperiod;
+  if (scanidle < SCAN_HOLD_MICROS) scanperiod=TIMER_MICROS_FAST;
+  else if (scanidle < SCAN_SLEEP_HOLD_MICROS) scanperiod=TIMER_MICROS;
+  else scanperiod=SCAN_SLEEP_MICROS;
   hw_clear_bits(&timer_hw->intr, 1u << ALARM_NUM); // clear IRQ flag
-  alarm_in_us_arm(TIMER_MICROS);  // reschedule interrupt
+  alarm_in_us_arm(scanperiod);  // reschedule interrupt
+  PROF_END(PROF_ISR);
+  PROF_OVERRUN(PROF_ISR,scanperiod);
+}
+
+// invalid quadrature transitions seen by all the encoders - each one is a step that was missed
+uint16_t encodererrors(void) {
+  uint16_t errors=lmenuenc.getErrors()+rmenuenc.getErrors();
+  for (int16_t i=0; i< NUMENCODERS;++i) errors+=enc[i].getErrors();
+  return errors;
 }
 
 
@@ -247,17 +300,85 @@ void blankdisplay(void) {
 
 // update the display and reset the display blanking timer
 void updatedisplay(){
+  if (splashing) return;  // drawn behind the power on message - it all shows when that comes down
+  PROF_START(PROF_DISPLAY);
   display.display();
+  PROF_END(PROF_DISPLAY);
   displaytimer=millis();
 }
 
+// sample the battery in the background and keep a running average - the menu just shows batteryvoltage
+void batteryservice(void) {
+  if (batfilter && ((millis()-battime) < BAT_SAMPLE_MS)) return;
+  battime=millis();
+  uint32_t sample=analogRead(BATVOLTAGE);
+  if (!batfilter) batfilter=sample << BAT_FILTER;  // first reading - start the average there
+  else batfilter+=sample-(batfilter >> BAT_FILTER);
+  batteryvoltage=(batfilter*BATTERY_SCALE) >> BAT_FILTER;
+}
+
 
 // midi related stuff - after initialization all MIDI stuff runs on core1 for timing accuracy
 // splitting it across both cores causes MidiUSB to hang eventually
 
+// USB MIDI event packets are collected in the Control Surface USB buffer instead of each going out as its own USB transfer
+// usbflush() sends everything collected as one transfer - call it at the end of each batch of sends
+// real time messages go through sendrealtime() which sends straight away
+uint32_t usbpending;    // event packets waiting in the buffer
+uint32_t usbpackets;    // event packets sent
+uint32_t usbtransfers;  // flushes that had something to send
+
+void usbflush(void) {
+  usbMIDI.sendNow();
+  if (usbpending) {
+    usbpackets+=usbpending;
+    ++usbtransfers;
+    usbpending=0;
+  }
+}
+
+void sendrealtime(MIDIMessageType message) {
+  usbMIDI.sendRealTime(message);
+  ++usbpending;
+  usbflush();
+  serialMIDI.sendRealTime(message);
+#ifdef BLUETOOTH
+  bleMIDI.sendRealTime(message);
+#endif
+}
+
+#ifdef PROFILE
+int16_t usbperxfer;  // event packets per USB transfer - shown as a float in thousandths
+int16_t usbxfers;    // USB transfers in the last stats window
+uint32_t usblastpackets,usblasttransfers;
+
+// publish the USB counters - call when prof_tick() starts a new window
+void usbstats(void) {
+  uint32_t packets=usbpackets-usblastpackets;
+  uint32_t transfers=usbtransfers-usblasttransfers;
+  usblastpackets+=packets;
+  usblasttransfers+=transfers;
+  usbperxfer=transfers ? prof_clip(packets*1000/transfers) : 0;
+  usbxfers=prof_clip(transfers);
+}
+
+int16_t scanrate;     // encoder scans in the last stats window
+int16_t loststeps;    // invalid encoder transitions in the last stats window
+uint16_t lastencerrors;
+
+// publish the scan counters - call when prof_tick() starts a new window
+void scanstats(void) {
+  uint16_t errors=encodererrors();
+  loststeps=prof_clip((uint16_t)(errors-lastencerrors));
+  lastencerrors=errors;
+  scanrate=prof_clip(profwindow[PROF_ISR].count);
+}
+#endif
+
 void sendnoteOn(uint8_t channel,uint8_t pitch, uint8_t velocity) {
   MIDIAddress midiaddress ={pitch,Channel_1 + (channel-1)}; // control surface library requires this form of MIDI addressing -I'm not a fan of the design but its the only Arduino BLE MIDI library I could find
   usbMIDI.sendNoteOn(midiaddress, velocity);
+  ++usbpending;
   serialMIDI.sendNoteOn(midiaddress, velocity);
 #ifdef BLUETOOTH
   bleMIDI.sendNoteOn(midiaddress, velocity);
@@ -267,6 +388,7 @@ void sendnoteOn(uint8_t channel,uint8_t pitch, uint8_t velocity) {
 void sendnoteOff(uint8_t channel, uint8_t pitch,uint8_t velocity) {
   MIDIAddress midiaddress= {pitch,Channel_1 + (channel-1)};
   usbMIDI.sendNoteOff(midiaddress, velocity);
+  ++usbpending;
   serialMIDI.sendNoteOff(midiaddress, velocity);
 #ifdef BLUETOOTH
   bleMIDI.sendNoteOff(midiaddress, velocity);
@@ -279,7 +401,8 @@ void sendnoteOff(uint8_t channel, uint8_t pitch,uint8_t velocity) {
 
 void sendcontrolChange(uint8_t channel, uint8_t control, uint8_t value) {
   MIDIAddress midiaddress= {control,Channel_1 + (channel-1)};  
-  usbMIDI.sendControlChange(midiaddress, value); 
+  usbMIDI.sendControlChange(midiaddress, value);
+  ++usbpending;
   serialMIDI.sendControlChange(midiaddress, value); 
 #ifdef BLUETOOTH
   bleMIDI.sendControlChange(midiaddress, value); 
@@ -291,7 +414,8 @@ void sendcontrolChange(uint8_t channel, uint8_t control, uint8_t value) {
 
 void sendprogramChange(uint8_t channel, uint8_t value) {
   MIDIAddress midiaddress= {value,Channel_1 + (channel-1)};  // confusing way of sending MIDI messages
-  usbMIDI.sendProgramChange(midiaddress); 
+  usbMIDI.sendProgramChange(midiaddress);
+  ++usbpending;
   serialMIDI.sendProgramChange(midiaddress); 
 #ifdef BLUETOOTH
   bleMIDI.sendProgramChange(midiaddress); 
@@ -301,9 +425,18 @@ void sendprogramChange(uint8_t channel, uint8_t value) {
 
 // set up as include files because I'm too lazy to create proper header and .cpp files
 #include "scales.h"   //
+#include "noteoffs.h"
+#include "timing.h"
+#include "euclid.h"
 #include "seq.h"   // has to come after midi note on/of
-#include "menusystem.h"  // has to come after display and encoder objects creation
+#include "patterns.h"
+#include "autosave.h"
+#include "midilog.h"
 #include "MIDIcallbacks.h"
+#include "fasttext.h"
+#include "idle.h"
+#include "tasks.h"
+#include "menusystem.h"  // has to come after display and encoder objects creation
 
 // these functions are here to avoid forward references. should really do proper include files!
 
@@ -327,12 +460,14 @@ void flush_encoders(void) {
   rmenuenc.getValue();
 }
 
-// display rhythm divider value on OLED
+// display rhythm divider value on OLED - hits:steps if the divider is in Euclidean mode
 void showrhythm(int16_t r){
-  display.setCursor(SCREENWIDTH/NUM_CLOCKS*r,24);
-  display.print("     ");
-  display.setCursor(SCREENWIDTH/NUM_CLOCKS*r,24);
-  display.printf("/%d",rhythm[r].divider);
+  if (euclid[r].on) {
+    char pattern[8];
+    ft_format(pattern,sizeof(pattern),"%d:%d",euclid[r].hits,euclid[r].steps);
+    ft_printf(SCREENWIDTH/NUM_CLOCKS*r,24,1,"%-5s",pattern); // padded to 5 characters to erase the old value
+  }
+  else ft_printf(SCREENWIDTH/NUM_CLOCKS*r,24,1,"/%-4d",rhythm[r].divider); // padded to 5 characters to erase the old value
   updatedisplay();  
 }
 
@@ -343,12 +478,11 @@ void showrhythms(void) {
 
 // show note value on OLED
 void shownote(int16_t track, int16_t index){
-  display.setCursor(SCREENWIDTH/SEQ_STEPS*index,track*8); 
-  display.print("     ");
-  display.setCursor(SCREENWIDTH/SEQ_STEPS*index,track*8); 
+  char notename[8];
   int16_t notenumber=constrain(quantize(notes[track].val[index]+notes[track].root,scales[notes[track].scale],notes[track].root),0,127);
  // Serial.printf("track %d index %d notenumber %d note %d octave %d\n",track,index, notenumber,notenumber%12,notenumber/12-2);
-  display.printf("%s%d",notenames[notenumber%12],notenumber/12-2); 
+  ft_format(notename,sizeof(notename),"%s%d",notenames[notenumber%12],notenumber/12-2);
+  ft_printf(SCREENWIDTH/SEQ_STEPS*index,track*8,1,"%-5s",notename); // padded to 5 characters to erase the old value
   updatedisplay();   
 }
 
@@ -371,23 +505,35 @@ void showLEDs(void) {
   for (int16_t i=0; i< NUMENCODERS;++i) showLED(i);
 }
 
+bool fatal=false;  // fatalerror() has stopped the UI
+
+// flash all the encoder LEDs red - core 1 sends them
+void fatalflash(void) {
+  static bool on=false;
+  on=!on;
+  for (int16_t i=0;i<NUMENCODERS;++i) LEDS.setPixelColor(i,on ? LED_RED : LED_BLACK);
+}
+
+// stop the UI with an error message and flashing red LEDs. the sequencer on core 1 keeps running
 void fatalerror(const char * errorstring){
-  display.clearDisplay();
-  display.setTextSize(1);
-  display.setCursor(0,0);
-  display.printf("FATAL ERROR\n\n%s", errorstring);
-  updatedisplay();
-
-  while (1) {
-    for (int16_t i=0;i<NUMENCODERS;++i) LEDS.setPixelColor(i,LED_RED); // flashing red
-    LEDS.show();
-    delay(75);
-    for (int16_t i=0;i<NUMENCODERS;++i) LEDS.setPixelColor(i,LED_BLACK); // 
-    LEDS.show();
-    delay(75);
-  } 
+  splashing=false;
+  if (display.getBuffer()) {  // not if it's the display that failed
+    display.clearDisplay();
+    display.setTextSize(1);
+    display.setCursor(0,0);
+    display.printf("FATAL ERROR\n\n%s", errorstring);
+    updatedisplay();
+  }
+  fatal=true;
+  task_every(75,fatalflash);
 }
 
+#ifdef BENCHMARK
+#include "bench.h"
+#endif
+
+volatile bool core1go=false;  // set once MIDI is up and the session is restored
+
 void setup() {
   Serial.begin(115200);
 
@@ -403,23 +549,52 @@ void setup() {
   pinMode(RMENU_ENCB_IN, INPUT_PULLUP);    
   pinMode(RMENU_ENCSW_IN, INPUT_PULLUP); 
 
+// set up timer interrupt - the encoders are being scanned from here on
+  alarm_in_us(TIMER_MICROS);
+  bootstamp(BOOT_INPUTS);
+
+// MIDI comes up before anything slow. core 1 runs the ports and starts as soon as the session below is in
+  usbMIDI.disableTimeout();  // USB MIDI is only sent at usbflush()
+  usbMIDI.begin();
+  serialMIDI.begin();
+  // attach MIDI message handler functions
+  usbMIDI.setCallbacks(callback); // Attach the custom callbacks
+#ifdef BLUETOOTH
+  bleMIDI.setName("PicoRythmicon");
+  bleMIDI.begin();  // the radio takes a while to start so it goes after the wired ports
+  bleMIDI.setCallbacks(callback); // Attach the custom callbacks
+#endif
+
+// restore the pattern bank and the last session before core 1 starts clocking
+  bool fsok=LittleFS.begin(); // start up filesystem - an error can't be shown till the display is up
+  if (fsok) {
+    initpatterns();
+    bool bankloaded=loadbank();
+    if (!loadsession() && bankloaded) applypattern(&bank[patternselect-1]);
+  }
+  else initpatterns();
+  initautosave();
+  buildchannelmap(); // incoming MIDI channel to track lookup
+  initnoteoffs();
+  bootstamp(BOOT_SESSION);
+  core1go=true;  // core 1 takes over the clocks and MIDI from here
+
 // set up I2C pins - meant to use I2C0 controller but messed up the schematic pins so have to use I2C1
   Wire1.setSDA(PIN_WIRE_SDA);
   Wire1.setSCL(PIN_WIRE_SCL);
   Wire1.begin();
-
-// set up timer interrupt 
-  alarm_in_us(TIMER_MICROS);
  
   LEDS.begin(); // INITIALIZE NeoPixel strip object (REQUIRED)
-  LEDS.show();
+  showLEDs(); // show startup LED state - core 1 sends them
 
   // SSD1306_SWITCHCAPVCC = generate display voltage from 3.3V internally
   if(!display.begin(SSD1306_SWITCHCAPVCC, SCREEN_ADDRESS)) {
     Serial.println(F("SSD1306 allocation failed"));
-    fatalerror(""); // Don't proceed, loop forever
+    fatalerror(""); // Don't proceed - the sequencer still runs
+    return;
   }
   display.setRotation(2);
+  ft_init();  // fast text font table has to match the rotation
   display.clearDisplay();
   display.setTextSize(1);
 
@@ -427,27 +602,29 @@ void setup() {
   display.setCursor(16,10);
   display.printf("PicoRhythmicon\n"); // power on message
   display.display();
-  delay(3000);
-
- // display.setTextSize(1);
-
-#ifdef BLUETOOTH
-  bleMIDI.setName("PicoRythmicon");
-#endif
-
-  MIDI_Interface::beginAll();
-
-
-  displaytimer=millis(); // reset display blanking timer
+  if (!fsok) {
+    fatalerror("Can't mount FS");
+    return;
+  }
 
-  showLEDs(); // show startup LED state
+  // the sequencer screen is drawn in the buffer behind the power on message. the loop shows it after SPLASH_MS
+  // or the first display update from the UI shows it along with whatever it drew
+  splashing=true;
+  splashstart=millis();
+  display.clearDisplay();
   shownotes();
   showrhythms();
+  bootstamp(BOOT_DISPLAY);
 
-  // attach MIDI message handler functions
-  usbMIDI.setCallbacks(callback); // Attach the custom callbacks
-  bleMIDI.setCallbacks(callback); // Attach the custom callbacks
+  displaytimer=millis(); // reset display blanking timer
 
+#ifdef PROFILE
+  prof_init();
+#endif
+
+#ifdef BENCHMARK
+  runbenchmarks();
+#endif
 }
 
 // first Pico core does UI etc - not super time critical
@@ -456,6 +633,12 @@ void loop() {
   ClickEncoder::Button button;
   int16_t encvalue,edited_step,edited_val;
 
+  tasks_run();  // timers and UI waits
+  if (fatal) {  // nothing more for the UI to do
+    idle_wait();
+    return;
+  }
+  PROF_START(PROF_LOOP);
   if ((millis()-displaytimer) > DISPLAY_BLANK_MS) {
     UI_state=DISPLAYOFF;  // 
   } 
@@ -463,7 +646,6 @@ void loop() {
   if (menumode) {  // in menu mode we just loop here doing menus - a bit kludgy
 
     domenus();  // call the text menu state machine
-    batteryvoltage=analogRead(BATVOLTAGE)*BATTERY_SCALE; // update the battery voltage
     if ((lmenuenc.getButton() == ClickEncoder::Clicked) || (rmenuenc.getButton() == ClickEncoder::DoubleClicked) ) { // exit menu mode
       UI_state=RUN; // exiting text menus so force a redraw
       menumode=FALSE;
@@ -477,17 +659,33 @@ void loop() {
   
  if (!menumode) {  // do the UI state machine
 
-    if (rmenuenc.getButton() == ClickEncoder::Clicked) { // enter menu mode
+    button = rmenuenc.getButton();
+    if (button == ClickEncoder::Clicked) { // enter menu mode
       display.fillScreen(BLACK); // erase screen
+      splashing=false;  // the menu takes over the display straight away
       topmenuindex=0; // 
-      topmenu[topmenuindex].submenuindex=0;  // start from the first item
+      menupos[topmenuindex].submenuindex=0;  // start from the first item
       drawsubmenus();
-      drawselector(topmenu[topmenuindex].submenuindex);
+      drawselector(menupos[topmenuindex].submenuindex);
       updatedisplay();
       flush_encoders();   // toss any encoder messages
       menumode=TRUE; // shift button toggles onscreen menus
       UI_state=DISPLAYON; // because we will fall into the UI state machine below
     }
+#ifdef PROFILE
+    if (button == ClickEncoder::DoubleClicked) { // double click shows the profiler stats page
+      display.fillScreen(BLACK); // erase screen
+      topmenuindex=1; // 
+      menupos[topmenuindex].submenuindex=0;  // start from the first item
+      drawsubmenus();
+      drawselector(menupos[topmenuindex].submenuindex);
+      updatedisplay();
+      flush_encoders();   // toss any encoder messages
+      prof_dump();
+      menumode=TRUE;
+      UI_state=DISPLAYON; // because we will fall into the UI state machine below
+    }
+#endif
 
 // UI state machine
     switch (UI_state) {
@@ -530,7 +728,7 @@ void loop() {
     }
 
     if (button == ClickEncoder::DoubleClicked) { // sync sequencers
-      rp2040.fifo.push(0);  // send a sync message to other core which runs sequencers
+      rp2040.fifo.push(FIFO_SYNC);  // send a sync message to other core which runs sequencers
       UI_state=DISPLAYON; // redraw screen if it was blanked
     }
 
@@ -555,20 +753,59 @@ void loop() {
     }
     for (int16_t i=NTRACKS*NUM_CLOCKS; i< NUMENCODERS;++i) { // last 4 encoders set clock dividers
       int16_t val;
+      int16_t clk=i%NUM_CLOCKS;
+      button = enc[i].getButton();
+      if (button == ClickEncoder::Clicked) { // toggle Euclidean mode
+        euclid[clk].on=!euclid[clk].on;
+        showrhythm(clk);
+        UI_state=DISPLAYON; // redraw screen if it was blanked
+      }
       if ((val=enc[i].getValue()) !=0) { // change clock dividers if encoder changed
-        rhythm[i%NUM_CLOCKS].divider=constrain(rhythm[i%NUM_CLOCKS].divider-val,1,MAX_DIVIDER); // divider range is 1-16, CCW increases divider as on SubHarmonicon
-        showrhythm(i%NUM_CLOCKS);
+        if (!euclid[clk].on) rhythm[clk].divider=constrain(rhythm[clk].divider-val,1,MAX_DIVIDER); // divider range is 1-16, CCW increases divider as on SubHarmonicon
+        else { // Euclidean mode - turning sets the hits, held down and turning sets the steps
+          if (button == ClickEncoder::Held) euclid[clk].steps=constrain(euclid[clk].steps+val,1,EUCLID_MAX);
+          else euclid[clk].hits=constrain(euclid[clk].hits+val,0,euclid[clk].steps);
+          euclidupdate(clk);
+        }
+        showrhythm(clk);
         UI_state=DISPLAYON; // redraw screen if it was blanked
       }
     }
   }
-
+  if (patternswapped) {  // core 1 switched patterns - show the new notes and dividers
+    patternswapped=false;
+    if (!menumode) {
+      shownotes();
+      showrhythms();
+    }
+  }
+  batteryservice();
+  autosave_service();  // write changed settings to flash when core 1 can spare it
+  if (splashdone()) updatedisplay();  // power on message has been up long enough
+  PROF_END(PROF_LOOP);
+
+  midilog_drain(); // print any MIDI diagnostics the callbacks on core 1 have queued up
+
+#ifdef PROFILE
+  if (prof_tick()) {
+    usbstats();
+    scanstats();
+    idlestats();
+    outstats();
+    if (menumode && (topmenuindex == 1) && (menustate == SUBSELECT)) { // new stats - redraw unless a value is being "edited"
+      drawsubmenus();
+      drawselector(menupos[topmenuindex].submenuindex);
+    }
+  }
+#endif
+  idle_wait();  // sleep till the next scan or FIFO interrupt - core 1 keeps running the sequencer
 }
 
 // second core setup
 // second core dedicated to clock and MIDI processing
 void setup1() {
-  delay (1000); // wait for main core to start up peripherals
+  while (!core1go) tight_loop_contents(); // wait for the main core to bring up MIDI and restore the session
+  bootstamp(BOOT_MIDI);
 
 }
 
@@ -578,19 +815,38 @@ void setup1() {
 // shift + start button resyncs sequencers
 void loop1(){
 
-  LEDS.show(); // update LED display
+  PROF_START(PROF_LOOP1);
+  PROF_START(PROF_LEDSHOW);
+  showleds(); // update LED display if anything changed
+  PROF_END(PROF_LEDSHOW);
 
+  PROF_START(PROF_MIDI);
   MIDI_Interface::updateAll(); // Update the Control Surface MIDI interfaces
+  PROF_END(PROF_MIDI);
 
 // multicore safe messages from core1 to core2 via the fifo
 
   while (rp2040.fifo.available()) { // get MIDI command, channel# = voice#
-    rp2040.fifo.pop(); // only one command - sync
-    sync_sequencers();
-    showLEDs();  // update LEDs which probably changed
+    uint32_t command=rp2040.fifo.pop();
+    if (command & FIFO_PATTERN) {  // stage a pattern - it's swapped in at the next switch point
+      patternstage=bank[command & (FIFO_PATTERN-1)];
+      patternqueued=true;
+    }
+    else {
+      sync_sequencers();
+      showLEDs();  // update LEDs which probably changed
+    }
   }
 
   if (controlstate==RUNNING) do_clocks();
-
+  else {
+    patternswap();  // stopped - no need to wait for a boundary
+    clocktimer=micros();  // first tick goes as soon as we start
+  }
+  noteoff_service();   // end the notes whose gate is up
+  outqueue_service();  // send the notes that are due
+  autosave_park();     // out of the way in RAM if core 0 is saving and nothing is due
+  usbflush();  // all the notes from this tick and the MIDI callbacks go out in one USB transfer
+  PROF_END(PROF_LOOP1);
 }
 
@@ -0,0 +1,198 @@
+// background autosave for the PicoRhythmicon
+// writing flash stops code running from flash on both cores, so a save in the middle of a tick would freeze the sequencer
+// mid-note. saves here are never started from the menu directly:
+// - the live settings are compared with what was last saved every AUTOSAVE_CHECK_MS, so any change from the encoders or menus
+//   is picked up without every edit having to flag it. a save waits until nothing has changed for AUTOSAVE_QUIET_MS
+//   so a burst of edits becomes one write
+// - while the sequencer is running core 0 asks core 1 to park. core 1 parks right after a tick when no divider pulse, note
+//   on or note off is due for FLASH_GAP_US, spinning in a function that runs from RAM until the write is done. ticks
+//   between pulses don't start notes so they can wait
+// - each park writes one small file - the session is under 100 bytes and the pattern bank under 1K - so the flash work
+//   is a single erase block and a few pages, and fits the gap core 1 found. if both need saving the bank waits for the next gap
+// - after the write core 1 catches up the ticks it missed on their original grid (see do_clocks()), so the sequence
+//   doesn't slip - notes due during the save just go out late
+// the session is loaded at power on so the unit comes back the way it was left
+
+#define SESSION_FILE "session.bin"
+#define AUTOSAVE_CHECK_MS 500   // how often the live settings are compared with the saved ones
+#define AUTOSAVE_QUIET_MS 3000  // a save waits this long after the last change
+#define AUTOSAVE_RETRY_MS 10000 // wait before trying again after a failed write
+#define PARK_TIMEOUT_MS 2000    // give up waiting for a gap and save anyway
+#define FLASH_GAP_US 50000      // core 1 only parks if nothing is due for this long - one file's erase (45ms typical) and pages
+
+// everything that isn't in a pattern but should survive power off
+struct sessiondata {
+  char id[4];
+  struct pattern live;  // what the encoders are set to now
+  int16_t bpm;
+  int16_t switchpoint;
+  int16_t patternselect;
+  int16_t swing[NUM_CLOCKS];
+  int16_t trackdelay[NTRACKS];
+  int16_t gate[NTRACKS];
+  int16_t gatems[NTRACKS];
+  int16_t midiin[NTRACKS];
+  int16_t midiout[NTRACKS];
+};
+
+struct sessiondata sessionsaved;  // last written - or loaded - session
+struct sessiondata sessionlast;   // session at the last check
+uint32_t autosavecheck;   // time of the last check
+uint32_t sessionchanged;  // time the session last changed
+bool sessiondirty=false;
+uint32_t saveretry;       // time of the last failed write
+
+enum SAVESTATES {SAVE_IDLE,SAVE_PARKING};
+int16_t savestate=SAVE_IDLE;
+uint32_t parktime;        // when core 1 was asked to park
+volatile bool parkrequest=false;  // core 0 wants flash to itself
+volatile bool core1parked=false;  // core 1 is spinning in RAM
+
+#ifdef PROFILE
+int16_t savestall;  // longest time core 1 has been parked for a save in ms
+#endif
+
+void getsession(struct sessiondata * s) {
+  memset(s,0,sizeof(struct sessiondata));  // padding too so memcmp works
+  memcpy(s->id,"RHS2",4);
+  getpattern(&s->live);
+  s->bpm=bpm;
+  s->switchpoint=switchpoint;
+  s->patternselect=patternselect;
+  for (int16_t clk=0; clk< NUM_CLOCKS;++clk) s->swing[clk]=swing[clk];
+  for (int16_t track=0; track< NTRACKS;++track) {
+    s->trackdelay[track]=trackdelay[track];
+    s->gate[track]=notes[track].gate;
+    s->gatems[track]=notes[track].gatems;
+    s->midiin[track]=MIDIinputchannel[track];
+    s->midiout[track]=MIDIoutputchannel[track];
+  }
+}
+
+void applysession(struct sessiondata * s) {
+  applypattern(&s->live);
+  bpm=constrain(s->bpm,20,240);
+  switchpoint=constrain(s->switchpoint,(int16_t)SWITCH_BAR,(int16_t)SWITCH_CYCLE);
+  patternselect=constrain(s->patternselect,1,NUM_PATTERNS);
+  for (int16_t clk=0; clk< NUM_CLOCKS;++clk) swing[clk]=constrain(s->swing[clk],SWING_STRAIGHT,SWING_MAX);
+  for (int16_t track=0; track< NTRACKS;++track) {
+    trackdelay[track]=constrain(s->trackdelay[track],0,OFFSET_MAX_US);
+    notes[track].gate=constrain(s->gate[track],1,100);
+    notes[track].gatems=constrain(s->gatems[track],0,GATE_MAX_MS);
+    MIDIinputchannel[track]=constrain(s->midiin[track],1,16);
+    MIDIoutputchannel[track]=constrain(s->midiout[track],1,16);
+  }
+}
+
+// load the last session - call at startup before core 1 runs. returns false if there isn't one
+bool loadsession(void) {
+  struct sessiondata s;
+  File file=LittleFS.open(SESSION_FILE,"r");
+  if (!file) return false;
+  bool ok=(file.size() == sizeof(s)) && (file.read((uint8_t *)&s,sizeof(s)) == sizeof(s)) && !memcmp(s.id,"RHS2",4);
+  file.close();
+  if (!ok) return false;
+  applysession(&s);
+  return true;
+}
+
+bool savesession(struct sessiondata * s) {
+  File file=LittleFS.open(SESSION_FILE,"w");  // "w" truncates - one write and no separate remove
+  if (!file) return false;
+  bool ok=file.write((uint8_t *)s,sizeof(struct sessiondata)) == sizeof(struct sessiondata);
+  file.close();
+  return ok;
+}
+
+// when the next pulse of a divider any track is clocked from is due
+uint32_t nextpulse(void) {
+  uint32_t ticks=0xffffffff;
+  for (int16_t clk=0; clk< NUM_CLOCKS;++clk) {
+    bool used=false;
+    for (int16_t track=0; track< NTRACKS;++track) used|=rhythmclks[track][clk];
+    if (!used) continue;
+    uint32_t t=(uint32_t)(rhythm[clk].counter-1)*PPQN_DIV+rhythm[clk].ppqn_counter;  // the tick it's clocked on, counting the next as 1
+    if (t < ticks) ticks=t;
+  }
+  if (ticks == 0xffffffff) return clocktimer+FLASH_GAP_US;  // nothing routed - no notes to wait for
+  return clocktimer+(ticks-1)*tickperiod;
+}
+
+// core 1 side - park in RAM if core 0 is waiting to save and this is a quiet moment
+// called from loop1 right after the tick and the output stage have run
+bool flashgap(void) {
+  if (controlstate != RUNNING) return true;
+  uint32_t now=micros();
+  if (patternqueued && ((int32_t)(clocktimer-now) < FLASH_GAP_US)) return false;  // a swap on the next tick restarts the dividers
+  if ((int32_t)(nextpulse()-now) < FLASH_GAP_US) return false;  // a divider pulse could start a note
+  if (outcount && ((int32_t)(outqueue[0].due-now) < FLASH_GAP_US)) return false;  // a note on is due
+  for (int16_t slot=0; slot< WHEEL_SLOTS;++slot) {  // a note off is due
+    for (int16_t i=wheel[slot]; i >= 0; i=noteoffs[i].next) {
+      if ((int32_t)(noteoffs[i].due-now) < FLASH_GAP_US) return false;
+    }
+  }
+  return true;
+}
+
+void __not_in_flash_func(parkcore1)(void) {
+  core1parked=true;
+  while (parkrequest) tight_loop_contents();  // nothing from flash in here
+  core1parked=false;
+}
+
+void autosave_park(void) {
+  if (!parkrequest || !flashgap()) return;
+#ifdef PROFILE
+  uint32_t start=micros();
+  parkcore1();
+  uint32_t stall=(micros()-start)/1000;
+  if (stall > (uint32_t)savestall) savestall=prof_clip(stall);
+#else
+  parkcore1();
+#endif
+}
+
+// core 0 side - write whatever needs saving once core 1 is out of the way. call from loop
+void autosave_service(void) {
+  if (savestate == SAVE_PARKING) {
+    if (!core1parked && ((millis()-parktime) < PARK_TIMEOUT_MS)) return;  // still waiting for a gap
+    bool ok=true;
+    if (sessiondirty) {
+      if (savesession(&sessionlast)) {
+        sessionsaved=sessionlast;
+        sessiondirty=false;
+      }
+      else ok=false;
+    }
+    else if (bankdirty) {  // one file a park
+      if (savebank()) bankdirty=false;
+      else ok=false;
+    }
+    parkrequest=false;  // let core 1 go
+    if (!ok) saveretry=millis();
+    savestate=SAVE_IDLE;
+    return;
+  }
+  if ((millis()-autosavecheck) < AUTOSAVE_CHECK_MS) return;
+  autosavecheck=millis();
+  struct sessiondata s;
+  getsession(&s);
+  if (memcmp(&s,&sessionlast,sizeof(s))) {  // changed since the last check - wait for it to settle
+    sessionlast=s;
+    sessionchanged=millis();
+  }
+  sessiondirty=memcmp(&sessionlast,&sessionsaved,sizeof(s)) != 0;
+  if (!sessiondirty && !bankdirty) return;
+  if ((millis()-sessionchanged) < AUTOSAVE_QUIET_MS) return;
+  if (saveretry && ((millis()-saveretry) < AUTOSAVE_RETRY_MS)) return;
+  saveretry=0;
+  parktime=millis();
+  parkrequest=true;
+  savestate=SAVE_PARKING;
+}
+
+// the settings as loaded at power on count as saved
+void initautosave(void) {
+  getsession(&sessionsaved);
+  sessionlast=sessionsaved;
+}
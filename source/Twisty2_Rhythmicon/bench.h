@@ -0,0 +1,150 @@
+// Copyright 2026 Rich Heslip
+//
+// Author: Rich Heslip
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+// See http://creativecommons.org/licenses/MIT/ for more information.
+//
+// -----------------------------------------------------------------------------
+
+// microbenchmarks for the PicoRhythmicon hot paths
+// uncomment #define BENCHMARK in the main source file to run these once at the end of setup()
+// the RP2040 microsecond timer is the clock. the encoder scan interrupt is turned off and the sequencer is stopped while timing so they don't skew the numbers
+// results go out the USB serial port as one JSON object per line so runs from different revisions can be diffed or parsed by a script
+// allocs is how many times the run called new - none of the hot paths should. new and delete are replaced here to count
+// them, which catches LittleFS File objects and String. a plain malloc() isn't counted
+// the first line is the memory map from the linker: flash is the whole image, data is initialized RAM (copied from flash
+// at power on), bss is zeroed RAM and heap is what's left for malloc
+// the last line is a checksum of what the benchmarks that work something out came up with - printing it is what stops the
+// compiler from throwing that work away
+
+uint32_t bench_start_us;
+uint32_t benchallocs;  // calls to new since power on
+uint32_t bench_start_allocs;
+
+void * operator new(size_t size) {
+  ++benchallocs;
+  return malloc(size);
+}
+
+void * operator new[](size_t size) {
+  ++benchallocs;
+  return malloc(size);
+}
+
+void operator delete(void * p) noexcept { free(p); }
+void operator delete[](void * p) noexcept { free(p); }
+void operator delete(void * p, size_t) noexcept { free(p); }
+void operator delete[](void * p, size_t) noexcept { free(p); }
+
+void bench_begin(void) {
+  bench_start_allocs=benchallocs;
+  bench_start_us=timer_hw->timerawl;
+}
+
+void bench_end(const char * name, uint32_t iterations) {
+  uint32_t elapsed=timer_hw->timerawl - bench_start_us;
+  uint32_t allocs=benchallocs - bench_start_allocs;
+  Serial.printf("{\"fw\":\"Rhythmicon\",\"build\":\"%s %s\",\"bench\":\"%s\",\"iters\":%lu,\"ns_per_op\":%lu,\"allocs\":%lu}\n",
+    __DATE__,__TIME__,name,(unsigned long)iterations,(unsigned long)((uint64_t)elapsed*1000/iterations),(unsigned long)allocs);
+}
+
+// run statement s n times and report it
+#define BENCH(name,n,s) { bench_begin(); for (uint32_t _i=0;_i<(n);++_i) { s; } bench_end(name,n); }
+
+// section bounds from the linker script
+extern "C" char __flash_binary_start[],__flash_binary_end[];
+extern "C" char __data_start__[],__data_end__[],__bss_start__[],__bss_end__[];
+
+void bench_memory(void) {
+  Serial.printf("{\"fw\":\"Rhythmicon\",\"build\":\"%s %s\",\"flash\":%lu,\"data\":%lu,\"bss\":%lu,\"heap_free\":%d}\n",
+    __DATE__,__TIME__,(unsigned long)(__flash_binary_end-__flash_binary_start),(unsigned long)(__data_end__-__data_start__),
+    (unsigned long)(__bss_end__-__bss_start__),rp2040.getFreeHeap());
+}
+
+uint32_t benchsum;  // results folded together for the checksum line
+
+void bench_checksum(void) {
+  Serial.printf("{\"fw\":\"Rhythmicon\",\"build\":\"%s %s\",\"checksum\":%lu}\n",__DATE__,__TIME__,(unsigned long)benchsum);
+}
+
+void runbenchmarks(void) {
+  int16_t savedstate=controlstate;
+
+  while (!Serial) delay(10);  // wait for USB connection so the results aren't lost
+  bench_memory();
+  controlstate=IDLE;  // stop core 1 clocking the sequencers while we do it here
+  irq_set_enabled(ALARM_IRQ, false);  // stop the encoder scan while timing
+
+  BENCH("ClickEncoder::service",10000,enc[0].service());
+  BENCH("ClickEncoder::service x18",1000,for (int e=0;e<NUMENCODERS;++e) enc[e].service(); lmenuenc.service(); rmenuenc.service());
+  BENCH("ClickEncoder::getValue",10000,enc[0].getValue());
+  BENCH("scan_encoders",1000,scan_encoders());  // the scan alarm_irq does, mux settling delays and all, without rearming the alarm
+
+  BENCH("quantize",10000,benchsum+=quantize(_i & 0x7f,scales[_i % 10],60));
+  BENCH("clocktick",PPQN*64,clocktick(); usbflush());  // 16 bars with the default clock routing - includes the MIDI sends
+  all_notes_off();
+  usbflush();
+  sync_sequencers();
+
+  euclid[0].on=1;
+  BENCH("euclidhit",10000,benchsum+=euclidhit(0));
+  euclid[0].on=0;
+  euclidgen savedeuclid[NUM_CLOCKS];
+  memcpy(savedeuclid,euclid,sizeof(euclid));
+  for (int16_t clk=0; clk< NUM_CLOCKS;++clk) {  // E(5,16) on every divider
+    euclid[clk].on=1;
+    euclid[clk].steps=16;
+    euclid[clk].hits=5;
+    euclidupdate(clk);
+  }
+  BENCH("clocktick euclid",PPQN*64,clocktick(); usbflush());
+  memcpy(euclid,savedeuclid,sizeof(euclid));
+  all_notes_off();
+  usbflush();
+  sync_sequencers();
+
+  BENCH("showLED",10000,showLED(0));
+  BENCH("showLEDs",1000,showLEDs());
+  BENCH("LEDS.show",100,LEDS.show());
+
+  // these all end in a display update so they include the I2C transfer
+  BENCH("shownote",100,shownote(0,0));
+  BENCH("shownotes",10,shownotes());
+  BENCH("showrhythm",100,showrhythm(0));
+  BENCH("showrhythms",10,showrhythms());
+  topmenuindex=0;
+  menupos[topmenuindex].submenuindex=0;
+  BENCH("drawsubmenu",100,drawsubmenu(0));
+  BENCH("drawsubmenus",100,drawsubmenus());
+  BENCH("display.display",100,display.display());
+
+  // text drawing into the frame buffer only - fast path against GFX
+  BENCH("ft_printf size 1",1000,ft_printf(0,8,1,"%-5s","C#3"));
+  BENCH("GFX printf size 1",1000,display.setCursor(0,8); display.printf("%-5s","C#3"));
+
+  irq_set_enabled(ALARM_IRQ, true);
+  display.clearDisplay();
+  showLEDs();
+  shownotes();
+  showrhythms();
+  controlstate=savedstate;
+  bench_checksum();
+}
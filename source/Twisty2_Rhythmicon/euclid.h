@@ -0,0 +1,117 @@
+// Euclidean rhythms for the PicoRhythmicon
+// each clock divider can spread a number of hits as evenly as possible over a number of its pulses instead of firing on
+// every pulse - 3 hits over 8 steps is the tresillo, 5 over 8 the cinquillo and so on
+// the patterns come from Bjorklund's algorithm. every pattern up to EUCLID_MAX steps is worked out by the compiler and
+// kept in flash as a bitmask, step 0 in bit 0. when a setting changes the pattern is rotated into euclid[].mask, so on a
+// divider pulse core 1 just tests a bit - nothing is worked out while the sequencer runs
+// the divider still sets the step rate - the pattern picks which of its pulses clock the tracks
+
+#define EUCLID_MAX 32  // longest pattern - has to fit a uint32_t
+
+// Bjorklund's algorithm with each group of steps kept as bits plus a length
+// start with k groups of "1" and n-k of "0". pair the front groups with the back ones until there is at most one left over
+constexpr uint32_t bjorklund(int16_t steps, int16_t hits) {
+  if (hits <= 0) return 0;
+  if (hits >= steps) return (steps >= 32) ? 0xffffffff : ((1u << steps)-1);
+  uint32_t bits[EUCLID_MAX]={};
+  int16_t len[EUCLID_MAX]={};
+  for (int16_t i=0; i< steps;++i) {
+    bits[i]=(i < hits) ? 1 : 0;
+    len[i]=1;
+  }
+  int16_t front=hits;        // groups at the front
+  int16_t back=steps-hits;   // groups after them
+  while (back > 1) {
+    int16_t pairs=(front < back) ? front : back;
+    for (int16_t i=0; i< pairs;++i) {
+      bits[i]|=bits[front+i] << len[i];
+      len[i]+=len[front+i];
+    }
+    int16_t left=front-pairs;  // leftover front groups are already in place after the pairs
+    if (front <= back) {  // leftover back groups move up behind the pairs
+      left=back-pairs;
+      for (int16_t i=0; i< left;++i) {
+        bits[pairs+i]=bits[front+pairs+i];
+        len[pairs+i]=len[front+pairs+i];
+      }
+    }
+    front=pairs;
+    back=left;
+  }
+  uint32_t pattern=0;
+  int16_t n=0;
+  for (int16_t i=0; i< front+back;++i) {
+    pattern|=bits[i] << n;
+    n+=len[i];
+  }
+  return pattern;
+}
+
+struct euclidtables {
+  uint32_t mask[EUCLID_MAX+1][EUCLID_MAX+1];  // [steps][hits]
+};
+
+constexpr euclidtables makeeuclidtables(void) {
+  euclidtables t={};
+  for (int16_t steps=1; steps <= EUCLID_MAX;++steps) {
+    for (int16_t hits=0; hits <= steps;++hits) t.mask[steps][hits]=bjorklund(steps,hits);
+  }
+  return t;
+}
+
+constexpr euclidtables euclidtable=makeeuclidtables();
+
+static_assert(euclidtable.mask[8][3] == 0x49, "E(3,8) should be x..x..x.");
+static_assert(euclidtable.mask[8][5] == 0x6d, "E(5,8) should be x.xx.xx.");
+static_assert(euclidtable.mask[16][4] == 0x1111, "E(4,16) should be four on the floor");
+
+// settings for each clock divider - anything modified by a menu must be int16
+struct euclidgen {
+  int16_t on;      // 0 - every pulse clocks the tracks
+  int16_t steps;   // pattern length in divider pulses
+  int16_t hits;    // pulses in the pattern that clock the tracks
+  int16_t rotate;  // the pattern starts this many steps in
+  int16_t pos;     // step the next pulse plays - only core 1 touches it
+  uint32_t mask;   // rotated pattern, step 0 in bit 0
+};
+
+euclidgen euclid[NUM_CLOCKS] = {
+  0,8,3,0,0,0x49,
+  0,8,3,0,0,0x49,
+  0,8,3,0,0,0x49,
+  0,8,3,0,0,0x49,
+};
+
+// keep a divider's settings in range and rotate its pattern into place - call after anything changes them
+void euclidupdate(int16_t clk) {
+  euclidgen * e=&euclid[clk];
+  e->steps=constrain(e->steps,1,EUCLID_MAX);
+  e->hits=constrain(e->hits,0,e->steps);
+  e->rotate=constrain(e->rotate,0,e->steps-1);
+  uint32_t m=euclidtable.mask[e->steps][e->hits];
+  if (e->rotate) {
+    m=(m >> e->rotate) | (m << (e->steps-e->rotate));
+    if (e->steps < 32) m&=(1u << e->steps)-1;
+  }
+  e->mask=m;
+}
+
+// menu handler
+void euclidedit(void) {
+  for (int16_t clk=0; clk< NUM_CLOCKS;++clk) euclidupdate(clk);
+}
+
+// true if this pulse of the divider should clock the tracks - called on core 1 for every divider pulse
+bool euclidhit(int16_t clk) {
+  euclidgen * e=&euclid[clk];
+  if (!e->on) return true;
+  if (e->pos >= e->steps) e->pos=0;  // pattern was shortened from the menu
+  bool hit=(e->mask >> e->pos) & 1;
+  if (++e->pos >= e->steps) e->pos=0;
+  return hit;
+}
+
+// start every pattern over from its first step
+void euclidrestart(void) {
+  for (int16_t clk=0; clk< NUM_CLOCKS;++clk) euclid[clk].pos=0;
+}
@@ -0,0 +1,169 @@
+// fast text for the SSD1306
+// Adafruit GFX draws every character pixel by pixel through drawPixel() with clipping and rotation on each pixel
+// text that starts on an 8 pixel page boundary can instead be copied into the display buffer a whole font column byte at a time
+// ft_init() renders the GFX 6x8 font once into a table of column bytes already flipped for the display rotation
+// size 2 text doubles each column byte with a nibble lookup so it covers two pages
+// anything else - unaligned y, other sizes or rotations - falls back to GFX so it still looks the same
+// ft_format() is a small printf that only does %d %u %s %c with width, '-' and '0' flags - no floats and no heap
+
+#define FT_FIRST 32   // first character in the table
+#define FT_CHARS 96   // printable ASCII
+#define FT_WIDTH 6    // 5 pixel glyph plus a blank column, same as GFX
+
+uint8_t ftfont[FT_CHARS][FT_WIDTH];  // column bytes in display buffer bit order
+bool ftfast=false;    // display rotation is one we can blit
+bool ftflip;          // rotation 2 - columns run right to left and rows bottom to top
+int16_t ftwidth;      // display width in pixels
+int16_t ftpages;      // display height in 8 pixel pages
+
+// 4 bits to 8 with each bit doubled - for size 2 text
+const uint8_t ftdouble[16] = {0x00,0x03,0x0c,0x0f,0x30,0x33,0x3c,0x3f,0xc0,0xc3,0xcc,0xcf,0xf0,0xf3,0xfc,0xff};
+
+// build the font table - call after display.begin() and setRotation()
+void ft_init(void) {
+  GFXcanvas1 glyph(FT_WIDTH,8);
+  ftwidth=display.width();
+  ftpages=display.height()/8;
+  ftflip=(display.getRotation() == 2);
+  ftfast=(display.getRotation() == 0) || ftflip;
+  for (int16_t c=0; c<FT_CHARS; ++c) {
+    glyph.fillScreen(BLACK);
+    glyph.drawChar(0,0,c+FT_FIRST,WHITE,BLACK,1);
+    for (int16_t x=0; x<FT_WIDTH; ++x) {
+      uint8_t col=0;
+      for (int16_t y=0; y<8; ++y) {
+        if (glyph.getPixel(x,y)) col |= ftflip ? (0x80 >> y) : (1 << y);
+      }
+      ftfont[c][x]=col;
+    }
+  }
+}
+
+// store one column byte at logical column x and page
+void ft_putcolumn(uint8_t * buf, int16_t x, int16_t page, uint8_t col) {
+  if ((x < 0) || (x >= ftwidth) || (page < 0) || (page >= ftpages)) return;
+  if (ftflip) buf[(ftpages-1-page)*ftwidth+ftwidth-1-x]=col;
+  else buf[page*ftwidth+x]=col;
+}
+
+// print a string at x,y in size 1 or 2. returns the x position after the text
+int16_t ft_print(int16_t x, int16_t y, const char * s, uint8_t textsize) {
+  if (!ftfast || (y & 7) || (textsize < 1) || (textsize > 2)) { // GFX does the odd cases
+    display.setTextSize(textsize);
+    display.setCursor(x,y);
+    display.print(s);
+    display.setTextSize(1);
+    return x+strlen(s)*FT_WIDTH*textsize;
+  }
+  uint8_t * buf=display.getBuffer();
+  int16_t page=y/8;
+  for (; *s; ++s) {
+    uint8_t c=*s-FT_FIRST;
+    if (c >= FT_CHARS) c='?'-FT_FIRST;
+    for (int16_t i=0; i<FT_WIDTH; ++i) {
+      uint8_t col=ftfont[c][i];
+      if (textsize == 1) ft_putcolumn(buf,x++,page,col);
+      else {
+        uint8_t top=ftflip ? ftdouble[col >> 4] : ftdouble[col & 0x0f];
+        uint8_t bottom=ftflip ? ftdouble[col & 0x0f] : ftdouble[col >> 4];
+        for (int16_t j=0; j<2; ++j,++x) {
+          ft_putcolumn(buf,x,page,top);
+          ft_putcolumn(buf,x,page+1,bottom);
+        }
+      }
+    }
+  }
+  return x;
+}
+
+// blank w pixels starting at x,y for a line of text in size 1 or 2
+void ft_clear(int16_t x, int16_t y, int16_t w, uint8_t textsize) {
+  if (!ftfast || (y & 7)) {
+    display.fillRect(x,y,w,8*textsize,BLACK);
+    return;
+  }
+  uint8_t * buf=display.getBuffer();
+  for (int16_t p=y/8; p<(y/8+textsize); ++p)
+    for (int16_t i=x; i<(x+w); ++i) ft_putcolumn(buf,i,p,0);
+}
+
+// minimal vsnprintf - %d %u %s %c %% with optional '-' or '0' flag and width. always terminates buf
+int16_t ft_vformat(char * buf, int16_t size, const char * fmt, va_list args) {
+  int16_t len=0;
+  for (; *fmt && (len < size-1); ++fmt) {
+    if (*fmt != '%') {
+      buf[len++]=*fmt;
+      continue;
+    }
+    ++fmt;
+    bool left=false, zero=false;
+    if (*fmt == '-') { left=true; ++fmt; }
+    if (*fmt == '0') { zero=true; ++fmt; }
+    int16_t width=0;
+    while ((*fmt >= '0') && (*fmt <= '9')) width=width*10+(*fmt++ - '0');
+    char digits[12];
+    const char * field=digits;
+    int16_t n=0;
+    switch (*fmt) {
+      case 'd':
+      case 'u':
+        {
+          int32_t v=va_arg(args,int);
+          uint32_t u=((*fmt == 'd') && (v < 0)) ? -(uint32_t)v : (uint32_t)v;
+          char * p=&digits[sizeof(digits)];
+          do {
+            *--p='0'+u%10;
+            u/=10;
+          } while (u);
+          if ((*fmt == 'd') && (v < 0)) *--p='-';
+          field=p;
+          n=&digits[sizeof(digits)]-p;
+        }
+        break;
+      case 's':
+        field=va_arg(args,const char *);
+        n=strlen(field);
+        break;
+      case 'c':
+        digits[0]=va_arg(args,int);
+        n=1;
+        break;
+      case '%':
+        digits[0]='%';
+        n=1;
+        break;
+      default:  // unsupported - give up on the rest
+        buf[len]=0;
+        return len;
+    }
+    int16_t pad=width-n;
+    if (zero && !left && (pad > 0) && (*field == '-')) { // zero padding goes after the sign
+      if (len < size-1) buf[len++]='-';
+      ++field;
+      --n;
+    }
+    while (!left && (pad-- > 0) && (len < size-1)) buf[len++]=zero ? '0' : ' ';
+    while ((n-- > 0) && (len < size-1)) buf[len++]=*field++;
+    while (left && (pad-- > 0) && (len < size-1)) buf[len++]=' ';
+  }
+  buf[len]=0;
+  return len;
+}
+
+int16_t ft_format(char * buf, int16_t size, const char * fmt, ...) {
+  va_list args;
+  va_start(args,fmt);
+  int16_t len=ft_vformat(buf,size,fmt,args);
+  va_end(args);
+  return len;
+}
+
+// formatted print at x,y. returns the x position after the text
+int16_t ft_printf(int16_t x, int16_t y, uint8_t textsize, const char * fmt, ...) {
+  char text[32];  // wider than the display in size 1
+  va_list args;
+  va_start(args,fmt);
+  ft_vformat(text,sizeof(text),fmt,args);
+  va_end(args);
+  return ft_print(x,y,text,textsize);
+}
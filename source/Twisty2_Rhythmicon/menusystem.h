@@ -77,20 +77,31 @@ struct submenu {
   int16_t max;  // max value of parameter
   int16_t step; // step size. if 0, don't print ie spacer
   enum paramtype ptype; // how its displayed
-  const char ** ptext;   // points to array of text for text display
+  const char * const * ptext;   // points to array of text for text display
   int16_t *parameter; // value to modify
   void (*handler)(void);  // function to call on value change
-//  void (*exithandler)(void);  // function to call on exiting value change
+  void (*exithandler)(void);  // function to call on exiting value change
 };
 
 // top menus
+// the menu tables and the text they point to are all const so they stay in flash - the only thing that changes as the
+// menus are used is which item is selected, and that's kept in menupos[]
 struct menu {
    const char *name; // menu text
-   struct submenu * submenus; // points to submenus for this menu
-   int8_t submenuindex;   // stores the index of the submenu we are currently using
+   const struct submenu * submenus; // points to submenus for this menu
    int8_t numsubmenus; // number of submenus - not sure why this has to be int but it crashes otherwise. compiler bug?
 };
 
+struct menuposition {
+   int8_t submenuindex;   // stores the index of the submenu we are currently using
+};
+
+// number of items in a submenu array, checked at compile time against the int8_t indexes
+template <size_t N> constexpr int8_t menuitems(const struct submenu (&)[N]) {
+  static_assert(N < 128,"too many items for one menu");
+  return N;
+}
+
 // timer and flag for managing temporary messages
 #define MESSAGE_TIMEOUT 1500
 long messagetimer;
@@ -106,52 +117,131 @@ void dummy( void) {}
 // ********** menu structs that build the menu system below *********
 
 // text arrays used for submenu TYPE_TEXT fields
-const char * textoffon[] = {"   Off", "    On"};
-const char * textstepmode[] = {" Fwd", " Rev","Pong","Walk","Rand"};
+const char * const textoffon[] = {"   Off", "    On"};
+const char * const textstepmode[] = {" Fwd", " Rev","Pong","Walk","Rand"};
+const char * const textswitchpoint[] = {"   Bar"," Cycle"};
 //{CHROMATIC,MAJOR,MINOR,HARMONIC_MINOR,MAJOR_PENTATONIC,MINOR_PENTATONIC,DORIAN,PHRYGIAN,LYDIAN,MIXOLYDIAN};
-const char * scalenames[] = {"Chroma"," Major", " Minor","HarMin","MajPen","MinPen","Dorian","Phrygi","Lydian","Mixoly"};
-//const char * textrates[] = {" 8x"," 6x"," 4x"," 3x", " 2x","1.5x"," 1x","/1.5"," /2"," /3"," /4"," /5"," /6"," /7"," /8"," /9"," /10"," /11"," /12"," /13"," /14"," /15"," /16"," /32"," /64","/128"};
+const char * const scalenames[] = {"Chroma"," Major", " Minor","HarMin","MajPen","MinPen","Dorian","Phrygi","Lydian","Mixoly"};
+//const char * const textrates[] = {" 8x"," 6x"," 4x"," 3x", " 2x","1.5x"," 1x","/1.5"," /2"," /3"," /4"," /5"," /6"," /7"," /8"," /9"," /10"," /11"," /12"," /13"," /14"," /15"," /16"," /32"," /64","/128"};
 
 // NOTE that the order and number of the text menus much match the graphical UI pages
 // ie we keep the graphic display and its associated text menus in sync - uses variable UIpage for main menus - notes, gates etc
 // current_track is the index of the sequence we are editing which indexes into the submenus ie note 1, note 2
 // menus are created at compile time so we have to point to each sequencer array parameter individually
-struct submenu note1params[] = {
-  // name,longname,min,max,step,type,*textfield,*parameter,*handler
+const struct submenu note1params[] = {
+  // name,longname,min,max,step,type,*textfield,*parameter,*handler,*exithandler
 //  "RATE",0,25,-1,TYPE_TEXT,textrates,&notes[0].divider,0,
 
-  "Root 1",1,115,1,TYPE_INTEGER,0,&notes[0].root,0,
-  "Scale 1",0,9,1,TYPE_TEXT,scalenames,&notes[0].scale,0,
-  "Step Mode",0,4,1,TYPE_TEXT,textstepmode,&notes[0].stepmode,0,
-  "MIDI Out 1",1,16,1,TYPE_INTEGER,0,&MIDIoutputchannel[0],0,
-  "MIDI In 1",1,16,1,TYPE_INTEGER,0,&MIDIinputchannel[0],0,
-  "Root 2",1,115,1,TYPE_INTEGER,0,&notes[1].root,0,
-  "Scale 2",0,9,1,TYPE_TEXT,scalenames,&notes[1].scale,0,
-  "Step Mode",0,4,1,TYPE_TEXT,textstepmode,&notes[1].stepmode,0,
-  "MIDI Out 2",1,16,1,TYPE_INTEGER,0,&MIDIoutputchannel[1],0,
-  "MIDI In 2",1,16,1,TYPE_INTEGER,0,&MIDIinputchannel[1],0,
-  "Root 3",1,115,1,TYPE_INTEGER,0,&notes[2].root,0,
-  "Scale 3",0,9,1,TYPE_TEXT,scalenames,&notes[2].scale,0,
-  "Step Mode",0,4,1,TYPE_TEXT,textstepmode,&notes[2].stepmode,0,
-  "MIDI Out 3",1,16,1,TYPE_INTEGER,0,&MIDIoutputchannel[2],0,
-  "MIDI In 3",1,16,1,TYPE_INTEGER,0,&MIDIinputchannel[2],0,
-  " BPM",20,240,1,TYPE_INTEGER,0,&bpm,0,
-  "Bat Voltage",0,0,1,TYPE_FLOAT,0,&batteryvoltage,0,  // battery voltage displayed in menu - no screen real estate left on main screen
+  "Root 1",1,115,1,TYPE_INTEGER,0,&notes[0].root,0,0,
+  "Scale 1",0,9,1,TYPE_TEXT,scalenames,&notes[0].scale,0,0,
+  "Step Mode",0,4,1,TYPE_TEXT,textstepmode,&notes[0].stepmode,0,0,
+  "MIDI Out 1",1,16,1,TYPE_INTEGER,0,&MIDIoutputchannel[0],0,0,
+  "MIDI In 1",1,16,1,TYPE_INTEGER,0,&MIDIinputchannel[0],buildchannelmap,0,
+  "Delay 1 us",0,OFFSET_MAX_US,250,TYPE_INTEGER,0,&trackdelay[0],0,0,
+  "Gate 1 %",1,100,1,TYPE_INTEGER,0,&notes[0].gate,0,0,
+  "Gate 1 ms",0,GATE_MAX_MS,10,TYPE_INTEGER,0,&notes[0].gatems,0,0,
+  "Root 2",1,115,1,TYPE_INTEGER,0,&notes[1].root,0,0,
+  "Scale 2",0,9,1,TYPE_TEXT,scalenames,&notes[1].scale,0,0,
+  "Step Mode",0,4,1,TYPE_TEXT,textstepmode,&notes[1].stepmode,0,0,
+  "MIDI Out 2",1,16,1,TYPE_INTEGER,0,&MIDIoutputchannel[1],0,0,
+  "MIDI In 2",1,16,1,TYPE_INTEGER,0,&MIDIinputchannel[1],buildchannelmap,0,
+  "Delay 2 us",0,OFFSET_MAX_US,250,TYPE_INTEGER,0,&trackdelay[1],0,0,
+  "Gate 2 %",1,100,1,TYPE_INTEGER,0,&notes[1].gate,0,0,
+  "Gate 2 ms",0,GATE_MAX_MS,10,TYPE_INTEGER,0,&notes[1].gatems,0,0,
+  "Root 3",1,115,1,TYPE_INTEGER,0,&notes[2].root,0,0,
+  "Scale 3",0,9,1,TYPE_TEXT,scalenames,&notes[2].scale,0,0,
+  "Step Mode",0,4,1,TYPE_TEXT,textstepmode,&notes[2].stepmode,0,0,
+  "MIDI Out 3",1,16,1,TYPE_INTEGER,0,&MIDIoutputchannel[2],0,0,
+  "MIDI In 3",1,16,1,TYPE_INTEGER,0,&MIDIinputchannel[2],buildchannelmap,0,
+  "Delay 3 us",0,OFFSET_MAX_US,250,TYPE_INTEGER,0,&trackdelay[2],0,0,
+  "Gate 3 %",1,100,1,TYPE_INTEGER,0,&notes[2].gate,0,0,
+  "Gate 3 ms",0,GATE_MAX_MS,10,TYPE_INTEGER,0,&notes[2].gatems,0,0,
+  " BPM",20,240,1,TYPE_INTEGER,0,&bpm,0,0,
+  "Swing 1 %",SWING_STRAIGHT,SWING_MAX,1,TYPE_INTEGER,0,&swing[0],0,0,
+  "Swing 2 %",SWING_STRAIGHT,SWING_MAX,1,TYPE_INTEGER,0,&swing[1],0,0,
+  "Swing 3 %",SWING_STRAIGHT,SWING_MAX,1,TYPE_INTEGER,0,&swing[2],0,0,
+  "Swing 4 %",SWING_STRAIGHT,SWING_MAX,1,TYPE_INTEGER,0,&swing[3],0,0,
+  "Euclid 1",0,1,1,TYPE_TEXT,textoffon,&euclid[0].on,0,0,
+  "Eucl 1 Steps",1,EUCLID_MAX,1,TYPE_INTEGER,0,&euclid[0].steps,euclidedit,0,
+  "Eucl 1 Hits",0,EUCLID_MAX,1,TYPE_INTEGER,0,&euclid[0].hits,euclidedit,0,
+  "Eucl 1 Rotate",0,EUCLID_MAX-1,1,TYPE_INTEGER,0,&euclid[0].rotate,euclidedit,0,
+  "Euclid 2",0,1,1,TYPE_TEXT,textoffon,&euclid[1].on,0,0,
+  "Eucl 2 Steps",1,EUCLID_MAX,1,TYPE_INTEGER,0,&euclid[1].steps,euclidedit,0,
+  "Eucl 2 Hits",0,EUCLID_MAX,1,TYPE_INTEGER,0,&euclid[1].hits,euclidedit,0,
+  "Eucl 2 Rotate",0,EUCLID_MAX-1,1,TYPE_INTEGER,0,&euclid[1].rotate,euclidedit,0,
+  "Euclid 3",0,1,1,TYPE_TEXT,textoffon,&euclid[2].on,0,0,
+  "Eucl 3 Steps",1,EUCLID_MAX,1,TYPE_INTEGER,0,&euclid[2].steps,euclidedit,0,
+  "Eucl 3 Hits",0,EUCLID_MAX,1,TYPE_INTEGER,0,&euclid[2].hits,euclidedit,0,
+  "Eucl 3 Rotate",0,EUCLID_MAX-1,1,TYPE_INTEGER,0,&euclid[2].rotate,euclidedit,0,
+  "Euclid 4",0,1,1,TYPE_TEXT,textoffon,&euclid[3].on,0,0,
+  "Eucl 4 Steps",1,EUCLID_MAX,1,TYPE_INTEGER,0,&euclid[3].steps,euclidedit,0,
+  "Eucl 4 Hits",0,EUCLID_MAX,1,TYPE_INTEGER,0,&euclid[3].hits,euclidedit,0,
+  "Eucl 4 Rotate",0,EUCLID_MAX-1,1,TYPE_INTEGER,0,&euclid[3].rotate,euclidedit,0,
+  "Pattern",1,NUM_PATTERNS,1,TYPE_INTEGER,0,&patternselect,queuepattern,0,
+  "Switch At",0,1,1,TYPE_TEXT,textswitchpoint,&switchpoint,0,0,
+  "Store To",1,NUM_PATTERNS,1,TYPE_INTEGER,0,&patternstore,0,storepattern,
+  "Bat Voltage",0,0,1,TYPE_FLOAT,0,&batteryvoltage,0,0,  // battery voltage displayed in menu - no screen real estate left on main screen
 
 
 };
 
 
 
+#ifdef PROFILE
+// profiler results - these are display only, the values are refreshed every PROF_WINDOW_MS
+const struct submenu statsparams[] = {
+  // name,min,max,step,type,*textfield,*parameter,*handler
+  "kLoops/s",0,0,1,TYPE_FLOAT,0,&profloops,0,0,
+  "kLoops1/s",0,0,1,TYPE_FLOAT,0,&profloops1,0,0,
+  "ISR Overruns",0,0,1,TYPE_INTEGER,0,&profoverrun,0,0,
+  "Loop Busy %",0,0,1,TYPE_INTEGER,0,&loopbusy,0,0,
+  "Scans/s",0,0,1,TYPE_INTEGER,0,&scanrate,0,0,
+  "Lost Steps",0,0,1,TYPE_INTEGER,0,&loststeps,0,0,
+  "USB Pkts/Xfer",0,0,1,TYPE_FLOAT,0,&usbperxfer,0,0,
+  "USB Xfers/s",0,0,1,TYPE_INTEGER,0,&usbxfers,0,0,
+  "Note Late us",0,0,1,TYPE_INTEGER,0,&outlate,0,0,
+  "Save Stall ms",0,0,1,TYPE_INTEGER,0,&savestall,0,0,
+  "ISR min us",0,0,1,TYPE_INTEGER,0,&profmin[PROF_ISR],0,0,
+  "ISR avg us",0,0,1,TYPE_INTEGER,0,&profavg[PROF_ISR],0,0,
+  "ISR max us",0,0,1,TYPE_INTEGER,0,&profmax[PROF_ISR],0,0,
+  "Loop min us",0,0,1,TYPE_INTEGER,0,&profmin[PROF_LOOP],0,0,
+  "Loop avg us",0,0,1,TYPE_INTEGER,0,&profavg[PROF_LOOP],0,0,
+  "Loop max us",0,0,1,TYPE_INTEGER,0,&profmax[PROF_LOOP],0,0,
+  "Disp min us",0,0,1,TYPE_INTEGER,0,&profmin[PROF_DISPLAY],0,0,
+  "Disp avg us",0,0,1,TYPE_INTEGER,0,&profavg[PROF_DISPLAY],0,0,
+  "Disp max us",0,0,1,TYPE_INTEGER,0,&profmax[PROF_DISPLAY],0,0,
+  "Loop1 min us",0,0,1,TYPE_INTEGER,0,&profmin[PROF_LOOP1],0,0,
+  "Loop1 avg us",0,0,1,TYPE_INTEGER,0,&profavg[PROF_LOOP1],0,0,
+  "Loop1 max us",0,0,1,TYPE_INTEGER,0,&profmax[PROF_LOOP1],0,0,
+  "Clock min us",0,0,1,TYPE_INTEGER,0,&profmin[PROF_CLOCKTICK],0,0,
+  "Clock avg us",0,0,1,TYPE_INTEGER,0,&profavg[PROF_CLOCKTICK],0,0,
+  "Clock max us",0,0,1,TYPE_INTEGER,0,&profmax[PROF_CLOCKTICK],0,0,
+  "MIDI min us",0,0,1,TYPE_INTEGER,0,&profmin[PROF_MIDI],0,0,
+  "MIDI avg us",0,0,1,TYPE_INTEGER,0,&profavg[PROF_MIDI],0,0,
+  "MIDI max us",0,0,1,TYPE_INTEGER,0,&profmax[PROF_MIDI],0,0,
+  "LEDs min us",0,0,1,TYPE_INTEGER,0,&profmin[PROF_LEDSHOW],0,0,
+  "LEDs avg us",0,0,1,TYPE_INTEGER,0,&profavg[PROF_LEDSHOW],0,0,
+  "LEDs max us",0,0,1,TYPE_INTEGER,0,&profmax[PROF_LEDSHOW],0,0,
+  "Boot MIDI ms",0,0,1,TYPE_INTEGER,0,&bootms[BOOT_MIDI],0,0,
+  "Boot Load ms",0,0,1,TYPE_INTEGER,0,&bootms[BOOT_SESSION],0,0,
+  "Boot Disp ms",0,0,1,TYPE_INTEGER,0,&bootms[BOOT_DISPLAY],0,0,
+  "1st MIDI ms",0,0,1,TYPE_INTEGER,0,&bootms[BOOT_FIRSTMIDI],0,0,
+};
+#endif
+
 // top level menu structure - each top level menu contains one submenu
-struct menu mainmenu[] = {
-  // name,submenu *,initial submenu index,number of submenus
-  "Note 1",note1params,0,sizeof(note1params)/sizeof(submenu),
+const struct menu mainmenu[] = {
+  // name,submenu *,number of submenus
+  "Note 1",note1params,menuitems(note1params),
+#ifdef PROFILE
+  "Stats",statsparams,menuitems(statsparams),
+#endif
 
 };
 
 #define NUM_MAIN_MENUS sizeof(mainmenu)/ sizeof(menu)
-menu * topmenu=mainmenu;  // points at current menu
+const menu * topmenu=mainmenu;  // points at current menu
+menuposition menupos[NUM_MAIN_MENUS];  // selected item in each menu
 int16_t topmenuindex=0;  // keeps track of which top menu item we are displaying
 
 // highlight the currently selected menu item
@@ -202,7 +292,7 @@ void drawtopmenu( int8_t index) {
 // index is the index into the current top menu's submenu array
 
 void drawsubmenu( int8_t index) {
-    submenu * sub;
+    const submenu * sub;
     sub=topmenu[topmenuindex].submenus; //get pointer to the submenu array
     // print the name text
     int y= SUBMENU_Y+DISPLAY_Y_MENUPAD+(index % SUBMENU_LINES)*(DISPLAY_CHAR_HEIGHT+DISPLAY_Y_MENUPAD); // Y position of this menu index
@@ -218,12 +308,12 @@ void drawsubmenu( int8_t index) {
       char temp[7];
       switch (sub[index].ptype) {
         case TYPE_INTEGER:   // print the value as an unsigned integer    
-          sprintf(temp,"%6d",val); // lcd.print doesn't seem to print uint8 properly
+          ft_format(temp,sizeof(temp),"%6d",val); // lcd.print doesn't seem to print uint8 properly
           display.print(temp);  
           display.print(" ");  // blank out any garbage
           break;
         case TYPE_FLOAT:   // print the int value as a float  
-          sprintf(temp,"%1.2f",(float)val/1000); // menu should have int value between -1000 to +1000 so float is -1 to +1
+          ft_format(temp,sizeof(temp),"%s%d.%02d",(val < 0) ? "-" : "",abs(val)/1000,abs(val)%1000/10); // menu should have int value between -1000 to +1000 so float is -1 to +1
           display.print(temp);  
           display.print(" ");  // blank out any garbage
           break;
@@ -246,9 +336,9 @@ void drawsubmenu( int8_t index) {
 
 void drawsubmenus() {
     int8_t index,len;
-    index= topmenu[topmenuindex].submenuindex; // submenu field index
+    index= menupos[topmenuindex].submenuindex; // submenu field index
     len= topmenu[topmenuindex].numsubmenus; // number of submenu items
-    submenu * sub=topmenu[topmenuindex].submenus; //get pointer to the current submenu array
+    const submenu * sub=topmenu[topmenuindex].submenus; //get pointer to the current submenu array
     display.fillScreen(BLACK);
     display.setCursor(0,DISPLAY_Y_OFFSET);
 //    display.printf("%s",topmenu[topmenuindex].name); // show the menu we came from at top of screen
@@ -264,8 +354,14 @@ void drawsubmenus() {
 } 
 
 
+bool menuhold=false;  // the menu button was pressed and hasn't been let go yet
+
+void menurelease(void) {
+  menuhold=false;
+}
+
 // menu handler
-// a run to completion state machine - it never blocks except while waiting for encoder button release
+// a run to completion state machine - it never blocks. after a button press it does nothing till the button is let go
 // allows the rest of the application to run while parameters are adjusted
 // Dec 2025 - modded for Twisty 2 menus - only submenu level is used
 
@@ -274,34 +370,36 @@ void domenus(void) {
   int8_t index; 
 
   
+  if (menuhold) return;  // encoder moves wait till the button is let go
   enc=rmenuenc.getValue();
 
   switch (menustate) {
 
     case SUBSELECT:  // 
       if (enc !=0 ) { // move selector
-        int submenupage = topmenu[topmenuindex].submenuindex / SUBMENU_LINES;  
-        undrawselector(topmenu[topmenuindex].submenuindex);
-        topmenu[topmenuindex].submenuindex+=enc;
-        if (topmenu[topmenuindex].submenuindex <0) topmenu[topmenuindex].submenuindex=0;  // we don't wrap menus around, just stop at the ends
-        if (topmenu[topmenuindex].submenuindex >=(topmenu[topmenuindex].numsubmenus -1) ) topmenu[topmenuindex].submenuindex=topmenu[topmenuindex].numsubmenus -1; 
-        if ((topmenu[topmenuindex].submenuindex / SUBMENU_LINES) != submenupage) {
+        int submenupage = menupos[topmenuindex].submenuindex / SUBMENU_LINES;  
+        undrawselector(menupos[topmenuindex].submenuindex);
+        menupos[topmenuindex].submenuindex+=enc;
+        if (menupos[topmenuindex].submenuindex <0) menupos[topmenuindex].submenuindex=0;  // we don't wrap menus around, just stop at the ends
+        if (menupos[topmenuindex].submenuindex >=(topmenu[topmenuindex].numsubmenus -1) ) menupos[topmenuindex].submenuindex=topmenu[topmenuindex].numsubmenus -1; 
+        if ((menupos[topmenuindex].submenuindex / SUBMENU_LINES) != submenupage) {
           drawsubmenus();  // redraw if we scrolled beyond the menu page
         }
-        drawselector(topmenu[topmenuindex].submenuindex);   
+        drawselector(menupos[topmenuindex].submenuindex);   
       } 
       if (!digitalRead(RMENU_ENCSW_IN)) { // submenu item has been selected so either go back to top or go to change parameter state
-	      submenu * sub;
+	      const submenu * sub;
 		    sub=topmenu[topmenuindex].submenus; //get pointer to the submenu array
-        undrawselector(topmenu[topmenuindex].submenuindex);
-        draweditselector(topmenu[topmenuindex].submenuindex); // show we are editing
+        undrawselector(menupos[topmenuindex].submenuindex);
+        draweditselector(menupos[topmenuindex].submenuindex); // show we are editing
         menustate=PARAM_INPUT;  // change the submenu parameter
-        while(!digitalRead(RMENU_ENCSW_IN)) delay(10); // loop here till button released 
+        menuhold=true;  // ignore the button till it's let go
+        task_onrelease(RMENU_ENCSW_IN,menurelease);
       }  
       break;
     case PARAM_INPUT:  // changing value of a parameter
-      submenu * sub=topmenu[topmenuindex].submenus; //get pointer to the current submenu array
-      index= topmenu[topmenuindex].submenuindex; // submenu field index
+      const submenu * sub=topmenu[topmenuindex].submenus; //get pointer to the current submenu array
+      index= menupos[topmenuindex].submenuindex; // submenu field index
       if (enc !=0 ) { // change value      
         int16_t temp=*sub[index].parameter + enc*sub[index].step; // menu code uses ints - convert to floats when needed
         if (temp < (int16_t)sub[index].min) temp=sub[index].min;
@@ -311,11 +409,12 @@ void domenus(void) {
         drawsubmenu(index);
       }
       if (!digitalRead(RMENU_ENCSW_IN)) { // stop changing parameter
-        undrawselector(topmenu[topmenuindex].submenuindex);
-        drawselector(topmenu[topmenuindex].submenuindex); // show we are selecting again
+        undrawselector(menupos[topmenuindex].submenuindex);
+        drawselector(menupos[topmenuindex].submenuindex); // show we are selecting again
         menustate=SUBSELECT;
-        //if (sub[index].exithandler != 0) (*sub[index].exithandler)();  // call the exit handler function
-        while(!digitalRead(RMENU_ENCSW_IN)) delay(10); // loop till button released
+        if (sub[index].exithandler != 0) (*sub[index].exithandler)();  // call the exit handler function
+        menuhold=true;
+        task_onrelease(RMENU_ENCSW_IN,menurelease);
         
       }   
       break;
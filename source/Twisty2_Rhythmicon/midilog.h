@@ -0,0 +1,81 @@
+// deferred MIDI diagnostics
+// the MIDI callbacks run inside MIDI_Interface::updateAll() on core 1 and printing from there steals time from clocktick()
+// so callbacks just drop a small record in this ring buffer and core 0 prints them when it gets around to it
+// one producer (core 1) and one consumer (core 0) so the head and tail indices don't need a lock
+// the dropped count works the same way - core 1 only counts up and core 0 only remembers how many it has reported
+// if core 0 falls behind records are dropped and counted rather than blocking the timing core
+
+#define MIDILOG_SIZE 32  // must be a power of 2
+
+struct midilogrecord {
+  uint8_t type;    // MIDI status byte, channel stripped
+  uint8_t channel; // 1-16 for channel messages
+  uint8_t data1;
+  uint8_t data2;
+  uint16_t length; // sysex length
+  uint8_t cable;
+};
+
+midilogrecord midilog[MIDILOG_SIZE];
+volatile uint16_t midiloghead=0;  // written by core 1
+volatile uint16_t midilogtail=0;  // written by core 0
+volatile uint16_t midilogdropped=0;   // written by core 1
+uint16_t midilogreported=0;            // core 0 - drops already printed
+
+// called from the MIDI callbacks
+void midilog_push(uint8_t type, uint8_t channel, uint8_t data1, uint8_t data2, uint16_t length, uint8_t cable) {
+  uint16_t head=midiloghead;
+  if ((uint16_t)(head-midilogtail) >= MIDILOG_SIZE) { // full
+    ++midilogdropped;
+    return;
+  }
+  midilogrecord * r=&midilog[head & (MIDILOG_SIZE-1)];
+  r->type=type;
+  r->channel=channel;
+  r->data1=data1;
+  r->data2=data2;
+  r->length=length;
+  r->cable=cable;
+  __dmb();  // record has to be written before the other core can see it
+  midiloghead=head+1;
+}
+
+// print pending records - call from the core 0 loop. prints at most a few per call so the UI stays responsive
+void midilog_drain(void) {
+  for (int16_t n=0; (n < 4) && (midilogtail != midiloghead); ++n) {
+    __dmb();
+    midilogrecord * r=&midilog[midilogtail & (MIDILOG_SIZE-1)];
+    switch (r->type) {
+      case CONTROL_CHANGE:
+        Serial.printf("Control Change: ch %d, controller %d, value %d, cable %d\n",r->channel,r->data1,r->data2,r->cable+1);
+        break;
+      case SYSEX_START:
+        Serial.printf("System Exclusive: [%d] %02X %02X ..., cable %d\n",r->length,r->data1,r->data2,r->cable+1);
+        break;
+      case MTC_QUARTER_FRAME:
+        Serial.printf("MTC Quarter Frame: %d, cable %d\n",r->data1,r->cable+1);
+        break;
+      case SONG_POSITION_POINTER:
+        Serial.printf("Song Position Pointer: %d, cable %d\n",r->data1 | (r->data2 << 7),r->cable+1);
+        break;
+      case SONG_SELECT:
+        Serial.printf("Song Select: %d, cable %d\n",r->data1,r->cable+1);
+        break;
+      case ACTIVE_SENSING:
+        Serial.printf("Active Sensing: cable %d\n",r->cable+1);
+        break;
+      case SYSTEM_RESET:
+        Serial.printf("System Reset: cable %d\n",r->cable+1);
+        break;
+      default:
+        Serial.printf("MIDI %02X %d %d\n",r->type,r->data1,r->data2);
+        break;
+    }
+    midilogtail=midilogtail+1;
+  }
+  uint16_t dropped=midilogdropped-midilogreported;
+  if (dropped) {
+    Serial.printf("MIDI log dropped %d messages\n",dropped);
+    midilogreported+=dropped;
+  }
+}
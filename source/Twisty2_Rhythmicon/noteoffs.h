@@ -0,0 +1,124 @@
+// note off engine for the PicoRhythmicon
+// every note on schedules its own note off at an exact time in microseconds, so overlapping notes from several clock
+// sources each get the gate they were given and nothing is cut short or left hanging
+// the note offs wait in a timer wheel - WHEEL_SLOTS lists, one per 2^WHEEL_SHIFT us slice of time, so scheduling is O(1)
+// and the service only looks at the slots whose time has come. a gate longer than the whole wheel just stays in its slot
+// until its time comes round
+// a table of sounding notes for each channel makes panic and stop exact - it knows every note that is on, not just the last one
+// a note that is played again while it's still sounding is retriggered: its note off goes out first and its old note off is cancelled
+
+#define WHEEL_SHIFT 11  // 2048us slots
+#define WHEEL_SLOTS 64  // 131ms around the wheel
+#define NOTEOFF_POOL 128  // note offs that can be waiting at once
+#define GATE_MAX_MS 2000  // longest fixed gate - keeps the pool big enough for fast clocks
+
+struct noteoff {
+  uint32_t due;   // micros() time to send
+  uint8_t channel;
+  uint8_t note;
+  int16_t next;   // next entry in the slot or free list, -1 at the end
+};
+
+noteoff noteoffs[NOTEOFF_POOL];
+int16_t wheel[WHEEL_SLOTS];  // first entry in each slot
+int16_t noteofffree;         // first free entry
+uint32_t wheelslot;          // slot number the service got up to
+uint32_t soundingnotes[16][4];  // bit per note for each channel
+
+bool notesounding(uint8_t channel, uint8_t note) {
+  return (soundingnotes[(channel-1) & 0x0f][note >> 5] >> (note & 31)) & 1;
+}
+
+void setsounding(uint8_t channel, uint8_t note, bool on) {
+  uint32_t bit=1ul << (note & 31);
+  if (on) soundingnotes[(channel-1) & 0x0f][note >> 5] |= bit;
+  else soundingnotes[(channel-1) & 0x0f][note >> 5] &= ~bit;
+}
+
+void initnoteoffs(void) {
+  for (int16_t i=0; i< WHEEL_SLOTS;++i) wheel[i]=-1;
+  for (int16_t i=0; i< NOTEOFF_POOL;++i) noteoffs[i].next=i+1;
+  noteoffs[NOTEOFF_POOL-1].next=-1;
+  noteofffree=0;
+  wheelslot=micros() >> WHEEL_SHIFT;
+  memset(soundingnotes,0,sizeof(soundingnotes));
+}
+
+// take a note's pending note off out of the wheel. returns false if it didn't have one
+bool cancelnoteoff(uint8_t channel, uint8_t note) {
+  for (int16_t slot=0; slot< WHEEL_SLOTS;++slot) {
+    for (int16_t * link=&wheel[slot]; *link >= 0; link=&noteoffs[*link].next) {
+      int16_t i=*link;
+      if ((noteoffs[i].channel == channel) && (noteoffs[i].note == note)) {
+        *link=noteoffs[i].next;
+        noteoffs[i].next=noteofffree;
+        noteofffree=i;
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+// send a note on and schedule its note off gate us after due, the time the note on was meant to go out
+// a note that can't get a note off isn't played at all - a missing note is better than a stuck one
+void playnote(uint8_t channel, uint8_t note, uint8_t velocity, uint32_t due, uint32_t gate) {
+  if (notesounding(channel,note)) {  // retrigger
+    cancelnoteoff(channel,note);
+    sendnoteOff(channel,note,0);
+    setsounding(channel,note,false);
+  }
+  if (noteofffree < 0) return;
+  int16_t i=noteofffree;
+  noteofffree=noteoffs[i].next;
+  noteoffs[i].due=due+gate;
+  noteoffs[i].channel=channel;
+  noteoffs[i].note=note;
+  uint32_t slot=noteoffs[i].due >> WHEEL_SHIFT;
+  if ((int32_t)(noteoffs[i].due-(wheelslot << WHEEL_SHIFT)) < 0) slot=wheelslot;  // already due (a late note on) - the next slot the service looks at
+  slot&=WHEEL_SLOTS-1;
+  noteoffs[i].next=wheel[slot];
+  wheel[slot]=i;
+  sendnoteOn(channel,note,velocity);
+  setsounding(channel,note,true);
+}
+
+// send the note offs in one slot that are due
+void wheel_runslot(int16_t slot, uint32_t now) {
+  int16_t * link=&wheel[slot];
+  while (*link >= 0) {
+    int16_t i=*link;
+    if ((int32_t)(now-noteoffs[i].due) >= 0) {
+      sendnoteOff(noteoffs[i].channel,noteoffs[i].note,0);
+      setsounding(noteoffs[i].channel,noteoffs[i].note,false);
+      *link=noteoffs[i].next;
+      noteoffs[i].next=noteofffree;
+      noteofffree=i;
+    }
+    else link=&noteoffs[i].next;  // due on a later turn of the wheel
+  }
+}
+
+// send the note offs that are due - call from loop1
+// visits every slot whose time has started since the last call and the current slot again for anything due in it now
+void noteoff_service(void) {
+  uint32_t now=micros();
+  uint32_t slotnow=now >> WHEEL_SHIFT;
+  uint32_t behind=slotnow-wheelslot;
+  if (behind >= WHEEL_SLOTS) behind=WHEEL_SLOTS-1;  // been away more than a whole turn - every slot gets looked at once
+  for (uint32_t slot=slotnow-behind; slot != slotnow+1;++slot) wheel_runslot(slot & (WHEEL_SLOTS-1),now);
+  wheelslot=slotnow;
+}
+
+// turn off every sounding note now and forget the pending note offs
+void notes_panic(void) {
+  for (int16_t ch=0; ch< 16;++ch) {
+    for (int16_t word=0; word< 4;++word) {
+      uint32_t bits=soundingnotes[ch][word];
+      for (int16_t bit=0; bits; ++bit, bits >>= 1) {
+        if (bits & 1) sendnoteOff(ch+1,word*32+bit,0);
+      }
+    }
+  }
+  initnoteoffs();
+}
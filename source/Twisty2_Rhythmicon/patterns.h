@@ -0,0 +1,82 @@
+// pattern bank for the PicoRhythmicon
+// NUM_PATTERNS patterns are kept in RAM and saved to flash as one small file so they survive power off
+// the bank is loaded at startup and the pattern that was playing when it was last saved comes back
+// picking a pattern in the menu sends it to core 1 which switches to it at the next bar or divider cycle - see patternswap() in seq.h
+// storing copies the live settings into a bank slot and rewrites the file
+// file format: "RHP2" <number of patterns> <current pattern> <patterns>
+
+#define NUM_PATTERNS 16
+#define PATTERN_FILE "patterns.bin"
+#define PATTERN_HEADER 6
+
+// core 0 to core 1 FIFO commands
+#define FIFO_SYNC 0          // resync the sequencers
+#define FIFO_PATTERN 0x100   // | pattern number - stage a pattern from the bank
+
+struct pattern bank[NUM_PATTERNS];
+int16_t patternselect=1;  // pattern playing or waiting to play - 1 based for the menu
+int16_t patternstore=1;   // bank slot the Store To menu item saves into
+bool bankdirty=false;     // a pattern was stored and the bank needs writing to flash
+
+// copy the live sequencer settings into a pattern
+void getpattern(struct pattern * pat) {
+  pat->clocks=0;
+  pat->euclid=0;
+  for (int16_t track=0; track< NTRACKS;++track) {
+    for (int16_t step=0; step< SEQ_STEPS;++step) pat->val[track][step]=notes[track].val[step];
+    pat->root[track]=notes[track].root;
+    pat->scale[track]=notes[track].scale;
+    pat->stepmode[track]=notes[track].stepmode;
+    for (int16_t clk=0; clk< NUM_CLOCKS;++clk) if (rhythmclks[track][clk]) pat->clocks|=1 << (track*NUM_CLOCKS+clk);
+  }
+  for (int16_t clk=0; clk< NUM_CLOCKS;++clk) {
+    pat->divider[clk]=rhythm[clk].divider;
+    pat->eucsteps[clk]=euclid[clk].steps;
+    pat->euchits[clk]=euclid[clk].hits;
+    pat->eucrotate[clk]=euclid[clk].rotate;
+    if (euclid[clk].on) pat->euclid|=1 << clk;
+  }
+}
+
+// every slot starts out as the power on settings
+void initpatterns(void) {
+  getpattern(&bank[0]);
+  for (int16_t i=1; i< NUM_PATTERNS;++i) bank[i]=bank[0];
+}
+
+bool savebank(void) {
+  uint8_t header[PATTERN_HEADER]={'R','H','P','2',NUM_PATTERNS,0};
+  header[5]=patternselect-1;
+  if (LittleFS.exists(PATTERN_FILE)) LittleFS.remove(PATTERN_FILE);
+  File file=LittleFS.open(PATTERN_FILE,"w");
+  if (!file) return false;
+  bool ok=(file.write(header,sizeof(header)) == sizeof(header)) && (file.write((uint8_t *)bank,sizeof(bank)) == sizeof(bank));
+  file.close();
+  return ok;
+}
+
+// load the bank - returns false and leaves the bank alone if there isn't a valid one
+bool loadbank(void) {
+  uint8_t header[PATTERN_HEADER];
+  File file=LittleFS.open(PATTERN_FILE,"r");
+  if (!file) return false;
+  bool ok=(file.read(header,sizeof(header)) == sizeof(header)) && !memcmp(header,"RHP2",4) && (header[4] == NUM_PATTERNS)
+    && (file.size() == PATTERN_HEADER+sizeof(bank)) && (file.read((uint8_t *)bank,sizeof(bank)) == sizeof(bank));
+  file.close();
+  if (!ok) return false;
+  patternselect=constrain(header[5]+1,1,NUM_PATTERNS);
+  return true;
+}
+
+// menu handlers
+// a new pattern was picked - core 1 takes it from here
+void queuepattern(void) {
+  rp2040.fifo.push(FIFO_PATTERN | (patternselect-1));
+}
+
+// store the live settings in the bank - menu exit handler for Store To. the autosave in autosave.h writes it to flash
+void storepattern(void) {
+  getpattern(&bank[patternstore-1]);
+  patternselect=patternstore;  // what's playing is now this pattern
+  bankdirty=true;
+}
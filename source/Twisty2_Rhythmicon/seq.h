@@ -2,7 +2,7 @@
 // Jan 2025 stripped dramtically and modified for Subharmonicon like behaviour 
 
 
-uint32_t clocktimer = 0; // clock rate in ms
+uint32_t clocktimer = 0; // when the next PPQN tick is due in us
 
 enum STEPMODE {FORWARD,BACKWARD,PINGPONG,RANDOMWALK,RANDOM};
 
@@ -35,14 +35,14 @@ seqclock rhythm[NUM_CLOCKS] = {
 struct sequencer { // anything modified by a menu must be int16
   int8_t val[SEQ_STEPS];  // values of note offsets from root 
   int8_t index;    // index of step we are on
-  int8_t lastnotesent; // for doing note offs
+  int8_t lastnotesent; // last note played
   int16_t stepmode;    // step mode - fwd, backward etc
   int16_t state;    // state - used for step modes  
-  int16_t root;   // "root" note - note offsets are relative to this. also used for euclidean offset and CC number
+  int16_t root;   // "root" note - note offsets are relative to this. also used for CC number
   int16_t offset; // offset value from external MIDI
   int16_t scale;  // index of scale to apply
-  int16_t gatecounter; // for gate on/off timing
-  int16_t gateduration; // duration in PPQN clocks
+  int16_t gate;   // gate length as a percent of the fastest clock driving the track
+  int16_t gatems; // gate length in ms - 0 to use the percentage
 };
 
 // notes are stored as offsets from the root 
@@ -55,8 +55,8 @@ sequencer notes[NTRACKS] = {
   60,   // root note
   0,    // offset
   0,    // chromatic scale
-  0,   // gate counter
-  GATE_DIV,   // gate duration derived from PPQN clock
+  GATE_PERCENT,   // gate percent
+  0,   // gate ms
 
   0,0,0,0,  // initial data
   0,   // step index
@@ -66,8 +66,8 @@ sequencer notes[NTRACKS] = {
   60,   // root note
   0,    // offset
   0,    // chromatic scale
-  0,   // gate counter
-  GATE_DIV,   // gate duration derived from PPQN clock
+  GATE_PERCENT,   // gate percent
+  0,   // gate ms
 
     0,0,0,0,  // initial data
   0,   // step index
@@ -77,25 +77,137 @@ sequencer notes[NTRACKS] = {
   60,   // root note
   0,    // offset
   0,    // chromatic scale
-  0,   // gate counter
-  GATE_DIV,   // gate duration derived from PPQN clock
+  GATE_PERCENT,   // gate percent
+  0,   // gate ms
 };
 
+// pattern switching
+// a pattern is everything the encoders set - step notes, root, scale, step mode, clock dividers and clock routing
+// core 0 asks for a pattern through the FIFO, core 1 copies it into patternstage and swaps it in at the next bar
+// or divider cycle boundary. the swap only touches the settings - notes that are sounding keep their gate timers so nothing hangs
+#define BAR_TICKS (PPQN*4)  // 4/4 bars
+enum SWITCHPOINTS {SWITCH_BAR,SWITCH_CYCLE};
+
+struct pattern {  // packed into bytes so the bank stays small in flash and RAM
+  int8_t val[NTRACKS][SEQ_STEPS];
+  uint8_t root[NTRACKS];
+  uint8_t scale[NTRACKS];
+  uint8_t stepmode[NTRACKS];
+  uint8_t divider[NUM_CLOCKS];
+  uint8_t eucsteps[NUM_CLOCKS];  // Euclidean pattern for each divider - see euclid.h
+  uint8_t euchits[NUM_CLOCKS];
+  uint8_t eucrotate[NUM_CLOCKS];
+  uint8_t euclid;   // Euclidean mode on, one bit per clock
+  uint16_t clocks;  // rhythmclks for the tracks, one bit per track and clock
+};
+
+struct pattern patternstage;  // back buffer - only core 1 touches it
+bool patternqueued=false;     // patternstage is waiting for the next switch point
+volatile bool patternswapped=false;  // set by core 1 after a swap so core 0 redraws
+int16_t switchpoint=SWITCH_BAR;
+int16_t bartick=0;  // PPQN ticks since the start of the bar
+
+// restart a track so its next step is the first one for its step mode
+void restarttrack(int16_t track) {
+  notes[track].state=FORWARD;
+  switch (notes[track].stepmode) {
+    case BACKWARD:
+      notes[track].index=0;  // steps back to the last step
+      break;
+    case PINGPONG:
+      notes[track].index=1;  // steps back to 0 then turns around
+      notes[track].state=BACKWARD;
+      break;
+    default:
+      notes[track].index=SEQ_STEPS-1;  // wraps to 0
+      break;
+  }
+}
+
+// copy a pattern into the live sequencer settings
+void applypattern(struct pattern * pat) {
+  for (int16_t track=0; track< NTRACKS;++track) {
+    for (int16_t step=0; step< SEQ_STEPS;++step) notes[track].val[step]=pat->val[track][step];
+    notes[track].root=pat->root[track];
+    notes[track].scale=pat->scale[track];
+    notes[track].stepmode=pat->stepmode[track];
+    for (int16_t clk=0; clk< NUM_CLOCKS;++clk) rhythmclks[track][clk]=(pat->clocks >> (track*NUM_CLOCKS+clk)) & 1;
+  }
+  for (int16_t clk=0; clk< NUM_CLOCKS;++clk) {
+    rhythm[clk].divider=constrain(pat->divider[clk],1,MAX_DIVIDER);
+    euclid[clk].on=(pat->euclid >> clk) & 1;
+    euclid[clk].steps=pat->eucsteps[clk];
+    euclid[clk].hits=pat->euchits[clk];
+    euclid[clk].rotate=pat->eucrotate[clk];
+    euclidupdate(clk);  // range checks them too
+  }
+}
+
+// true if the tick about to be clocked starts a bar or the slowest connected divider's cycle
+// a divider in Euclidean mode cycles once per pattern
+// when the sequencer is stopped any time will do
+bool atswitchpoint(void) {
+  if (controlstate != RUNNING) return true;
+  if (switchpoint == SWITCH_BAR) return bartick == 0;
+  int16_t slowest=-1;
+  int32_t longest=0;  // ticks in the slowest cycle
+  for (int16_t clk=0; clk< NUM_CLOCKS;++clk) {
+    bool used=false;
+    for (int16_t track=0; track< NTRACKS;++track) used|=rhythmclks[track][clk];
+    int32_t cycle=(int32_t)rhythm[clk].divider*(euclid[clk].on ? euclid[clk].steps : 1);
+    if (used && (cycle > longest)) {
+      slowest=clk;
+      longest=cycle;
+    }
+  }
+  if (slowest < 0) return bartick == 0;  // nothing connected - fall back to the bar
+  if (euclid[slowest].on && (euclid[slowest].pos != 0)) return false;  // not the pattern's first step
+  return (rhythm[slowest].ppqn_counter == 1) && (rhythm[slowest].counter == 1); // it fires on this tick
+}
+
+// swap in a staged pattern if this tick is a switch point - called on core 1 before the dividers are clocked
+// every divider is set to fire on this tick so the new pattern starts together on the boundary
+void patternswap(void) {
+  if (patternqueued && atswitchpoint()) {
+    patternqueued=false;
+    applypattern(&patternstage);
+    for (int16_t track=0; track< NTRACKS;++track) restarttrack(track);
+    for (int16_t clk=0; clk< NUM_CLOCKS;++clk) {
+      rhythm[clk].ppqn_counter=1;
+      rhythm[clk].counter=1;
+    }
+    euclidrestart();
+    resetswing();
+    showLEDs();  // clock routing changed and the step LEDs moved
+    patternswapped=true;  // core 0 redraws the notes and dividers
+  }
+}
+
+// how late a divider's pulse goes out - every second pulse is swung
+uint32_t swingdelay(int16_t clk) {
+  bool offbeat=swingpulse[clk];
+  swingpulse[clk]=!offbeat;
+  if (!offbeat) return 0;
+  uint32_t pulseperiod=(uint32_t)rhythm[clk].divider*PPQN_DIV*tickperiod;
+  return (uint32_t)(swing[clk]-SWING_STRAIGHT)*pulseperiod/SWING_STRAIGHT;
+}
+
+// gate length in us for a note on a track whose fastest clock has this divider
+uint32_t gatelength(int16_t track, int16_t divider) {
+  if (notes[track].gatems > 0) return (uint32_t)notes[track].gatems*1000;
+  return (uint32_t)divider*PPQN_DIV*tickperiod/100*notes[track].gate;
+}
 
 // clock all the clock dividers
 // called at PPQN rate
+// notes are queued with the time they should go out and their gate length - see timing.h and noteoffs.h
 void clocktick () {
   bool clked[NTRACKS];
   int16_t smallestdivider;
+  uint32_t swung;  // swing delay of the divider being clocked
 
-  for (uint8_t track=0; track<NTRACKS;++track) { // gate counter is in PPQN clocks
-    if (notes[track].gatecounter > 0) {
-      --notes[track].gatecounter;
-      if (notes[track].gatecounter ==0) {
-        sendnoteOff(MIDIoutputchannel[track],notes[track].lastnotesent,0);
-      }     
-    }
-  }
+  patternswap();  // pattern changes land on a bar or divider cycle boundary
+  if (++bartick >= BAR_TICKS) bartick=0;
 
   clked[0]=clked[1]=clked[2]=false;
   for (uint8_t i=0; i<NUM_CLOCKS;++i) { // clock the sequencers from the rhythm generators
@@ -103,9 +215,11 @@ void clocktick () {
 		  rhythm[i].ppqn_counter=PPQN_DIV;
 		  if ((--rhythm[i].counter) == 0) {
 			  rhythm[i].counter=rhythm[i].divider;
-        smallestdivider=MAX_DIVIDER;
+        swung=swingdelay(i);  // swing follows every pulse of the divider, hit or not
+        if (!euclidhit(i)) continue;  // a rest in this divider's Euclidean pattern
         for (int8_t track=0;track<NTRACKS;++track) {
           if (rhythmclks[track][i]) {  // if this is a clock source for this track
+            smallestdivider=MAX_DIVIDER;  // each track's own fastest clock
             for (uint8_t clk=0; clk<NUM_CLOCKS;++clk) { 
               if ((rhythm[clk].divider < smallestdivider) && (rhythmclks[track][clk])) smallestdivider=rhythm[clk].divider; // find the fastest clock - to calculate gate time
             }
@@ -150,12 +264,10 @@ void clocktick () {
                 }             
            //   ++notes[track].index;
            //   if (notes[track].index >= SEQ_STEPS) notes[track].index=0;
-              if (notes[track].gatecounter !=0) sendnoteOff(MIDIoutputchannel[track],notes[track].lastnotesent,0); // don't leave notes on - could happen with multiple clock sources
               notes[track].lastnotesent=constrain(quantize(notes[track].val[notes[track].index]+notes[track].root+notes[track].offset,scales[notes[track].scale],notes[track].root),0,127);
-              sendnoteOn(MIDIoutputchannel[track],notes[track].lastnotesent,DEFAULT_VELOCITY);
-              notes[track].gatecounter=smallestdivider*PPQN/PPQN_DIV; // initialize gate timer from fastest clock period *** thought this would be half this value for 50% gate - something I'm not getting here 
+              queuenoteOn(ticktime+swung+trackdelay[track],MIDIoutputchannel[track],notes[track].lastnotesent,DEFAULT_VELOCITY,gatelength(track,smallestdivider));
               LEDS.setPixelColor(notes[track].index+track*SEQ_STEPS,LED_WHITE);  // turn on seq led
-            //  Serial.printf("div 0 %d smallest %d %d\n",rhythm[0].divider,smallestdivider,notes[track].gatecounter);
+            //  Serial.printf("div 0 %d smallest %d\n",rhythm[0].divider,smallestdivider);
             }
           }
         }
@@ -166,19 +278,27 @@ void clocktick () {
  
 
 // must be called regularly for sequencer to run
+// ticks are on absolute deadlines in us so the tick grid doesn't drift with loop timing
+// ticks missed while core 1 was held up (by a flash write for instance) are caught up one per call on their original grid
+#define MAX_CATCHUP_TICKS 12  // further behind than this and the grid starts over from now
 void do_clocks(void) {
-  uint32_t clockperiod= (uint32_t)(((60.0/(float)bpm)/PPQN)*1000);
-  if ((millis() - clocktimer) > clockperiod) {
-    clocktimer=millis(); 
+  uint32_t now=micros();
+  tickperiod=60000000/((uint32_t)bpm*PPQN);
+  if ((int32_t)(now-clocktimer) >= 0) {
+    if ((now-clocktimer) >= MAX_CATCHUP_TICKS*tickperiod) clocktimer=now;
+    ticktime=clocktimer;
+    clocktimer+=tickperiod;
+    PROF_START(PROF_CLOCKTICK);
     clocktick();
+    PROF_END(PROF_CLOCKTICK);
   }
 }
 
 // send noteoff for all notes
+// every note that is sounding on any channel is turned off, including ones whose track has moved to another channel since
 void all_notes_off(void) {
-  for (uint8_t track=0; track<NTRACKS;++track) {
-    sendnoteOff(MIDIoutputchannel[track],notes[track].lastnotesent,0); // turn the note off
-  }
+  outqueue_flush();  // notes that haven't gone out yet are dropped
+  notes_panic();
 }
 
 // resets all clock counters and indices to get everything back in sync
@@ -190,5 +310,8 @@ void sync_sequencers(void){
     rhythm[i].ppqn_counter=PPQN;
     rhythm[i].counter=rhythm[i].divider;
   }
+  euclidrestart();
+  resetswing();
+  bartick=0;
 }
 
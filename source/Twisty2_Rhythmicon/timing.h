@@ -0,0 +1,90 @@
+// swing and microtiming for the PicoRhythmicon
+// clocktick() doesn't send notes itself - it works out when each note should go out and puts it in a small queue
+// stamped with that time in microseconds. outqueue_service() on core 1 plays whatever is due
+// so swing and timing offsets aren't tied to the PPQN tick grid
+//
+// swing delays every second pulse of a clock divider. 50% is straight, 66% is a triplet feel, 75% is a dotted feel
+// each track can also be pushed late by a fixed number of microseconds to sit behind the beat
+// note offs are timed from when the note on was due - see noteoffs.h - so the gate length doesn't change
+
+#define SWING_STRAIGHT 50  // percent
+#define SWING_MAX 75
+#define OFFSET_MAX_US 25000  // track delay limit
+#define OUTQ_SIZE 64  // queued note ons
+
+int16_t swing[NUM_CLOCKS]={SWING_STRAIGHT,SWING_STRAIGHT,SWING_STRAIGHT,SWING_STRAIGHT};
+int16_t trackdelay[NTRACKS];    // microseconds
+bool swingpulse[NUM_CLOCKS];    // true if the divider's next pulse is the off beat
+uint32_t ticktime;              // when the PPQN tick being clocked was due in us
+uint32_t tickperiod;            // PPQN tick period in us
+
+struct outevent {
+  uint32_t due;   // micros() time to send
+  uint32_t gate;  // note length in us
+  uint8_t channel;
+  uint8_t note;
+  uint8_t velocity;
+};
+
+outevent outqueue[OUTQ_SIZE];  // in due order
+int16_t outcount;
+
+#ifdef PROFILE
+uint32_t outlatest;  // latest a message has gone out this stats window
+int16_t outlate;     // published lateness in us
+#endif
+
+// queue a note on in due order. notes due at the same time go out in the order they were queued
+// if the queue is full the note goes out now - late is better than lost
+void queuenoteOn(uint32_t due, uint8_t channel, uint8_t note, uint8_t velocity, uint32_t gate) {
+  if (outcount >= OUTQ_SIZE) {
+    playnote(channel,note,velocity,due,gate);
+    return;
+  }
+  int16_t i=outcount;
+  while ((i > 0) && ((int32_t)(outqueue[i-1].due-due) > 0)) {
+    outqueue[i]=outqueue[i-1];
+    --i;
+  }
+  outqueue[i].due=due;
+  outqueue[i].gate=gate;
+  outqueue[i].channel=channel;
+  outqueue[i].note=note;
+  outqueue[i].velocity=velocity;
+  ++outcount;
+}
+
+// play everything that's due - call from loop1 after noteoff_service() so a note off due at the same time goes first
+void outqueue_service(void) {
+  uint32_t now=micros();
+  int16_t sent=0;
+  while ((sent < outcount) && ((int32_t)(now-outqueue[sent].due) >= 0)) {
+    playnote(outqueue[sent].channel,outqueue[sent].note,outqueue[sent].velocity,outqueue[sent].due,outqueue[sent].gate);
+#ifdef PROFILE
+    if (now-outqueue[sent].due > outlatest) outlatest=now-outqueue[sent].due;
+#endif
+    ++sent;
+  }
+  if (sent) {
+    outcount-=sent;
+    memmove(outqueue,&outqueue[sent],outcount*sizeof(outevent));
+  }
+}
+
+// drop the note ons that haven't gone out yet - used when stopping
+void outqueue_flush(void) {
+  outcount=0;
+}
+
+// the next pulse of every divider is on the beat
+void resetswing(void) {
+  for (int16_t clk=0; clk< NUM_CLOCKS;++clk) swingpulse[clk]=false;
+}
+
+#ifdef PROFILE
+// publish the output lateness - call when prof_tick() starts a new window
+void outstats(void) {
+  outlate=prof_clip(outlatest);
+  outlatest=0;
+}
+#endif